@@ -0,0 +1,1303 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmarks for the core rut/rig data structures.
+ *
+ * Each benchmark is calibrated to run for at least --min-time
+ * seconds and the results are written as JSON so that they can be
+ * tracked per commit:
+ *
+ * {
+ *   "version": 1,
+ *   "benchmarks": [
+ *     { "name": "property/fan_out_16", "iterations": 1048576,
+ *       "ns_per_op": 41.2, "allocs_per_op": 0.0, "bytes_per_op": 0.0 },
+ *     ...
+ *   ]
+ * }
+ *
+ * Usage:
+ * rut-bench [OPTION...]
+ *
+ * Application Options:
+ *   -f, --filter=SUBSTRING      Only run benchmarks whose name matches
+ *   -t, --min-time=SECONDS      Minimum time to run each benchmark for
+ *   -o, --output=FILE           Write the JSON results to FILE
+ *   -l, --list                  List the benchmark names and exit
+ *
+ * Allocations are counted by interposing malloc(), calloc() and
+ * realloc() which is only supported with glibc. Elsewhere the
+ * allocation counts are reported as -1.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <rut.h>
+
+#include "rig-path.h"
+#include "rig.pb-c.h"
+
+typedef void (*RutBenchFunc) (void *data, uint64_t n_iterations);
+
+typedef struct _RutBench
+{
+  const char *filter;
+  double min_time;
+  gboolean list_only;
+  FILE *out;
+  int n_results;
+
+  RutShell *shell;
+  RutContext *ctx;
+} RutBench;
+
+static char *filter = NULL;
+static double min_time = 0.5;
+static char *output = NULL;
+static gboolean list_only = FALSE;
+
+static const GOptionEntry options[] =
+{
+  { "filter", 'f', 0, G_OPTION_ARG_STRING,
+    &filter, "Only run benchmarks whose name matches", "SUBSTRING" },
+  { "min-time", 't', 0, G_OPTION_ARG_DOUBLE,
+    &min_time, "Minimum time to run each benchmark for", "SECONDS" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME,
+    &output, "Write the JSON results to FILE", "FILE" },
+  { "list", 'l', 0, 0,
+    &list_only, "List the benchmark names and exit" },
+  { 0 }
+};
+
+/* Written to by benchmarks so the compiler can't discard the work
+ * being measured */
+static volatile uint64_t bench_sink;
+
+/*
+ * Allocation counting
+ */
+
+#ifdef __GLIBC__
+#define BENCH_COUNTS_ALLOCATIONS 1
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+/* NB: The benchmarks are all single threaded so we don't bother
+ * with atomic counters */
+static gboolean bench_counting;
+static uint64_t bench_n_allocs;
+static uint64_t bench_n_bytes;
+
+void *
+malloc (size_t size)
+{
+  if (bench_counting)
+    {
+      bench_n_allocs++;
+      bench_n_bytes += size;
+    }
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members, size_t size)
+{
+  if (bench_counting)
+    {
+      bench_n_allocs++;
+      bench_n_bytes += n_members * size;
+    }
+  return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  if (bench_counting)
+    {
+      bench_n_allocs++;
+      bench_n_bytes += size;
+    }
+  return __libc_realloc (ptr, size);
+}
+#else
+#define BENCH_COUNTS_ALLOCATIONS 0
+
+static gboolean bench_counting;
+static uint64_t bench_n_allocs;
+static uint64_t bench_n_bytes;
+#endif
+
+static uint64_t
+get_time_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+bench_measure (RutBenchFunc func,
+               void *data,
+               uint64_t n_iterations,
+               uint64_t *elapsed_ns,
+               uint64_t *n_allocs,
+               uint64_t *n_bytes)
+{
+  uint64_t start;
+
+  bench_n_allocs = 0;
+  bench_n_bytes = 0;
+  bench_counting = TRUE;
+
+  start = get_time_ns ();
+  func (data, n_iterations);
+  *elapsed_ns = get_time_ns () - start;
+
+  bench_counting = FALSE;
+
+  *n_allocs = bench_n_allocs;
+  *n_bytes = bench_n_bytes;
+}
+
+static gboolean
+bench_wanted (RutBench *bench, const char *name)
+{
+  if (bench->list_only)
+    {
+      printf ("%s\n", name);
+      return FALSE;
+    }
+
+  return bench->filter == NULL || strstr (name, bench->filter) != NULL;
+}
+
+static void
+bench_run (RutBench *bench,
+           const char *name,
+           RutBenchFunc func,
+           void *data)
+{
+  uint64_t min_time_ns = bench->min_time * 1e9;
+  uint64_t n_iterations = 1;
+  uint64_t elapsed_ns;
+  uint64_t n_allocs;
+  uint64_t n_bytes;
+
+  /* Warm up caches and any lazily initialized state */
+  func (data, 1);
+
+  for (;;)
+    {
+      uint64_t next;
+
+      bench_measure (func, data, n_iterations,
+                     &elapsed_ns, &n_allocs, &n_bytes);
+
+      if (elapsed_ns >= min_time_ns || n_iterations >= (1ULL << 32))
+        break;
+
+      /* Aim 20% past the minimum time based on the rate so far, but
+       * grow by at most 100x per step to cope with noisy first
+       * measurements */
+      if (elapsed_ns == 0)
+        next = n_iterations * 100;
+      else
+        next = n_iterations * (min_time_ns * 1.2 / elapsed_ns);
+
+      next = CLAMP (next, n_iterations + 1, n_iterations * 100);
+      n_iterations = next;
+    }
+
+  fprintf (bench->out,
+           "%s    { \"name\": \"%s\", \"iterations\": %" G_GUINT64_FORMAT
+           ", \"ns_per_op\": %.3f",
+           bench->n_results ? ",\n" : "",
+           name,
+           n_iterations,
+           (double)elapsed_ns / n_iterations);
+
+  if (BENCH_COUNTS_ALLOCATIONS)
+    fprintf (bench->out,
+             ", \"allocs_per_op\": %.3f, \"bytes_per_op\": %.3f }",
+             (double)n_allocs / n_iterations,
+             (double)n_bytes / n_iterations);
+  else
+    fprintf (bench->out,
+             ", \"allocs_per_op\": -1, \"bytes_per_op\": -1 }");
+
+  bench->n_results++;
+
+  fprintf (stderr, "%-40s %12.3f ns/op\n",
+           name, (double)elapsed_ns / n_iterations);
+}
+
+/*
+ * rut_property_dirty ()
+ */
+
+/* NB: rut_property_init() treats a data_offset of 0 as meaning there
+ * is no backing storage so the value mustn't be the first member */
+typedef struct _PropertyObject
+{
+  RutProperty property;
+  float value;
+} PropertyObject;
+
+static RutPropertySpec property_object_spec = {
+  .name = "value",
+  .flags = RUT_PROPERTY_FLAG_READWRITE,
+  .type = RUT_PROPERTY_TYPE_FLOAT,
+  .data_offset = offsetof (PropertyObject, value)
+};
+
+typedef struct _PropertyState
+{
+  RutPropertyContext property_ctx;
+  PropertyObject *source;
+  PropertyObject *objects;
+  int n_objects;
+  float value;
+} PropertyState;
+
+static void
+property_state_init (PropertyState *state, int n_objects, gboolean chain)
+{
+  int i;
+
+  rut_property_context_init (&state->property_ctx);
+
+  state->source = g_new0 (PropertyObject, 1);
+  rut_property_init (&state->source->property,
+                     &property_object_spec,
+                     state->source);
+
+  state->objects = g_new0 (PropertyObject, n_objects);
+  state->n_objects = n_objects;
+  state->value = 0;
+
+  for (i = 0; i < n_objects; i++)
+    {
+      PropertyObject *object = &state->objects[i];
+      PropertyObject *dependency;
+
+      rut_property_init (&object->property, &property_object_spec, object);
+
+      /* Either every object depends directly on the source or each
+       * object depends on the one before it */
+      if (chain && i > 0)
+        dependency = &state->objects[i - 1];
+      else
+        dependency = state->source;
+
+      rut_property_set_copy_binding (&state->property_ctx,
+                                     &object->property,
+                                     &dependency->property);
+    }
+}
+
+static void
+property_state_destroy (PropertyState *state)
+{
+  int i;
+
+  for (i = 0; i < state->n_objects; i++)
+    rut_property_destroy (&state->objects[i].property);
+  rut_property_destroy (&state->source->property);
+
+  g_free (state->objects);
+  g_free (state->source);
+
+  rut_property_context_destroy (&state->property_ctx);
+}
+
+static void
+bench_property_set (void *data, uint64_t n_iterations)
+{
+  PropertyState *state = data;
+  uint64_t i;
+
+  /* NB: the value has to change each time otherwise the setter
+   * short circuits without dirtying the property */
+  for (i = 0; i < n_iterations; i++)
+    rut_property_set_float (&state->property_ctx,
+                            &state->source->property,
+                            state->value += 1.0f);
+
+  bench_sink += state->objects[state->n_objects - 1].value;
+}
+
+static void
+bench_property (RutBench *bench)
+{
+  static const int sizes[] = { 1, 16, 256 };
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      char *name = g_strdup_printf ("property/fan_out_%d", sizes[i]);
+      PropertyState state;
+
+      if (bench_wanted (bench, name))
+        {
+          property_state_init (&state, sizes[i], FALSE);
+          bench_run (bench, name, bench_property_set, &state);
+          property_state_destroy (&state);
+        }
+
+      g_free (name);
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      char *name = g_strdup_printf ("property/chain_%d", sizes[i]);
+      PropertyState state;
+
+      if (bench_wanted (bench, name))
+        {
+          property_state_init (&state, sizes[i], TRUE);
+          bench_run (bench, name, bench_property_set, &state);
+          property_state_destroy (&state);
+        }
+
+      g_free (name);
+    }
+}
+
+/*
+ * rig_path_find_control_points2 ()
+ */
+
+#define N_PATH_SEEKS 4096
+
+typedef struct _PathState
+{
+  RigPath *path;
+  float length;
+  float step;
+  float t;
+  float seeks[N_PATH_SEEKS];
+} PathState;
+
+static void
+bench_path_sequential (void *data, uint64_t n_iterations)
+{
+  PathState *state = data;
+  RigNode *n0, *n1;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      state->t += state->step;
+      if (state->t > state->length)
+        state->t = 0;
+
+      rig_path_find_control_points2 (state->path, state->t,
+                                     RIG_PATH_DIRECTION_FORWARDS,
+                                     &n0, &n1);
+      bench_sink += (uintptr_t)n0;
+    }
+}
+
+static void
+bench_path_random (void *data, uint64_t n_iterations)
+{
+  PathState *state = data;
+  RigNode *n0, *n1;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      float t = state->seeks[i % N_PATH_SEEKS];
+
+      rig_path_find_control_points2 (state->path, t,
+                                     RIG_PATH_DIRECTION_FORWARDS,
+                                     &n0, &n1);
+      bench_sink += (uintptr_t)n0;
+    }
+}
+
+static void
+bench_path (RutBench *bench)
+{
+  static const int sizes[] = { 4, 64, 1024 };
+  GRand *rand = g_rand_new_with_seed (0);
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      char *sequential_name =
+        g_strdup_printf ("path/sequential_%d_nodes", sizes[i]);
+      char *random_name =
+        g_strdup_printf ("path/random_%d_nodes", sizes[i]);
+      PathState *state;
+      int j;
+
+      if (!bench_wanted (bench, sequential_name) &&
+          !bench_wanted (bench, random_name))
+        goto next;
+
+      state = g_new0 (PathState, 1);
+      state->path = rig_path_new (bench->ctx, RUT_PROPERTY_TYPE_FLOAT);
+      state->length = sizes[i];
+
+      for (j = 0; j < sizes[i]; j++)
+        rig_path_insert_float (state->path, j, g_rand_double (rand));
+
+      /* Sequential seeks step through each segment in roughly 16
+       * frames, similar to a controller playing back at 60fps */
+      state->step = 1.0f / 16.0f;
+
+      for (j = 0; j < N_PATH_SEEKS; j++)
+        state->seeks[j] = g_rand_double_range (rand, 0, state->length);
+
+      if (bench_wanted (bench, sequential_name))
+        bench_run (bench, sequential_name, bench_path_sequential, state);
+      if (bench_wanted (bench, random_name))
+        bench_run (bench, random_name, bench_path_random, state);
+
+      rut_refable_unref (state->path);
+      g_free (state);
+
+    next:
+      g_free (sequential_name);
+      g_free (random_name);
+    }
+
+  g_rand_free (rand);
+}
+
+/*
+ * rut_graphable_traverse ()
+ */
+
+static RutTraverseVisitFlags
+count_node_cb (RutObject *object, int depth, void *user_data)
+{
+  int *n_nodes = user_data;
+
+  (*n_nodes)++;
+
+  return RUT_TRAVERSE_VISIT_CONTINUE;
+}
+
+static void
+bench_graphable_traverse (void *data, uint64_t n_iterations)
+{
+  RutObject *root = data;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      int n_nodes = 0;
+
+      rut_graphable_traverse (root,
+                              RUT_TRAVERSE_DEPTH_FIRST,
+                              count_node_cb,
+                              NULL,
+                              &n_nodes);
+      bench_sink += n_nodes;
+    }
+}
+
+static void
+add_children (RutContext *ctx, RutObject *parent, int fan_out, int depth)
+{
+  int i;
+
+  if (depth == 0)
+    return;
+
+  for (i = 0; i < fan_out; i++)
+    {
+      RutTransform *child = rut_transform_new (ctx);
+
+      rut_graphable_add_child (parent, child);
+      rut_refable_unref (child);
+
+      add_children (ctx, child, fan_out, depth - 1);
+    }
+}
+
+static void
+bench_graphable (RutBench *bench)
+{
+  static const struct {
+    const char *name;
+    int fan_out;
+    int depth;
+  } trees[] = {
+    /* NB: the traversal is recursive so the deep tree is limited to
+     * a depth that won't overflow the stack */
+    { "graphable/traverse_deep_1000", 1, 1000 },
+    { "graphable/traverse_wide_1000", 1000, 1 },
+    { "graphable/traverse_balanced_5460", 4, 6 }
+  };
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (trees); i++)
+    {
+      RutTransform *root;
+
+      if (!bench_wanted (bench, trees[i].name))
+        continue;
+
+      root = rut_transform_new (bench->ctx);
+      add_children (bench->ctx, root, trees[i].fan_out, trees[i].depth);
+
+      bench_run (bench, trees[i].name, bench_graphable_traverse, root);
+
+      rut_refable_unref (root);
+    }
+}
+
+/*
+ * rut_util_intersect_mesh () and rut_mesh_foreach_triangle ()
+ */
+
+#define N_RAYS 256
+
+typedef struct _MeshState
+{
+  RutMesh *mesh;
+  float ray_origins[N_RAYS][3];
+  float ray_directions[N_RAYS][3];
+} MeshState;
+
+/* Creates an indexed UV sphere of radius 1 with
+ * (n_rings * n_rings * 4) triangles */
+static RutMesh *
+create_sphere_mesh (int n_rings)
+{
+  int n_segments = n_rings * 2;
+  int stride = n_segments + 1;
+  int n_vertices = (n_rings + 1) * stride;
+  int n_indices = n_rings * n_segments * 6;
+  RutBuffer *vertex_buffer =
+    rut_buffer_new (sizeof (CoglVertexP3) * n_vertices);
+  RutBuffer *index_buffer = rut_buffer_new (sizeof (uint16_t) * n_indices);
+  CoglVertexP3 *vertices = (CoglVertexP3 *)vertex_buffer->data;
+  uint16_t *indices = (uint16_t *)index_buffer->data;
+  RutMesh *mesh;
+  int i, j;
+
+  g_return_val_if_fail (n_vertices <= 0x10000, NULL);
+
+  for (i = 0; i <= n_rings; i++)
+    {
+      float theta = G_PI * i / n_rings;
+
+      for (j = 0; j <= n_segments; j++)
+        {
+          float phi = 2 * G_PI * j / n_segments;
+          CoglVertexP3 *v = &vertices[i * stride + j];
+
+          v->x = sinf (theta) * cosf (phi);
+          v->y = cosf (theta);
+          v->z = sinf (theta) * sinf (phi);
+        }
+    }
+
+  for (i = 0; i < n_rings; i++)
+    for (j = 0; j < n_segments; j++)
+      {
+        uint16_t *index = indices + (i * n_segments + j) * 6;
+        uint16_t v0 = i * stride + j;
+        uint16_t v2 = v0 + stride;
+
+        index[0] = v0;
+        index[1] = v2;
+        index[2] = v0 + 1;
+        index[3] = v0 + 1;
+        index[4] = v2;
+        index[5] = v2 + 1;
+      }
+
+  mesh = rut_mesh_new_from_buffer_p3 (COGL_VERTICES_MODE_TRIANGLES,
+                                      n_vertices,
+                                      vertex_buffer);
+  rut_mesh_set_indices (mesh,
+                        COGL_INDICES_TYPE_UNSIGNED_SHORT,
+                        index_buffer,
+                        n_indices);
+
+  rut_refable_unref (vertex_buffer);
+  rut_refable_unref (index_buffer);
+
+  return mesh;
+}
+
+static void
+bench_intersect_mesh (void *data, uint64_t n_iterations)
+{
+  MeshState *state = data;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      int ray = i % N_RAYS;
+      int index = 0;
+      float t;
+
+      rut_util_intersect_mesh (state->mesh,
+                               state->ray_origins[ray],
+                               state->ray_directions[ray],
+                               &index,
+                               &t);
+      bench_sink += index;
+    }
+}
+
+static void
+count_triangle_cb (void **attributes_v0,
+                   void **attributes_v1,
+                   void **attributes_v2,
+                   int i0,
+                   int i1,
+                   int i2,
+                   void *user_data)
+{
+  float *sum = user_data;
+  float *v0 = attributes_v0[0];
+
+  *sum += v0[0];
+}
+
+static void
+bench_foreach_triangle (void *data, uint64_t n_iterations)
+{
+  MeshState *state = data;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      float sum = 0;
+
+      rut_mesh_foreach_triangle (state->mesh,
+                                 count_triangle_cb,
+                                 &sum,
+                                 "cogl_position_in",
+                                 NULL);
+      bench_sink += sum;
+    }
+}
+
+static void
+bench_mesh (RutBench *bench)
+{
+  static const int rings[] = { 8, 32, 64 };
+  GRand *rand = g_rand_new_with_seed (0);
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (rings); i++)
+    {
+      int n_triangles = rings[i] * rings[i] * 4;
+      char *intersect_name =
+        g_strdup_printf ("mesh/intersect_%d_triangles", n_triangles);
+      char *foreach_name =
+        g_strdup_printf ("mesh/foreach_triangle_%d_triangles", n_triangles);
+      MeshState *state;
+      int j;
+
+      if (!bench_wanted (bench, intersect_name) &&
+          !bench_wanted (bench, foreach_name))
+        goto next;
+
+      state = g_new0 (MeshState, 1);
+      state->mesh = create_sphere_mesh (rings[i]);
+
+      /* Rays start on a sphere of radius 3 around the mesh and aim
+       * at a jittered point near the center so most of them hit */
+      for (j = 0; j < N_RAYS; j++)
+        {
+          float theta = g_rand_double_range (rand, 0, G_PI);
+          float phi = g_rand_double_range (rand, 0, 2 * G_PI);
+          float *origin = state->ray_origins[j];
+          float *direction = state->ray_directions[j];
+          float target[3];
+          float len;
+          int k;
+
+          origin[0] = 3 * sinf (theta) * cosf (phi);
+          origin[1] = 3 * cosf (theta);
+          origin[2] = 3 * sinf (theta) * sinf (phi);
+
+          for (k = 0; k < 3; k++)
+            target[k] = g_rand_double_range (rand, -0.5, 0.5);
+
+          for (k = 0; k < 3; k++)
+            direction[k] = target[k] - origin[k];
+
+          len = sqrtf (direction[0] * direction[0] +
+                       direction[1] * direction[1] +
+                       direction[2] * direction[2]);
+          for (k = 0; k < 3; k++)
+            direction[k] /= len;
+        }
+
+      if (bench_wanted (bench, intersect_name))
+        bench_run (bench, intersect_name, bench_intersect_mesh, state);
+      if (bench_wanted (bench, foreach_name))
+        bench_run (bench, foreach_name, bench_foreach_triangle, state);
+
+      rut_refable_unref (state->mesh);
+      g_free (state);
+
+    next:
+      g_free (intersect_name);
+      g_free (foreach_name);
+    }
+
+  g_rand_free (rand);
+}
+
+/*
+ * rut_memory_stack_alloc ()
+ */
+
+typedef struct _MemoryStackState
+{
+  RutMemoryStack *stack;
+  size_t size;
+} MemoryStackState;
+
+static void
+bench_memory_stack_alloc (void *data, uint64_t n_iterations)
+{
+  MemoryStackState *state = data;
+  uint64_t i;
+
+  /* We rewind periodically, as the serializer does for each UI, so
+   * that the stack settles at a fixed size */
+  for (i = 0; i < n_iterations; i++)
+    {
+      if ((i & 4095) == 0)
+        rut_memory_stack_rewind (state->stack);
+
+      bench_sink += (uintptr_t)rut_memory_stack_alloc (state->stack,
+                                                        state->size);
+    }
+}
+
+static void
+bench_memory_stack (RutBench *bench)
+{
+  static const int sizes[] = { 16, 256 };
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      char *name = g_strdup_printf ("memory_stack/alloc_%d", sizes[i]);
+      MemoryStackState state;
+
+      if (bench_wanted (bench, name))
+        {
+          state.stack = rut_memory_stack_new (8192);
+          state.size = sizes[i];
+
+          bench_run (bench, name, bench_memory_stack_alloc, &state);
+
+          rut_memory_stack_free (state.stack);
+        }
+
+      g_free (name);
+    }
+}
+
+/*
+ * RutBitmask
+ */
+
+typedef struct _BitmaskState
+{
+  RutBitmask bitmask;
+  int n_bits;
+} BitmaskState;
+
+static void
+bench_bitmask_set_get (void *data, uint64_t n_iterations)
+{
+  BitmaskState *state = data;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      unsigned int bit = (i * 7) % state->n_bits;
+
+      _rut_bitmask_set (&state->bitmask, bit,
+                        !_rut_bitmask_get (&state->bitmask, bit));
+    }
+
+  bench_sink += _rut_bitmask_get (&state->bitmask, 0);
+}
+
+static void
+bench_bitmask_popcount (void *data, uint64_t n_iterations)
+{
+  BitmaskState *state = data;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    bench_sink += _rut_bitmask_popcount (&state->bitmask);
+}
+
+static gboolean
+count_bit_cb (int bit_num, void *user_data)
+{
+  int *count = user_data;
+
+  (*count)++;
+
+  return TRUE;
+}
+
+static void
+bench_bitmask_foreach (void *data, uint64_t n_iterations)
+{
+  BitmaskState *state = data;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      int count = 0;
+
+      _rut_bitmask_foreach (&state->bitmask, count_bit_cb, &count);
+      bench_sink += count;
+    }
+}
+
+static void
+bench_bitmask (RutBench *bench)
+{
+  /* NB: up to COGL_BITMASK_MAX_DIRECT_BITS bits are stored directly
+   * in the pointer, beyond that an array is allocated */
+  static const int sizes[] = { 32, 1024, 65536 };
+  static const struct {
+    const char *name;
+    RutBenchFunc func;
+  } ops[] = {
+    { "set_get", bench_bitmask_set_get },
+    { "popcount", bench_bitmask_popcount },
+    { "foreach", bench_bitmask_foreach }
+  };
+  int i, j;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    for (j = 0; j < G_N_ELEMENTS (ops); j++)
+      {
+        char *name = g_strdup_printf ("bitmask/%s_%d",
+                                      ops[j].name, sizes[i]);
+        BitmaskState state;
+        int bit;
+
+        if (bench_wanted (bench, name))
+          {
+            _rut_bitmask_init (&state.bitmask);
+            state.n_bits = sizes[i];
+
+            /* Set every third bit */
+            for (bit = 0; bit < sizes[i]; bit += 3)
+              _rut_bitmask_set (&state.bitmask, bit, TRUE);
+
+            bench_run (bench, name, ops[j].func, &state);
+
+            _rut_bitmask_destroy (&state.bitmask);
+          }
+
+        g_free (name);
+      }
+}
+
+/*
+ * Rig__UI protobuf pack and unpack
+ */
+
+typedef struct _ProtobufState
+{
+  RutMemoryStack *stack;
+  Rig__UI *ui;
+  uint8_t *packed;
+  size_t packed_len;
+  RutMemoryStack *unpack_stack;
+} ProtobufState;
+
+typedef void (*PBMessageInitFunc) (void *message);
+
+static inline void *
+_pb_new (RutMemoryStack *stack, size_t size, void *_message_init)
+{
+  PBMessageInitFunc message_init = _message_init;
+  void *msg = rut_memory_stack_memalign (stack, size,
+                                         RUT_UTIL_ALIGNOF (void *));
+
+  message_init (msg);
+  return msg;
+}
+
+#define pb_new(STACK, TYPE, INIT) \
+  ((TYPE *)_pb_new (STACK, sizeof (TYPE), INIT))
+
+static Rig__Boxed *
+pb_boxed_float_new (RutMemoryStack *stack, const char *name, float value)
+{
+  Rig__Boxed *pb_boxed = pb_new (stack, Rig__Boxed, rig__boxed__init);
+
+  pb_boxed->name = (char *)name;
+  pb_boxed->has_type = TRUE;
+  pb_boxed->type = RIG__PROPERTY_TYPE__FLOAT;
+  pb_boxed->value = pb_new (stack, Rig__PropertyValue,
+                            rig__property_value__init);
+  pb_boxed->value->has_float_value = TRUE;
+  pb_boxed->value->float_value = value;
+
+  return pb_boxed;
+}
+
+static Rig__Boxed *
+pb_boxed_color_new (RutMemoryStack *stack, const char *name)
+{
+  Rig__Boxed *pb_boxed = pb_new (stack, Rig__Boxed, rig__boxed__init);
+
+  pb_boxed->name = (char *)name;
+  pb_boxed->has_type = TRUE;
+  pb_boxed->type = RIG__PROPERTY_TYPE__COLOR;
+  pb_boxed->value = pb_new (stack, Rig__PropertyValue,
+                            rig__property_value__init);
+  pb_boxed->value->color_value = pb_new (stack, Rig__Color, rig__color__init);
+  pb_boxed->value->color_value->hex = "#ff8000ff";
+
+  return pb_boxed;
+}
+
+/* Builds a UI similar to what rig_pb_serialize_ui() produces for a
+ * scene of shapes with materials and one controller animating the
+ * position of every entity */
+static Rig__UI *
+create_ui (RutMemoryStack *stack, int n_entities, int n_keyframes)
+{
+  Rig__UI *ui = pb_new (stack, Rig__UI, rig__ui__init);
+  Rig__Controller *pb_controller;
+  int i;
+
+  ui->entities = rut_memory_stack_alloc (stack, sizeof (void *) * n_entities);
+  ui->n_entities = n_entities;
+
+  for (i = 0; i < n_entities; i++)
+    {
+      Rig__Entity *pb_entity = pb_new (stack, Rig__Entity, rig__entity__init);
+      Rig__Entity__Component *pb_material;
+      Rig__Entity__Component *pb_shape;
+
+      pb_entity->has_id = TRUE;
+      pb_entity->id = i + 1;
+      if (i)
+        {
+          pb_entity->has_parent_id = TRUE;
+          pb_entity->parent_id = i / 4 + 1;
+        }
+
+      pb_entity->label = "entity";
+
+      pb_entity->position = pb_new (stack, Rig__Vec3, rig__vec3__init);
+      pb_entity->position->x = i;
+      pb_entity->position->y = i * 2;
+      pb_entity->position->z = i * 3;
+
+      pb_entity->rotation = pb_new (stack, Rig__Rotation, rig__rotation__init);
+      pb_entity->rotation->angle = i;
+      pb_entity->rotation->z = 1;
+
+      pb_material = pb_new (stack, Rig__Entity__Component,
+                            rig__entity__component__init);
+      pb_material->has_id = TRUE;
+      pb_material->id = n_entities * 2 + i;
+      pb_material->has_type = TRUE;
+      pb_material->type = RIG__ENTITY__COMPONENT__TYPE__MATERIAL;
+      pb_material->n_properties = 3;
+      pb_material->properties =
+        rut_memory_stack_alloc (stack, sizeof (void *) * 3);
+      pb_material->properties[0] = pb_boxed_color_new (stack, "ambient");
+      pb_material->properties[1] = pb_boxed_color_new (stack, "diffuse");
+      pb_material->properties[2] = pb_boxed_float_new (stack, "shininess", 50);
+
+      pb_shape = pb_new (stack, Rig__Entity__Component,
+                         rig__entity__component__init);
+      pb_shape->has_id = TRUE;
+      pb_shape->id = n_entities * 3 + i;
+      pb_shape->has_type = TRUE;
+      pb_shape->type = RIG__ENTITY__COMPONENT__TYPE__SHAPE;
+      pb_shape->n_properties = 2;
+      pb_shape->properties =
+        rut_memory_stack_alloc (stack, sizeof (void *) * 2);
+      pb_shape->properties[0] = pb_boxed_float_new (stack, "width", 100);
+      pb_shape->properties[1] = pb_boxed_float_new (stack, "height", 100);
+
+      pb_entity->n_components = 2;
+      pb_entity->components =
+        rut_memory_stack_alloc (stack, sizeof (void *) * 2);
+      pb_entity->components[0] = pb_material;
+      pb_entity->components[1] = pb_shape;
+
+      ui->entities[i] = pb_entity;
+    }
+
+  pb_controller = pb_new (stack, Rig__Controller, rig__controller__init);
+  pb_controller->has_id = TRUE;
+  pb_controller->id = n_entities * 4 + 1;
+  pb_controller->name = "Controller 0";
+  pb_controller->n_properties = n_entities;
+  pb_controller->properties =
+    rut_memory_stack_alloc (stack, sizeof (void *) * n_entities);
+
+  for (i = 0; i < n_entities; i++)
+    {
+      Rig__Controller__Property *pb_property =
+        pb_new (stack, Rig__Controller__Property,
+                rig__controller__property__init);
+      Rig__Path *pb_path = pb_new (stack, Rig__Path, rig__path__init);
+      int j;
+
+      pb_property->has_object_id = TRUE;
+      pb_property->object_id = i + 1;
+      pb_property->name = "position";
+      pb_property->has_method = TRUE;
+      pb_property->method = RIG__CONTROLLER__PROPERTY__METHOD__PATH;
+      pb_property->constant = pb_new (stack, Rig__PropertyValue,
+                                      rig__property_value__init);
+
+      pb_path->n_nodes = n_keyframes;
+      pb_path->nodes =
+        rut_memory_stack_alloc (stack, sizeof (void *) * n_keyframes);
+      for (j = 0; j < n_keyframes; j++)
+        {
+          Rig__Node *pb_node = pb_new (stack, Rig__Node, rig__node__init);
+
+          pb_node->has_t = TRUE;
+          pb_node->t = j;
+          pb_node->value = pb_new (stack, Rig__PropertyValue,
+                                   rig__property_value__init);
+          pb_node->value->vec3_value = pb_new (stack, Rig__Vec3,
+                                               rig__vec3__init);
+          pb_node->value->vec3_value->x = j;
+
+          pb_path->nodes[j] = pb_node;
+        }
+
+      pb_property->path = pb_path;
+      pb_controller->properties[i] = pb_property;
+    }
+
+  ui->n_controllers = 1;
+  ui->controllers = rut_memory_stack_alloc (stack, sizeof (void *));
+  ui->controllers[0] = pb_controller;
+
+  return ui;
+}
+
+static void
+bench_pb_pack (void *data, uint64_t n_iterations)
+{
+  ProtobufState *state = data;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      size_t len = rig__ui__get_packed_size (state->ui);
+
+      g_assert (len == state->packed_len);
+      bench_sink += rig__ui__pack (state->ui, state->packed);
+    }
+}
+
+static void
+bench_pb_unpack (void *data, uint64_t n_iterations)
+{
+  ProtobufState *state = data;
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      Rig__UI *ui = rig__ui__unpack (NULL, state->packed_len, state->packed);
+
+      bench_sink += ui->n_entities;
+      rig__ui__free_unpacked (ui, NULL);
+    }
+}
+
+static void
+ignore_free (void *allocator_data, void *ptr)
+{
+  /* NOP */
+}
+
+/* This is how rig_load() unpacks a UI */
+static void
+bench_pb_unpack_stack (void *data, uint64_t n_iterations)
+{
+  ProtobufState *state = data;
+  ProtobufCAllocator protobuf_c_allocator =
+    {
+      rut_memory_stack_alloc,
+      ignore_free,
+      rut_memory_stack_alloc, /* tmp_alloc */
+      8192, /* max_alloca */
+      state->unpack_stack /* allocator_data */
+    };
+  uint64_t i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      Rig__UI *ui;
+
+      rut_memory_stack_rewind (state->unpack_stack);
+
+      ui = rig__ui__unpack (&protobuf_c_allocator,
+                            state->packed_len, state->packed);
+
+      bench_sink += ui->n_entities;
+      rig__ui__free_unpacked (ui, &protobuf_c_allocator);
+    }
+}
+
+static void
+bench_protobuf (RutBench *bench)
+{
+  static const int sizes[] = { 100, 1000, 10000 };
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      char *pack_name = g_strdup_printf ("protobuf/pack_%d_entities",
+                                         sizes[i]);
+      char *unpack_name = g_strdup_printf ("protobuf/unpack_%d_entities",
+                                           sizes[i]);
+      char *unpack_stack_name =
+        g_strdup_printf ("protobuf/unpack_stack_%d_entities", sizes[i]);
+      ProtobufState state;
+
+      if (!bench_wanted (bench, pack_name) &&
+          !bench_wanted (bench, unpack_name) &&
+          !bench_wanted (bench, unpack_stack_name))
+        goto next;
+
+      state.stack = rut_memory_stack_new (8192);
+      state.unpack_stack = rut_memory_stack_new (8192);
+      state.ui = create_ui (state.stack, sizes[i], 8);
+      state.packed_len = rig__ui__get_packed_size (state.ui);
+      state.packed = g_malloc (state.packed_len);
+      rig__ui__pack (state.ui, state.packed);
+
+      if (bench_wanted (bench, pack_name))
+        bench_run (bench, pack_name, bench_pb_pack, &state);
+      if (bench_wanted (bench, unpack_name))
+        bench_run (bench, unpack_name, bench_pb_unpack, &state);
+      if (bench_wanted (bench, unpack_stack_name))
+        bench_run (bench, unpack_stack_name, bench_pb_unpack_stack, &state);
+
+      g_free (state.packed);
+      rut_memory_stack_free (state.unpack_stack);
+      rut_memory_stack_free (state.stack);
+
+    next:
+      g_free (pack_name);
+      g_free (unpack_name);
+      g_free (unpack_stack_name);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  RutBench bench;
+
+  /* Make sure GSlice allocations go through malloc() so they are
+   * included in the allocation counts */
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+
+  context = g_option_context_new (NULL);
+  g_option_context_add_main_entries (context, options, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "option parsing failed: %s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  memset (&bench, 0, sizeof (bench));
+  bench.filter = filter;
+  bench.min_time = min_time;
+  bench.list_only = list_only;
+
+  if (output && !list_only)
+    {
+      bench.out = fopen (output, "w");
+      if (!bench.out)
+        {
+          fprintf (stderr, "Failed to open %s for writing\n", output);
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    bench.out = stdout;
+
+  bench.shell = rut_shell_new (true, /* headless */
+                               NULL, NULL, NULL, NULL);
+  bench.ctx = rut_context_new (bench.shell);
+
+  if (!list_only)
+    fprintf (bench.out, "{\n  \"version\": 1,\n  \"benchmarks\": [\n");
+
+  bench_property (&bench);
+  bench_path (&bench);
+  bench_graphable (&bench);
+  bench_mesh (&bench);
+  bench_memory_stack (&bench);
+  bench_bitmask (&bench);
+  bench_protobuf (&bench);
+
+  if (!list_only)
+    fprintf (bench.out, "\n  ]\n}\n");
+
+  if (bench.out != stdout)
+    fclose (bench.out);
+
+  rut_refable_unref (bench.ctx);
+  rut_refable_unref (bench.shell);
+
+  g_option_context_free (context);
+
+  return EXIT_SUCCESS;
+}
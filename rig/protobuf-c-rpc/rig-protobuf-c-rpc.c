@@ -1275,6 +1275,16 @@ read_client_reply (PB_RPC_Client *client,
   uint8_t *packed_data;
   ProtobufCMessage *msg;
 
+  RUT_STATIC_TIMER (reply_timer,
+                    NULL,
+                    "RPC replies",
+                    "Time spent handling replies to RPC requests",
+                    0);
+  RUT_STATIC_COUNTER (reply_bytes_counter,
+                      "RPC reply bytes",
+                      "Size of each RPC reply received",
+                      0);
+
   g_return_if_fail (client->state == PB_RPC_CLIENT_STATE_CONNECTED);
 
   /* lookup request by id */
@@ -1311,8 +1321,12 @@ read_client_reply (PB_RPC_Client *client,
       return;
     }
 
+  RUT_COUNTER_ADD (reply_bytes_counter, message_length);
+
   /* invoke closure */
+  RUT_TIMER_START (reply_timer);
   closure->closure (msg, closure->closure_data);
+  RUT_TIMER_STOP (reply_timer);
   closure->response_type = NULL;
   closure->closure = NULL;
   closure->closure_data =
@@ -1336,6 +1350,16 @@ read_server_request (PB_RPC_ServerConnection *conn,
   ProtobufCMessage *message;
   ServerRequest *server_request;
 
+  RUT_STATIC_TIMER (request_timer,
+                    NULL,
+                    "RPC requests",
+                    "Time spent handling incoming RPC requests",
+                    0);
+  RUT_STATIC_COUNTER (request_bytes_counter,
+                      "RPC request bytes",
+                      "Size of each RPC request received",
+                      0);
+
   if ((method_index >=
        conn->server->service->descriptor->n_methods))
     {
@@ -1364,11 +1388,15 @@ read_server_request (PB_RPC_ServerConnection *conn,
       return;
     }
 
+  RUT_COUNTER_ADD (request_bytes_counter, message_length);
+
   /* Invoke service (note that it may call back immediately) */
+  RUT_TIMER_START (request_timer);
   server_request =
     create_server_request (conn, request_id, method_index);
   service->invoke (service, method_index, message,
                    server_connection_response_closure, server_request);
+  RUT_TIMER_STOP (request_timer);
   protobuf_c_message_free_unpacked (message, allocator);
 }
 
@@ -152,7 +152,7 @@ save_activated (GSimpleAction *action,
   RigApplication *app = user_data;
   RigEngine *engine = app->priv->engine;
 
-  rig_save (engine, engine->ui_filename);
+  rig_save_async (engine, engine->ui_filename);
 }
 
 static void
@@ -0,0 +1,380 @@
+/*
+ * Rig
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "rig-asset-index.h"
+
+/* NB: The index is hidden so that it isn't itself treated as an
+ * asset */
+#define INDEX_FILENAME ".rig-asset-index"
+
+/* This should be bumped whenever the way tags are inferred changes
+ * so that old entries get re-inferred, or when the entries change */
+#define INDEX_VERSION 2
+
+#define INDEX_GROUP "Index"
+
+/* How long to wait after a change before saving the index so that a
+ * burst of changes only causes one save */
+#define SAVE_DELAY_SECONDS 2
+
+struct _RigAssetIndex
+{
+  char *filename;
+
+  /* Maps paths to RigAssetIndexEntries */
+  GHashTable *entries;
+
+  bool dirty;
+  unsigned int save_timeout;
+};
+
+static void
+entry_free (RigAssetIndexEntry *entry)
+{
+  g_free (entry->path);
+  g_list_free (entry->inferred_tags);
+  g_free (entry->content_hash);
+
+  g_slice_free (RigAssetIndexEntry, entry);
+}
+
+static GList *
+intern_tags (char **tags)
+{
+  GList *ret = NULL;
+  int i;
+
+  for (i = 0; tags[i]; i++)
+    ret = g_list_prepend (ret, (char *)g_intern_string (tags[i]));
+
+  return g_list_reverse (ret);
+}
+
+static void
+load_index (RigAssetIndex *index)
+{
+  GKeyFile *key_file = g_key_file_new ();
+  char **groups;
+  int i;
+
+  if (!g_key_file_load_from_file (key_file, index->filename,
+                                  G_KEY_FILE_NONE, NULL))
+    goto DONE;
+
+  if (g_key_file_get_integer (key_file, INDEX_GROUP, "version", NULL) !=
+      INDEX_VERSION)
+    goto DONE;
+
+  groups = g_key_file_get_groups (key_file, NULL);
+
+  for (i = 0; groups[i]; i++)
+    {
+      const char *group = groups[i];
+      RigAssetIndexEntry *entry;
+      char *path;
+      char **tags;
+
+      if (strcmp (group, INDEX_GROUP) == 0)
+        continue;
+
+      path = g_key_file_get_string (key_file, group, "path", NULL);
+      if (path == NULL)
+        continue;
+
+      entry = g_slice_new0 (RigAssetIndexEntry);
+      entry->path = path;
+      entry->mtime = g_key_file_get_uint64 (key_file, group, "mtime", NULL);
+      entry->mtime_usec =
+        g_key_file_get_integer (key_file, group, "mtime-usec", NULL);
+      entry->size = g_key_file_get_uint64 (key_file, group, "size", NULL);
+      entry->is_asset =
+        g_key_file_get_boolean (key_file, group, "asset", NULL);
+
+      tags = g_key_file_get_string_list (key_file, group, "tags", NULL, NULL);
+      if (tags)
+        {
+          entry->inferred_tags = intern_tags (tags);
+          g_strfreev (tags);
+        }
+
+      entry->content_hash =
+        g_key_file_get_string (key_file, group, "hash", NULL);
+
+      g_hash_table_insert (index->entries, entry->path, entry);
+    }
+
+  g_strfreev (groups);
+
+DONE:
+  g_key_file_free (key_file);
+}
+
+static void
+save_index (RigAssetIndex *index)
+{
+  GKeyFile *key_file = g_key_file_new ();
+  GHashTableIter iter;
+  void *value;
+  GError *error = NULL;
+  char *data;
+  gsize len;
+  int n = 0;
+
+  g_key_file_set_integer (key_file, INDEX_GROUP, "version", INDEX_VERSION);
+
+  g_hash_table_iter_init (&iter, index->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      RigAssetIndexEntry *entry = value;
+      char group[32];
+
+      /* NB: Paths can contain characters that aren't allowed in group
+       * names so the entries are numbered instead */
+      g_snprintf (group, sizeof (group), "%d", n++);
+
+      g_key_file_set_string (key_file, group, "path", entry->path);
+      g_key_file_set_uint64 (key_file, group, "mtime", entry->mtime);
+      g_key_file_set_integer (key_file, group, "mtime-usec",
+                              entry->mtime_usec);
+      g_key_file_set_uint64 (key_file, group, "size", entry->size);
+      g_key_file_set_boolean (key_file, group, "asset", entry->is_asset);
+
+      if (entry->inferred_tags)
+        {
+          int n_tags = g_list_length (entry->inferred_tags);
+          const char **tags = g_alloca (sizeof (char *) * n_tags);
+          GList *l;
+          int i;
+
+          for (l = entry->inferred_tags, i = 0; l; l = l->next, i++)
+            tags[i] = l->data;
+
+          g_key_file_set_string_list (key_file, group, "tags",
+                                      tags, n_tags);
+        }
+
+      if (entry->content_hash)
+        g_key_file_set_string (key_file, group, "hash", entry->content_hash);
+    }
+
+  data = g_key_file_to_data (key_file, &len, NULL);
+
+  /* NB: g_file_set_contents() writes to a temporary file first so a
+   * crash can't leave a truncated index behind */
+  if (!g_file_set_contents (index->filename, data, len, &error))
+    {
+      g_warning ("Failed to save asset index: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_free (data);
+  g_key_file_free (key_file);
+
+  index->dirty = false;
+}
+
+static gboolean
+save_timeout_cb (void *user_data)
+{
+  RigAssetIndex *index = user_data;
+
+  index->save_timeout = 0;
+  save_index (index);
+
+  return FALSE;
+}
+
+static void
+queue_save (RigAssetIndex *index)
+{
+  index->dirty = true;
+
+  if (index->save_timeout == 0)
+    {
+      index->save_timeout = g_timeout_add_seconds (SAVE_DELAY_SECONDS,
+                                                   save_timeout_cb,
+                                                   index);
+    }
+}
+
+RigAssetIndex *
+rig_asset_index_new (const char *assets_location)
+{
+  RigAssetIndex *index = g_slice_new0 (RigAssetIndex);
+
+  index->filename = g_build_filename (assets_location, INDEX_FILENAME, NULL);
+  index->entries = g_hash_table_new_full (g_str_hash,
+                                          g_str_equal,
+                                          NULL, /* key destroy */
+                                          (GDestroyNotify)entry_free);
+
+  load_index (index);
+
+  return index;
+}
+
+void
+rig_asset_index_free (RigAssetIndex *index)
+{
+  if (index->save_timeout)
+    g_source_remove (index->save_timeout);
+
+  if (index->dirty)
+    save_index (index);
+
+  g_hash_table_destroy (index->entries);
+  g_free (index->filename);
+
+  g_slice_free (RigAssetIndex, index);
+}
+
+void
+rig_asset_index_begin_scan (RigAssetIndex *index)
+{
+  GHashTableIter iter;
+  void *value;
+
+  g_hash_table_iter_init (&iter, index->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      RigAssetIndexEntry *entry = value;
+      entry->seen = false;
+    }
+}
+
+static gboolean
+remove_unseen_cb (void *key,
+                  void *value,
+                  void *user_data)
+{
+  RigAssetIndexEntry *entry = value;
+
+  return !entry->seen;
+}
+
+void
+rig_asset_index_end_scan (RigAssetIndex *index)
+{
+  if (g_hash_table_foreach_remove (index->entries, remove_unseen_cb, NULL))
+    queue_save (index);
+}
+
+RigAssetIndexEntry *
+rig_asset_index_lookup (RigAssetIndex *index,
+                        const char *path)
+{
+  RigAssetIndexEntry *entry = g_hash_table_lookup (index->entries, path);
+
+  if (entry)
+    entry->seen = true;
+
+  return entry;
+}
+
+bool
+rig_asset_index_entry_is_current (RigAssetIndexEntry *entry,
+                                  GFileInfo *info)
+{
+  uint64_t mtime =
+    g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  uint32_t mtime_usec =
+    g_file_info_get_attribute_uint32 (info,
+                                      G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+  /* NB: the seconds alone aren't enough to notice a file that is
+   * rewritten with the same size twice within a second */
+  return (entry->mtime == mtime &&
+          entry->mtime_usec == mtime_usec &&
+          entry->size == g_file_info_get_size (info));
+}
+
+RigAssetIndexEntry *
+rig_asset_index_update (RigAssetIndex *index,
+                        const char *path,
+                        GFileInfo *info,
+                        bool is_asset,
+                        const GList *inferred_tags)
+{
+  RigAssetIndexEntry *entry = g_slice_new0 (RigAssetIndexEntry);
+  const GList *l;
+
+  entry->path = g_strdup (path);
+  entry->mtime =
+    g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  entry->mtime_usec =
+    g_file_info_get_attribute_uint32 (info,
+                                      G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  entry->size = g_file_info_get_size (info);
+  entry->is_asset = is_asset;
+  entry->seen = true;
+
+  for (l = inferred_tags; l; l = l->next)
+    entry->inferred_tags =
+      g_list_prepend (entry->inferred_tags, (char *)g_intern_string (l->data));
+  entry->inferred_tags = g_list_reverse (entry->inferred_tags);
+
+  /* NB: the key is owned by the entry so we can't use
+   * g_hash_table_insert() which would keep the old entry's key */
+  g_hash_table_replace (index->entries, entry->path, entry);
+
+  queue_save (index);
+
+  return entry;
+}
+
+static gboolean
+remove_path_cb (void *key,
+                void *value,
+                void *user_data)
+{
+  RigAssetIndexEntry *entry = value;
+  const char *path = user_data;
+  int len = strlen (path);
+
+  return (strncmp (entry->path, path, len) == 0 &&
+          (entry->path[len] == '\0' || entry->path[len] == G_DIR_SEPARATOR));
+}
+
+void
+rig_asset_index_remove (RigAssetIndex *index,
+                        const char *path)
+{
+  if (g_hash_table_foreach_remove (index->entries,
+                                   remove_path_cb,
+                                   (void *)path))
+    queue_save (index);
+}
+
+void
+rig_asset_index_set_content_hash (RigAssetIndex *index,
+                                  RigAssetIndexEntry *entry,
+                                  const char *content_hash)
+{
+  g_free (entry->content_hash);
+  entry->content_hash = g_strdup (content_hash);
+
+  queue_save (index);
+}
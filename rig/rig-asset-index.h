@@ -0,0 +1,121 @@
+/*
+ * Rig
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RIG_ASSET_INDEX_H_
+#define _RIG_ASSET_INDEX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <gio/gio.h>
+
+/* A persistent record of every file in an assets directory, saved as
+ * a hidden file in the directory itself. It lets the editor skip
+ * sniffing the content type of, and inferring tags for, files that
+ * haven't changed since they were last seen.
+ *
+ * Files are compared by their modification time, to the microsecond,
+ * and size so scanning
+ * the directory only needs the attributes in
+ * RIG_ASSET_INDEX_ATTRIBUTES.
+ *
+ * Changes are saved lazily from a timeout, and when the index is
+ * freed.
+ */
+typedef struct _RigAssetIndex RigAssetIndex;
+
+#define RIG_ASSET_INDEX_ATTRIBUTES \
+  G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+  G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+  G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+  G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+
+typedef struct _RigAssetIndexEntry
+{
+  /* Relative to the assets directory */
+  char *path;
+
+  uint64_t mtime;
+  uint32_t mtime_usec;
+  uint64_t size;
+
+  /* Files that aren't assets are indexed too so that they don't have
+   * to be sniffed again */
+  bool is_asset;
+  GList *inferred_tags;
+
+  /* A hex SHA1 checksum of the file or NULL if it hasn't been loaded
+   * since it changed */
+  char *content_hash;
+
+  bool seen;
+} RigAssetIndexEntry;
+
+/* Loads the index of @assets_location, or creates an empty one if
+ * there isn't one yet or it can't be read. */
+RigAssetIndex *
+rig_asset_index_new (const char *assets_location);
+
+/* Saves any pending changes before freeing the index */
+void
+rig_asset_index_free (RigAssetIndex *index);
+
+/* Entries that aren't looked up or updated between
+ * rig_asset_index_begin_scan() and rig_asset_index_end_scan() are
+ * assumed to have been deleted and are removed. */
+void
+rig_asset_index_begin_scan (RigAssetIndex *index);
+
+void
+rig_asset_index_end_scan (RigAssetIndex *index);
+
+RigAssetIndexEntry *
+rig_asset_index_lookup (RigAssetIndex *index,
+                        const char *path);
+
+/* Returns true if @entry still describes the file that @info was
+ * queried from with RIG_ASSET_INDEX_ATTRIBUTES */
+bool
+rig_asset_index_entry_is_current (RigAssetIndexEntry *entry,
+                                  GFileInfo *info);
+
+/* Adds or replaces the entry for @path. @info must have been queried
+ * with RIG_ASSET_INDEX_ATTRIBUTES. Any content hash of a replaced entry
+ * is discarded. */
+RigAssetIndexEntry *
+rig_asset_index_update (RigAssetIndex *index,
+                        const char *path,
+                        GFileInfo *info,
+                        bool is_asset,
+                        const GList *inferred_tags);
+
+/* Removes the entry for @path, or every entry under @path if it is a
+ * directory */
+void
+rig_asset_index_remove (RigAssetIndex *index,
+                        const char *path);
+
+void
+rig_asset_index_set_content_hash (RigAssetIndex *index,
+                                  RigAssetIndexEntry *entry,
+                                  const char *content_hash);
+
+#endif /* _RIG_ASSET_INDEX_H_ */
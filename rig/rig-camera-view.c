@@ -112,6 +112,8 @@ _rig_camera_view_free (void *object)
   rig_selection_tool_destroy (view->selection_tool);
   rig_rotation_tool_destroy (view->rotation_tool);
 
+  rig_pick_index_free (view->pick_index);
+
   g_slice_free (RigCameraView, view);
 }
 
@@ -1278,7 +1280,6 @@ typedef struct _PickContext
 {
   RigEngine *engine;
   RutCamera *view_camera;
-  CoglFramebuffer *fb;
   float x;
   float y;
   float *ray_origin;
@@ -1288,160 +1289,104 @@ typedef struct _PickContext
   int selected_index;
 } PickContext;
 
-static RutTraverseVisitFlags
-entitygraph_pre_pick_cb (RutObject *object,
-                         int depth,
-                         void *user_data)
+static bool
+pick_input_entity_cb (RutEntity *entity,
+                      const CoglMatrix *transform,
+                      void *user_data)
 {
   PickContext *pick_ctx = user_data;
-  CoglFramebuffer *fb = pick_ctx->fb;
-
-  /* XXX: It could be nice if Cogl exposed matrix stacks directly, but for now
-   * we just take advantage of an arbitrary framebuffer matrix stack so that
-   * we can avoid repeated accumulating the transform of ancestors when
-   * traversing between scenegraph nodes that have common ancestors.
-   */
-  if (rut_object_is (object, RUT_INTERFACE_ID_TRANSFORMABLE))
+  RutObject *input =
+    rut_entity_get_component (entity, RUT_COMPONENT_TYPE_INPUT);
+  CoglMatrix modelview = *transform;
+
+  if (rut_pickable_pick (input,
+                         pick_ctx->view_camera,
+                         &modelview,
+                         pick_ctx->x,
+                         pick_ctx->y))
     {
-      const CoglMatrix *matrix = rut_transformable_get_matrix (object);
-      cogl_framebuffer_push_matrix (fb);
-      cogl_framebuffer_transform (fb, matrix);
+      pick_ctx->selected_entity = entity;
+      return false; /* stop */
     }
 
-  if (rut_object_get_type (object) == &rut_entity_type)
-    {
-      RutEntity *entity = object;
-      RutMaterial *material;
-      RutComponent *geometry;
-      RutMesh *mesh;
-      int index;
-      float distance;
-      bool hit;
-      float transformed_ray_origin[3];
-      float transformed_ray_direction[3];
-      CoglMatrix transform;
-      RutObject *input;
-
-      input = rut_entity_get_component (entity, RUT_COMPONENT_TYPE_INPUT);
-
-      if (input)
-        {
-          if (rut_object_is (input, RUT_INTERFACE_ID_PICKABLE))
-            {
-              cogl_framebuffer_get_modelview_matrix (fb, &transform);
-
-              if (rut_pickable_pick (input,
-                                     pick_ctx->view_camera,
-                                     &transform,
-                                     pick_ctx->x,
-                                     pick_ctx->y))
-                {
-                  pick_ctx->selected_entity = entity;
-                  return RUT_TRAVERSE_VISIT_BREAK;
-                }
-              else
-                return RUT_TRAVERSE_VISIT_CONTINUE;
-            }
-          else
-            {
-              geometry = rut_entity_get_component (entity,
-                                                   RUT_COMPONENT_TYPE_GEOMETRY);
-            }
-        }
-      else
-        {
-          if (_rig_in_editor_mode && !pick_ctx->engine->play_mode)
-            {
-              material = rut_entity_get_component (entity,
-                                                   RUT_COMPONENT_TYPE_MATERIAL);
-              if (!material || !rut_material_get_visible (material))
-                return RUT_TRAVERSE_VISIT_CONTINUE;
-            }
-
-          geometry = rut_entity_get_component (entity,
-                                               RUT_COMPONENT_TYPE_GEOMETRY);
-        }
-
-      /* Get a model we can pick against */
-      if (!(geometry &&
-            rut_object_is (geometry, RUT_INTERFACE_ID_MESHABLE) &&
-            (mesh = rut_meshable_get_mesh (geometry))))
-        return RUT_TRAVERSE_VISIT_CONTINUE;
-
-      /* transform the ray into the model space */
-      memcpy (transformed_ray_origin,
-              pick_ctx->ray_origin, 3 * sizeof (float));
-      memcpy (transformed_ray_direction,
-              pick_ctx->ray_direction, 3 * sizeof (float));
-
-      cogl_framebuffer_get_modelview_matrix (fb, &transform);
-
-      transform_ray (&transform,
-                     TRUE, /* inverse of the transform */
-                     transformed_ray_origin,
-                     transformed_ray_direction);
-
-      /* intersect the transformed ray with the model engine */
-      hit = rut_util_intersect_mesh (mesh,
-                                     transformed_ray_origin,
-                                     transformed_ray_direction,
-                                     &index,
-                                     &distance);
-
-      if (hit)
-        {
-          const CoglMatrix *view =
-            rut_camera_get_view_transform (pick_ctx->view_camera);
-          float w = 1;
-
-          /* to compare intersection distances we find the actual point of ray
-           * intersection in model coordinates and transform that into eye
-           * coordinates */
-
-          transformed_ray_direction[0] *= distance;
-          transformed_ray_direction[1] *= distance;
-          transformed_ray_direction[2] *= distance;
-
-          transformed_ray_direction[0] += transformed_ray_origin[0];
-          transformed_ray_direction[1] += transformed_ray_origin[1];
-          transformed_ray_direction[2] += transformed_ray_origin[2];
-
-          cogl_matrix_transform_point (&transform,
-                                       &transformed_ray_direction[0],
-                                       &transformed_ray_direction[1],
-                                       &transformed_ray_direction[2],
-                                       &w);
-          cogl_matrix_transform_point (view,
-                                       &transformed_ray_direction[0],
-                                       &transformed_ray_direction[1],
-                                       &transformed_ray_direction[2],
-                                       &w);
-          distance = transformed_ray_direction[2];
-
-          if (distance > pick_ctx->selected_distance)
-            {
-              pick_ctx->selected_entity = entity;
-              pick_ctx->selected_distance = distance;
-              pick_ctx->selected_index = index;
-            }
-        }
-    }
-
-  return RUT_TRAVERSE_VISIT_CONTINUE;
+  return true; /* continue */
 }
 
-static RutTraverseVisitFlags
-entitygraph_post_pick_cb (RutObject *object,
-                          int depth,
-                          void *user_data)
+static float
+pick_entity_cb (RutEntity *entity,
+                const CoglMatrix *transform,
+                RutMesh *mesh,
+                float max_t,
+                void *user_data)
 {
-  if (rut_object_is (object, RUT_INTERFACE_ID_TRANSFORMABLE))
+  PickContext *pick_ctx = user_data;
+  const CoglMatrix *view;
+  int index;
+  float distance;
+  float transformed_ray_origin[3];
+  float transformed_ray_direction[3];
+  float hit[3], offset[3];
+  CoglMatrix modelview = *transform;
+  float w = 1;
+  float t;
+
+  if (_rig_in_editor_mode && !pick_ctx->engine->play_mode &&
+      !rut_entity_get_component (entity, RUT_COMPONENT_TYPE_INPUT))
     {
-      PickContext *pick_ctx = user_data;
-      cogl_framebuffer_pop_matrix (pick_ctx->fb);
+      RutMaterial *material =
+        rut_entity_get_component (entity, RUT_COMPONENT_TYPE_MATERIAL);
+      if (!material || !rut_material_get_visible (material))
+        return max_t;
     }
 
-  return RUT_TRAVERSE_VISIT_CONTINUE;
+  /* transform the ray into the model space */
+  memcpy (transformed_ray_origin,
+          pick_ctx->ray_origin, 3 * sizeof (float));
+  memcpy (transformed_ray_direction,
+          pick_ctx->ray_direction, 3 * sizeof (float));
+
+  transform_ray (&modelview,
+                 TRUE, /* inverse of the transform */
+                 transformed_ray_origin,
+                 transformed_ray_direction);
+
+  /* intersect the transformed ray with the model engine */
+  if (!rut_util_intersect_mesh (mesh,
+                                transformed_ray_origin,
+                                transformed_ray_direction,
+                                &index,
+                                &distance))
+    return max_t;
+
+  /* find the actual point of ray intersection in model coordinates
+   * and transform that back into scene coordinates */
+  hit[0] = transformed_ray_origin[0] + transformed_ray_direction[0] * distance;
+  hit[1] = transformed_ray_origin[1] + transformed_ray_direction[1] * distance;
+  hit[2] = transformed_ray_origin[2] + transformed_ray_direction[2] * distance;
+
+  cogl_matrix_transform_point (&modelview, &hit[0], &hit[1], &hit[2], &w);
+
+  /* The spatial index orders entities by distance along the scene
+   * space ray so that's what we need to report back */
+  offset[0] = hit[0] - pick_ctx->ray_origin[0];
+  offset[1] = hit[1] - pick_ctx->ray_origin[1];
+  offset[2] = hit[2] - pick_ctx->ray_origin[2];
+  t = (cogl_vector3_dot_product (offset, pick_ctx->ray_direction) /
+       cogl_vector3_dot_product (pick_ctx->ray_direction,
+                                 pick_ctx->ray_direction));
+
+  if (t >= max_t)
+    return max_t;
+
+  /* The selected distance is reported in eye coordinates */
+  view = rut_camera_get_view_transform (pick_ctx->view_camera);
+  cogl_matrix_transform_point (view, &hit[0], &hit[1], &hit[2], &w);
+
+  pick_ctx->selected_entity = entity;
+  pick_ctx->selected_distance = hit[2];
+  pick_ctx->selected_index = index;
+
+  return t;
 }
 
 static void
@@ -1518,18 +1463,18 @@ move_entity_to_camera (RigCameraView *view,
 }
 
 static RutEntity *
-pick (RigEngine *engine,
+pick (RigCameraView *view,
       RutCamera *view_camera,
       float x,
       float y,
       float ray_origin[3],
       float ray_direction[3])
 {
+  RigEngine *engine = view->engine;
   PickContext pick_ctx;
 
   pick_ctx.engine = engine;
   pick_ctx.view_camera = view_camera;
-  pick_ctx.fb = rut_camera_get_framebuffer (view_camera);
   pick_ctx.x = x;
   pick_ctx.y = y;
   pick_ctx.selected_distance = -G_MAXFLOAT;
@@ -1537,15 +1482,21 @@ pick (RigEngine *engine,
   pick_ctx.ray_origin = ray_origin;
   pick_ctx.ray_direction = ray_direction;
 
-  /* We are hijacking the framebuffer's matrix to track the graphable
-   * transforms so we need to initialise it to a known state */
-  cogl_framebuffer_identity_matrix (pick_ctx.fb);
+  rig_pick_index_update (view->pick_index, engine->scene);
+
+  /* Entities with their own input region take priority over any
+   * geometry, regardless of depth */
+  rig_pick_index_foreach_input_entity (view->pick_index,
+                                       pick_input_entity_cb,
+                                       &pick_ctx);
+  if (pick_ctx.selected_entity)
+    return pick_ctx.selected_entity;
 
-  rut_graphable_traverse (engine->scene,
-                          RUT_TRAVERSE_DEPTH_FIRST,
-                          entitygraph_pre_pick_cb,
-                          entitygraph_post_pick_cb,
-                          &pick_ctx);
+  rig_pick_index_ray_cast (view->pick_index,
+                           ray_origin,
+                           ray_direction,
+                           pick_entity_cb,
+                           &pick_ctx);
 
   if (pick_ctx.selected_entity)
     {
@@ -1667,7 +1618,7 @@ input_cb (RutInputEvent *event,
                                 len);
         }
 
-      picked_entity = pick (engine,
+      picked_entity = pick (view,
                             view_camera,
                             x, y,
                             ray_position,
@@ -2077,6 +2028,8 @@ rig_camera_view_new (RigEngine *engine)
   rut_graphable_init (view);
   rut_paintable_init (view);
 
+  view->pick_index = rig_pick_index_new ();
+
   if (!_rig_in_simulator_mode)
     view->bg_pipeline = cogl_pipeline_new (ctx->cogl_context);
 
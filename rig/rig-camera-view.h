@@ -29,6 +29,7 @@ typedef struct _RigCameraView RigCameraView;
 #include "rig-engine.h"
 #include "rig-selection-tool.h"
 #include "rig-rotation-tool.h"
+#include "rig-pick-index.h"
 
 typedef struct _EntityTranslateGrabClosure EntityTranslateGrabClosure;
 typedef struct _EntitiesTranslateGrabClosure EntitiesTranslateGrabClosure;
@@ -86,6 +87,8 @@ struct _RigCameraView
   float view_camera_z;
   RutInputRegion *input_region;
 
+  RigPickIndex *pick_index;
+
   float last_viewport_x;
   float last_viewport_y;
   CoglBool dirty_viewport_size;
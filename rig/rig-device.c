@@ -56,6 +56,8 @@ static void
 handle_run_frame_ack (const Rig__RunFrameAck *ack,
                       void *closure_data)
 {
+  RUT_TRACE_INSTANT ("RunFrame ack", NULL);
+
   g_print ("Device: Run Frame ACK received\n");
 }
 
@@ -87,6 +89,8 @@ rig_device_paint (RutShell *shell, void *user_data)
       frontend->has_resized = false;
     }
 
+  RUT_TRACE_INSTANT ("RunFrame send", NULL);
+
   rig__simulator__run_frame (simulator_service,
                              &setup,
                              handle_run_frame_ack,
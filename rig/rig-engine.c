@@ -35,6 +35,7 @@
 
 
 #include <cogl/cogl.h>
+#include <cogl-pango/cogl-pango.h>
 
 #include <rut.h>
 #include <rut-bin.h>
@@ -43,6 +44,7 @@
 #include "rig-controller.h"
 #include "rig-load-save.h"
 #include "rig-undo-journal.h"
+#include "rig-asset-index.h"
 #include "rig-renderer.h"
 #include "rig-defines.h"
 #include "rig-osx.h"
@@ -191,6 +193,82 @@ scenegraph_post_paint_cb (RutObject *object,
   return RUT_TRAVERSE_VISIT_CONTINUE;
 }
 
+#ifdef RIG_EDITOR_ENABLED
+static void
+paint_renderer_stats_hud (RigEngine *engine, CoglFramebuffer *fb)
+{
+  const RigRendererStats *stats = rig_renderer_get_stats (engine->renderer);
+  GString *text = g_string_new (NULL);
+  PangoRectangle logical;
+  CoglColor color;
+  float x, y;
+  int i;
+
+  if (!engine->renderer_stats_layout)
+    {
+      PangoFontDescription *font_desc =
+        pango_font_description_from_string ("Mono 9px");
+
+      engine->renderer_stats_layout =
+        pango_layout_new (engine->ctx->pango_context);
+      pango_layout_set_font_description (engine->renderer_stats_layout,
+                                         font_desc);
+      pango_font_description_free (font_desc);
+
+      engine->renderer_stats_bg_pipeline =
+        cogl_pipeline_new (engine->ctx->cogl_context);
+      cogl_pipeline_set_color4f (engine->renderer_stats_bg_pipeline,
+                                 0, 0, 0, 0.7);
+    }
+
+  g_string_append_printf (text, "%-10s %9s %6s %6s\n",
+                          "Pass", "traversed", "culled", "logged");
+  for (i = 0; i < RIG_N_PASSES; i++)
+    {
+      const RigRendererPassStats *pass = &stats->passes[i];
+
+      g_string_append_printf (text, "%-10s %9d %6d %6d\n",
+                              rig_pass_get_name (i),
+                              pass->entities_traversed,
+                              pass->entities_culled,
+                              pass->entities_logged);
+    }
+
+  g_string_append_printf (text,
+                          "\n"
+                          "Draw calls            %6d\n"
+                          "Pipelines created     %6d\n"
+                          "Pipelines cached      %6d\n"
+                          "Primitives rebuilt    %6d\n"
+                          "Image sources created %6d\n"
+                          "Hair shell draws      %6d",
+                          stats->draw_calls,
+                          stats->pipelines_created,
+                          stats->pipelines_cached,
+                          stats->primitives_rebuilt,
+                          stats->image_sources_created,
+                          stats->hair_shell_draws);
+
+  pango_layout_set_text (engine->renderer_stats_layout, text->str, text->len);
+  pango_layout_get_pixel_extents (engine->renderer_stats_layout,
+                                  NULL, &logical);
+
+  x = engine->width - logical.width - 20;
+  y = 10;
+
+  cogl_framebuffer_draw_rectangle (fb,
+                                   engine->renderer_stats_bg_pipeline,
+                                   x - 8, y - 8,
+                                   x + logical.width + 8,
+                                   y + logical.height + 8);
+
+  cogl_color_init_from_4f (&color, 1, 1, 1, 1);
+  cogl_pango_show_layout (fb, engine->renderer_stats_layout, x, y, &color);
+
+  g_string_free (text, TRUE);
+}
+#endif /* RIG_EDITOR_ENABLED */
+
 void
 rig_engine_paint (RigEngine *engine)
 {
@@ -198,6 +276,16 @@ rig_engine_paint (RigEngine *engine)
   RigPaintContext paint_ctx;
   RutPaintContext *rut_paint_ctx = &paint_ctx._parent;
 
+  RUT_STATIC_TIMER (paint_timer,
+                    "Mainloop",
+                    "Paint",
+                    "Time spent painting the scenegraph",
+                    0);
+
+  RUT_TIMER_START (paint_timer);
+
+  rig_renderer_reset_stats (engine->renderer);
+
   rut_camera_set_framebuffer (engine->camera, fb);
 
   cogl_framebuffer_clear4f (fb,
@@ -215,9 +303,32 @@ rig_engine_paint (RigEngine *engine)
                                scenegraph_pre_paint_cb,
                                scenegraph_post_paint_cb,
                                rut_paint_ctx);
+
+#ifdef RIG_EDITOR_ENABLED
+  if (_rig_in_editor_mode &&
+      (rut_profile_get_enabled () || engine->show_renderer_stats))
+    {
+      /* Painting the graph may have flushed other cameras */
+      rut_camera_flush (engine->camera);
+
+      if (rut_profile_get_enabled ())
+        {
+          if (!engine->profile_overlay)
+            engine->profile_overlay = rig_profile_overlay_new (engine->ctx);
+
+          rig_profile_overlay_paint (engine->profile_overlay, fb, 10, 10);
+        }
+
+      if (engine->show_renderer_stats)
+        paint_renderer_stats_hud (engine, fb);
+    }
+#endif
+
   rut_camera_end_frame (engine->camera);
 
   cogl_onscreen_swap_buffers (COGL_ONSCREEN (fb));
+
+  RUT_TIMER_STOP (paint_timer);
 }
 
 void
@@ -884,15 +995,45 @@ typedef struct _ResultInputClosure
   RigEngine *engine;
 } ResultInputClosure;
 
+/* The width and height of each search result, which is also the size
+ * of the asset thumbnails */
+#define SEARCH_RESULT_SIZE 100
+
+/* The widget representing an object in the search results. These
+ * live for as long as the object is indexed so that searching again
+ * only has to move the widgets into new flows. */
+typedef struct _SearchResult
+{
+  RutBin *bin;
+
+  /* The flow that the bin is currently in, if any */
+  RutFlowLayout *flow;
+
+  ResultInputClosure input_closure;
+
+  /* Set while waiting for the thumbnail of an asset result */
+  RutClosure *thumbnail_closure;
+
+  /* What the widget shows, so it can be recreated if that changes */
+  CoglTexture *texture;
+  char *label;
+} SearchResult;
+
 static void
-free_result_input_closures (RigEngine *engine)
+search_result_free (SearchResult *result)
 {
-  GList *l;
+  if (result->flow)
+    rut_flow_layout_remove (result->flow, result->bin);
+  rut_refable_unref (result->bin);
+
+  if (result->thumbnail_closure)
+    rut_closure_disconnect (result->thumbnail_closure);
+
+  if (result->texture)
+    cogl_object_unref (result->texture);
+  g_free (result->label);
 
-  for (l = engine->result_input_closures; l; l = l->next)
-    g_slice_free (ResultInputClosure, l->data);
-  g_list_free (engine->result_input_closures);
-  engine->result_input_closures = NULL;
+  g_slice_free (SearchResult, result);
 }
 
 static void
@@ -905,6 +1046,20 @@ apply_asset_input_with_entity (RigEngine *engine,
   RutMaterial *material;
   RutObject *geom;
 
+  /* A deferred asset is decoded now that it is actually needed */
+  if (!rut_asset_is_ready (asset))
+    {
+      RutAssetBatch *batch = rut_asset_batch_new (engine->ctx);
+
+      rut_asset_load (asset, batch);
+      rut_asset_batch_finish (batch);
+    }
+
+  /* The asset's texture or model isn't available until it has been
+   * loaded by the asset loader */
+  if (!rut_asset_is_ready (asset))
+    return;
+
   rig_engine_push_undo_subjournal (engine);
 
   switch (type)
@@ -1328,68 +1483,6 @@ result_input_cb (RutInputRegion *region,
   return status;
 }
 
-static CoglBool
-asset_matches_search (RigEngine *engine,
-                      RutAsset *asset,
-                      const char *search)
-{
-  GList *l;
-  bool found = false;
-  const GList *inferred_tags;
-  char **tags;
-  const char *path;
-  int i;
-
-  for (l = engine->required_search_tags; l; l = l->next)
-    {
-      if (rut_asset_has_tag (asset, l->data))
-        {
-          found = true;
-          break;
-        }
-    }
-
-  if (engine->required_search_tags && found == false)
-    return FALSE;
-
-  if (!search)
-    return TRUE;
-
-  inferred_tags = rut_asset_get_inferred_tags (asset);
-  tags = g_strsplit_set (search, " \t", 0);
-
-  path = rut_asset_get_path (asset);
-  if (path)
-    {
-      if (strstr (path, search))
-        return TRUE;
-    }
-
-  for (i = 0; tags[i]; i++)
-    {
-      const GList *l;
-      CoglBool found = FALSE;
-
-      for (l = inferred_tags; l; l = l->next)
-        {
-          if (strcmp (tags[i], l->data) == 0)
-            {
-              found = TRUE;
-              break;
-            }
-        }
-
-      if (!found)
-        {
-          g_strfreev (tags);
-          return FALSE;
-        }
-    }
-
-  g_strfreev (tags);
-  return TRUE;
-}
-
 static RutFlowLayout *
 add_results_flow (RutContext *ctx,
                   const char *label,
@@ -1416,7 +1509,7 @@ add_results_flow (RutContext *ctx,
 
   rut_flow_layout_set_x_padding (flow, 5);
   rut_flow_layout_set_y_padding (flow, 5);
-  rut_flow_layout_set_max_child_height (flow, 100);
+  rut_flow_layout_set_max_child_height (flow, SEARCH_RESULT_SIZE);
 
   //rut_bin_set_left_padding (flow_bin, 5);
   rut_bin_set_child (flow_bin, flow);
@@ -1428,22 +1521,23 @@ add_results_flow (RutContext *ctx,
   return flow;
 }
 
-static void
-add_search_result (RigEngine *engine,
-                   RutObject *result)
+static SearchResult *
+create_search_result (RigEngine *engine,
+                      RutObject *result)
 {
-  ResultInputClosure *closure;
+  SearchResult *search_result = g_slice_new0 (SearchResult);
+  ResultInputClosure *closure = &search_result->input_closure;
   RutStack *stack;
   RutBin *bin;
   CoglTexture *texture;
   RutInputRegion *region;
   RutDragBin *drag_bin;
 
-  closure = g_slice_new (ResultInputClosure);
   closure->result = result;
   closure->engine = engine;
 
   bin = rut_bin_new (engine->ctx);
+  search_result->bin = bin;
 
   drag_bin = rut_drag_bin_new (engine->ctx);
   rut_drag_bin_set_payload (drag_bin, result);
@@ -1454,7 +1548,9 @@ add_search_result (RigEngine *engine,
   rut_drag_bin_set_child (drag_bin, stack);
   rut_refable_unref (stack);
 
-  region = rut_input_region_new_rectangle (0, 0, 100, 100,
+  region = rut_input_region_new_rectangle (0, 0,
+                                           SEARCH_RESULT_SIZE,
+                                           SEARCH_RESULT_SIZE,
                                            result_input_cb,
                                            closure);
   rut_stack_add (stack, region);
@@ -1471,6 +1567,8 @@ add_search_result (RigEngine *engine,
           RutImage *image = rut_image_new (engine->ctx, texture);
           rut_stack_add (stack, image);
           rut_refable_unref (image);
+
+          search_result->texture = cogl_object_ref (texture);
         }
       else
         {
@@ -1505,6 +1603,8 @@ add_search_result (RigEngine *engine,
       text = rut_text_new_with_text (engine->ctx, NULL, entity->label);
       rut_box_layout_add (vbox, false, text);
       rut_refable_unref (text);
+
+      search_result->label = g_strdup (entity->label);
     }
   else if (rut_object_get_type (result) == &rig_controller_type)
     {
@@ -1530,8 +1630,37 @@ add_search_result (RigEngine *engine,
       text = rut_text_new_with_text (engine->ctx, NULL, controller->label);
       rut_box_layout_add (vbox, FALSE, text);
       rut_refable_unref (text);
+
+      search_result->label = g_strdup (controller->label);
+    }
+
+  return search_result;
+}
+
+static bool
+search_result_is_current (SearchResult *search_result,
+                          RutObject *result)
+{
+  if (rut_object_get_type (result) == &rut_asset_type)
+    return search_result->texture == rut_asset_get_texture (result);
+  else if (rut_object_get_type (result) == &rut_entity_type)
+    {
+      RutEntity *entity = result;
+      return g_strcmp0 (search_result->label, entity->label) == 0;
     }
+  else if (rut_object_get_type (result) == &rig_controller_type)
+    {
+      RigController *controller = result;
+      return g_strcmp0 (search_result->label, controller->label) == 0;
+    }
+  else
+    return true;
+}
 
+static RutFlowLayout *
+get_results_flow (RigEngine *engine,
+                  RutObject *result)
+{
   if (rut_object_get_type (result) == &rut_asset_type)
     {
       RutAsset *asset = result;
@@ -1546,8 +1675,7 @@ add_search_result (RigEngine *engine,
                                   engine->search_results_vbox);
             }
 
-          rut_flow_layout_add (engine->assets_geometry_results, bin);
-          rut_refable_unref (bin);
+          return engine->assets_geometry_results;
         }
       else if (rut_asset_has_tag (asset, "image"))
         {
@@ -1559,8 +1687,7 @@ add_search_result (RigEngine *engine,
                                   engine->search_results_vbox);
             }
 
-          rut_flow_layout_add (engine->assets_image_results, bin);
-          rut_refable_unref (bin);
+          return engine->assets_image_results;
         }
       else if (rut_asset_has_tag (asset, "video"))
         {
@@ -1572,8 +1699,7 @@ add_search_result (RigEngine *engine,
                                   engine->search_results_vbox);
             }
 
-          rut_flow_layout_add (engine->assets_video_results, bin);
-          rut_refable_unref (bin);
+          return engine->assets_video_results;
         }
       else
         {
@@ -1585,8 +1711,7 @@ add_search_result (RigEngine *engine,
                                   engine->search_results_vbox);
             }
 
-          rut_flow_layout_add (engine->assets_other_results, bin);
-          rut_refable_unref (bin);
+          return engine->assets_other_results;
         }
     }
   else if (rut_object_get_type (result) == &rut_entity_type)
@@ -1599,10 +1724,9 @@ add_search_result (RigEngine *engine,
                               engine->search_results_vbox);
         }
 
-      rut_flow_layout_add (engine->entity_results, bin);
-      rut_refable_unref (bin);
+      return engine->entity_results;
     }
-  else if (rut_object_get_type (result) == &rig_controller_type)
+  else
     {
       if (!engine->controller_results)
         {
@@ -1612,15 +1736,59 @@ add_search_result (RigEngine *engine,
                               engine->search_results_vbox);
         }
 
-      rut_flow_layout_add (engine->controller_results, bin);
-      rut_refable_unref (bin);
+      return engine->controller_results;
     }
+}
+
+static void
+queue_search_refresh (RigEngine *engine);
+
+static void
+search_result_thumbnail_cb (RutAsset *asset,
+                            void *user_data)
+{
+  SearchResult *search_result = user_data;
 
+  /* The closure is freed once the thumbnail callbacks return */
+  search_result->thumbnail_closure = NULL;
 
-  /* XXX: It could be nicer to have some form of weak pointer
-   * mechanism to manage the lifetime of these closures... */
-  engine->result_input_closures = g_list_prepend (engine->result_input_closures,
-                                               closure);
+  /* The result is recreated with the new texture */
+  queue_search_refresh (search_result->input_closure.engine);
+}
+
+static void
+add_search_result (RigEngine *engine,
+                   RutObject *result)
+{
+  SearchResult *search_result =
+    g_hash_table_lookup (engine->search_results, result);
+
+  if (search_result && !search_result_is_current (search_result, result))
+    {
+      g_hash_table_remove (engine->search_results, result);
+      search_result = NULL;
+    }
+
+  if (search_result == NULL)
+    {
+      search_result = create_search_result (engine, result);
+      g_hash_table_insert (engine->search_results, result, search_result);
+    }
+
+  /* Thumbnails are only made for the assets that are actually shown */
+  if (rut_object_get_type (result) == &rut_asset_type &&
+      search_result->thumbnail_closure == NULL &&
+      rut_asset_needs_thumbnail (result))
+    {
+      search_result->thumbnail_closure =
+        rut_asset_thumbnail (result,
+                             search_result_thumbnail_cb,
+                             search_result,
+                             NULL); /* destroy */
+    }
+
+  search_result->flow = get_results_flow (engine, result);
+  rut_flow_layout_add (search_result->flow, search_result->bin);
 }
 
 static void
@@ -1628,11 +1796,28 @@ clear_search_results (RigEngine *engine)
 {
   if (engine->search_results_vbox)
     {
+      GHashTableIter iter;
+      void *value;
+
+      /* The result widgets are taken out of their flows first so that
+       * they survive for the next search */
+      g_hash_table_iter_init (&iter, engine->search_results);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          SearchResult *search_result = value;
+
+          if (search_result->flow)
+            {
+              rut_flow_layout_remove (search_result->flow,
+                                      search_result->bin);
+              search_result->flow = NULL;
+            }
+        }
+
       rut_fold_set_child (engine->search_results_fold, NULL);
-      free_result_input_closures (engine);
 
-      /* NB: We don't maintain any additional references on asset
-       * result widgets beyond the references for them being in the
+      /* NB: We don't maintain any additional references on the
+       * result flows beyond the references for them being in the
        * scene graph and so setting a NULL fold child should release
        * everything underneath...
        */
@@ -1648,70 +1833,200 @@ clear_search_results (RigEngine *engine)
     }
 }
 
-typedef struct _SearchState
+static void
+search_object_removed_cb (RutObject *object,
+                          void *user_data)
 {
-  RigEngine *engine;
-  const char *search;
-  bool found;
-} SearchState;
+  RigEngine *engine = user_data;
+
+  g_hash_table_remove (engine->search_results, object);
+}
+
+static void
+entity_search_object_removed_cb (RutObject *object,
+                                 void *user_data)
+{
+  RigEngine *engine = user_data;
+  RutPropertyClosure *closure =
+    g_hash_table_lookup (engine->entity_label_closures, object);
+
+  if (closure)
+    {
+      rut_property_closure_destroy (closure);
+      g_hash_table_remove (engine->entity_label_closures, object);
+    }
+
+  g_hash_table_remove (engine->search_results, object);
+}
+
+static void
+create_search_indices (RigEngine *engine)
+{
+  engine->asset_search_index =
+    rig_search_index_new (search_object_removed_cb, engine);
+  engine->entity_search_index =
+    rig_search_index_new (entity_search_object_removed_cb, engine);
+  engine->controller_search_index =
+    rig_search_index_new (search_object_removed_cb, engine);
+
+  engine->search_results =
+    g_hash_table_new_full (g_direct_hash,
+                           g_direct_equal,
+                           NULL, /* key destroy */
+                           (GDestroyNotify)search_result_free);
+  engine->entity_label_closures = g_hash_table_new (g_direct_hash,
+                                                    g_direct_equal);
+
+  /* NB: the scene's subtree age is only still zero if nothing has
+   * ever been added to it, in which case there is nothing to scan */
+  engine->search_scene_age = 0;
+}
+
+static void
+free_search_indices (RigEngine *engine)
+{
+  rig_search_index_free (engine->asset_search_index);
+  engine->asset_search_index = NULL;
+  rig_search_index_free (engine->entity_search_index);
+  engine->entity_search_index = NULL;
+  rig_search_index_free (engine->controller_search_index);
+  engine->controller_search_index = NULL;
+
+  g_hash_table_destroy (engine->search_results);
+  engine->search_results = NULL;
+  g_hash_table_destroy (engine->entity_label_closures);
+  engine->entity_label_closures = NULL;
+}
+
+static void
+index_asset (RigEngine *engine,
+             RutAsset *asset)
+{
+  rig_search_index_add (engine->asset_search_index,
+                        asset,
+                        rut_asset_get_path (asset),
+                        rut_asset_get_inferred_tags (asset));
+}
+
+static void
+index_entity (RigEngine *engine,
+              RutEntity *entity)
+{
+  const char *label = entity->label;
+
+  /* Internal entities are only listed when there's no search */
+  if (label && strncmp (label, "rig:", 4) == 0)
+    label = NULL;
+
+  rig_search_index_add (engine->entity_search_index, entity, label, NULL);
+}
+
+static void
+entity_label_changed_cb (RutProperty *property,
+                         void *user_data)
+{
+  index_entity (user_data, property->object);
+}
 
 static RutTraverseVisitFlags
-add_matching_entity_cb (RutObject *object,
-                        int depth,
-                        void *user_data)
+index_entity_cb (RutObject *object,
+                 int depth,
+                 void *user_data)
 {
+  RigEngine *engine = user_data;
+
   if (rut_object_get_type (object) == &rut_entity_type)
     {
       RutEntity *entity = object;
-      SearchState *state = user_data;
 
-      if (state->search == NULL)
-        {
-          state->found = true;
-          add_search_result (state->engine, entity);
-        }
-      else if (entity->label &&
-               strncmp (entity->label, "rig:", 4) != 0)
-        {
-          char *entity_label = g_ascii_strdown (entity->label, -1);
-#warning "FIXME: handle utf8 string comparisons!"
-
-          if (strstr (entity_label, state->search))
-            {
-              state->found = true;
-              add_search_result (state->engine, entity);
-            }
+      index_entity (engine, entity);
 
-          g_free (entity_label);
+      if (!g_hash_table_lookup (engine->entity_label_closures, entity))
+        {
+          RutProperty *label_prop =
+            &entity->properties[RUT_ENTITY_PROP_LABEL];
+          RutPropertyClosure *closure =
+            rut_property_connect_callback (label_prop,
+                                           entity_label_changed_cb,
+                                           engine);
+
+          g_hash_table_insert (engine->entity_label_closures,
+                               entity, closure);
         }
     }
+
   return RUT_TRAVERSE_VISIT_CONTINUE;
 }
 
+/* Entities are only rescanned when the structure of the scene has
+ * changed since the last search. Changes to their labels are tracked
+ * separately.
+ *
+ * NB: this has to look at the scene's own subtree age rather than the
+ * global graph age because showing the results of each search adds
+ * and removes widgets which would otherwise force a rescan every
+ * time. */
 static void
-add_matching_controller (RigController *controller,
-                         SearchState *state)
+update_entity_search_index (RigEngine *engine)
 {
-  char *controller_label = g_ascii_strdown (controller->label, -1);
-#warning "FIXME: handle utf8 string comparisons!"
+  unsigned int scene_age = rut_graphable_get_subtree_age (engine->scene);
+
+  if (scene_age == engine->search_scene_age)
+    return;
+
+  rig_search_index_begin_scan (engine->entity_search_index);
+  rut_graphable_traverse (engine->scene,
+                          RUT_TRAVERSE_DEPTH_FIRST,
+                          index_entity_cb,
+                          NULL, /* post visit */
+                          engine);
+  rig_search_index_end_scan (engine->entity_search_index);
+
+  engine->search_scene_age = scene_age;
+}
 
-  if (state->search == NULL ||
-      strstr (controller_label, state->search))
+/* There are only ever a handful of controllers and they are added
+ * and removed from several places so they are simply rescanned */
+static void
+update_controller_search_index (RigEngine *engine)
+{
+  GList *l;
+
+  rig_search_index_begin_scan (engine->controller_search_index);
+  for (l = engine->controllers; l; l = l->next)
     {
-      state->found = true;
-      add_search_result (state->engine, controller);
+      RigController *controller = l->data;
+
+      rig_search_index_add (engine->controller_search_index,
+                            controller,
+                            controller->label,
+                            NULL);
     }
+  rig_search_index_end_scan (engine->controller_search_index);
+}
+
+static bool
+add_search_results (RigEngine *engine,
+                    RigSearchIndex *index,
+                    const char *search,
+                    const GList *any_tags)
+{
+  GList *results = rig_search_index_query (index, search, any_tags);
+  bool found = results != NULL;
+  GList *l;
+
+  for (l = results; l; l = l->next)
+    add_search_result (engine, l->data);
+
+  g_list_free (results);
 
-  g_free (controller_label);
+  return found;
 }
 
 static bool
 rig_search_with_text (RigEngine *engine, const char *user_search)
 {
-  GList *l;
-  int i;
   CoglBool found = FALSE;
-  SearchState state;
   char *search;
 
   if (user_search)
@@ -1728,42 +2043,35 @@ rig_search_with_text (RigEngine *engine, const char *user_search)
                       engine->search_results_vbox);
   rut_refable_unref (engine->search_results_vbox);
 
-  for (l = engine->assets, i= 0; l; l = l->next, i++)
-    {
-      RutAsset *asset = l->data;
-
-      if (!asset_matches_search (engine, asset, search))
-        continue;
-
-      found = TRUE;
-      add_search_result (engine, asset);
-    }
-
-  state.engine = engine;
-  state.search = search;
-  state.found = FALSE;
+  found |= add_search_results (engine,
+                               engine->asset_search_index,
+                               search,
+                               engine->required_search_tags);
 
   if (!engine->required_search_tags ||
       rut_util_find_tag (engine->required_search_tags, "entity"))
     {
-      rut_graphable_traverse (engine->scene,
-                              RUT_TRAVERSE_DEPTH_FIRST,
-                              add_matching_entity_cb,
-                              NULL, /* post visit */
-                              &state);
+      update_entity_search_index (engine);
+      found |= add_search_results (engine,
+                                   engine->entity_search_index,
+                                   search,
+                                   NULL);
     }
 
   if (!engine->required_search_tags ||
       rut_util_find_tag (engine->required_search_tags, "controller"))
     {
-      for (l = engine->controllers; l; l = l->next)
-        add_matching_controller (l->data, &state);
+      update_controller_search_index (engine);
+      found |= add_search_results (engine,
+                                   engine->controller_search_index,
+                                   search,
+                                   NULL);
     }
 
   g_free (search);
 
   if (!engine->required_search_tags)
-    return found | state.found;
+    return found;
   else
     {
       /* If the user has toggled on certain search
@@ -1779,17 +2087,34 @@ rig_search_with_text (RigEngine *engine, const char *user_search)
 static void
 rig_run_search (RigEngine *engine)
 {
+  /* Nothing can be searched until the asset list has been loaded */
+  if (!engine->asset_search_index)
+    return;
+
   if (!rig_search_with_text (engine, rut_text_get_text (engine->search_text)))
     rig_search_with_text (engine, NULL);
 }
 
 static void
-rig_refresh_thumbnails (RutAsset *video,
-                        void *user_data)
+refresh_search_pre_paint_cb (RutObject *graphable,
+                             void *user_data)
 {
   rig_run_search (user_data);
 }
 
+/* Lots of assets can change together, such as when they finish
+ * loading at startup, so the search results are only rebuilt once
+ * per frame */
+static void
+queue_search_refresh (RigEngine *engine)
+{
+  rut_shell_add_pre_paint_callback (engine->ctx->shell,
+                                    engine->search_results_fold,
+                                    refresh_search_pre_paint_cb,
+                                    engine);
+  rut_shell_queue_redraw (engine->ctx->shell);
+}
+
 static void
 asset_search_update_cb (RutText *text,
                         void *user_data)
@@ -2469,6 +2794,9 @@ create_assets_view (RigEngine *engine)
 
   engine->search_results_fold = rut_fold_new (engine->ctx, "Results");
 
+  /* Asset thumbnails are only ever shown as search results */
+  rut_set_thumbnail_size (engine->ctx, SEARCH_RESULT_SIZE);
+
   rut_color_init_from_uint32 (&color, 0x79b8b0ff);
   rut_fold_set_label_color (engine->search_results_fold, &color);
 
@@ -3001,6 +3329,8 @@ rig_engine_handle_ui_update (RigEngine *engine)
                                               engine->controllers->data);
 
           rig_load_asset_list (engine);
+
+          rig_autosave_start (engine);
         }
 #endif
     }
@@ -3014,9 +3344,14 @@ rig_engine_free_ui (RigEngine *engine)
 #ifdef RIG_EDITOR_ENABLED
   if (_rig_in_editor_mode)
     {
+      GHashTableIter iter;
+      void *closure;
+
       rig_controller_view_set_controller (engine->controller_view,
                                           NULL);
 
+      rig_autosave_stop (engine);
+
       if (engine->grid_prim)
         {
           cogl_object_unref (engine->grid_prim);
@@ -3024,6 +3359,32 @@ rig_engine_free_ui (RigEngine *engine)
         }
 
       clear_search_results (engine);
+
+      if (engine->asset_search_index)
+        free_search_indices (engine);
+
+      /* Assets that are still loading may outlive the engine's
+       * references so make sure they won't call back into the
+       * engine */
+      g_hash_table_iter_init (&iter, engine->loading_assets);
+      while (g_hash_table_iter_next (&iter, NULL, &closure))
+        rut_closure_disconnect (closure);
+      g_hash_table_remove_all (engine->loading_assets);
+
+      rut_shell_remove_pre_paint_callback_by_graphable (engine->ctx->shell,
+                                                        engine->search_results_fold);
+
+      if (engine->asset_monitors)
+        {
+          g_hash_table_destroy (engine->asset_monitors);
+          engine->asset_monitors = NULL;
+        }
+
+      if (engine->asset_index)
+        {
+          rig_asset_index_free (engine->asset_index);
+          engine->asset_index = NULL;
+        }
     }
 #endif
 
@@ -3056,8 +3417,6 @@ rig_engine_free_ui (RigEngine *engine)
   g_list_free (engine->assets);
   engine->assets = NULL;
 
-  free_result_input_closures (engine);
-
   /* NB: no extra reference is held on the light other than the
    * reference for it being in the scenegraph. */
   engine->light = NULL;
@@ -3149,6 +3508,15 @@ _rig_engine_free (void *object)
       rut_refable_unref (engine->objects_selection);
 
       rut_closure_list_disconnect_all (&engine->tool_changed_cb_list);
+
+      if (engine->profile_overlay)
+        rig_profile_overlay_free (engine->profile_overlay);
+
+      if (engine->renderer_stats_layout)
+        {
+          g_object_unref (engine->renderer_stats_layout);
+          cogl_object_unref (engine->renderer_stats_bg_pipeline);
+        }
 #endif
 
       cogl_object_unref (engine->onscreen);
@@ -3307,6 +3675,8 @@ _rig_engine_new_full (RutShell *shell,
                                                    g_free,
                                                    rut_refable_unref);
 
+  engine->loading_assets = g_hash_table_new (g_direct_hash, g_direct_equal);
+
   /*
    * Setup the entity scenegraph
    */
@@ -3397,10 +3767,28 @@ _rig_engine_new_full (RutShell *shell,
 #ifndef __ANDROID__
       if (engine->ui_filename)
         {
+          char *recovery_filename = NULL;
           struct stat st;
 
-          stat (engine->ui_filename, &st);
-          if (S_ISREG (st.st_mode))
+#ifdef RIG_EDITOR_ENABLED
+          /* An autosave newer than the UI has the unsaved changes from
+           * an editor that didn't get to save them. They only replace
+           * the UI once it is saved. */
+          if (_rig_in_editor_mode)
+            recovery_filename =
+              rig_autosave_find_recovery_file (engine->ui_filename);
+#endif
+
+          if (recovery_filename)
+            {
+              g_message ("Recovering unsaved changes from %s. Save to keep "
+                         "them or delete the file to discard them.",
+                         recovery_filename);
+              rig_load (engine, recovery_filename);
+              g_free (recovery_filename);
+            }
+          else if (stat (engine->ui_filename, &st) == 0 &&
+                   S_ISREG (st.st_mode))
             rig_load (engine, engine->ui_filename);
           else
             rig_engine_handle_ui_update (engine);
@@ -3518,7 +3906,7 @@ rig_engine_input_handler (RutInputEvent *event, void *user_data)
               if ((rut_key_event_get_modifier_state (event) &
                    RUT_MODIFIER_CTRL_ON))
                 {
-                  rig_save (engine, engine->ui_filename);
+                  rig_save_async (engine, engine->ui_filename);
                   return RUT_INPUT_EVENT_STATUS_UNHANDLED;
                 }
               break;
@@ -3538,6 +3926,24 @@ rig_engine_input_handler (RutInputEvent *event, void *user_data)
                   return RUT_INPUT_EVENT_STATUS_HANDLED;
                 }
               break;
+            case RUT_KEY_p:
+              if ((rut_key_event_get_modifier_state (event) &
+                   RUT_MODIFIER_CTRL_ON))
+                {
+                  rut_profile_set_enabled (!rut_profile_get_enabled ());
+                  rut_shell_queue_redraw (engine->shell);
+                  return RUT_INPUT_EVENT_STATUS_HANDLED;
+                }
+              break;
+            case RUT_KEY_i:
+              if ((rut_key_event_get_modifier_state (event) &
+                   RUT_MODIFIER_CTRL_ON))
+                {
+                  engine->show_renderer_stats = !engine->show_renderer_stats;
+                  rut_shell_queue_redraw (engine->shell);
+                  return RUT_INPUT_EVENT_STATUS_HANDLED;
+                }
+              break;
 
 #if 1
               /* HACK: Currently it's quite hard to select the play
@@ -3606,37 +4012,96 @@ rig_lookup_asset (RigEngine *engine,
   return g_hash_table_lookup (engine->assets_registry, path);
 }
 
-RutAsset *
-rig_load_asset (RigEngine *engine, GFileInfo *info, GFile *asset_file)
+static RutAsset *
+load_asset (RigEngine *engine,
+            const char *path,
+            const GList *inferred_tags,
+            const char *content_hash,
+            bool async,
+            bool deferred,
+            RutAssetBatch *batch)
 {
-  GFile *assets_dir = g_file_new_for_path (engine->ctx->assets_location);
-  GFile *dir = g_file_get_parent (asset_file);
-  char *path = g_file_get_relative_path (assets_dir, asset_file);
-  GList *inferred_tags = NULL;
   RutAsset *asset = NULL;
+  RutAssetType type;
 
-  inferred_tags = rut_infer_asset_tags (engine->ctx, info, asset_file);
+  RUT_TRACE_BEGIN ("Asset load", path);
 
   if (rut_util_find_tag (inferred_tags, "image") ||
       rut_util_find_tag (inferred_tags, "video"))
     {
       if (rut_util_find_tag (inferred_tags, "normal-maps"))
-        asset = rut_asset_new_normal_map (engine->ctx, path, inferred_tags);
+        type = RUT_ASSET_TYPE_NORMAL_MAP;
       else if (rut_util_find_tag (inferred_tags, "alpha-masks"))
-        asset = rut_asset_new_alpha_mask (engine->ctx, path, inferred_tags);
+        type = RUT_ASSET_TYPE_ALPHA_MASK;
       else
-        asset = rut_asset_new_texture (engine->ctx, path, inferred_tags);
+        type = RUT_ASSET_TYPE_TEXTURE;
     }
   else if (rut_util_find_tag (inferred_tags, "ply"))
-    asset = rut_asset_new_ply_model (engine->ctx, path, inferred_tags);
+    type = RUT_ASSET_TYPE_PLY_MODEL;
+  else
+    goto DONE;
+
+  if (batch)
+    asset = rut_asset_batch_add_file (batch, path, inferred_tags, type,
+                                      content_hash);
+  else if (deferred)
+    asset = rut_asset_new_deferred (engine->ctx, path, inferred_tags, type,
+                                    content_hash);
+  else if (async)
+    asset = rut_asset_new_async (engine->ctx, path, inferred_tags, type,
+                                 content_hash);
+  else
+    {
+      switch (type)
+        {
+        case RUT_ASSET_TYPE_NORMAL_MAP:
+          asset = rut_asset_new_normal_map (engine->ctx, path, inferred_tags);
+          break;
+        case RUT_ASSET_TYPE_ALPHA_MASK:
+          asset = rut_asset_new_alpha_mask (engine->ctx, path, inferred_tags);
+          break;
+        case RUT_ASSET_TYPE_PLY_MODEL:
+          asset = rut_asset_new_ply_model (engine->ctx, path, inferred_tags);
+          break;
+        default:
+          asset = rut_asset_new_texture (engine->ctx, path, inferred_tags);
+          break;
+        }
+    }
 
-  if (asset && _rig_in_editor_mode && rut_asset_needs_thumbnail (asset))
-    rut_asset_thumbnail (asset, rig_refresh_thumbnails, engine, NULL);
+DONE:
 
-  g_list_free (inferred_tags);
+  RUT_TRACE_END ("Asset load");
+
+  return asset;
+}
+
+RutAsset *
+rig_load_asset (RigEngine *engine, GFileInfo *info, GFile *asset_file)
+{
+  return rig_load_asset_in_batch (engine, NULL, info, asset_file);
+}
+
+RutAsset *
+rig_load_asset_in_batch (RigEngine *engine,
+                         RutAssetBatch *batch,
+                         GFileInfo *info,
+                         GFile *asset_file)
+{
+  GFile *assets_dir = g_file_new_for_path (engine->ctx->assets_location);
+  char *path = g_file_get_relative_path (assets_dir, asset_file);
+  GList *inferred_tags = NULL;
+  RutAsset *asset;
+
+  inferred_tags = rut_infer_asset_tags (engine->ctx, info, asset_file);
+
+  asset = load_asset (engine, path, inferred_tags, NULL,
+                      false, /* async */
+                      false, /* deferred */
+                      batch);
 
+  g_list_free (inferred_tags);
   g_object_unref (assets_dir);
-  g_object_unref (dir);
   g_free (path);
 
   return asset;
@@ -3644,26 +4109,159 @@ rig_load_asset (RigEngine *engine, GFileInfo *info, GFile *asset_file)
 
 #ifdef RIG_EDITOR_ENABLED
 
+static void
+asset_ready_cb (RutAsset *asset,
+                bool loaded,
+                void *user_data)
+{
+  RigEngine *engine = user_data;
+
+  g_hash_table_remove (engine->loading_assets, asset);
+
+  if (loaded)
+    {
+      const char *content_hash = rut_asset_get_content_hash (asset);
+      RigAssetIndexEntry *entry =
+        rig_asset_index_lookup (engine->asset_index,
+                                rut_asset_get_path (asset));
+
+      if (entry && content_hash &&
+          g_strcmp0 (entry->content_hash, content_hash) != 0)
+        {
+          rig_asset_index_set_content_hash (engine->asset_index,
+                                            entry,
+                                            content_hash);
+        }
+    }
+  else
+    {
+      rig_search_index_remove (engine->asset_search_index, asset);
+      engine->assets = g_list_remove (engine->assets, asset);
+      rut_refable_unref (asset);
+    }
+
+  queue_search_refresh (engine);
+}
+
+static void
+remove_asset (RigEngine *engine, const char *path)
+{
+  GList *l, *next;
+  int len = strlen (path);
+
+  /* NB: @path may also be a directory that was deleted */
+  for (l = engine->assets; l; l = next)
+    {
+      RutAsset *asset = l->data;
+      const char *asset_path = rut_asset_get_path (asset);
+      RutClosure *closure;
+
+      next = l->next;
+
+      if (strncmp (asset_path, path, len) != 0 ||
+          (asset_path[len] != '\0' && asset_path[len] != G_DIR_SEPARATOR))
+        continue;
+
+      closure = g_hash_table_lookup (engine->loading_assets, asset);
+      if (closure)
+        {
+          rut_closure_disconnect (closure);
+          g_hash_table_remove (engine->loading_assets, asset);
+        }
+
+      rig_search_index_remove (engine->asset_search_index, asset);
+      engine->assets = g_list_delete_link (engine->assets, l);
+      rut_refable_unref (asset);
+    }
+}
+
+/* @info only needs to have been queried with
+ * RIG_ASSET_INDEX_ATTRIBUTES */
 static void
 add_asset (RigEngine *engine, GFileInfo *info, GFile *asset_file)
 {
   GFile *assets_dir = g_file_new_for_path (engine->ctx->assets_location);
   char *path = g_file_get_relative_path (assets_dir, asset_file);
+  RigAssetIndexEntry *entry;
   GList *l;
   RutAsset *asset = NULL;
 
+  g_object_unref (assets_dir);
+
   /* Avoid loading duplicate assets... */
   for (l = engine->assets; l; l = l->next)
     {
       RutAsset *existing = l->data;
 
       if (strcmp (rut_asset_get_path (existing), path) == 0)
-        return;
+        goto DONE;
     }
 
-  asset = rig_load_asset (engine, info, asset_file);
+  /* Finding the content type may involve sniffing the file so that and
+   * inferring the tags is only done for files that have changed since
+   * they were last indexed */
+  entry = rig_asset_index_lookup (engine->asset_index, path);
+  if (entry == NULL || !rig_asset_index_entry_is_current (entry, info))
+    {
+      GError *error = NULL;
+      GFileInfo *full_info = g_file_query_info (asset_file,
+                                                "standard::*",
+                                                G_FILE_QUERY_INFO_NONE,
+                                                NULL,
+                                                &error);
+      GList *inferred_tags = NULL;
+      bool is_asset;
+
+      if (!full_info)
+        {
+          g_warning ("Failed to query asset %s: %s", path, error->message);
+          g_error_free (error);
+          goto DONE;
+        }
+
+      is_asset = rut_file_info_is_asset (full_info,
+                                         g_file_info_get_name (full_info));
+      if (is_asset)
+        inferred_tags = rut_infer_asset_tags (engine->ctx,
+                                              full_info, asset_file);
+
+      entry = rig_asset_index_update (engine->asset_index,
+                                      path, info,
+                                      is_asset, inferred_tags);
+
+      g_list_free (inferred_tags);
+      g_object_unref (full_info);
+    }
+
+  if (!entry->is_asset)
+    goto DONE;
+
+  /* Decoding the assets is left to worker threads so that the editor
+   * doesn't block on loading every asset at startup. Assets that are
+   * unchanged since they were last indexed have a content hash and are
+   * only shown by their cached thumbnail until they are used. */
+  asset = load_asset (engine, path, entry->inferred_tags,
+                      entry->content_hash,
+                      true, /* async */
+                      true, /* deferred */
+                      NULL); /* batch */
   if (asset)
-    engine->assets = g_list_prepend (engine->assets, asset);
+    {
+      RutClosure *closure;
+
+      engine->assets = g_list_prepend (engine->assets, asset);
+      index_asset (engine, asset);
+
+      closure = rut_asset_add_ready_callback (asset,
+                                              asset_ready_cb,
+                                              engine,
+                                              NULL); /* destroy notify */
+      if (closure)
+        g_hash_table_insert (engine->loading_assets, asset, closure);
+    }
+
+DONE:
+  g_free (path);
 }
 
 #if 0
@@ -3704,13 +4302,184 @@ enumerate_file_info (RigEngine *engine, GFile *parent, GFileInfo *info)
   else if (type == G_FILE_TYPE_REGULAR ||
            type == G_FILE_TYPE_SYMBOLIC_LINK)
     {
-      if (rut_file_info_is_asset (info, name))
+      GFile *file = g_file_get_child (parent, name);
+      add_asset (engine, info, file);
+      g_object_unref (file);
+    }
+}
+
+static void
+asset_file_changed (RigEngine *engine, GFile *file)
+{
+  GFile *assets_dir = g_file_new_for_path (engine->ctx->assets_location);
+  char *path = g_file_get_relative_path (assets_dir, file);
+  GFile *parent = g_file_get_parent (file);
+  RigAssetIndexEntry *entry;
+  GFileInfo *info;
+
+  info = g_file_query_info (file,
+                            RIG_ASSET_INDEX_ATTRIBUTES,
+                            G_FILE_QUERY_INFO_NONE,
+                            NULL, /* cancellable */
+                            NULL); /* error */
+  if (info == NULL || path == NULL)
+    goto DONE;
+
+  /* Directories don't have an entry in the index so they are only
+   * enumerated when they are first seen. Changes to their contents
+   * are reported by their own monitor. */
+  if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+    {
+      char *full_path = g_file_get_path (file);
+      bool monitored = g_hash_table_contains (engine->asset_monitors,
+                                              full_path);
+
+      g_free (full_path);
+
+      if (!monitored)
         {
-          GFile *image = g_file_get_child (parent, name);
-          add_asset (engine, info, image);
-          g_object_unref (image);
+          enumerate_file_info (engine, parent, info);
+          queue_search_refresh (engine);
         }
+
+      goto DONE;
     }
+
+  /* Nothing needs to be reloaded if the file hasn't really changed */
+  entry = rig_asset_index_lookup (engine->asset_index, path);
+  if (entry && rig_asset_index_entry_is_current (entry, info))
+    goto DONE;
+
+  remove_asset (engine, path);
+  enumerate_file_info (engine, parent, info);
+
+  queue_search_refresh (engine);
+
+DONE:
+  if (info)
+    g_object_unref (info);
+  g_object_unref (parent);
+  g_object_unref (assets_dir);
+  g_free (path);
+}
+
+static gboolean
+remove_monitor_cb (void *key,
+                   void *value,
+                   void *user_data)
+{
+  const char *monitored_path = key;
+  const char *path = user_data;
+  int len = strlen (path);
+
+  return (strncmp (monitored_path, path, len) == 0 &&
+          (monitored_path[len] == '\0' ||
+           monitored_path[len] == G_DIR_SEPARATOR));
+}
+
+static void
+asset_file_deleted (RigEngine *engine, GFile *file)
+{
+  GFile *assets_dir = g_file_new_for_path (engine->ctx->assets_location);
+  char *path = g_file_get_relative_path (assets_dir, file);
+
+  if (path)
+    {
+      char *full_path = g_file_get_path (file);
+
+      /* NB: @file may have been a directory in which case the
+       * monitors for it and any of its subdirectories are dropped */
+      g_hash_table_foreach_remove (engine->asset_monitors,
+                                   remove_monitor_cb,
+                                   full_path);
+      g_free (full_path);
+
+      remove_asset (engine, path);
+      rig_asset_index_remove (engine->asset_index, path);
+
+      queue_search_refresh (engine);
+    }
+
+  g_object_unref (assets_dir);
+  g_free (path);
+}
+
+static void
+assets_dir_changed_cb (GFileMonitor *monitor,
+                       GFile *file,
+                       GFile *other_file,
+                       GFileMonitorEvent event_type,
+                       void *user_data)
+{
+  RigEngine *engine = user_data;
+  char *basename = g_file_get_basename (file);
+  bool hidden = basename[0] == '.';
+
+  g_free (basename);
+
+  /* This also ignores the index and the mesh cache */
+  if (hidden)
+    return;
+
+  switch (event_type)
+    {
+    /* NB: A file may still be being written when it is created. If so
+     * it will be loaded again when the changes are done */
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+      asset_file_changed (engine, file);
+      break;
+    case G_FILE_MONITOR_EVENT_DELETED:
+      asset_file_deleted (engine, file);
+      break;
+    default:
+      break;
+    }
+}
+
+static void
+free_asset_monitor (void *data)
+{
+  GFileMonitor *monitor = data;
+
+  g_file_monitor_cancel (monitor);
+  g_object_unref (monitor);
+}
+
+/* Keeps the assets and the asset index up to date with changes made to
+ * the assets directory while the editor is running. NB: Directory
+ * monitors aren't recursive so every directory gets its own. */
+static void
+monitor_assets_dir (RigEngine *engine, GFile *directory)
+{
+  char *path = g_file_get_path (directory);
+  GError *error = NULL;
+  GFileMonitor *monitor;
+
+  if (g_hash_table_contains (engine->asset_monitors, path))
+    {
+      g_free (path);
+      return;
+    }
+
+  monitor = g_file_monitor_directory (directory,
+                                      G_FILE_MONITOR_NONE,
+                                      NULL, /* cancellable */
+                                      &error);
+  if (!monitor)
+    {
+      g_warning ("Failed to monitor assets dir %s: %s",
+                 path, error->message);
+      g_free (path);
+      g_error_free (error);
+      return;
+    }
+
+  g_signal_connect (monitor, "changed",
+                    G_CALLBACK (assets_dir_changed_cb), engine);
+
+  /* NB: the table takes ownership of @path */
+  g_hash_table_insert (engine->asset_monitors, path, monitor);
 }
 
 #ifdef USE_ASYNC_IO
@@ -3830,8 +4599,11 @@ enumerate_dir_for_assets (RigEngine *engine,
   GError *error = NULL;
   GFileInfo *file_info;
 
+  /* NB: Only the attributes needed to check the asset index are
+   * queried here. In particular the content type may involve sniffing
+   * the file so that is only queried for files that have changed. */
   enumerator = g_file_enumerate_children (file,
-                                          "standard::*",
+                                          RIG_ASSET_INDEX_ATTRIBUTES,
                                           G_FILE_QUERY_INFO_NONE,
                                           NULL,
                                           &error);
@@ -3850,9 +4622,12 @@ enumerate_dir_for_assets (RigEngine *engine,
                                                    &error)))
     {
       enumerate_file_info (engine, file, file_info);
+      g_object_unref (file_info);
     }
 
   g_object_unref (enumerator);
+
+  monitor_assets_dir (engine, file);
 }
 #endif /* USE_ASYNC_IO */
 
@@ -3860,8 +4635,21 @@ static void
 rig_load_asset_list (RigEngine *engine)
 {
   GFile *assets_dir = g_file_new_for_path (engine->ctx->assets_location);
+  GList *l;
+
+  engine->asset_index = rig_asset_index_new (engine->ctx->assets_location);
+  engine->asset_monitors = g_hash_table_new_full (g_str_hash,
+                                                  g_str_equal,
+                                                  g_free,
+                                                  free_asset_monitor);
 
+  create_search_indices (engine);
+
+  /* Anything in the index that isn't found while enumerating has been
+   * deleted since the index was saved */
+  rig_asset_index_begin_scan (engine->asset_index);
   enumerate_dir_for_assets (engine, assets_dir);
+  rig_asset_index_end_scan (engine->asset_index);
 
   rut_refable_ref (engine->nine_slice_builtin_asset);
   engine->assets = g_list_prepend (engine->assets,
@@ -3891,6 +4679,10 @@ rig_load_asset_list (RigEngine *engine)
   engine->assets = g_list_prepend (engine->assets,
                                    engine->button_input_builtin_asset);
 
+  /* NB: this also picks up any assets that were loaded with the UI */
+  for (l = engine->assets; l; l = l->next)
+    index_asset (engine, l->data);
+
   g_object_unref (assets_dir);
 
   rig_run_search (engine);
@@ -40,10 +40,13 @@ typedef enum _RigToolID
 #include "rig-controller-view.h"
 #include "rig-types.h"
 #include "rig-undo-journal.h"
+#include "rig-asset-index.h"
+#include "rig-search-index.h"
 #include "rut-box-layout.h"
 #include "rig-osx.h"
 #include "rig-split-view.h"
 #include "rig-camera-view.h"
+#include "rig-profile-overlay.h"
 
 enum {
   RIG_ENGINE_PROP_WIDTH,
@@ -83,6 +86,10 @@ typedef struct _RigFrontend
   int pending_width;
   int pending_height;
 
+  /* Set once the simulator has reported that it can't load PACKED UIs
+   * from us */
+  bool packed_disabled;
+
 } RigFrontend;
 
 /* The "simulator" is the process responsible for updating object
@@ -155,6 +162,16 @@ struct _RigEngine
   GList *undo_journal_stack;
   RigUndoJournal *undo_journal;
 
+  /* The change count of the main undo journal when the UI was last
+   * saved, and when it was last autosaved, see rig_autosave_start() */
+  unsigned int saved_n_changes;
+  unsigned int autosaved_n_changes;
+  unsigned int autosave_timeout;
+
+  /* What has been written to the autosave file since it was last
+   * rewritten in full, so that only changes need to be appended */
+  RigSaveLog *autosave_log;
+
   /* shadow mapping */
   CoglOffscreen *shadow_fb;
   CoglTexture2D *shadow_color;
@@ -229,9 +246,25 @@ struct _RigEngine
   RutAsset *pointalism_grid_builtin_asset;
   RutAsset *hair_builtin_asset;
   RutAsset *button_input_builtin_asset;
-  GList *result_input_closures;
   GList *asset_enumerators;
 
+  /* Searches are answered from these indices instead of comparing
+   * against every asset, entity and controller. The result widget of
+   * each indexed object is kept in search_results so it can be reused
+   * by the next search. */
+  RigSearchIndex *asset_search_index;
+  RigSearchIndex *entity_search_index;
+  RigSearchIndex *controller_search_index;
+  GHashTable *search_results;
+  GHashTable *entity_label_closures;
+  unsigned int search_scene_age;
+
+  /* The persistent index of the assets directory and the monitors
+   * that keep it up to date while the editor is running, keyed by the
+   * path of the directory each one monitors */
+  RigAssetIndex *asset_index;
+  GHashTable *asset_monitors;
+
   RutUIViewport *tool_vp;
   RutUIViewport *properties_vp;
   RutBin *inspector_bin;
@@ -268,6 +301,9 @@ struct _RigEngine
   float grab_progress;
 
   GList *assets;
+  /* Maps assets that are still being loaded by the asset loader's
+   * worker threads to the closure of their ready callback */
+  GHashTable *loading_assets;
 
   GList *controllers;
   RigController *selected_controller;
@@ -280,6 +316,16 @@ struct _RigEngine
   CoglPrimitive *picking_ray;
   CoglBool debug_pick_ray;
 
+#ifdef RIG_EDITOR_ENABLED
+  /* Shown while profiling is enabled, toggled with Ctrl+P */
+  RigProfileOverlay *profile_overlay;
+
+  /* Renderer statistics HUD, toggled with Ctrl+I */
+  CoglBool show_renderer_stats;
+  PangoLayout *renderer_stats_layout;
+  CoglPipeline *renderer_stats_bg_pipeline;
+#endif
+
   /* The transparency grid widget that is displayed behind the assets list */
   RutImage *transparency_grid;
 
@@ -390,6 +436,14 @@ rig_lookup_asset (RigEngine *engine,
 RutAsset *
 rig_load_asset (RigEngine *engine, GFileInfo *info, GFile *asset_file);
 
+/* Like rig_load_asset() but the asset is decoded as part of @batch, or
+ * straight away if @batch is NULL */
+RutAsset *
+rig_load_asset_in_batch (RigEngine *engine,
+                         RutAssetBatch *batch,
+                         GFileInfo *info,
+                         GFile *asset_file);
+
 typedef enum _RutSelectAction
 {
   /* replaces the current selection */
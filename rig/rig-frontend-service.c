@@ -56,8 +56,12 @@ frontend__update_ui (Rig__Frontend_Service *service,
 
   g_return_if_fail (ui_diff != NULL);
 
+  RUT_TRACE_BEGIN ("UpdateUI apply", NULL);
+
   g_print ("Frontend: Update UI Request\n");
 
+  RUT_TRACE_END ("UpdateUI apply");
+
   closure (&ack, closure_data);
 }
 
@@ -101,19 +105,34 @@ asset_filter_cb (RutAsset *asset,
    return false;
 }
 
+static void
+load_simulator_ui (RigFrontend *frontend,
+                   PB_RPC_Client *pb_client);
+
 static void
 handle_load_response (const Rig__LoadResult *result,
                       void *closure_data)
 {
+  RigFrontend *frontend = closure_data;
+
+  if (result && result->schema_mismatch &&
+      !frontend->packed_disabled)
+    {
+      g_warning ("Simulator has different properties, resending the UI "
+                 "without packing it");
+      frontend->packed_disabled = true;
+      load_simulator_ui (frontend, frontend->frontend_peer->pb_rpc_client);
+      return;
+    }
+
   g_print ("Simulator: UI loaded\n");
 }
 
 static void
-frontend_peer_connected (PB_RPC_Client *pb_client,
-                         void *user_data)
+load_simulator_ui (RigFrontend *frontend,
+                   PB_RPC_Client *pb_client)
 {
   RigPBSerializer *serializer;
-  RigFrontend *frontend = user_data;
   ProtobufCService *simulator_service =
     rig_pb_rpc_client_get_service (pb_client);
   Rig__UI *ui;
@@ -123,15 +142,28 @@ frontend_peer_connected (PB_RPC_Client *pb_client,
   rig_pb_serializer_set_asset_filter (serializer,
                                       asset_filter_cb,
                                       NULL);
+  rig_pb_serializer_set_packed_enabled (serializer,
+                                        !frontend->packed_disabled);
 
   ui = rig_pb_serialize_ui (serializer);
 
   rig__simulator__load (simulator_service, ui,
                         handle_load_response,
-                        NULL);
+                        frontend);
 
   rig_pb_serialized_ui_destroy (ui);
 
+  rig_pb_serializer_destroy (serializer);
+}
+
+static void
+frontend_peer_connected (PB_RPC_Client *pb_client,
+                         void *user_data)
+{
+  RigFrontend *frontend = user_data;
+
+  load_simulator_ui (frontend, pb_client);
+
 #if 0
   Rig__Query query = RIG__QUERY__INIT;
 
@@ -140,8 +172,6 @@ frontend_peer_connected (PB_RPC_Client *pb_client,
                         handle_simulator_test_response, NULL);
 #endif
 
-  rig_pb_serializer_destroy (serializer);
-
   g_print ("Frontend peer connected\n");
 }
 
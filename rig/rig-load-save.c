@@ -22,35 +22,519 @@
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/mman.h>
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
 
 #include "rig.pb-c.h"
 #include "rig-engine.h"
 #include "rig-pb.h"
+#include "rig-load-save.h"
+#include "rig-undo-journal.h"
+
+/* Packing appends each field of the UI separately so the writes are
+ * gathered in a large buffer to avoid a system call per field */
+#define WRITE_BUFFER_SIZE (64 * 1024)
+
+/* How often unsaved changes are saved in the background while
+ * editing */
+#define AUTOSAVE_INTERVAL_SECONDS 30
+
+/* Autosaves are written next to the UI instead of replacing it */
+#define AUTOSAVE_SUFFIX ".autosave"
+
+/* Changes are appended to an autosave until they add up to more than
+ * this many times the size of its last full save, after which it is
+ * compacted by being rewritten in full */
+#define AUTOSAVE_COMPACT_RATIO 1
+
+/* Autosaves are append-only. After an autosave has been written in
+ * full the following autosaves only append another Rig__UI with the
+ * records of the entities and controllers that have changed and of
+ * the assets that haven't been written yet. Concatenated messages are
+ * merged when they are unpacked so loading the file only has to keep
+ * the newest record with each id, see merge_appended_records().
+ *
+ * That depends on the records keeping the same ids and order so
+ * adding, removing or moving any entities or controllers means the
+ * autosave is rewritten in full instead. */
+struct _RigSaveLog
+{
+  char *path;
+
+  /* Gives the saved objects the same ids in every autosave */
+  RigPBIdTable *ids;
+
+  /* Maps the ids of entities and controllers to a checksum of the
+   * record last written for them */
+  GHashTable *checksums;
+
+  /* Maps the assets that have been written to a SavedAsset */
+  GHashTable *assets;
+
+  /* A checksum of the layout of the scene and of the controllers when
+   * the file was last written in full */
+  char *structure;
+
+  size_t full_size;
+  size_t appended_size;
+};
+
+typedef struct _SavedAsset
+{
+  RutClosure *mesh_closure;
+  bool changed;
+} SavedAsset;
 
 typedef struct _BufferedFile
 {
   ProtobufCBuffer base;
-  FILE *fp;
-  CoglBool error;
+  int fd;
+  uint8_t *buffer;
+  size_t buffer_len;
+
+  /* The errno of the first failed write or 0 */
+  int error;
 } BufferedFile;
 
+/* A piece of a packed UI. Large payloads point straight into one of
+ * the job's payload buffers while everything else is copied into the
+ * job's bytes array, in which case @data is NULL and @offset is where
+ * the piece starts. */
+typedef struct _SaveChunk
+{
+  const uint8_t *data;
+  size_t offset;
+  size_t len;
+} SaveChunk;
+
+/* A UI that has already been packed and is waiting to be written by
+ * the save thread */
+typedef struct _SaveJob
+{
+  RigEngine *engine;
+  char *path;
+  bool autosave;
+
+  /* The change count of the undo journal when the UI was packed */
+  unsigned int n_changes;
+
+  /* Whether the UI is appended to the file rather than replacing it,
+   * see RigSaveLog */
+  bool append;
+
+  GArray *chunks;
+  GByteArray *bytes;
+
+  /* The RutBuffers the chunks borrow their data from. NB: these are
+   * only referenced and unreferenced on the main thread. */
+  GList *payloads;
+  GHashTable *payload_map;
+
+  bool saved;
+} SaveJob;
+
+typedef struct _SaveJobBuffer
+{
+  ProtobufCBuffer base;
+  SaveJob *job;
+} SaveJobBuffer;
+
+static GThreadPool *save_pool;
+
+/* Finished jobs are handed back to the main thread through this */
+static GAsyncQueue *save_done_queue;
+
+/* Returns 0 or the errno of the failed write */
+static int
+write_all (int fd,
+           const uint8_t *data,
+           size_t len)
+{
+  while (len)
+    {
+      ssize_t written = write (fd, data, len);
+
+      if (written == -1)
+        {
+          if (errno != EINTR)
+            return errno;
+          continue;
+        }
+
+      data += written;
+      len -= written;
+    }
+
+  return 0;
+}
+
+static void
+write_to_file (BufferedFile *buffered_file,
+               const uint8_t *data,
+               size_t len)
+{
+  if (!buffered_file->error)
+    buffered_file->error = write_all (buffered_file->fd, data, len);
+}
+
+static void
+flush_buffered_file (BufferedFile *buffered_file)
+{
+  write_to_file (buffered_file,
+                 buffered_file->buffer,
+                 buffered_file->buffer_len);
+  buffered_file->buffer_len = 0;
+}
+
 static void
 append_to_file (ProtobufCBuffer *buffer,
                 unsigned len,
-                const unsigned char *engine)
+                const unsigned char *data)
 {
   BufferedFile *buffered_file = (BufferedFile *)buffer;
 
   if (buffered_file->error)
     return;
 
-  if (fwrite (engine, len, 1, buffered_file->fp) != 1)
-    buffered_file->error = TRUE;
+  if (buffered_file->buffer_len + len > WRITE_BUFFER_SIZE)
+    flush_buffered_file (buffered_file);
+
+  /* Large chunks, such as mesh buffers, aren't worth copying */
+  if (len >= WRITE_BUFFER_SIZE)
+    write_to_file (buffered_file, data, len);
+  else
+    {
+      memcpy (buffered_file->buffer + buffered_file->buffer_len, data, len);
+      buffered_file->buffer_len += len;
+    }
+}
+
+/* Saves are written to a temporary file which then replaces the
+ * original so that a failed save can't leave a truncated file
+ * behind. Meshes loaded from the original may also still be
+ * borrowing their buffers from a mapping of it which stays valid
+ * after it is replaced. */
+typedef struct _SaveFile
+{
+  int fd;
+
+  /* The file that gets replaced. If the path being saved is a
+   * symlink then this is what it points to so that the link isn't
+   * replaced by a regular file. */
+  char *target;
+
+  char *tmp_filename;
+} SaveFile;
+
+static bool
+open_save_file (const char *path,
+                SaveFile *file)
+{
+  char *resolved = realpath (path, NULL);
+  struct stat sb;
+
+  /* NB: this fails if the file doesn't exist yet, in which case
+   * there's no link to follow */
+  file->target = g_strdup (resolved ? resolved : path);
+  free (resolved);
+
+  file->tmp_filename = g_strconcat (file->target, ".XXXXXX", NULL);
+  file->fd = g_mkstemp_full (file->tmp_filename, O_WRONLY, 0666);
+
+  if (file->fd == -1)
+    {
+      g_warning ("Failed to open %s for saving: %s",
+                 file->tmp_filename, g_strerror (errno));
+      g_free (file->tmp_filename);
+      g_free (file->target);
+      return false;
+    }
+
+  /* The replacement should keep the permissions of the original
+   * rather than get the default ones */
+  if (stat (file->target, &sb) == 0)
+    fchmod (file->fd, sb.st_mode & 07777);
+
+  return true;
+}
+
+/* The rename is only on disk once the directory containing the file
+ * has been synced too */
+static void
+sync_parent_dir (const char *filename)
+{
+  char *dir = g_path_get_dirname (filename);
+  int fd = open (dir, O_RDONLY);
+
+  if (fd == -1 || fsync (fd) == -1)
+    g_warning ("Failed to sync %s: %s", dir, g_strerror (errno));
+
+  if (fd != -1)
+    close (fd);
+
+  g_free (dir);
+}
+
+/* Replaces the target of the file opened by open_save_file() unless
+ * writing to it failed with @error. This frees the file's names. */
+static bool
+finish_save_file (SaveFile *file,
+                  int error)
+{
+  /* NB: the data has to be on disk before the rename otherwise a
+   * crash could leave an empty file in place of the original */
+  if (!error && fsync (file->fd) == -1)
+    error = errno;
+
+  if (close (file->fd) == -1 && !error)
+    error = errno;
+
+  if (!error && g_rename (file->tmp_filename, file->target) == -1)
+    error = errno;
+
+  if (error)
+    {
+      g_warning ("Failed to save %s: %s", file->target, g_strerror (error));
+      g_unlink (file->tmp_filename);
+    }
+  else
+    sync_parent_dir (file->target);
+
+  g_free (file->tmp_filename);
+  g_free (file->target);
+
+  return error == 0;
+}
+
+static unsigned int
+get_n_changes (RigEngine *engine)
+{
+  /* NB: the bottom of the stack is the main journal that all of the
+   * subjournals end up being logged into */
+  GList *l = g_list_last (engine->undo_journal_stack);
+
+  return l ? rig_undo_journal_get_n_changes (l->data) : 0;
+}
+
+static char *
+get_autosave_filename (const char *path)
+{
+  return g_strconcat (path, AUTOSAVE_SUFFIX, NULL);
+}
+
+static void
+asset_mesh_changed_cb (RutMesh *mesh,
+                       void *user_data)
+{
+  SavedAsset *saved = user_data;
+
+  saved->changed = true;
+}
+
+static void
+free_saved_asset (void *data)
+{
+  SavedAsset *saved = data;
+
+  if (saved->mesh_closure)
+    rut_closure_disconnect (saved->mesh_closure);
+
+  g_slice_free (SavedAsset, saved);
+}
+
+static RigSaveLog *
+save_log_new (const char *path)
+{
+  RigSaveLog *log = g_slice_new0 (RigSaveLog);
+
+  log->path = g_strdup (path);
+  log->ids = rig_pb_id_table_new ();
+  log->checksums = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                          g_free, g_free);
+  log->assets = g_hash_table_new_full (NULL, /* direct hash */
+                                       NULL, /* direct key equal */
+                                       NULL, /* owned by the id table */
+                                       free_saved_asset);
+
+  return log;
+}
+
+static void
+discard_autosave_log (RigEngine *engine)
+{
+  RigSaveLog *log = engine->autosave_log;
+
+  if (log == NULL)
+    return;
+
+  /* NB: the assets are kept alive by the id table */
+  g_hash_table_destroy (log->assets);
+  g_hash_table_destroy (log->checksums);
+  rig_pb_id_table_free (log->ids);
+  g_free (log->structure);
+  g_free (log->path);
+
+  g_slice_free (RigSaveLog, log);
+
+  engine->autosave_log = NULL;
+}
+
+/* Assets don't change once they are loaded, other than meshes which
+ * can be edited, so each asset is only written again if its mesh has
+ * changed since */
+static bool
+autosave_asset_filter_cb (RutAsset *asset,
+                          void *user_data)
+{
+  RigSaveLog *log = user_data;
+  SavedAsset *saved = g_hash_table_lookup (log->assets, asset);
+  RutMesh *mesh;
+
+  if (saved)
+    {
+      if (!saved->changed)
+        return false;
+
+      saved->changed = false;
+      return true;
+    }
+
+  saved = g_slice_new0 (SavedAsset);
+
+  mesh = rut_asset_get_mesh (asset);
+  if (mesh)
+    saved->mesh_closure = rut_mesh_add_changed_callback (mesh,
+                                                         asset_mesh_changed_cb,
+                                                         saved,
+                                                         NULL);
+
+  g_hash_table_insert (log->assets, asset, saved);
+
+  return true;
+}
+
+static RutTraverseVisitFlags
+add_structure_cb (RutObject *object,
+                  int depth,
+                  void *user_data)
+{
+  GChecksum *checksum = user_data;
+  RutObject *parent = rut_graphable_get_parent (object);
+
+  g_checksum_update (checksum, (const guchar *) &object, sizeof (object));
+  g_checksum_update (checksum, (const guchar *) &parent, sizeof (parent));
+
+  return RUT_TRAVERSE_VISIT_CONTINUE;
+}
+
+/* Returns a checksum of the order and parents of the objects in the
+ * scene and of the order of the controllers. NB: the objects are
+ * identified by their address which is only safe because the objects
+ * that are saved are kept alive by the log's id table. */
+static char *
+get_structure_checksum (RigEngine *engine)
+{
+  GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA1);
+  char *result;
+  GList *l;
+
+  rut_graphable_traverse (engine->scene,
+                          RUT_TRAVERSE_DEPTH_FIRST,
+                          add_structure_cb,
+                          NULL, /* after_children_cb */
+                          checksum);
+
+  for (l = engine->controllers; l; l = l->next)
+    g_checksum_update (checksum, (const guchar *) &l->data, sizeof (l->data));
+
+  result = g_strdup (g_checksum_get_string (checksum));
+  g_checksum_free (checksum);
+
+  return result;
+}
+
+/* Returns true if @message, the record with @id, differs from what
+ * was last written for it */
+static bool
+update_record_checksum (RigSaveLog *log,
+                        int64_t id,
+                        const ProtobufCMessage *message)
+{
+  size_t len = protobuf_c_message_get_packed_size (message);
+  uint8_t *data = g_malloc (len);
+  const char *last_checksum;
+  char *checksum;
+
+  protobuf_c_message_pack (message, data);
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1, data, len);
+  g_free (data);
+
+  last_checksum = g_hash_table_lookup (log->checksums, &id);
+  if (last_checksum && strcmp (last_checksum, checksum) == 0)
+    {
+      g_free (checksum);
+      return false;
+    }
+
+  g_hash_table_replace (log->checksums,
+                        g_memdup (&id, sizeof (id)),
+                        checksum);
+
+  return true;
+}
+
+/* Removes the entities and controllers from @ui that haven't changed
+ * since they were last written to the log's file. NB: the assets have
+ * already been filtered by autosave_asset_filter_cb(). Returns false
+ * if there's nothing left to write. */
+static bool
+filter_changed_records (RigSaveLog *log,
+                        Rig__UI *ui)
+{
+  size_t i, n;
+
+  for (i = 0, n = 0; i < ui->n_entities; i++)
+    {
+      Rig__Entity *entity = ui->entities[i];
+
+      if (update_record_checksum (log, entity->id, &entity->base))
+        ui->entities[n++] = entity;
+    }
+  ui->n_entities = n;
+
+  for (i = 0, n = 0; i < ui->n_controllers; i++)
+    {
+      Rig__Controller *controller = ui->controllers[i];
+
+      if (update_record_checksum (log, controller->id, &controller->base))
+        ui->controllers[n++] = controller;
+    }
+  ui->n_controllers = n;
+
+  return ui->n_entities || ui->n_controllers || ui->n_assets;
+}
+
+/* Once the UI itself has been saved any autosave of it is out of
+ * date */
+static void
+remove_autosave (RigEngine *engine, const char *path)
+{
+  if (engine->ui_filename && strcmp (path, engine->ui_filename) == 0)
+    {
+      char *autosave_filename = get_autosave_filename (path);
+
+      g_unlink (autosave_filename);
+      g_free (autosave_filename);
+
+      discard_autosave_log (engine);
+    }
 }
 
 void
@@ -59,42 +543,449 @@ rig_save (RigEngine *engine, const char *path)
   RigPBSerializer *serializer;
   struct stat sb;
   Rig__UI *ui;
-  char *rig_filename;
-  FILE *fp;
+  SaveFile file;
+  unsigned int n_changes = get_n_changes (engine);
 
   BufferedFile buffered_file = {
     { append_to_file },
-    NULL, /* file pointer */
-    FALSE
+    -1, /* fd */
+    NULL, /* buffer */
+    0, /* buffer_len */
+    0 /* error */
   };
 
-  rig_filename = g_strdup (path);
+  /* Make sure an older background save can't replace this one */
+  rig_save_wait ();
 
-  fp = fopen (rig_filename, "w");
-  g_free (rig_filename);
+  if (!open_save_file (path, &file))
+    return;
+
+  buffered_file.fd = file.fd;
+  buffered_file.buffer = g_malloc (WRITE_BUFFER_SIZE);
 
-  if (!fp)
+  if (stat (engine->ctx->assets_location, &sb) == -1)
+    mkdir (engine->ctx->assets_location, 0777);
+
+  serializer = rig_pb_serializer_new (engine);
+
+  ui = rig_pb_serialize_ui (serializer);
+
+  rig__ui__pack_to_buffer (ui, &buffered_file.base );
+
+  rig_pb_serialized_ui_destroy (ui);
+
+  rig_pb_serializer_destroy (serializer);
+
+  flush_buffered_file (&buffered_file);
+  g_free (buffered_file.buffer);
+
+  if (finish_save_file (&file, buffered_file.error))
+    {
+      engine->saved_n_changes = n_changes;
+      remove_autosave (engine, path);
+    }
+}
+
+static void
+append_to_job (ProtobufCBuffer *buffer,
+               unsigned len,
+               const unsigned char *data)
+{
+  SaveJob *job = ((SaveJobBuffer *)buffer)->job;
+  RutBuffer *payload = NULL;
+  SaveChunk *last;
+  SaveChunk chunk;
+
+  /* Only data owned by one of the payload buffers can be borrowed.
+   * Anything else may be changed by the main thread before the save
+   * thread gets to it. */
+  if (len >= WRITE_BUFFER_SIZE)
+    payload = g_hash_table_lookup (job->payload_map, data);
+
+  if (payload && payload->size == len)
     {
-      g_warning ("Failed to open %s for saving", rig_filename);
+      chunk.data = data;
+      chunk.offset = 0;
+      chunk.len = len;
+      g_array_append_val (job->chunks, chunk);
       return;
     }
 
-  buffered_file.fp = fp;
+  last = (job->chunks->len ?
+          &g_array_index (job->chunks, SaveChunk, job->chunks->len - 1) :
+          NULL);
 
-  if (stat (engine->ctx->assets_location, &sb) == -1)
-    mkdir (engine->ctx->assets_location, 0777);
+  g_byte_array_append (job->bytes, data, len);
+
+  if (last && last->data == NULL)
+    last->len += len;
+  else
+    {
+      chunk.data = NULL;
+      chunk.offset = job->bytes->len - len;
+      chunk.len = len;
+      g_array_append_val (job->chunks, chunk);
+    }
+}
+
+static gboolean
+save_done_idle_cb (void *user_data);
+
+static size_t
+get_job_size (SaveJob *job)
+{
+  size_t size = 0;
+  int i;
+
+  for (i = 0; i < job->chunks->len; i++)
+    size += g_array_index (job->chunks, SaveChunk, i).len;
+
+  return size;
+}
+
+/* Returns 0 or the errno of the failed write */
+static int
+write_job (SaveJob *job,
+           int fd)
+{
+  int error = 0;
+  int i;
+
+  for (i = 0; i < job->chunks->len && !error; i++)
+    {
+      SaveChunk *chunk = &g_array_index (job->chunks, SaveChunk, i);
+      const uint8_t *chunk_data =
+        chunk->data ? chunk->data : job->bytes->data + chunk->offset;
+
+      error = write_all (fd, chunk_data, chunk->len);
+    }
+
+  return error;
+}
+
+/* Appending can't be made atomic with a rename so a failed append is
+ * truncated away instead. If the editor stops in the middle of one
+ * the partial message is skipped when loading, see
+ * get_complete_length(). */
+static bool
+append_job_to_file (SaveJob *job)
+{
+  int fd = open (job->path, O_WRONLY | O_APPEND);
+  struct stat sb;
+  int error = 0;
+
+  if (fd == -1 || fstat (fd, &sb) == -1)
+    error = errno;
+
+  if (!error)
+    error = write_job (job, fd);
+
+  if (!error && fsync (fd) == -1)
+    error = errno;
+
+  if (error && fd != -1 && ftruncate (fd, sb.st_size) == -1)
+    g_warning ("Failed to truncate %s: %s", job->path, g_strerror (errno));
+
+  if (fd != -1 && close (fd) == -1 && !error)
+    error = errno;
+
+  if (error)
+    g_warning ("Failed to append to %s: %s", job->path, g_strerror (error));
+
+  return error == 0;
+}
+
+/* Runs in the save thread */
+static void
+save_thread_cb (void *data,
+                void *user_data)
+{
+  SaveJob *job = data;
+  SaveFile file;
+
+  if (job->append)
+    job->saved = append_job_to_file (job);
+  else if (open_save_file (job->path, &file))
+    job->saved = finish_save_file (&file, write_job (job, file.fd));
+
+  /* The payload buffers can only be released on the main thread */
+  g_async_queue_push (save_done_queue, job);
+  g_idle_add (save_done_idle_cb, NULL);
+}
+
+static void
+finish_save_job (SaveJob *job)
+{
+  RigEngine *engine = job->engine;
+  GList *l;
+
+  if (job->saved)
+    {
+      if (job->autosave)
+        engine->autosaved_n_changes = job->n_changes;
+      else
+        {
+          engine->saved_n_changes = job->n_changes;
+          remove_autosave (engine, job->path);
+        }
+    }
+  else if (job->autosave)
+    {
+      /* The log no longer matches what is in the file so the next
+       * autosave has to start again from scratch */
+      discard_autosave_log (engine);
+    }
+
+  for (l = job->payloads; l; l = l->next)
+    rut_refable_unref (l->data);
+  g_list_free (job->payloads);
+
+  g_hash_table_destroy (job->payload_map);
+  g_array_free (job->chunks, TRUE);
+  g_byte_array_free (job->bytes, TRUE);
+  g_free (job->path);
+
+  g_slice_free (SaveJob, job);
+}
+
+static void
+finish_save_jobs (void)
+{
+  SaveJob *job;
+
+  if (save_done_queue == NULL)
+    return;
+
+  while ((job = g_async_queue_try_pop (save_done_queue)))
+    finish_save_job (job);
+}
+
+static gboolean
+save_done_idle_cb (void *user_data)
+{
+  finish_save_jobs ();
+
+  return FALSE;
+}
+
+static void
+queue_save_job (SaveJob *job)
+{
+  if (save_pool == NULL)
+    {
+#if !GLIB_CHECK_VERSION (2, 32, 0)
+      if (!g_thread_supported ())
+        g_thread_init (NULL);
+#endif
+
+      if (save_done_queue == NULL)
+        save_done_queue = g_async_queue_new ();
+
+      /* NB: a single thread means the saves finish in the order they
+       * were started */
+      save_pool = g_thread_pool_new (save_thread_cb,
+                                     NULL, /* user data */
+                                     1, /* max threads */
+                                     TRUE, /* exclusive */
+                                     NULL); /* error */
+    }
+
+  g_thread_pool_push (save_pool, job, NULL);
+}
+
+/* Returns the log to write an autosave to @path with, which is a new
+ * one if the autosave has to be written in full */
+static RigSaveLog *
+get_autosave_log (RigEngine *engine,
+                  const char *path)
+{
+  RigSaveLog *log = engine->autosave_log;
+  char *structure = get_structure_checksum (engine);
+
+  if (log == NULL ||
+      strcmp (log->path, path) != 0 ||
+      strcmp (log->structure, structure) != 0 ||
+      log->appended_size > log->full_size * AUTOSAVE_COMPACT_RATIO)
+    {
+      discard_autosave_log (engine);
+      log = engine->autosave_log = save_log_new (path);
+    }
+
+  g_free (log->structure);
+  log->structure = structure;
+
+  return log;
+}
+
+static void
+save_in_background (RigEngine *engine,
+                    const char *path,
+                    bool autosave)
+{
+  RigPBSerializer *serializer;
+  SaveJobBuffer job_buffer;
+  RigSaveLog *log = NULL;
+  bool append = false;
+  Rig__UI *ui;
+  SaveJob *job;
+  GList *l;
 
   serializer = rig_pb_serializer_new (engine);
 
+  /* The main thread is free to modify the meshes while the job is
+   * being written so the job gets its own copy of their buffers */
+  rig_pb_serializer_set_copy_payloads_enabled (serializer, true);
+
+  if (autosave)
+    {
+      log = get_autosave_log (engine, path);
+
+      /* NB: a new log hasn't written anything yet */
+      append = log->full_size > 0;
+
+      rig_pb_serializer_set_id_table (serializer, log->ids);
+      rig_pb_serializer_set_asset_filter (serializer,
+                                          autosave_asset_filter_cb,
+                                          log);
+    }
+
   ui = rig_pb_serialize_ui (serializer);
 
-  rig__ui__pack_to_buffer (ui, &buffered_file.base );
+  /* NB: this also records the checksums of everything written by a
+   * full autosave. If there is nothing to append then the changes
+   * must have been undone again. */
+  if (log && !filter_changed_records (log, ui) && append)
+    {
+      engine->autosaved_n_changes = get_n_changes (engine);
+
+      rig_pb_serialized_ui_destroy (ui);
+      rig_pb_serializer_destroy (serializer);
+      return;
+    }
+
+  job = g_slice_new0 (SaveJob);
+  job->engine = engine;
+  job->path = g_strdup (path);
+  job->autosave = autosave;
+  job->append = append;
+  job->n_changes = get_n_changes (engine);
+  job->chunks = g_array_new (FALSE, FALSE, sizeof (SaveChunk));
+  job->bytes = g_byte_array_new ();
+
+  job->payloads = rig_pb_serializer_steal_payloads (serializer);
+  job->payload_map = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (l = job->payloads; l; l = l->next)
+    {
+      RutBuffer *payload = l->data;
+      g_hash_table_insert (job->payload_map, payload->data, payload);
+    }
+
+  /* The serialized UI points into the engine's objects so it is
+   * packed here, but the mesh buffers and asset contents that make up
+   * most of it are private copies owned by the job so they are only
+   * referenced and are written to the file by the save thread */
+  job_buffer.base.append = append_to_job;
+  job_buffer.job = job;
+  rig__ui__pack_to_buffer (ui, &job_buffer.base);
 
   rig_pb_serialized_ui_destroy (ui);
 
   rig_pb_serializer_destroy (serializer);
 
-  fclose (fp);
+  if (append)
+    log->appended_size += get_job_size (job);
+  else if (log)
+    {
+      log->full_size = get_job_size (job);
+      log->appended_size = 0;
+    }
+
+  queue_save_job (job);
+}
+
+void
+rig_save_async (RigEngine *engine, const char *path)
+{
+  save_in_background (engine, path, false);
+}
+
+void
+rig_save_wait (void)
+{
+  if (save_pool)
+    {
+      /* NB: this waits for all of the queued saves to finish */
+      g_thread_pool_free (save_pool, FALSE, TRUE);
+      save_pool = NULL;
+    }
+
+  finish_save_jobs ();
+}
+
+static gboolean
+autosave_cb (void *user_data)
+{
+  RigEngine *engine = user_data;
+  unsigned int n_changes = get_n_changes (engine);
+
+  if (n_changes != engine->saved_n_changes &&
+      n_changes != engine->autosaved_n_changes)
+    {
+      char *autosave_filename =
+        get_autosave_filename (engine->ui_filename);
+
+      save_in_background (engine, autosave_filename, true);
+
+      g_free (autosave_filename);
+    }
+
+  return TRUE;
+}
+
+char *
+rig_autosave_find_recovery_file (const char *path)
+{
+  char *autosave_filename = get_autosave_filename (path);
+  struct stat autosave_sb, sb;
+
+  /* An autosave older than the UI is left over from before the UI
+   * was last saved by something else */
+  if (stat (autosave_filename, &autosave_sb) == 0 &&
+      (stat (path, &sb) == -1 || autosave_sb.st_mtime >= sb.st_mtime))
+    return autosave_filename;
+
+  g_free (autosave_filename);
+
+  return NULL;
+}
+
+void
+rig_autosave_start (RigEngine *engine)
+{
+  if (engine->autosave_timeout ||
+      rut_util_is_boolean_env_set ("RIG_DISABLE_AUTOSAVE"))
+    return;
+
+  /* Only changes made from now on need saving */
+  engine->saved_n_changes = get_n_changes (engine);
+  engine->autosaved_n_changes = engine->saved_n_changes;
+
+  engine->autosave_timeout =
+    g_timeout_add_seconds (AUTOSAVE_INTERVAL_SECONDS, autosave_cb, engine);
+}
+
+void
+rig_autosave_stop (RigEngine *engine)
+{
+  if (engine->autosave_timeout)
+    {
+      g_source_remove (engine->autosave_timeout);
+      engine->autosave_timeout = 0;
+    }
+
+  rig_save_wait ();
+
+  discard_autosave_log (engine);
 }
 
 static void
@@ -103,15 +994,160 @@ ignore_free (void *allocator_data, void *ptr)
   /* NOP */
 }
 
+static bool
+read_varint (const uint8_t *data,
+             size_t len,
+             size_t *pos,
+             uint64_t *value)
+{
+  int shift;
+
+  *value = 0;
+
+  for (shift = 0; shift < 64 && *pos < len; shift += 7)
+    {
+      uint8_t byte = data[(*pos)++];
+
+      *value |= (uint64_t) (byte & 0x7f) << shift;
+
+      if ((byte & 0x80) == 0)
+        return true;
+    }
+
+  return false;
+}
+
+/* If the editor stopped while appending to an autosave the file may
+ * end with part of a message. This returns the length of the file up
+ * to the end of the last complete top level field so that the rest
+ * can be ignored. */
+static size_t
+get_complete_length (const uint8_t *data,
+                     size_t len)
+{
+  size_t complete = 0;
+  size_t pos = 0;
+
+  while (pos < len)
+    {
+      uint64_t tag;
+      uint64_t field_len;
+
+      if (!read_varint (data, len, &pos, &tag))
+        break;
+
+      switch (tag & 7)
+        {
+        case 0: /* varint */
+          if (!read_varint (data, len, &pos, &field_len))
+            return complete;
+          field_len = 0;
+          break;
+        case 1: /* 64-bit */
+          field_len = 8;
+          break;
+        case 2: /* length delimited */
+          if (!read_varint (data, len, &pos, &field_len))
+            return complete;
+          break;
+        case 5: /* 32-bit */
+          field_len = 4;
+          break;
+        default:
+          return complete;
+        }
+
+      if (field_len > len - pos)
+        break;
+
+      pos += field_len;
+      complete = pos;
+    }
+
+  return complete;
+}
+
+static int64_t *
+get_entity_id (void *record)
+{
+  Rig__Entity *entity = record;
+  return entity->has_id ? &entity->id : NULL;
+}
+
+static int64_t *
+get_controller_id (void *record)
+{
+  Rig__Controller *controller = record;
+  return controller->has_id ? &controller->id : NULL;
+}
+
+static int64_t *
+get_asset_id (void *record)
+{
+  Rig__Asset *asset = record;
+  return asset->has_id ? &asset->id : NULL;
+}
+
+/* Replaces the first record with each id by the last one with the
+ * same id and removes the rest. The first position is kept since
+ * parent entities have to come before their children. Returns the
+ * new number of records. */
+static size_t
+merge_records (void **records,
+               size_t n_records,
+               int64_t *(*get_id) (void *record))
+{
+  GHashTable *first_index = g_hash_table_new (g_int64_hash, g_int64_equal);
+  size_t i, n;
+
+  for (i = 0, n = 0; i < n_records; i++)
+    {
+      int64_t *id = get_id (records[i]);
+      void *index;
+
+      if (id &&
+          g_hash_table_lookup_extended (first_index, id, NULL, &index))
+        {
+          records[GPOINTER_TO_SIZE (index)] = records[i];
+          continue;
+        }
+
+      if (id)
+        g_hash_table_insert (first_index, id, GSIZE_TO_POINTER (n));
+
+      records[n++] = records[i];
+    }
+
+  g_hash_table_destroy (first_index);
+
+  return n;
+}
+
+/* Incremental autosaves append newer versions of records to the file
+ * and, since concatenated messages are merged when they are
+ * unpacked, the UI then has several records with the same id of
+ * which the last is the newest. See RigSaveLog. */
+static void
+merge_appended_records (Rig__UI *ui)
+{
+  ui->n_entities = merge_records ((void **) ui->entities,
+                                  ui->n_entities,
+                                  get_entity_id);
+  ui->n_controllers = merge_records ((void **) ui->controllers,
+                                     ui->n_controllers,
+                                     get_controller_id);
+  ui->n_assets = merge_records ((void **) ui->assets,
+                                ui->n_assets,
+                                get_asset_id);
+}
+
 void
 rig_load (RigEngine *engine, const char *file)
 {
-  struct stat sb;
-  int fd;
+  GMappedFile *mapped_file;
   uint8_t *contents;
   size_t len;
   GError *error = NULL;
-  gboolean needs_munmap = FALSE;
   RigPBUnSerializer *unserializer;
   Rig__UI *ui;
 
@@ -136,35 +1172,43 @@ rig_load (RigEngine *engine, const char *file)
       return;
     }
 
-  fd = open (file, O_CLOEXEC);
-  if (fd > 0 &&
-      fstat (fd, &sb) == 0 &&
-      (contents = mmap (NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)))
-    {
-      len = sb.st_size;
-      needs_munmap = TRUE;
-    }
-  else if (!g_file_get_contents (file,
-                                 (gchar **)&contents,
-                                 &len,
-                                 &error))
+  /* NB: the mapping is writable but private so that meshes which
+   * borrow their buffers from it can still be modified without
+   * changing the file, which itself is only opened for reading */
+  mapped_file = rut_util_map_file_private (file, &error);
+  if (!mapped_file)
     {
       g_warning ("Failed to load ui description: %s", error->message);
+      g_error_free (error);
       return;
     }
 
+  contents = (uint8_t *) g_mapped_file_get_contents (mapped_file);
+  len = get_complete_length (contents,
+                             g_mapped_file_get_length (mapped_file));
+
   unserializer = rig_pb_unserializer_new (engine);
 
   ui = rig__ui__unpack (&protobuf_c_allocator, len, contents);
+  if (!ui)
+    {
+      g_warning ("Failed to unpack ui description %s", file);
+      goto DONE;
+    }
+
+  merge_appended_records (ui);
+
+  rig_pb_unserializer_set_mapped_file (unserializer, ui, mapped_file);
 
   rig_pb_unserialize_ui (unserializer, ui, false);
 
   rig__ui__free_unpacked (ui, &protobuf_c_allocator);
 
-  if (needs_munmap)
-    munmap (contents, len);
-  else
-    g_free (contents);
+DONE:
 
   rig_pb_unserializer_destroy (unserializer);
+
+  /* Any meshes that borrowed their buffers keep their own
+   * references on the mapping */
+  g_mapped_file_unref (mapped_file);
 }
@@ -25,6 +25,44 @@
 void
 rig_save (RigEngine *engine, const char *path);
 
+/* Saves the UI to @path from a background thread. A snapshot of the
+ * UI, including copies of the mesh buffers, is taken before this
+ * returns so later changes don't affect what is saved. The engine's
+ * saved_n_changes is only updated once the save has succeeded, from
+ * the main loop or rig_save_wait(). */
+void
+rig_save_async (RigEngine *engine, const char *path);
+
+/* Waits for any saves started with rig_save_async() to finish. This
+ * must be called before the engine is freed. */
+void
+rig_save_wait (void);
+
+/* Periodically saves the UI in the background to a file next to the
+ * engine's ui_filename whenever the undo journal shows that it has
+ * changed since it was last saved. The UI itself is never replaced
+ * by an autosave and the autosave is removed once the UI is saved.
+ * After the first full autosave only the entities, controllers and
+ * assets that changed are appended to the file until the appended
+ * data outgrows the full save or the scene structure changes, at
+ * which point the file is rewritten in full. Setting the
+ * RIG_DISABLE_AUTOSAVE environment variable turns this off. */
+void
+rig_autosave_start (RigEngine *engine);
+
+/* Stops autosaving and waits for any save in progress */
+void
+rig_autosave_stop (RigEngine *engine);
+
+/* Returns the filename of an autosave of @path that is newer than
+ * @path itself, which means there were unsaved changes when the
+ * editor last stopped, or NULL if there isn't one. */
+char *
+rig_autosave_find_recovery_file (const char *path);
+
+/* Loads a UI saved by rig_save() or an autosave. Records appended by
+ * incremental autosaves replace earlier records with the same id and
+ * an incomplete record at the end of the file is ignored. */
 void
 rig_load (RigEngine *engine, const char *file);
 
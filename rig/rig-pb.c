@@ -49,8 +49,37 @@ struct _RigPBSerializer
 
   int next_id;
   GHashTable *id_map;
+
+  /* If set, objects keep the ids they were given by earlier
+   * serializations, see rig_pb_serializer_set_id_table() */
+  RigPBIdTable *id_table;
+
+  /* Quantized copies of mesh assets. The serialized buffers point
+   * directly at their data so they need to outlive the serialized
+   * messages. */
+  bool quantize_meshes;
+  GList *quantized_meshes;
+
+  /* RutBuffers holding the large payloads that the serialized
+   * messages point to, ie. mesh buffers and the contents of assets,
+   * see rig_pb_serializer_steal_payloads() */
+  GList *payloads;
+
+  /* Whether mesh buffers are copied into new payloads instead of
+   * being referenced, see rig_pb_serializer_set_copy_payloads_enabled() */
+  bool copy_payloads;
+
+  /* Whether to write a RIG__UI__MODE__PACKED UI */
+  bool packed;
+
+  /* Maps the names of the types whose properties a PACKED UI refers
+   * to by index to the hash of their properties */
+  GHashTable *schemas;
 };
 
+/* The length of the Rig__Entity transform array in PACKED UIs */
+#define PACKED_TRANSFORM_LEN 8
+
 typedef void (*PBMessageInitFunc) (void *message);
 
 static void *
@@ -236,6 +265,205 @@ pb_path_new (RigEngine *engine, RigPath *path)
   return pb_path;
 }
 
+/* The PACKED version of pb_path_new() which stores the nodes in
+ * arrays instead of a message per node */
+static Rig__Path *
+pb_packed_path_new (RigEngine *engine, RigPath *path)
+{
+  RutMemoryStack *stack = engine->serialization_stack;
+  Rig__Path *pb_path = pb_new (engine, sizeof (Rig__Path), rig__path__init);
+  int n_components = 0;
+  float *floats = NULL;
+  RigNode *node;
+  int i;
+
+  if (!path->length)
+    return pb_path;
+
+  switch (path->type)
+    {
+    case RUT_PROPERTY_TYPE_FLOAT:
+      n_components = 1;
+      break;
+    case RUT_PROPERTY_TYPE_VEC3:
+      n_components = 3;
+      break;
+    case RUT_PROPERTY_TYPE_VEC4:
+    case RUT_PROPERTY_TYPE_COLOR:
+    case RUT_PROPERTY_TYPE_QUATERNION:
+      n_components = 4;
+      break;
+    case RUT_PROPERTY_TYPE_DOUBLE:
+      pb_path->n_double_values = path->length;
+      pb_path->double_values =
+        rut_memory_stack_alloc (stack, sizeof (double) * path->length);
+      break;
+    case RUT_PROPERTY_TYPE_INTEGER:
+      pb_path->n_integer_values = path->length;
+      pb_path->integer_values =
+        rut_memory_stack_alloc (stack, sizeof (int32_t) * path->length);
+      break;
+    case RUT_PROPERTY_TYPE_UINT32:
+      pb_path->n_uint32_values = path->length;
+      pb_path->uint32_values =
+        rut_memory_stack_alloc (stack, sizeof (uint32_t) * path->length);
+      break;
+
+      /* These types of properties can't be interoplated so they
+       * probably shouldn't end up in a path */
+    case RUT_PROPERTY_TYPE_ENUM:
+    case RUT_PROPERTY_TYPE_BOOLEAN:
+    case RUT_PROPERTY_TYPE_TEXT:
+    case RUT_PROPERTY_TYPE_ASSET:
+    case RUT_PROPERTY_TYPE_OBJECT:
+    case RUT_PROPERTY_TYPE_POINTER:
+      g_warn_if_reached ();
+      return pb_path;
+    }
+
+  if (n_components)
+    {
+      pb_path->n_float_values = path->length * n_components;
+      pb_path->float_values = floats =
+        rut_memory_stack_alloc (stack,
+                                sizeof (float) * pb_path->n_float_values);
+    }
+
+  pb_path->n_t = path->length;
+  pb_path->t = rut_memory_stack_alloc (stack, sizeof (float) * path->length);
+
+  i = 0;
+  rut_list_for_each (node, &path->nodes, list_node)
+    {
+      float *value = floats + i * n_components;
+
+      pb_path->t[i] = node->t;
+
+      switch (path->type)
+        {
+        case RUT_PROPERTY_TYPE_FLOAT:
+          value[0] = node->boxed.d.float_val;
+          break;
+        case RUT_PROPERTY_TYPE_DOUBLE:
+          pb_path->double_values[i] = node->boxed.d.double_val;
+          break;
+        case RUT_PROPERTY_TYPE_INTEGER:
+          pb_path->integer_values[i] = node->boxed.d.integer_val;
+          break;
+        case RUT_PROPERTY_TYPE_UINT32:
+          pb_path->uint32_values[i] = node->boxed.d.uint32_val;
+          break;
+        case RUT_PROPERTY_TYPE_VEC3:
+          memcpy (value, node->boxed.d.vec3_val, sizeof (float) * 3);
+          break;
+        case RUT_PROPERTY_TYPE_VEC4:
+          memcpy (value, node->boxed.d.vec4_val, sizeof (float) * 4);
+          break;
+        case RUT_PROPERTY_TYPE_COLOR:
+          {
+            const CoglColor *color = &node->boxed.d.color_val;
+
+            value[0] = cogl_color_get_red (color);
+            value[1] = cogl_color_get_green (color);
+            value[2] = cogl_color_get_blue (color);
+            value[3] = cogl_color_get_alpha (color);
+            break;
+          }
+        case RUT_PROPERTY_TYPE_QUATERNION:
+          {
+            const CoglQuaternion *quaternion = &node->boxed.d.quaternion_val;
+
+            value[0] = quaternion->w;
+            value[1] = quaternion->x;
+            value[2] = quaternion->y;
+            value[3] = quaternion->z;
+            break;
+          }
+        default:
+          break;
+        }
+
+      i++;
+    }
+
+  return pb_path;
+}
+
+/* Returns the position of @property amongst its object's
+ * introspectable properties which is how PACKED UIs refer to
+ * properties */
+typedef struct _PropertyIndexState
+{
+  RutProperty *property;
+  int index;
+  int n_properties;
+} PropertyIndexState;
+
+static void
+find_property_index_cb (RutProperty *property,
+                        void *user_data)
+{
+  PropertyIndexState *state = user_data;
+
+  if (property == state->property)
+    state->index = state->n_properties;
+
+  state->n_properties++;
+}
+
+static void
+hash_property_cb (RutProperty *property,
+                  void *user_data)
+{
+  uint32_t *hash = user_data;
+
+  *hash = *hash * 33 + g_str_hash (property->spec->name);
+  *hash = *hash * 33 + property->spec->type;
+}
+
+/* Returns a hash of the names and types of the object's properties
+ * in the order that PACKED UIs index them */
+static uint32_t
+get_schema_hash (RutObject *object)
+{
+  uint32_t hash = 5381;
+
+  rut_introspectable_foreach_property (object, hash_property_cb, &hash);
+
+  return hash;
+}
+
+static void
+add_schema (RigPBSerializer *serializer,
+            RutObject *object)
+{
+  const char *type_name = rut_object_get_type_name (object);
+
+  if (serializer->schemas == NULL)
+    serializer->schemas = g_hash_table_new (NULL, NULL);
+
+  /* NB: type names are static so they can be compared directly */
+  if (!g_hash_table_lookup_extended (serializer->schemas, type_name,
+                                     NULL, NULL))
+    {
+      g_hash_table_insert (serializer->schemas,
+                           (char *)type_name,
+                           GUINT_TO_POINTER (get_schema_hash (object)));
+    }
+}
+
+static int
+get_property_index (RutProperty *property)
+{
+  PropertyIndexState state = { property, -1, 0 };
+
+  rut_introspectable_foreach_property (property->object,
+                                       find_property_index_cb,
+                                       &state);
+
+  return state.index;
+}
+
 static uint64_t
 serializer_lookup_object_id (RigPBSerializer *serializer, void *object)
 {
@@ -431,6 +659,60 @@ pb_boxed_new (RigPBSerializer *serializer,
   return pb_boxed;
 }
 
+struct _RigPBIdTable
+{
+  GHashTable *ids;
+
+  /* NB: 0 is reserved as in the serializer's own id_map */
+  uint64_t next_id;
+};
+
+static void
+free_id_slice (void *id);
+
+RigPBIdTable *
+rig_pb_id_table_new (void)
+{
+  RigPBIdTable *table = g_slice_new (RigPBIdTable);
+
+  table->ids = g_hash_table_new_full (NULL, /* direct hash */
+                                      NULL, /* direct key equal */
+                                      rut_refable_unref,
+                                      free_id_slice);
+  table->next_id = 1;
+
+  return table;
+}
+
+void
+rig_pb_id_table_free (RigPBIdTable *table)
+{
+  g_hash_table_destroy (table->ids);
+  g_slice_free (RigPBIdTable, table);
+}
+
+static uint64_t
+id_table_get_id (RigPBIdTable *table, void *object)
+{
+  uint64_t *id = g_hash_table_lookup (table->ids, object);
+
+  if (id)
+    return *id;
+
+  /* The ids of mesh buffers are only used within their mesh so they
+   * don't need to be stable, but they are still taken from the table
+   * so they can't clash with any other ids */
+  if (rut_object_get_type (object) == &rut_buffer_type)
+    return table->next_id++;
+
+  id = g_slice_new (uint64_t);
+  *id = table->next_id++;
+
+  g_hash_table_insert (table->ids, rut_refable_ref (object), id);
+
+  return *id;
+}
+
 static uint64_t
 register_serializer_object (RigPBSerializer *serializer,
                             void *object)
@@ -444,7 +726,10 @@ register_serializer_object (RigPBSerializer *serializer,
       return 0;
     }
 
-  id = serializer->next_id++;
+  if (serializer->id_table)
+    id = id_table_get_id (serializer->id_table, object);
+  else
+    id = serializer->next_id++;
   g_return_val_if_fail (id != 0, 0);
 
   id_value = g_slice_new (uint64_t);
@@ -470,14 +755,28 @@ serialize_instrospectables_cb (RutProperty *property,
 {
   RigPBSerializer *serializer = user_data;
   void **properties_out = serializer->properties_out;
+  int index = serializer->n_properties++;
+  Rig__Boxed *pb_boxed;
   RutBoxed boxed;
 
   rut_property_box (property, &boxed);
 
-  properties_out[serializer->n_properties++] =
-    pb_boxed_new (serializer,
-                  property->spec->name,
-                  &boxed);
+  /* NB: the properties are always listed in the same order so the
+   * index within this list is enough to identify them and the type is
+   * implied by the property */
+  if (serializer->packed)
+    {
+      pb_boxed = pb_new (serializer->engine,
+                         sizeof (Rig__Boxed),
+                         rig__boxed__init);
+      pb_boxed->has_index = TRUE;
+      pb_boxed->index = index;
+      pb_boxed->value = pb_property_value_new (serializer, &boxed);
+    }
+  else
+    pb_boxed = pb_boxed_new (serializer, property->spec->name, &boxed);
+
+  properties_out[index] = pb_boxed;
 
   rut_boxed_destroy (&boxed);
 }
@@ -500,6 +799,9 @@ serialize_instrospectable_properties (RutObject *object,
     rut_memory_stack_alloc (engine->serialization_stack,
                             sizeof (void *) * serializer->n_properties);
 
+  if (serializer->packed)
+    add_schema (serializer, object);
+
   serializer->n_properties = 0;
   rut_introspectable_foreach_property (object,
                                        serialize_instrospectables_cb,
@@ -774,23 +1076,44 @@ _rut_entitygraph_pre_serialize_cb (RutObject *object,
     }
 
   q = rut_entity_get_rotation (entity);
-
-  position = rut_memory_stack_alloc (engine->serialization_stack,
-                                     sizeof (Rig__Vec3));
-  rig__vec3__init (position);
-  position->x = rut_entity_get_x (entity);
-  position->y = rut_entity_get_y (entity);
-  position->z = rut_entity_get_z (entity);
-  pb_entity->position = position;
-
   scale = rut_entity_get_scale (entity);
-  if (scale != 1)
+
+  if (serializer->packed)
     {
-      pb_entity->has_scale = TRUE;
-      pb_entity->scale = scale;
+      float *transform =
+        rut_memory_stack_alloc (engine->serialization_stack,
+                                sizeof (float) * PACKED_TRANSFORM_LEN);
+
+      transform[0] = rut_entity_get_x (entity);
+      transform[1] = rut_entity_get_y (entity);
+      transform[2] = rut_entity_get_z (entity);
+      transform[3] = scale;
+      transform[4] = q->w;
+      transform[5] = q->x;
+      transform[6] = q->y;
+      transform[7] = q->z;
+
+      pb_entity->n_transform = PACKED_TRANSFORM_LEN;
+      pb_entity->transform = transform;
     }
+  else
+    {
+      position = rut_memory_stack_alloc (engine->serialization_stack,
+                                         sizeof (Rig__Vec3));
+      rig__vec3__init (position);
+      position->x = rut_entity_get_x (entity);
+      position->y = rut_entity_get_y (entity);
+      position->z = rut_entity_get_z (entity);
+      pb_entity->position = position;
+
+      if (scale != 1)
+        {
+          pb_entity->has_scale = TRUE;
+          pb_entity->scale = scale;
+        }
 
-  pb_entity->rotation = pb_rotation_new (engine, q);
+      pb_entity->rotation = pb_rotation_new (engine, q);
+    }
 
   serializer->n_pb_components = 0;
   serializer->pb_components = NULL;
@@ -837,7 +1160,14 @@ serialize_property_cb (RigControllerPropData *prop_data,
   pb_property->has_object_id = TRUE;
   pb_property->object_id = id;
 
-  pb_property->name = (char *)prop_data->property->spec->name;
+  if (serializer->packed)
+    {
+      pb_property->has_index = TRUE;
+      pb_property->index = get_property_index (prop_data->property);
+      add_schema (serializer, object);
+    }
+  else
+    pb_property->name = (char *)prop_data->property->spec->name;
 
   pb_property->has_method = TRUE;
   switch (prop_data->method)
@@ -856,7 +1186,12 @@ serialize_property_cb (RigControllerPropData *prop_data,
   pb_property->constant = pb_property_value_new (serializer, &prop_data->constant_value);
 
   if (prop_data->path && prop_data->path->length)
-    pb_property->path = pb_path_new (engine, prop_data->path);
+    {
+      if (serializer->packed)
+        pb_property->path = pb_packed_path_new (engine, prop_data->path);
+      else
+        pb_property->path = pb_path_new (engine, prop_data->path);
+    }
 }
 
 static void
@@ -896,14 +1231,55 @@ rig_pb_serializer_set_asset_filter (RigPBSerializer *serializer,
   serializer->asset_filter_data = user_data;
 }
 
+void
+rig_pb_serializer_set_quantize_meshes_enabled (RigPBSerializer *serializer,
+                                               bool enabled)
+{
+  serializer->quantize_meshes = enabled;
+}
+
+void
+rig_pb_serializer_set_packed_enabled (RigPBSerializer *serializer,
+                                      bool enabled)
+{
+  serializer->packed = enabled;
+}
+
+void
+rig_pb_serializer_set_copy_payloads_enabled (RigPBSerializer *serializer,
+                                             bool enabled)
+{
+  serializer->copy_payloads = enabled;
+}
+
+void
+rig_pb_serializer_set_id_table (RigPBSerializer *serializer,
+                                RigPBIdTable *table)
+{
+  serializer->id_table = table;
+}
+
 void
 rig_pb_serializer_destroy (RigPBSerializer *serializer)
 {
+  GList *l;
+
   if (serializer->required_assets)
     g_list_free (serializer->required_assets);
 
+  for (l = serializer->quantized_meshes; l; l = l->next)
+    rut_refable_unref (l->data);
+  g_list_free (serializer->quantized_meshes);
+
+  for (l = serializer->payloads; l; l = l->next)
+    rut_refable_unref (l->data);
+  g_list_free (serializer->payloads);
+
   g_hash_table_destroy (serializer->id_map);
 
+  if (serializer->schemas)
+    g_hash_table_destroy (serializer->schemas);
+
   g_slice_free (RigPBSerializer, serializer);
 }
 
@@ -918,7 +1294,20 @@ serialize_buffer (RigPBSerializer *serializer, RutBuffer *buffer)
     register_serializer_object (serializer, buffer);
 
   /* NB: The serialized asset points directly to the RutMesh
-   * data to avoid copying it... */
+   * data to avoid copying it unless the mesh could be modified before
+   * the payload is written... */
+  if (serializer->copy_payloads)
+    {
+      RutBuffer *copy = rut_buffer_new (buffer->size);
+
+      memcpy (copy->data, buffer->data, buffer->size);
+      buffer = copy;
+    }
+  else
+    rut_refable_ref (buffer);
+
+  serializer->payloads = g_list_prepend (serializer->payloads, buffer);
+
   pb_buffer->has_data = true;
   pb_buffer->data.data = buffer->data;
   pb_buffer->data.len = buffer->size;
@@ -938,8 +1327,23 @@ serialize_mesh_asset (RigPBSerializer *serializer, RutAsset *asset)
   Rig__Buffer **attribute_buffers_map;
   Rig__Attribute **attributes;
   Rig__Mesh *pb_mesh;
+  RutMesh *quantized = NULL;
+  float position_scale[3];
+  float position_offset[3];
   int i;
 
+  if (serializer->quantize_meshes)
+    {
+      quantized = rut_mesh_quantize (mesh, RUT_MESH_QUANTIZE_ALL,
+                                     position_scale, position_offset);
+      if (quantized)
+        {
+          serializer->quantized_meshes =
+            g_list_prepend (serializer->quantized_meshes, quantized);
+          mesh = quantized;
+        }
+    }
+
   pb_asset = pb_new (engine, sizeof (Rig__Asset), rig__asset__init);
 
   pb_asset->path = (char *)rut_asset_get_path (asset);
@@ -964,7 +1368,7 @@ serialize_mesh_asset (RigPBSerializer *serializer, RutAsset *asset)
     {
       int j;
 
-      for (j = 0; i < n_buffers; j++)
+      for (j = 0; j < n_buffers; j++)
         if (buffers[j] == mesh->attributes[i]->buffer)
           break;
 
@@ -1002,6 +1406,9 @@ serialize_mesh_asset (RigPBSerializer *serializer, RutAsset *asset)
 
       pb_attribute->name = (char *)mesh->attributes[i]->name;
 
+      pb_attribute->has_normalized = true;
+      pb_attribute->normalized = mesh->attributes[i]->normalized;
+
       pb_attribute->has_stride = true;
       pb_attribute->stride = mesh->attributes[i]->stride;
       pb_attribute->has_offset = true;
@@ -1071,6 +1478,18 @@ serialize_mesh_asset (RigPBSerializer *serializer, RutAsset *asset)
   pb_mesh->has_n_vertices = true;
   pb_mesh->n_vertices = mesh->n_vertices;
 
+  if (quantized)
+    {
+      pb_mesh->position_scale = pb_vec3_new (engine,
+                                             position_scale[0],
+                                             position_scale[1],
+                                             position_scale[2]);
+      pb_mesh->position_offset = pb_vec3_new (engine,
+                                              position_offset[0],
+                                              position_offset[1],
+                                              position_offset[2]);
+    }
+
   if (mesh->indices_buffer)
     {
       pb_mesh->has_indices_type = true;
@@ -1110,6 +1529,7 @@ serialize_asset (RigPBSerializer *serializer, RutAsset *asset)
   char *full_path;
   Rig__Asset *pb_asset;
   GError *error = NULL;
+  RutBuffer *buffer;
   char *contents;
   size_t len;
 
@@ -1131,6 +1551,11 @@ serialize_asset (RigPBSerializer *serializer, RutAsset *asset)
 
   g_free (full_path);
 
+  /* The contents are freed along with the serializer */
+  buffer = rut_buffer_new_for_data ((uint8_t *)contents, len,
+                                    g_free, contents);
+  serializer->payloads = g_list_prepend (serializer->payloads, buffer);
+
   pb_asset = pb_new (engine, sizeof (Rig__Asset), rig__asset__init);
 
   pb_asset->path = (char *)path;
@@ -1149,13 +1574,6 @@ serialize_asset (RigPBSerializer *serializer, RutAsset *asset)
 #endif
 }
 
-static void
-serialized_asset_destroy (Rig__Asset *serialized_asset)
-{
-  if (serialized_asset->has_data)
-    g_free (serialized_asset->data.data);
-}
-
 Rig__UI *
 rig_pb_serialize_ui (RigPBSerializer *serializer)
 {
@@ -1165,11 +1583,22 @@ rig_pb_serialize_ui (RigPBSerializer *serializer)
   Rig__UI *ui;
   Rig__Device *device;
 
+  RUT_STATIC_TIMER (serialize_timer,
+                    "Mainloop",
+                    "Serialize UI",
+                    "Time spent serializing the UI to protocol buffers",
+                    0);
+
+  RUT_TIMER_START (serialize_timer);
+
   ui = pb_new (engine, sizeof (Rig__UI), rig__ui__init);
   device = pb_new (engine, sizeof (Rig__Device), rig__device__init);
 
   ui->device = device;
 
+  ui->has_mode = TRUE;
+  ui->mode = serializer->packed ? RIG__UI__MODE__PACKED : RIG__UI__MODE__FULL;
+
   device->has_width = TRUE;
   device->width = engine->device_width;
   device->has_height = TRUE;
@@ -1272,16 +1701,50 @@ rig_pb_serialize_ui (RigPBSerializer *serializer)
       serializer->asset_filter = save_filter;
     }
 
+  if (serializer->schemas)
+    {
+      GHashTableIter iter;
+      void *key, *value;
+
+      ui->n_schemas = g_hash_table_size (serializer->schemas);
+      ui->schemas = rut_memory_stack_alloc (engine->serialization_stack,
+                                            ui->n_schemas * sizeof (void *));
+
+      i = 0;
+      g_hash_table_iter_init (&iter, serializer->schemas);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          Rig__UI__TypeSchema *pb_schema =
+            pb_new (engine, sizeof (Rig__UI__TypeSchema),
+                    rig__ui__type_schema__init);
+
+          pb_schema->type = key;
+          pb_schema->has_hash = TRUE;
+          pb_schema->hash = GPOINTER_TO_UINT (value);
+
+          ui->schemas[i++] = pb_schema;
+        }
+    }
+
+  RUT_TIMER_STOP (serialize_timer);
+
   return ui;
 }
 
 void
 rig_pb_serialized_ui_destroy (Rig__UI *ui)
 {
-  int i;
+  /* NOP: everything the UI points to is owned by the serializer */
+}
+
+GList *
+rig_pb_serializer_steal_payloads (RigPBSerializer *serializer)
+{
+  GList *payloads = serializer->payloads;
 
-  for (i = 0; i < ui->n_assets; i++)
-    serialized_asset_destroy (ui->assets[i]);
+  serializer->payloads = NULL;
+
+  return payloads;
 }
 
 Rig__Event **
@@ -1404,6 +1867,20 @@ struct _RigPBUnSerializer
   GList *controllers;
 
   GHashTable *id_map;
+
+  /* If the UI was unpacked from a mapped file then this maps the
+   * unpacked copies of the mesh buffer data to where the same bytes
+   * are in the mapping (see rig_pb_unserializer_set_mapped_file()) */
+  GMappedFile *mapped_file;
+  GHashTable *mapped_data;
+
+  /* For PACKED UIs this maps type names to the hash of their
+   * properties as listed by the UI. Whether each type matched our own
+   * properties is recorded in checked_schemas the first time one of
+   * its properties is looked up. */
+  GHashTable *schemas;
+  GHashTable *checked_schemas;
+  bool schema_mismatch;
 };
 
 static void
@@ -1632,56 +2109,56 @@ set_property_from_pb_boxed (RigPBUnSerializer *unserializer,
       return;
     }
 
+  /* PACKED UIs leave the type to be implied by the property */
   if (!pb_boxed->has_type)
+    type = property->spec->type;
+  else
     {
-      collect_error (unserializer, "Boxed property has no type");
-      return;
-    }
-
-  switch (pb_boxed->type)
-    {
-    case RIG__PROPERTY_TYPE__FLOAT:
-      type = RUT_PROPERTY_TYPE_FLOAT;
-      break;
-    case RIG__PROPERTY_TYPE__DOUBLE:
-      type = RUT_PROPERTY_TYPE_DOUBLE;
-      break;
-    case RIG__PROPERTY_TYPE__INTEGER:
-      type = RUT_PROPERTY_TYPE_INTEGER;
-      break;
-    case RIG__PROPERTY_TYPE__ENUM:
-      type = RUT_PROPERTY_TYPE_ENUM;
-      break;
-    case RIG__PROPERTY_TYPE__UINT32:
-      type = RUT_PROPERTY_TYPE_UINT32;
-      break;
-    case RIG__PROPERTY_TYPE__BOOLEAN:
-      type = RUT_PROPERTY_TYPE_BOOLEAN;
-      break;
-    case RIG__PROPERTY_TYPE__OBJECT:
-      type = RUT_PROPERTY_TYPE_OBJECT;
-      break;
-    case RIG__PROPERTY_TYPE__POINTER:
-      type = RUT_PROPERTY_TYPE_POINTER;
-      break;
-    case RIG__PROPERTY_TYPE__QUATERNION:
-      type = RUT_PROPERTY_TYPE_QUATERNION;
-      break;
-    case RIG__PROPERTY_TYPE__COLOR:
-      type = RUT_PROPERTY_TYPE_COLOR;
-      break;
-    case RIG__PROPERTY_TYPE__VEC3:
-      type = RUT_PROPERTY_TYPE_VEC3;
-      break;
-    case RIG__PROPERTY_TYPE__VEC4:
-      type = RUT_PROPERTY_TYPE_VEC4;
-      break;
-    case RIG__PROPERTY_TYPE__TEXT:
-      type = RUT_PROPERTY_TYPE_TEXT;
-      break;
-    case RIG__PROPERTY_TYPE__ASSET:
-      type = RUT_PROPERTY_TYPE_ASSET;
-      break;
+      switch (pb_boxed->type)
+        {
+        case RIG__PROPERTY_TYPE__FLOAT:
+          type = RUT_PROPERTY_TYPE_FLOAT;
+          break;
+        case RIG__PROPERTY_TYPE__DOUBLE:
+          type = RUT_PROPERTY_TYPE_DOUBLE;
+          break;
+        case RIG__PROPERTY_TYPE__INTEGER:
+          type = RUT_PROPERTY_TYPE_INTEGER;
+          break;
+        case RIG__PROPERTY_TYPE__ENUM:
+          type = RUT_PROPERTY_TYPE_ENUM;
+          break;
+        case RIG__PROPERTY_TYPE__UINT32:
+          type = RUT_PROPERTY_TYPE_UINT32;
+          break;
+        case RIG__PROPERTY_TYPE__BOOLEAN:
+          type = RUT_PROPERTY_TYPE_BOOLEAN;
+          break;
+        case RIG__PROPERTY_TYPE__OBJECT:
+          type = RUT_PROPERTY_TYPE_OBJECT;
+          break;
+        case RIG__PROPERTY_TYPE__POINTER:
+          type = RUT_PROPERTY_TYPE_POINTER;
+          break;
+        case RIG__PROPERTY_TYPE__QUATERNION:
+          type = RUT_PROPERTY_TYPE_QUATERNION;
+          break;
+        case RIG__PROPERTY_TYPE__COLOR:
+          type = RUT_PROPERTY_TYPE_COLOR;
+          break;
+        case RIG__PROPERTY_TYPE__VEC3:
+          type = RUT_PROPERTY_TYPE_VEC3;
+          break;
+        case RIG__PROPERTY_TYPE__VEC4:
+          type = RUT_PROPERTY_TYPE_VEC4;
+          break;
+        case RIG__PROPERTY_TYPE__TEXT:
+          type = RUT_PROPERTY_TYPE_TEXT;
+          break;
+        case RIG__PROPERTY_TYPE__ASSET:
+          type = RUT_PROPERTY_TYPE_ASSET;
+          break;
+        }
     }
 
   pb_init_boxed_value (unserializer,
@@ -1693,31 +2170,137 @@ set_property_from_pb_boxed (RigPBUnSerializer *unserializer,
                           property, &boxed);
 }
 
+typedef struct _PropertyLookupState
+{
+  int index;
+  int n_properties;
+  RutProperty *property;
+} PropertyLookupState;
+
+static void
+lookup_property_by_index_cb (RutProperty *property,
+                             void *user_data)
+{
+  PropertyLookupState *state = user_data;
+
+  if (state->n_properties++ == state->index)
+    state->property = property;
+}
+
+/* Returns true if the indices used by the UI for the properties of
+ * @object's type can be trusted, see add_schema() */
+static bool
+check_schema (RigPBUnSerializer *unserializer,
+              RutObject *object)
+{
+  const char *type_name = rut_object_get_type_name (object);
+  void *value;
+  bool matches;
+
+  if (g_hash_table_lookup_extended (unserializer->checked_schemas, type_name,
+                                    NULL, &value))
+    return GPOINTER_TO_INT (value);
+
+  matches = (g_hash_table_lookup_extended (unserializer->schemas, type_name,
+                                           NULL, &value) &&
+             GPOINTER_TO_UINT (value) == get_schema_hash (object));
+
+  if (!matches)
+    {
+      collect_error (unserializer,
+                     "The properties of %s don't match the PACKED UI",
+                     type_name);
+      unserializer->schema_mismatch = true;
+    }
+
+  g_hash_table_insert (unserializer->checked_schemas,
+                       (char *)type_name,
+                       GINT_TO_POINTER (matches));
+
+  return matches;
+}
+
+/* Looks up a property the way that PACKED UIs refer to them, see
+ * get_property_index() */
+static RutProperty *
+lookup_property_by_index (RigPBUnSerializer *unserializer,
+                          RutObject *object,
+                          int index)
+{
+  PropertyLookupState state = { index, 0, NULL };
+
+  if (!check_schema (unserializer, object))
+    return NULL;
+
+  rut_introspectable_foreach_property (object,
+                                       lookup_property_by_index_cb,
+                                       &state);
+
+  return state.property;
+}
+
+static void
+append_property_cb (RutProperty *property,
+                    void *user_data)
+{
+  g_ptr_array_add (user_data, property);
+}
+
 static void
 set_properties_from_pb_boxed_values (RigPBUnSerializer *unserializer,
                                      RutObject *object,
                                      size_t n_properties,
                                      Rig__Boxed **properties)
 {
+  GPtrArray *indexed_properties = NULL;
   int i;
 
   for (i = 0; i < n_properties; i++)
     {
       Rig__Boxed *pb_boxed = properties[i];
-      RutProperty *property =
-        rut_introspectable_lookup_property (object, pb_boxed->name);
+      RutProperty *property = NULL;
+
+      if (pb_boxed->name)
+        property = rut_introspectable_lookup_property (object, pb_boxed->name);
+      else if (pb_boxed->has_index)
+        {
+          /* Typically every property of the object is listed so they
+           * are all looked up together */
+          if (!check_schema (unserializer, object))
+            continue;
+
+          if (indexed_properties == NULL)
+            {
+              indexed_properties = g_ptr_array_new ();
+              rut_introspectable_foreach_property (object,
+                                                   append_property_cb,
+                                                   indexed_properties);
+            }
+
+          if (pb_boxed->index < indexed_properties->len)
+            property = g_ptr_array_index (indexed_properties, pb_boxed->index);
+        }
 
       if (!property)
         {
-          collect_error (unserializer,
-                         "Unknown property %s for object of type %s",
-                         pb_boxed->name,
-                         rut_object_get_type_name (object));
+          if (pb_boxed->name)
+            collect_error (unserializer,
+                           "Unknown property %s for object of type %s",
+                           pb_boxed->name,
+                           rut_object_get_type_name (object));
+          else
+            collect_error (unserializer,
+                           "Unknown property %d for object of type %s",
+                           (int)pb_boxed->index,
+                           rut_object_get_type_name (object));
           continue;
         }
 
       set_property_from_pb_boxed (unserializer, property, pb_boxed);
     }
+
+  if (indexed_properties)
+    g_ptr_array_free (indexed_properties, TRUE);
 }
 
 static void
@@ -2326,6 +2909,20 @@ unserialize_entities (RigPBUnSerializer *unserializer,
       if (pb_entity->label)
         rut_entity_set_label (entity, pb_entity->label);
 
+      if (pb_entity->n_transform == PACKED_TRANSFORM_LEN)
+        {
+          float *transform = pb_entity->transform;
+          CoglQuaternion q;
+
+          rut_entity_set_position (entity, transform);
+          rut_entity_set_scale (entity, transform[3]);
+
+          cogl_quaternion_init_from_array (&q, transform + 4);
+          rut_entity_set_rotation (entity, &q);
+        }
+      else if (pb_entity->n_transform)
+        collect_error (unserializer, "Invalid entity transform");
+
       if (pb_entity->position)
         {
           Rig__Vec3 *pos = pb_entity->position;
@@ -2366,49 +2963,68 @@ unserialize_assets (RigPBUnSerializer *unserializer,
                     Rig__Asset **assets)
 {
   RigEngine *engine = unserializer->engine;
+  RutAssetBatch *batch = rut_asset_batch_new (engine->ctx);
+  RutAsset **loaded_assets = g_new0 (RutAsset *, n_assets);
   int i;
 
+  /* The assets are all queued before any are waited for so that the
+   * images and models can be decoded in parallel on the asset
+   * loader's threads */
   for (i = 0; i < n_assets; i++)
     {
       Rig__Asset *pb_asset = assets[i];
-      uint64_t id;
       RutAsset *asset = NULL;
 
-      if (!pb_asset->has_id)
+      if (!pb_asset->has_id || !pb_asset->path)
         continue;
 
-      id = pb_asset->id;
-      if (g_hash_table_lookup (unserializer->id_map, &id))
-        {
-          collect_error (unserializer, "Duplicate asset id %d", (int)id);
-          return;
-        }
-
-      if (!pb_asset->path)
-        continue;
+      RUT_TRACE_BEGIN ("Unserialize asset", pb_asset->path);
 
       if (pb_asset->has_data)
         {
-          asset = rut_asset_new_from_data (engine->ctx,
-                                           pb_asset->path,
-                                           pb_asset->type,
-                                           pb_asset->is_video,
-                                           pb_asset->data.data,
-                                           pb_asset->data.len);
+          /* NB: the data belongs to the Rig__UI which outlives the
+           * batch */
+          asset = rut_asset_batch_add_data (batch,
+                                            pb_asset->path,
+                                            pb_asset->type,
+                                            pb_asset->is_video,
+                                            pb_asset->data.data,
+                                            pb_asset->data.len);
         }
       else if (pb_asset->mesh)
         {
-          RutMesh *mesh =
-            rig_pb_unserialize_mesh (unserializer, pb_asset->mesh);
+          Rig__Mesh *pb_mesh = pb_asset->mesh;
+          RutMesh *mesh = rig_pb_unserialize_mesh (unserializer, pb_mesh);
           if (!mesh)
             {
               collect_error (unserializer,
                              "Error unserializing mesh for asset id %d",
-                             (int)id);
+                             (int)pb_asset->id);
+              RUT_TRACE_END ("Unserialize asset");
               continue;
             }
-          asset = rut_asset_new_from_mesh (engine->ctx, mesh);
-          rut_refable_unref (mesh);
+
+          /* NB: these take over our reference on the mesh. Quantized
+           * meshes are drawn without being expanded back to floats */
+          if (pb_mesh->position_scale && pb_mesh->position_offset)
+            {
+              float position_scale[3] = {
+                pb_mesh->position_scale->x,
+                pb_mesh->position_scale->y,
+                pb_mesh->position_scale->z
+              };
+              float position_offset[3] = {
+                pb_mesh->position_offset->x,
+                pb_mesh->position_offset->y,
+                pb_mesh->position_offset->z
+              };
+
+              asset = rut_asset_batch_add_quantized_mesh (batch, mesh,
+                                                          position_scale,
+                                                          position_offset);
+            }
+          else
+            asset = rut_asset_batch_add_mesh (batch, mesh);
         }
       else if (unserializer->engine->ctx->assets_location)
         {
@@ -2423,7 +3039,10 @@ unserialize_assets (RigPBUnSerializer *unserializer,
                                                NULL);
           if (info)
             {
-              asset = rig_load_asset (unserializer->engine, info, asset_file);
+              asset = rig_load_asset_in_batch (unserializer->engine,
+                                               batch,
+                                               info,
+                                               asset_file);
               g_object_unref (info);
             }
 
@@ -2431,6 +3050,44 @@ unserialize_assets (RigPBUnSerializer *unserializer,
           g_free (full_path);
         }
 
+      RUT_TRACE_END ("Unserialize asset");
+
+      loaded_assets[i] = asset;
+    }
+
+  RUT_TRACE_BEGIN ("Unserialize asset", "finish batch");
+  rut_asset_batch_finish (batch);
+  RUT_TRACE_END ("Unserialize asset");
+
+  /* The ids are registered in the original order so that errors are
+   * reported the same way as if the assets were loaded one by one */
+  for (i = 0; i < n_assets; i++)
+    {
+      Rig__Asset *pb_asset = assets[i];
+      RutAsset *asset = loaded_assets[i];
+      uint64_t id;
+
+      if (!pb_asset->has_id)
+        continue;
+
+      id = pb_asset->id;
+      if (g_hash_table_lookup (unserializer->id_map, &id))
+        {
+          collect_error (unserializer, "Duplicate asset id %d", (int)id);
+          break;
+        }
+
+      if (!pb_asset->path)
+        continue;
+
+      if (asset && !rut_asset_is_ready (asset))
+        {
+          rut_refable_unref (asset);
+          asset = NULL;
+        }
+
+      loaded_assets[i] = NULL;
+
       if (asset)
         {
           unserializer->assets =
@@ -2440,6 +3097,15 @@ unserialize_assets (RigPBUnSerializer *unserializer,
       else
         g_warning ("Failed to load \"%s\" asset", pb_asset->path);
     }
+
+  /* Drop any assets left over after an error */
+  for (; i < n_assets; i++)
+    {
+      if (loaded_assets[i])
+        rut_refable_unref (loaded_assets[i]);
+    }
+
+  g_free (loaded_assets);
 }
 
 static void
@@ -2526,6 +3192,101 @@ unserialize_path_nodes (RigPBUnSerializer *unserializer,
     }
 }
 
+/* The counterpart to pb_packed_path_new() */
+static void
+unserialize_packed_path (RigPBUnSerializer *unserializer,
+                         RigPath *path,
+                         Rig__Path *pb_path)
+{
+  int n_components = 1;
+  size_t n_values;
+  int i;
+
+  switch (path->type)
+    {
+    case RUT_PROPERTY_TYPE_FLOAT:
+      n_values = pb_path->n_float_values;
+      break;
+    case RUT_PROPERTY_TYPE_VEC3:
+      n_components = 3;
+      n_values = pb_path->n_float_values;
+      break;
+    case RUT_PROPERTY_TYPE_VEC4:
+    case RUT_PROPERTY_TYPE_COLOR:
+    case RUT_PROPERTY_TYPE_QUATERNION:
+      n_components = 4;
+      n_values = pb_path->n_float_values;
+      break;
+    case RUT_PROPERTY_TYPE_DOUBLE:
+      n_values = pb_path->n_double_values;
+      break;
+    case RUT_PROPERTY_TYPE_INTEGER:
+      n_values = pb_path->n_integer_values;
+      break;
+    case RUT_PROPERTY_TYPE_UINT32:
+      n_values = pb_path->n_uint32_values;
+      break;
+    default:
+      /* These shouldn't be animatable */
+      g_warn_if_reached ();
+      return;
+    }
+
+  if (n_values != pb_path->n_t * n_components)
+    {
+      collect_error (unserializer, "Packed path has the wrong number of values");
+      return;
+    }
+
+  for (i = 0; i < pb_path->n_t; i++)
+    {
+      float t = pb_path->t[i];
+
+      switch (path->type)
+        {
+        case RUT_PROPERTY_TYPE_FLOAT:
+          rig_path_insert_float (path, t, pb_path->float_values[i]);
+          break;
+        case RUT_PROPERTY_TYPE_DOUBLE:
+          rig_path_insert_double (path, t, pb_path->double_values[i]);
+          break;
+        case RUT_PROPERTY_TYPE_INTEGER:
+          rig_path_insert_integer (path, t, pb_path->integer_values[i]);
+          break;
+        case RUT_PROPERTY_TYPE_UINT32:
+          rig_path_insert_uint32 (path, t, pb_path->uint32_values[i]);
+          break;
+        case RUT_PROPERTY_TYPE_VEC3:
+          rig_path_insert_vec3 (path, t, pb_path->float_values + i * 3);
+          break;
+        case RUT_PROPERTY_TYPE_VEC4:
+          rig_path_insert_vec4 (path, t, pb_path->float_values + i * 4);
+          break;
+        case RUT_PROPERTY_TYPE_COLOR:
+          {
+            const float *value = pb_path->float_values + i * 4;
+            CoglColor color;
+
+            cogl_color_init_from_4f (&color,
+                                     value[0], value[1], value[2], value[3]);
+            rig_path_insert_color (path, t, &color);
+            break;
+          }
+        case RUT_PROPERTY_TYPE_QUATERNION:
+          {
+            CoglQuaternion quaternion;
+
+            cogl_quaternion_init_from_array (&quaternion,
+                                             pb_path->float_values + i * 4);
+            rig_path_insert_quaternion (path, t, &quaternion);
+            break;
+          }
+        default:
+          break;
+        }
+    }
+}
+
 static void
 unserialize_controller_properties (RigPBUnSerializer *unserializer,
                                    RigController *controller,
@@ -2544,7 +3305,7 @@ unserialize_controller_properties (RigPBUnSerializer *unserializer,
       RutBoxed boxed_value;
 
       if (!pb_property->has_object_id ||
-          pb_property->name == NULL)
+          (pb_property->name == NULL && !pb_property->has_index))
         continue;
 
       if (pb_property->has_method)
@@ -2586,10 +3347,16 @@ unserialize_controller_properties (RigPBUnSerializer *unserializer,
           continue;
         }
 
-      property = rut_introspectable_lookup_property (object, pb_property->name);
+      if (pb_property->name)
+        property = rut_introspectable_lookup_property (object,
+                                                       pb_property->name);
+      else
+        property = lookup_property_by_index (unserializer, object,
+                                             pb_property->index);
 
 #warning "todo: remove entity::cast_shadow compatibility"
       if (!property &&
+          pb_property->name &&
           rut_object_get_type (object) == &rut_entity_type &&
           strcmp (pb_property->name, "cast_shadow") == 0)
         {
@@ -2639,10 +3406,13 @@ unserialize_controller_properties (RigPBUnSerializer *unserializer,
           RigPath *path = rig_path_new (unserializer->engine->ctx,
                                         property->spec->type);
 
-          unserialize_path_nodes (unserializer,
-                                  path,
-                                  pb_path->n_nodes,
-                                  pb_path->nodes);
+          if (pb_path->n_t)
+            unserialize_packed_path (unserializer, path, pb_path);
+          else
+            unserialize_path_nodes (unserializer,
+                                    path,
+                                    pb_path->n_nodes,
+                                    pb_path->nodes);
 
           rig_controller_set_property_path (controller,
                                             property,
@@ -2725,15 +3495,21 @@ unserialize_controller_properties (RigPBUnSerializer *unserializer,
 }
 
 static bool
-have_boxed_pb_property (Rig__Boxed **properties,
+have_boxed_pb_property (RutObject *object,
+                        Rig__Boxed **properties,
                         int n_properties,
                         const char *name)
 {
+  RutProperty *property = rut_introspectable_lookup_property (object, name);
+  int index = property ? get_property_index (property) : -1;
   int i;
+
   for (i = 0; i < n_properties; i++)
     {
       Rig__Boxed *pb_boxed = properties[i];
-      if (strcmp (pb_boxed->name, name) == 0)
+      if (pb_boxed->name ?
+          strcmp (pb_boxed->name, name) == 0 :
+          pb_boxed->has_index && pb_boxed->index == index)
         return true;
     }
   return false;
@@ -2778,7 +3554,8 @@ unserialize_controllers (RigPBUnSerializer *unserializer,
                                            pb_controller->n_controller_properties,
                                            pb_controller->controller_properties);
 
-      if (!have_boxed_pb_property (pb_controller->controller_properties,
+      if (!have_boxed_pb_property (controller,
+                                   pb_controller->controller_properties,
                                    pb_controller->n_controller_properties,
                                    "length"))
         {
@@ -2831,6 +3608,9 @@ rig_pb_unserializer_new (RigEngine *engine)
                                                 free_id_slice,
                                                 NULL);
 
+  unserializer->schemas = g_hash_table_new (g_str_hash, g_str_equal);
+  unserializer->checked_schemas = g_hash_table_new (g_str_hash, g_str_equal);
+
   rut_memory_stack_rewind (engine->serialization_stack);
 
   return unserializer;
@@ -2840,10 +3620,24 @@ void
 rig_pb_unserializer_destroy (RigPBUnSerializer *unserializer)
 {
   g_hash_table_destroy (unserializer->id_map);
+  g_hash_table_destroy (unserializer->schemas);
+  g_hash_table_destroy (unserializer->checked_schemas);
+
+  if (unserializer->mapped_file)
+    {
+      g_mapped_file_unref (unserializer->mapped_file);
+      g_hash_table_destroy (unserializer->mapped_data);
+    }
 
   g_slice_free (RigPBUnSerializer, unserializer);
 }
 
+bool
+rig_pb_unserializer_get_schema_mismatch (RigPBUnSerializer *unserializer)
+{
+  return unserializer->schema_mismatch;
+}
+
 void
 rig_pb_unserialize_ui (RigPBUnSerializer *unserializer,
                        const Rig__UI *pb_ui,
@@ -2851,6 +3645,15 @@ rig_pb_unserialize_ui (RigPBUnSerializer *unserializer,
 {
   RigEngine *engine = unserializer->engine;
   GList *l;
+  int i;
+
+  RUT_STATIC_TIMER (unserialize_timer,
+                    "Mainloop",
+                    "Unserialize UI",
+                    "Time spent creating the UI from protocol buffers",
+                    0);
+
+  RUT_TIMER_START (unserialize_timer);
 
   if (pb_ui->device)
     {
@@ -2866,6 +3669,16 @@ rig_pb_unserialize_ui (RigPBUnSerializer *unserializer,
                        device->background);
     }
 
+  for (i = 0; i < pb_ui->n_schemas; i++)
+    {
+      Rig__UI__TypeSchema *pb_schema = pb_ui->schemas[i];
+
+      if (pb_schema->type && pb_schema->has_hash)
+        g_hash_table_insert (unserializer->schemas,
+                             pb_schema->type,
+                             GUINT_TO_POINTER (pb_schema->hash));
+    }
+
   unserialize_assets (unserializer,
                       pb_ui->n_assets,
                       pb_ui->assets);
@@ -2898,6 +3711,209 @@ rig_pb_unserialize_ui (RigPBUnSerializer *unserializer,
   rig_engine_handle_ui_update (engine);
 
   rut_shell_queue_redraw (engine->ctx->shell);
+
+  RUT_TIMER_STOP (unserialize_timer);
+}
+
+/* The field numbers of the path from the UI message to the mesh
+ * buffer data in rig.proto */
+#define UI_ASSETS_FIELD 2
+#define ASSET_MESH_FIELD 6
+#define MESH_BUFFERS_FIELD 2
+#define BUFFER_DATA_FIELD 2
+
+#define WIRE_TYPE_VARINT 0
+#define WIRE_TYPE_64BIT 1
+#define WIRE_TYPE_LENGTH_DELIMITED 2
+#define WIRE_TYPE_32BIT 5
+
+typedef struct _WireReader
+{
+  const uint8_t *data;
+  size_t len;
+  size_t pos;
+} WireReader;
+
+static bool
+read_varint (WireReader *reader,
+             uint64_t *value)
+{
+  int shift;
+
+  *value = 0;
+
+  for (shift = 0; shift < 64 && reader->pos < reader->len; shift += 7)
+    {
+      uint8_t byte = reader->data[reader->pos++];
+
+      *value |= (uint64_t) (byte & 0x7f) << shift;
+
+      if ((byte & 0x80) == 0)
+        return true;
+    }
+
+  return false;
+}
+
+/* Reads the next field of a message, skipping over its value unless
+ * it is length delimited in which case @data and @len are set to the
+ * value. Returns false at the end of the message or if the message
+ * can't be parsed. */
+static bool
+read_field (WireReader *reader,
+            int *field,
+            int *wire_type,
+            const uint8_t **data,
+            size_t *len)
+{
+  uint64_t tag, value;
+
+  if (!read_varint (reader, &tag))
+    return false;
+
+  *field = tag >> 3;
+  *wire_type = tag & 7;
+
+  switch (*wire_type)
+    {
+    case WIRE_TYPE_VARINT:
+      return read_varint (reader, &value);
+    case WIRE_TYPE_64BIT:
+      if (reader->len - reader->pos < 8)
+        return false;
+      reader->pos += 8;
+      return true;
+    case WIRE_TYPE_32BIT:
+      if (reader->len - reader->pos < 4)
+        return false;
+      reader->pos += 4;
+      return true;
+    case WIRE_TYPE_LENGTH_DELIMITED:
+      if (!read_varint (reader, &value) ||
+          value > reader->len - reader->pos)
+        return false;
+      *data = reader->data + reader->pos;
+      *len = value;
+      reader->pos += value;
+      return true;
+    default:
+      /* Groups are never used by rig.proto */
+      return false;
+    }
+}
+
+static void
+map_buffer_data (RigPBUnSerializer *unserializer,
+                 Rig__Buffer *pb_buffer,
+                 const uint8_t *buffer_data,
+                 size_t buffer_len)
+{
+  WireReader reader = { buffer_data, buffer_len, 0 };
+  const uint8_t *mapped = NULL;
+  size_t mapped_len = 0;
+  const uint8_t *data;
+  int field, wire_type;
+  size_t len;
+
+  /* NB: if a field is repeated the last value wins */
+  while (read_field (&reader, &field, &wire_type, &data, &len))
+    {
+      if (field == BUFFER_DATA_FIELD &&
+          wire_type == WIRE_TYPE_LENGTH_DELIMITED)
+        {
+          mapped = data;
+          mapped_len = len;
+        }
+    }
+
+  /* The data can only be borrowed if it is aligned well enough to be
+   * accessed as floats or indices */
+  if (mapped &&
+      pb_buffer->has_data &&
+      pb_buffer->data.len > 0 &&
+      mapped_len == pb_buffer->data.len &&
+      ((uintptr_t) mapped & 3) == 0)
+    {
+      g_hash_table_insert (unserializer->mapped_data,
+                           pb_buffer->data.data,
+                           (void *) mapped);
+    }
+}
+
+static void
+map_mesh_buffers (RigPBUnSerializer *unserializer,
+                  Rig__Mesh *pb_mesh,
+                  const uint8_t *mesh_data,
+                  size_t mesh_len,
+                  int *n_buffers)
+{
+  WireReader reader = { mesh_data, mesh_len, 0 };
+  const uint8_t *data;
+  int field, wire_type;
+  size_t len;
+
+  while (read_field (&reader, &field, &wire_type, &data, &len))
+    {
+      if (field == MESH_BUFFERS_FIELD &&
+          wire_type == WIRE_TYPE_LENGTH_DELIMITED &&
+          *n_buffers < pb_mesh->n_buffers)
+        {
+          map_buffer_data (unserializer,
+                           pb_mesh->buffers[(*n_buffers)++],
+                           data, len);
+        }
+    }
+}
+
+void
+rig_pb_unserializer_set_mapped_file (RigPBUnSerializer *unserializer,
+                                     const Rig__UI *pb_ui,
+                                     GMappedFile *mapped_file)
+{
+  WireReader reader;
+  const uint8_t *data;
+  int field, wire_type;
+  size_t len;
+  int n_assets = 0;
+
+  g_return_if_fail (unserializer->mapped_file == NULL);
+
+  unserializer->mapped_file = g_mapped_file_ref (mapped_file);
+  unserializer->mapped_data = g_hash_table_new (NULL, NULL);
+
+  reader.data = (const uint8_t *) g_mapped_file_get_contents (mapped_file);
+  reader.len = g_mapped_file_get_length (mapped_file);
+  reader.pos = 0;
+
+  /* protobuf-c copies bytes fields while unpacking so this walks the
+   * encoded message in parallel with the unpacked one to find where
+   * each mesh buffer's data originally came from. Repeated fields are
+   * unpacked in the order they appear so they can be matched up by
+   * index. */
+  while (read_field (&reader, &field, &wire_type, &data, &len))
+    {
+      WireReader asset_reader = { data, len, 0 };
+      Rig__Asset *pb_asset;
+      int n_buffers = 0;
+
+      if (field != UI_ASSETS_FIELD ||
+          wire_type != WIRE_TYPE_LENGTH_DELIMITED ||
+          n_assets >= pb_ui->n_assets)
+        continue;
+
+      pb_asset = pb_ui->assets[n_assets++];
+
+      while (read_field (&asset_reader, &field, &wire_type, &data, &len))
+        {
+          if (field == ASSET_MESH_FIELD &&
+              wire_type == WIRE_TYPE_LENGTH_DELIMITED &&
+              pb_asset->mesh)
+            {
+              map_mesh_buffers (unserializer, pb_asset->mesh,
+                                data, len, &n_buffers);
+            }
+        }
+    }
 }
 
 typedef struct _NamedBuffer
@@ -2906,6 +3922,37 @@ typedef struct _NamedBuffer
   RutBuffer *buffer;
 } NamedBuffer;
 
+static RutBuffer *
+unserialize_buffer_data (RigPBUnSerializer *unserializer,
+                         Rig__Buffer *pb_buffer)
+{
+  RutBuffer *buffer;
+  uint8_t *mapped = NULL;
+
+  if (unserializer->mapped_data)
+    mapped = g_hash_table_lookup (unserializer->mapped_data,
+                                  pb_buffer->data.data);
+
+  /* NB: the file is mapped privately so if the mesh is modified only
+   * the modified pages get copied.
+   *
+   * XXX: the buffers borrow the mapping for as long as the meshes
+   * live so if something else truncates the file in place then
+   * touching pages that are no longer backed by the file will raise
+   * SIGBUS. Rig itself always replaces the file when saving, see
+   * rig_save(), which leaves the mapping intact. */
+  if (mapped)
+    return rut_buffer_new_for_data (mapped,
+                                    pb_buffer->data.len,
+                                    (GDestroyNotify) g_mapped_file_unref,
+                                    g_mapped_file_ref (unserializer->mapped_file));
+
+  buffer = rut_buffer_new (pb_buffer->data.len);
+  memcpy (buffer->data, pb_buffer->data.data, pb_buffer->data.len);
+
+  return buffer;
+}
+
 RutMesh *
 rig_pb_unserialize_mesh (RigPBUnSerializer *unserializer,
                          Rig__Mesh *pb_mesh)
@@ -2928,8 +3975,7 @@ rig_pb_unserialize_mesh (RigPBUnSerializer *unserializer,
           goto ERROR;
         }
 
-      buffer = rut_buffer_new (pb_buffer->data.len);
-      memcpy (buffer->data, pb_buffer->data.data, pb_buffer->data.len);
+      buffer = unserialize_buffer_data (unserializer, pb_buffer);
       named_buffers[i].id = pb_buffer->id;
       named_buffers[i].buffer = buffer;
       n_buffers++;
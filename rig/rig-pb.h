@@ -42,6 +42,54 @@ rig_pb_serializer_set_asset_filter (RigPBSerializer *serializer,
                                     RigPBAssetFilter filter,
                                     void *user_data);
 
+/* When enabled, mesh assets are quantized before being serialized
+ * to reduce their size. This is lossy so it's only intended for
+ * transferring a UI to a slave device. */
+void
+rig_pb_serializer_set_quantize_meshes_enabled (RigPBSerializer *serializer,
+                                               bool enabled);
+
+/* When enabled the UI is written in the PACKED mode where properties
+ * are referred to by their index instead of by name, and entity
+ * transforms and controller paths are stored as flat arrays. This is
+ * smaller and quicker to pack and unpack but the indices depend on
+ * the order properties are declared in so the UI lists a hash of the
+ * properties of each type it refers to. A receiver whose properties
+ * differ reports a schema mismatch so the UI can be sent again without
+ * packing. It's intended for syncing a UI with a slave or simulator,
+ * not for saving. */
+void
+rig_pb_serializer_set_packed_enabled (RigPBSerializer *serializer,
+                                      bool enabled);
+
+/* When enabled the mesh buffers of the serialized UI are copies
+ * instead of pointing at the meshes' own buffers. The contents of
+ * other assets are always read into private copies. This makes the
+ * payloads returned by rig_pb_serializer_steal_payloads() an
+ * immutable snapshot that can be written out after the meshes have
+ * been changed again. */
+void
+rig_pb_serializer_set_copy_payloads_enabled (RigPBSerializer *serializer,
+                                             bool enabled);
+
+/* Objects are normally numbered from scratch each time a UI is
+ * serialized. An id table instead gives each object the same id
+ * every time it is serialized with that table so a later UI can
+ * replace the records of an earlier one, as incremental autosaves do.
+ * The table keeps a reference on each object it has given an id to so
+ * that the objects, and so their ids, can't be reused. */
+typedef struct _RigPBIdTable RigPBIdTable;
+
+RigPBIdTable *
+rig_pb_id_table_new (void);
+
+void
+rig_pb_id_table_free (RigPBIdTable *table);
+
+void
+rig_pb_serializer_set_id_table (RigPBSerializer *serializer,
+                                RigPBIdTable *table);
+
 void
 rig_pb_serializer_destroy (RigPBSerializer *serializer);
 
@@ -51,6 +99,19 @@ rig_pb_serialize_ui (RigPBSerializer *serializer);
 void
 rig_pb_serialized_ui_destroy (Rig__UI *ui);
 
+/* Returns the list of RutBuffers that hold the large payloads of the
+ * serialized UI, such as mesh buffers and the contents of assets,
+ * and that are otherwise kept alive until the serializer is
+ * destroyed. The caller owns the list and a reference on each buffer.
+ * This lets a UI be packed without copying the payloads again, which
+ * are then written out later, eg. from another thread. Unless the
+ * payloads were copied (see
+ * rig_pb_serializer_set_copy_payloads_enabled()) some of them may be
+ * the meshes' own buffers. The buffers' reference counts must still
+ * only be touched on the main thread. */
+GList *
+rig_pb_serializer_steal_payloads (RigPBSerializer *serializer);
+
 Rig__Event **
 rig_pb_serialize_input_events (RigEngine *engine,
                                RutList *input_queue,
@@ -62,11 +123,35 @@ rig_pb_unserializer_new (RigEngine *engine);
 void
 rig_pb_unserializer_destroy (RigPBUnSerializer *unserializer);
 
+/* Lets the mesh buffers of @pb_ui borrow their data from
+ * @mapped_file instead of copying it, where @pb_ui was unpacked from
+ * the whole contents of @mapped_file. The mapping should be writable
+ * and private so the meshes can still be modified. The buffers keep
+ * a reference on @mapped_file.
+ *
+ * The file must not be truncated in place while the meshes are alive
+ * since reading the missing pages would raise SIGBUS. Replacing it
+ * with a new file, as rig_save() does, is fine. */
+void
+rig_pb_unserializer_set_mapped_file (RigPBUnSerializer *unserializer,
+                                     const Rig__UI *pb_ui,
+                                     GMappedFile *mapped_file);
+
 void
 rig_pb_unserialize_ui (RigPBUnSerializer *unserializer,
                        const Rig__UI *pb_ui,
                        bool skip_assets);
 
+/* Returns true if the last PACKED UI that was unserialized referred to
+ * the properties of a type that doesn't have the same properties
+ * here, in which case those properties were ignored and the UI should
+ * be sent again in the FULL mode. */
+bool
+rig_pb_unserializer_get_schema_mismatch (RigPBUnSerializer *unserializer);
+
+/* NB: if @pb_mesh has a position scale and offset then the mesh was
+ * quantized by the serializer and it is returned as it is, without
+ * being expanded back into floats */
 RutMesh *
 rig_pb_unserialize_mesh (RigPBUnSerializer *unserializer,
                          Rig__Mesh *pb_mesh);
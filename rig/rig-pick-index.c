@@ -0,0 +1,629 @@
+/*
+ * Rig
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <rut.h>
+
+#include "rig-pick-index.h"
+
+/* There is an entry for each transformable node in the scene, stored
+ * in depth first order so that a parent's entry always comes before
+ * its children's entries and a node's subtree is the range of entries
+ * from its own entry to its last descendant's. */
+typedef struct _PickEntry
+{
+  RigPickIndex *index;
+
+  /* NB: we keep a reference on the node so that it can't be destroyed
+   * while we are still connected to it */
+  RutObject *node;
+  bool is_entity;
+
+  /* The index of the entry for the nearest transformable ancestor, or
+   * -1 if there isn't one */
+  int parent;
+
+  /* The index of the last entry in the node's subtree */
+  int last_descendant;
+
+  /* Entities tell us when their transform changes but for any other
+   * transformable we have to compare the matrix itself */
+  CoglMatrix local_transform;
+
+  /* The transform from the node's coordinate space to the scene's */
+  CoglMatrix transform;
+
+  /* Changes reported since the last update. The entry is on the
+   * index's dirty list whenever this is non-zero */
+  RutEntityChangeFlags changes;
+
+  /* Only for entities */
+  RutClosure *change_closure;
+  RutMesh *mesh;
+  RutClosure *mesh_closure;
+  bool has_pickable_input;
+  int proxy;
+} PickEntry;
+
+struct _RigPickIndex
+{
+  RutObject *scene;
+  unsigned int subtree_age;
+
+  GArray *entries;
+
+  /* The indices of the entries with changes to apply on the next
+   * update */
+  GArray *dirty;
+
+  /* The indices of the entries for transformables that aren't
+   * entities. Their matrices are only compared when the scene
+   * generation changes. */
+  GArray *others;
+  unsigned int scene_generation;
+
+  /* The indices of the entries with a pickable input component, in
+   * scene order. This is only rebuilt when an entity gains or loses
+   * one. */
+  GArray *input_entries;
+  bool input_entries_dirty;
+
+  RutAABBTree *tree;
+};
+
+RigPickIndex *
+rig_pick_index_new (void)
+{
+  RigPickIndex *index = g_slice_new0 (RigPickIndex);
+
+  index->entries = g_array_new (FALSE, FALSE, sizeof (PickEntry));
+  index->dirty = g_array_new (FALSE, FALSE, sizeof (int));
+  index->others = g_array_new (FALSE, FALSE, sizeof (int));
+  index->input_entries = g_array_new (FALSE, FALSE, sizeof (int));
+  index->tree = rut_aabb_tree_new ();
+
+  return index;
+}
+
+static void
+set_mesh (PickEntry *entry,
+          RutMesh *mesh);
+
+static void
+clear_entries (RigPickIndex *index)
+{
+  int i;
+
+  for (i = 0; i < index->entries->len; i++)
+    {
+      PickEntry *entry = &g_array_index (index->entries, PickEntry, i);
+
+      if (entry->change_closure)
+        rut_closure_disconnect (entry->change_closure);
+
+      set_mesh (entry, NULL);
+
+      rut_refable_unref (entry->node);
+    }
+
+  g_array_set_size (index->entries, 0);
+  g_array_set_size (index->dirty, 0);
+  g_array_set_size (index->others, 0);
+  g_array_set_size (index->input_entries, 0);
+  index->input_entries_dirty = false;
+
+  if (index->scene)
+    {
+      rut_refable_unref (index->scene);
+      index->scene = NULL;
+    }
+}
+
+void
+rig_pick_index_free (RigPickIndex *index)
+{
+  clear_entries (index);
+
+  g_array_free (index->entries, TRUE);
+  g_array_free (index->dirty, TRUE);
+  g_array_free (index->others, TRUE);
+  g_array_free (index->input_entries, TRUE);
+  rut_aabb_tree_free (index->tree);
+
+  g_slice_free (RigPickIndex, index);
+}
+
+static RutMesh *
+get_pick_mesh (RutEntity *entity)
+{
+  RutObject *geometry =
+    rut_entity_get_component (entity, RUT_COMPONENT_TYPE_GEOMETRY);
+
+  if (geometry && rut_object_is (geometry, RUT_INTERFACE_ID_MESHABLE))
+    return rut_meshable_get_mesh (geometry);
+
+  return NULL;
+}
+
+static bool
+get_has_pickable_input (RutEntity *entity)
+{
+  RutObject *input =
+    rut_entity_get_component (entity, RUT_COMPONENT_TYPE_INPUT);
+
+  return input && rut_object_is (input, RUT_INTERFACE_ID_PICKABLE);
+}
+
+static void
+mark_dirty (PickEntry *entry,
+            RutEntityChangeFlags changes)
+{
+  RigPickIndex *index = entry->index;
+
+  if (entry->changes == 0)
+    {
+      int entry_index = entry - (PickEntry *) index->entries->data;
+
+      g_array_append_val (index->dirty, entry_index);
+    }
+
+  entry->changes |= changes;
+}
+
+static void
+entity_change_cb (RutEntity *entity,
+                  RutEntityChangeFlags changes,
+                  void *user_data)
+{
+  mark_dirty (user_data, changes);
+}
+
+/* The mesh was modified in place so its bounds need updating */
+static void
+mesh_changed_cb (RutMesh *mesh,
+                 void *user_data)
+{
+  mark_dirty (user_data, RUT_ENTITY_CHANGE_GEOMETRY);
+}
+
+static void
+set_mesh (PickEntry *entry,
+          RutMesh *mesh)
+{
+  if (entry->mesh)
+    {
+      rut_closure_disconnect (entry->mesh_closure);
+      entry->mesh_closure = NULL;
+      rut_refable_unref (entry->mesh);
+    }
+
+  /* NB: we keep a reference on the mesh so that the pointer can't
+   * be reused by a different mesh without us noticing */
+  entry->mesh = mesh ? rut_refable_ref (mesh) : NULL;
+
+  if (mesh)
+    entry->mesh_closure =
+      rut_mesh_add_changed_callback (mesh,
+                                     mesh_changed_cb,
+                                     entry,
+                                     NULL); /* destroy */
+}
+
+/* Transforms an axis aligned box and returns the axis aligned box that
+ * contains the result */
+static void
+transform_bounds (const CoglMatrix *matrix,
+                  const float min[3],
+                  const float max[3],
+                  float min_out[3],
+                  float max_out[3])
+{
+  const float *m = cogl_matrix_get_array (matrix);
+  int i, j;
+
+  for (i = 0; i < 3; i++)
+    {
+      min_out[i] = max_out[i] = m[12 + i];
+
+      for (j = 0; j < 3; j++)
+        {
+          float a = m[j * 4 + i] * min[j];
+          float b = m[j * 4 + i] * max[j];
+
+          min_out[i] += MIN (a, b);
+          max_out[i] += MAX (a, b);
+        }
+    }
+}
+
+/* NB: the bounds come from rut_mesh_get_bounds() rather than the
+ * mesh's BVH so that the BVH is only built once a ray actually hits
+ * the mesh's box */
+static void
+update_proxy (RigPickIndex *index,
+              PickEntry *entry)
+{
+  float local_min[3], local_max[3];
+  float min[3], max[3];
+
+  if (entry->mesh &&
+      !entry->has_pickable_input &&
+      rut_mesh_get_bounds (entry->mesh, local_min, local_max))
+    {
+      transform_bounds (&entry->transform, local_min, local_max, min, max);
+
+      if (entry->proxy < 0)
+        entry->proxy = rut_aabb_tree_insert (index->tree, min, max, entry);
+      else
+        rut_aabb_tree_move (index->tree, entry->proxy, min, max);
+    }
+  else if (entry->proxy >= 0)
+    {
+      rut_aabb_tree_remove (index->tree, entry->proxy);
+      entry->proxy = -1;
+    }
+}
+
+static void
+update_transform (RigPickIndex *index,
+                  PickEntry *entry)
+{
+  const CoglMatrix *local = rut_transformable_get_matrix (entry->node);
+
+  if (!entry->is_entity)
+    entry->local_transform = *local;
+
+  if (entry->parent >= 0)
+    {
+      PickEntry *parent =
+        &g_array_index (index->entries, PickEntry, entry->parent);
+
+      cogl_matrix_multiply (&entry->transform, &parent->transform, local);
+    }
+  else
+    entry->transform = *local;
+}
+
+/* Recomputes the transforms of the entry at @entry_index and all of
+ * its descendants and moves their proxies to match */
+static void
+update_subtree (RigPickIndex *index,
+                int entry_index)
+{
+  PickEntry *root = &g_array_index (index->entries, PickEntry, entry_index);
+  int last = root->last_descendant;
+  int i;
+
+  for (i = entry_index; i <= last; i++)
+    {
+      PickEntry *entry = &g_array_index (index->entries, PickEntry, i);
+
+      update_transform (index, entry);
+
+      if (entry->is_entity)
+        update_proxy (index, entry);
+    }
+}
+
+static void
+update_geometry (RigPickIndex *index,
+                 PickEntry *entry)
+{
+  RutEntity *entity = entry->node;
+  RutMesh *mesh = get_pick_mesh (entity);
+  bool has_pickable_input = get_has_pickable_input (entity);
+
+  if (mesh != entry->mesh)
+    set_mesh (entry, mesh);
+
+  if (has_pickable_input != entry->has_pickable_input)
+    {
+      entry->has_pickable_input = has_pickable_input;
+      index->input_entries_dirty = true;
+    }
+
+  update_proxy (index, entry);
+}
+
+typedef struct _BuildState
+{
+  RigPickIndex *index;
+
+  /* The index of the entry that the children of the node at each
+   * depth should use as their parent */
+  GArray *parents;
+} BuildState;
+
+static RutTraverseVisitFlags
+build_entries_cb (RutObject *object,
+                  int depth,
+                  void *user_data)
+{
+  BuildState *state = user_data;
+  GArray *entries = state->index->entries;
+  int parent = depth > 0 ? g_array_index (state->parents, int, depth - 1) : -1;
+  int entry_index = parent;
+
+  if (rut_object_is (object, RUT_INTERFACE_ID_TRANSFORMABLE))
+    {
+      PickEntry entry;
+
+      memset (&entry, 0, sizeof (entry));
+      entry.index = state->index;
+      entry.node = rut_refable_ref (object);
+      entry.is_entity = rut_object_get_type (object) == &rut_entity_type;
+      entry.parent = parent;
+      entry.proxy = -1;
+
+      g_array_append_val (entries, entry);
+      entry_index = entries->len - 1;
+    }
+
+  g_array_set_size (state->parents, depth + 1);
+  g_array_index (state->parents, int, depth) = entry_index;
+
+  return RUT_TRAVERSE_VISIT_CONTINUE;
+}
+
+static RutTraverseVisitFlags
+finish_entry_cb (RutObject *object,
+                 int depth,
+                 void *user_data)
+{
+  BuildState *state = user_data;
+  GArray *entries = state->index->entries;
+
+  if (rut_object_is (object, RUT_INTERFACE_ID_TRANSFORMABLE))
+    {
+      int entry_index = g_array_index (state->parents, int, depth);
+      PickEntry *entry = &g_array_index (entries, PickEntry, entry_index);
+
+      entry->last_descendant = entries->len - 1;
+    }
+
+  return RUT_TRAVERSE_VISIT_CONTINUE;
+}
+
+static void
+rebuild (RigPickIndex *index,
+         RutObject *scene)
+{
+  BuildState state;
+  int i;
+
+  clear_entries (index);
+
+  rut_aabb_tree_free (index->tree);
+  index->tree = rut_aabb_tree_new ();
+
+  if (scene == NULL)
+    return;
+
+  index->scene = rut_refable_ref (scene);
+  index->subtree_age = rut_graphable_get_subtree_age (scene);
+
+  state.index = index;
+  state.parents = g_array_new (FALSE, FALSE, sizeof (int));
+
+  rut_graphable_traverse (scene,
+                          RUT_TRAVERSE_DEPTH_FIRST,
+                          build_entries_cb,
+                          finish_entry_cb,
+                          &state);
+
+  g_array_free (state.parents, TRUE);
+
+  /* NB: the entries array isn't resized again until the next rebuild
+   * so it is safe to give out pointers to the entries from here */
+  for (i = 0; i < index->entries->len; i++)
+    {
+      PickEntry *entry = &g_array_index (index->entries, PickEntry, i);
+
+      update_transform (index, entry);
+
+      if (entry->is_entity)
+        {
+          entry->change_closure =
+            rut_entity_add_change_callback (entry->node,
+                                            entity_change_cb,
+                                            entry,
+                                            NULL); /* destroy */
+          update_geometry (index, entry);
+        }
+      else
+        g_array_append_val (index->others, i);
+    }
+
+  index->input_entries_dirty = true;
+}
+
+static void
+check_other_transforms (RigPickIndex *index)
+{
+  int i;
+
+  for (i = 0; i < index->others->len; i++)
+    {
+      int entry_index = g_array_index (index->others, int, i);
+      PickEntry *entry =
+        &g_array_index (index->entries, PickEntry, entry_index);
+
+      if (!cogl_matrix_equal (rut_transformable_get_matrix (entry->node),
+                              &entry->local_transform))
+        mark_dirty (entry, RUT_ENTITY_CHANGE_TRANSFORM);
+    }
+}
+
+static int
+compare_indices (const void *a,
+                 const void *b)
+{
+  return *(const int *) a - *(const int *) b;
+}
+
+static void
+apply_changes (RigPickIndex *index)
+{
+  int updated_up_to = -1;
+  int i;
+
+  /* In scene order a changed transform is always seen before any
+   * changes beneath it, so once a subtree has been updated the
+   * transforms of any entries inside it are already up to date */
+  g_array_sort (index->dirty, compare_indices);
+
+  for (i = 0; i < index->dirty->len; i++)
+    {
+      int entry_index = g_array_index (index->dirty, int, i);
+      PickEntry *entry =
+        &g_array_index (index->entries, PickEntry, entry_index);
+
+      if ((entry->changes & RUT_ENTITY_CHANGE_TRANSFORM) &&
+          entry_index > updated_up_to)
+        {
+          update_subtree (index, entry_index);
+          updated_up_to = entry->last_descendant;
+        }
+    }
+
+  /* NB: looking up a mesh can lazily create it, which may report
+   * another geometry change, so the length is re-checked each time */
+  for (i = 0; i < index->dirty->len; i++)
+    {
+      int entry_index = g_array_index (index->dirty, int, i);
+      PickEntry *entry =
+        &g_array_index (index->entries, PickEntry, entry_index);
+
+      if (entry->changes & RUT_ENTITY_CHANGE_GEOMETRY)
+        update_geometry (index, entry);
+
+      entry->changes = 0;
+    }
+
+  g_array_set_size (index->dirty, 0);
+}
+
+void
+rig_pick_index_update (RigPickIndex *index,
+                       RutObject *scene)
+{
+  unsigned int scene_generation = rut_graphable_get_scene_generation ();
+
+  RUT_STATIC_TIMER (update_timer,
+                    "Mainloop",
+                    "Pick index update",
+                    "Bringing the scene's pick index up to date",
+                    0);
+
+  RUT_TIMER_START (update_timer);
+
+  if (scene != index->scene ||
+      (scene && rut_graphable_get_subtree_age (scene) != index->subtree_age))
+    rebuild (index, scene);
+  else
+    {
+      if (index->others->len && scene_generation != index->scene_generation)
+        check_other_transforms (index);
+
+      if (index->dirty->len)
+        apply_changes (index);
+    }
+
+  index->scene_generation = scene_generation;
+
+  RUT_TIMER_STOP (update_timer);
+}
+
+void
+rig_pick_index_foreach_input_entity (RigPickIndex *index,
+                                     RigPickIndexEntityCallback callback,
+                                     void *user_data)
+{
+  int i;
+
+  if (index->input_entries_dirty)
+    {
+      g_array_set_size (index->input_entries, 0);
+
+      for (i = 0; i < index->entries->len; i++)
+        {
+          PickEntry *entry = &g_array_index (index->entries, PickEntry, i);
+
+          if (entry->has_pickable_input)
+            g_array_append_val (index->input_entries, i);
+        }
+
+      index->input_entries_dirty = false;
+    }
+
+  for (i = 0; i < index->input_entries->len; i++)
+    {
+      int entry_index = g_array_index (index->input_entries, int, i);
+      PickEntry *entry =
+        &g_array_index (index->entries, PickEntry, entry_index);
+
+      if (!callback (entry->node, &entry->transform, user_data))
+        return;
+    }
+}
+
+typedef struct _RayCastState
+{
+  RigPickIndexRayCallback callback;
+  void *user_data;
+} RayCastState;
+
+static float
+ray_cast_cb (void *proxy_data,
+             float max_t,
+             void *user_data)
+{
+  PickEntry *entry = proxy_data;
+  RayCastState *state = user_data;
+
+  return state->callback (entry->node,
+                          &entry->transform,
+                          entry->mesh,
+                          max_t,
+                          state->user_data);
+}
+
+void
+rig_pick_index_ray_cast (RigPickIndex *index,
+                         const float ray_origin[3],
+                         const float ray_direction[3],
+                         RigPickIndexRayCallback callback,
+                         void *user_data)
+{
+  RayCastState state;
+
+  state.callback = callback;
+  state.user_data = user_data;
+
+  rut_aabb_tree_ray_cast (index->tree,
+                          ray_origin,
+                          ray_direction,
+                          G_MAXFLOAT,
+                          ray_cast_cb,
+                          &state);
+}
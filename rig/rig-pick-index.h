@@ -0,0 +1,85 @@
+/*
+ * Rig
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RIG_PICK_INDEX_H_
+#define _RIG_PICK_INDEX_H_
+
+#include <stdbool.h>
+
+#include <rut.h>
+
+/* Tracks the world transform and world space bounds of every entity
+ * in a scene so that picking only has to test the entities a ray
+ * actually passes near, nearest first.
+ *
+ * rig_pick_index_update() should be called before each query. It
+ * rebuilds the index if children have been added to or removed from
+ * the scene (see rut_graphable_get_subtree_age()). Otherwise it only
+ * updates the entities that reported a change to their transform,
+ * components or mesh since the last update, along with their
+ * descendants, so it costs nothing when the scene hasn't changed.
+ *
+ * The bounds of a mesh are computed without building its BVH so a
+ * BVH is only built for a mesh the first time a ray hits its bounds.
+ */
+typedef struct _RigPickIndex RigPickIndex;
+
+RigPickIndex *
+rig_pick_index_new (void);
+
+void
+rig_pick_index_free (RigPickIndex *index);
+
+void
+rig_pick_index_update (RigPickIndex *index,
+                       RutObject *scene);
+
+/* Entities with a pickable input component have no mesh to bound so
+ * they aren't in the spatial index. Instead they are visited in scene
+ * order, until the callback returns false. */
+typedef bool (*RigPickIndexEntityCallback) (RutEntity *entity,
+                                            const CoglMatrix *transform,
+                                            void *user_data);
+
+void
+rig_pick_index_foreach_input_entity (RigPickIndex *index,
+                                     RigPickIndexEntityCallback callback,
+                                     void *user_data);
+
+/* Called for the entities whose bounds a world space ray enters, in
+ * front to back order of where it enters. The callback should
+ * intersect the ray with @mesh and return the distance along the ray
+ * of the nearest hit found so far, in units of the ray direction, or
+ * @max_t if it didn't find a nearer hit. Returning a negative value
+ * stops the search. */
+typedef float (*RigPickIndexRayCallback) (RutEntity *entity,
+                                          const CoglMatrix *transform,
+                                          RutMesh *mesh,
+                                          float max_t,
+                                          void *user_data);
+
+void
+rig_pick_index_ray_cast (RigPickIndex *index,
+                         const float ray_origin[3],
+                         const float ray_direction[3],
+                         RigPickIndexRayCallback callback,
+                         void *user_data);
+
+#endif /* _RIG_PICK_INDEX_H_ */
@@ -0,0 +1,272 @@
+/*
+ * Rig
+ *
+ * Copyright (C) 2013  Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <cogl-pango/cogl-pango.h>
+
+#include <rut.h>
+
+#include "rig-profile-overlay.h"
+
+#define GRAPH_BAR_WIDTH 3
+#define GRAPH_HEIGHT 100
+/* The full height of the graph represents two frames at 60Hz and a
+ * marker is drawn at the height of one */
+#define GRAPH_MAX_NS (2 * 16666667)
+#define PADDING 8
+#define LEGEND_SWATCH_SIZE 10
+#define LEGEND_WIDTH 160
+
+static const uint32_t section_colors[] = {
+  0xe41a1cff,
+  0x377eb8ff,
+  0x4daf4aff,
+  0x984ea3ff,
+  0xff7f00ff,
+  0xffff33ff,
+  0xa65628ff,
+  0xf781bfff
+};
+
+#define N_SECTIONS G_N_ELEMENTS (section_colors)
+
+struct _RigProfileOverlay
+{
+  RutContext *ctx;
+
+  CoglPipeline *bg_pipeline;
+  CoglPipeline *marker_pipeline;
+  CoglPipeline *section_pipelines[N_SECTIONS];
+
+  PangoFontDescription *font_desc;
+  PangoLayout *layout;
+  PangoLayout *legend_layout;
+
+  GString *text;
+
+  /* The direct children of root timers, these are the timers that
+   * get stacked in the graph */
+  RutProfileTimer *sections[N_SECTIONS];
+  int n_sections;
+};
+
+RigProfileOverlay *
+rig_profile_overlay_new (RutContext *ctx)
+{
+  RigProfileOverlay *overlay = g_slice_new0 (RigProfileOverlay);
+  CoglContext *cogl_context = ctx->cogl_context;
+  int i;
+
+  overlay->ctx = rut_refable_ref (ctx);
+
+  overlay->bg_pipeline = cogl_pipeline_new (cogl_context);
+  cogl_pipeline_set_color4f (overlay->bg_pipeline, 0, 0, 0, 0.7);
+
+  overlay->marker_pipeline = cogl_pipeline_new (cogl_context);
+  cogl_pipeline_set_color4f (overlay->marker_pipeline, 0.5, 0.5, 0.5, 1);
+
+  for (i = 0; i < N_SECTIONS; i++)
+    {
+      uint32_t color = section_colors[i];
+      CoglPipeline *pipeline = cogl_pipeline_new (cogl_context);
+
+      cogl_pipeline_set_color4ub (pipeline,
+                                  color >> 24,
+                                  (color >> 16) & 0xff,
+                                  (color >> 8) & 0xff,
+                                  color & 0xff);
+      overlay->section_pipelines[i] = pipeline;
+    }
+
+  overlay->font_desc = pango_font_description_from_string ("Mono 9px");
+  overlay->layout = pango_layout_new (ctx->pango_context);
+  pango_layout_set_font_description (overlay->layout, overlay->font_desc);
+  overlay->legend_layout = pango_layout_new (ctx->pango_context);
+  pango_layout_set_font_description (overlay->legend_layout,
+                                     overlay->font_desc);
+
+  overlay->text = g_string_new (NULL);
+
+  return overlay;
+}
+
+void
+rig_profile_overlay_free (RigProfileOverlay *overlay)
+{
+  int i;
+
+  cogl_object_unref (overlay->bg_pipeline);
+  cogl_object_unref (overlay->marker_pipeline);
+  for (i = 0; i < N_SECTIONS; i++)
+    cogl_object_unref (overlay->section_pipelines[i]);
+
+  g_object_unref (overlay->layout);
+  g_object_unref (overlay->legend_layout);
+  pango_font_description_free (overlay->font_desc);
+
+  g_string_free (overlay->text, TRUE);
+
+  rut_refable_unref (overlay->ctx);
+
+  g_slice_free (RigProfileOverlay, overlay);
+}
+
+static void
+add_timer_cb (RutProfileTimer *timer,
+              int depth,
+              void *user_data)
+{
+  RigProfileOverlay *overlay = user_data;
+
+  if (depth == 1 && overlay->n_sections < N_SECTIONS)
+    overlay->sections[overlay->n_sections++] = timer;
+
+  g_string_append_printf (overlay->text,
+                          "%*s%-*s %7.2f ms %7.2f avg\n",
+                          depth * 2, "",
+                          MAX (1, 24 - depth * 2), timer->name,
+                          rut_profile_timer_get_frame_time (timer, 0) / 1e6,
+                          rut_profile_timer_get_average_time (timer) / 1e6);
+}
+
+static void
+add_counter_cb (RutProfileCounter *counter,
+                void *user_data)
+{
+  RigProfileOverlay *overlay = user_data;
+
+  g_string_append_printf (overlay->text,
+                          "%-24s %10" G_GINT64_FORMAT "\n",
+                          counter->name,
+                          rut_profile_counter_get_frame_value (counter, 0));
+}
+
+static void
+paint_graph (RigProfileOverlay *overlay,
+             CoglFramebuffer *fb,
+             float x,
+             float y)
+{
+  int n_frames = rut_profile_get_n_frames ();
+  float marker_y = y + GRAPH_HEIGHT - GRAPH_HEIGHT * 16666667.0f / GRAPH_MAX_NS;
+  int i, j;
+
+  /* Oldest frames on the left */
+  for (i = 0; i < n_frames; i++)
+    {
+      float x0 = x + (RUT_PROFILE_N_FRAMES - n_frames + i) * GRAPH_BAR_WIDTH;
+      float bottom = y + GRAPH_HEIGHT;
+
+      for (j = 0; j < overlay->n_sections && bottom > y; j++)
+        {
+          uint64_t ns =
+            rut_profile_timer_get_frame_time (overlay->sections[j],
+                                              n_frames - 1 - i);
+          float height = GRAPH_HEIGHT * (float)ns / GRAPH_MAX_NS;
+          float top = MAX (y, bottom - height);
+
+          if (top < bottom)
+            cogl_framebuffer_draw_rectangle (fb,
+                                             overlay->section_pipelines[j],
+                                             x0, top,
+                                             x0 + GRAPH_BAR_WIDTH - 1, bottom);
+          bottom = top;
+        }
+    }
+
+  cogl_framebuffer_draw_rectangle (fb,
+                                   overlay->marker_pipeline,
+                                   x, marker_y,
+                                   x + RUT_PROFILE_N_FRAMES * GRAPH_BAR_WIDTH,
+                                   marker_y + 1);
+}
+
+static void
+paint_legend (RigProfileOverlay *overlay,
+              CoglFramebuffer *fb,
+              float x,
+              float y,
+              const CoglColor *text_color)
+{
+  int i;
+
+  for (i = 0; i < overlay->n_sections; i++)
+    {
+      float entry_y = y + i * (LEGEND_SWATCH_SIZE + 2);
+
+      cogl_framebuffer_draw_rectangle (fb,
+                                       overlay->section_pipelines[i],
+                                       x, entry_y,
+                                       x + LEGEND_SWATCH_SIZE,
+                                       entry_y + LEGEND_SWATCH_SIZE);
+
+      pango_layout_set_text (overlay->legend_layout,
+                             overlay->sections[i]->name, -1);
+      cogl_pango_show_layout (fb, overlay->legend_layout,
+                              x + LEGEND_SWATCH_SIZE + 4, entry_y,
+                              text_color);
+    }
+}
+
+void
+rig_profile_overlay_paint (RigProfileOverlay *overlay,
+                           CoglFramebuffer *fb,
+                           float x,
+                           float y)
+{
+  float graph_width = RUT_PROFILE_N_FRAMES * GRAPH_BAR_WIDTH;
+  float text_y = y + PADDING + GRAPH_HEIGHT + PADDING;
+  float legend_x = x + PADDING + graph_width + PADDING;
+  PangoRectangle logical;
+  CoglColor text_color;
+
+  cogl_color_init_from_4f (&text_color, 1, 1, 1, 1);
+
+  g_string_set_size (overlay->text, 0);
+  overlay->n_sections = 0;
+
+  rut_profile_foreach_timer (add_timer_cb, overlay);
+  g_string_append_c (overlay->text, '\n');
+  rut_profile_foreach_counter (add_counter_cb, overlay);
+
+  pango_layout_set_text (overlay->layout,
+                         overlay->text->str,
+                         overlay->text->len);
+  pango_layout_get_pixel_extents (overlay->layout, NULL, &logical);
+
+  cogl_framebuffer_draw_rectangle (fb,
+                                   overlay->bg_pipeline,
+                                   x, y,
+                                   x + PADDING +
+                                   MAX (logical.width,
+                                        graph_width + PADDING + LEGEND_WIDTH) +
+                                   PADDING,
+                                   text_y + logical.height + PADDING);
+
+  cogl_pango_show_layout (fb, overlay->layout,
+                          x + PADDING, text_y,
+                          &text_color);
+
+  paint_graph (overlay, fb, x + PADDING, y + PADDING);
+
+  paint_legend (overlay, fb, legend_x, y + PADDING, &text_color);
+}
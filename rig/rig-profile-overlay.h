@@ -0,0 +1,47 @@
+/*
+ * Rig
+ *
+ * Copyright (C) 2013  Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _RIG_PROFILE_OVERLAY_H_
+#define _RIG_PROFILE_OVERLAY_H_
+
+#include <rut.h>
+
+/* Draws the state of the built-in profiler (see rut-profile.h) on
+ * top of the editor: a stacked graph of the top level timers over the
+ * last RUT_PROFILE_N_FRAMES frames followed by the per-frame timer
+ * and counter values of the most recent frame. */
+typedef struct _RigProfileOverlay RigProfileOverlay;
+
+RigProfileOverlay *
+rig_profile_overlay_new (RutContext *ctx);
+
+void
+rig_profile_overlay_free (RigProfileOverlay *overlay);
+
+/* The framebuffer is expected to have a 2D projection in pixels
+ * already flushed */
+void
+rig_profile_overlay_paint (RigProfileOverlay *overlay,
+                           CoglFramebuffer *fb,
+                           float x,
+                           float y);
+
+#endif /* _RIG_PROFILE_OVERLAY_H_ */
@@ -20,6 +20,9 @@
 
 #include <config.h>
 
+#include <math.h>
+#include <string.h>
+
 #include <rut.h>
 
 #include "rig-engine.h"
@@ -32,6 +35,8 @@ struct _RigRenderer
   int ref_count;
 
   GArray *journal;
+
+  RigRendererStats stats;
 };
 
 typedef enum _CacheSlot
@@ -172,7 +177,10 @@ set_entity_primitive_cache (RutEntity *entity,
 
   priv->primitive_caches[slot] = primitive;
   if (primitive)
-    cogl_object_ref (primitive);
+    {
+      cogl_object_ref (primitive);
+      priv->renderer->stats.primitives_rebuilt++;
+    }
 }
 
 static CoglPrimitive *
@@ -947,12 +955,15 @@ get_entity_mask_pipeline (RigEngine *engine,
                           RutImageSource **sources,
                           GetPipelineFlags flags)
 {
+  RigRenderer *renderer = engine->renderer;
   CoglPipeline *pipeline;
 
   pipeline = get_entity_pipeline_cache (entity, CACHE_SLOT_SHADOW);
 
   if (pipeline)
     {
+      renderer->stats.pipelines_cached++;
+
       if (sources[SOURCE_TYPE_COLOR] &&
           rut_object_get_type (geometry) == &rut_pointalism_grid_type)
         {
@@ -995,6 +1006,8 @@ get_entity_mask_pipeline (RigEngine *engine,
       return cogl_object_ref (pipeline);
     }
 
+  renderer->stats.pipelines_created++;
+
   if (rut_object_get_type (geometry) == &rut_diamond_type)
     {
       pipeline = cogl_object_ref (engine->dof_diamond_pipeline);
@@ -1104,6 +1117,7 @@ get_entity_color_pipeline (RigEngine *engine,
                            GetPipelineFlags flags,
                            CoglBool blended)
 {
+  RigRenderer *renderer = engine->renderer;
   CoglDepthState depth_state;
   CoglPipeline *pipeline;
   CoglPipeline *fin_pipeline;
@@ -1138,10 +1152,13 @@ get_entity_color_pipeline (RigEngine *engine,
 
   if (pipeline)
     {
+      renderer->stats.pipelines_cached++;
       cogl_object_ref (pipeline);
       goto FOUND;
     }
 
+  renderer->stats.pipelines_created++;
+
   pipeline = cogl_pipeline_new (engine->ctx->cogl_context);
 
   if (sources[SOURCE_TYPE_COLOR])
@@ -1458,6 +1475,7 @@ get_entity_pipeline (RigEngine *engine,
                      RutComponent *geometry,
                      RigPass pass)
 {
+  RigRenderer *renderer = engine->renderer;
   RutMaterial *material =
     rut_entity_get_component (entity, RUT_COMPONENT_TYPE_MATERIAL);
   RutImageSource *sources[3];
@@ -1489,6 +1507,7 @@ get_entity_pipeline (RigEngine *engine,
   if (asset && !sources[SOURCE_TYPE_COLOR])
     {
       sources[SOURCE_TYPE_COLOR] = rut_image_source_new (engine->ctx, asset);
+      renderer->stats.image_sources_created++;
 
       set_entity_image_source_cache (entity,
                                      SOURCE_TYPE_COLOR,
@@ -1513,6 +1532,7 @@ get_entity_pipeline (RigEngine *engine,
   if (asset && !sources[SOURCE_TYPE_ALPHA_MASK])
     {
       sources[SOURCE_TYPE_ALPHA_MASK] = rut_image_source_new (engine->ctx, asset);
+      renderer->stats.image_sources_created++;
 
       set_entity_image_source_cache (entity, 1, sources[SOURCE_TYPE_ALPHA_MASK]);
 #warning "FIXME: we need to track this as renderer priv since we're leaking closures a.t.m"
@@ -1537,6 +1557,7 @@ get_entity_pipeline (RigEngine *engine,
   if (asset && !sources[SOURCE_TYPE_NORMAL_MAP])
     {
       sources[SOURCE_TYPE_NORMAL_MAP] = rut_image_source_new (engine->ctx, asset);
+      renderer->stats.image_sources_created++;
 
       set_entity_image_source_cache (entity, 2, sources[SOURCE_TYPE_NORMAL_MAP]);
 #warning "FIXME: we need to track this as renderer priv since we're leaking closures a.t.m"
@@ -1569,6 +1590,52 @@ get_entity_pipeline (RigEngine *engine,
   g_warn_if_reached ();
   return NULL;
 }
+
+/* Estimates how many pixels across the bounding sphere of @model is
+ * when drawn with @modelview into @fb */
+static float
+get_model_screen_size (RutModel *model,
+                       CoglFramebuffer *fb,
+                       const CoglMatrix *modelview)
+{
+  CoglMatrix projection;
+  float x = (model->min_x + model->max_x) / 2.0f;
+  float y = (model->min_y + model->max_y) / 2.0f;
+  float z = (model->min_z + model->max_z) / 2.0f;
+  float w = 1;
+  float dx = model->max_x - model->min_x;
+  float dy = model->max_y - model->min_y;
+  float dz = model->max_z - model->min_z;
+  float radius = sqrtf (dx * dx + dy * dy + dz * dz) / 2.0f;
+  float scale_x, scale_y, scale_z, scale;
+  float viewport_height = cogl_framebuffer_get_viewport_height (fb);
+
+  scale_x = sqrtf (modelview->xx * modelview->xx +
+                   modelview->yx * modelview->yx +
+                   modelview->zx * modelview->zx);
+  scale_y = sqrtf (modelview->xy * modelview->xy +
+                   modelview->yy * modelview->yy +
+                   modelview->zy * modelview->zy);
+  scale_z = sqrtf (modelview->xz * modelview->xz +
+                   modelview->yz * modelview->yz +
+                   modelview->zz * modelview->zz);
+  scale = MAX (scale_x, MAX (scale_y, scale_z));
+  radius *= scale;
+
+  cogl_matrix_transform_point (modelview, &x, &y, &z, &w);
+  cogl_framebuffer_get_projection_matrix (fb, &projection);
+
+  /* An orthographic projection doesn't depend on the distance */
+  if (projection.wz == 0)
+    return radius * projection.yy * viewport_height;
+
+  /* Always use full detail when the camera is inside the sphere */
+  if (-z <= radius)
+    return G_MAXFLOAT;
+
+  return radius * projection.yy * viewport_height / -z;
+}
+
 static void
 get_normal_matrix (const CoglMatrix *matrix,
                    float *normal_matrix)
@@ -1625,6 +1692,13 @@ rig_renderer_flush_journal (RigRenderer *renderer,
   int start, dir, end;
   int i;
 
+  RUT_STATIC_COUNTER (journal_entry_counter,
+                      "Journal entries",
+                      "Increments for each primitive queued for a pass",
+                      0);
+
+  RUT_COUNTER_ADD (journal_entry_counter, journal->len);
+
   /* TODO: use an inline qsort implementation */
   g_array_sort (journal, (void *)sort_entry_cb);
 
@@ -1667,6 +1741,7 @@ rig_renderer_flush_journal (RigRenderer *renderer,
         {
           cogl_framebuffer_set_modelview_matrix (fb, &entry->matrix);
           rut_paintable_paint (geometry, rut_paint_ctx);
+          renderer->stats.draw_calls++;
           continue;
         }
 
@@ -1772,15 +1847,40 @@ rig_renderer_flush_journal (RigRenderer *renderer,
        * Draw Primitive...
        */
 
-      primitive = get_entity_primitive_cache (entity, 0);
-      if (!primitive)
+      /* Models with levels of detail need to pick a primitive each
+       * time they are drawn according to their size on screen */
+      if (rut_object_get_type (geometry) == &rut_model_type &&
+          RUT_MODEL (geometry)->n_lods)
         {
-          primitive = rut_primable_get_primitive (geometry);
-          set_entity_primitive_cache (entity, 0, primitive);
+          float screen_size =
+            get_model_screen_size (geometry, fb, &entry->matrix);
+
+          primitive = rut_model_get_lod_primitive (geometry, screen_size);
+        }
+      else
+        {
+          primitive = get_entity_primitive_cache (entity, 0);
+          if (!primitive)
+            {
+              primitive = rut_primable_get_primitive (geometry);
+              set_entity_primitive_cache (entity, 0, primitive);
+            }
         }
 
       cogl_framebuffer_set_modelview_matrix (fb, &entry->matrix);
 
+      /* Quantized positions need to be mapped back into model space.
+       * The normal matrix is deliberately derived from the entity
+       * matrix alone since the normals aren't scaled. */
+      if (rut_object_get_type (geometry) == &rut_model_type)
+        {
+          const CoglMatrix *position_matrix =
+            rut_model_get_position_matrix (geometry);
+
+          if (position_matrix)
+            cogl_framebuffer_transform (fb, position_matrix);
+        }
+
       if (hair)
         {
           CoglTexture *texture;
@@ -1790,6 +1890,7 @@ rig_renderer_flush_journal (RigRenderer *renderer,
             {
               RutModel *model = geometry;
               cogl_primitive_draw (model->fin_primitive, fb, fin_pipeline);
+              renderer->stats.draw_calls++;
             }
 
           if (paint_ctx->pass == RIG_PASS_COLOR_BLENDED)
@@ -1815,6 +1916,8 @@ rig_renderer_flush_journal (RigRenderer *renderer,
            * make sure we reduce the work involved in blending all
            * the shells on top. */
           cogl_primitive_draw (primitive, fb, pipeline);
+          renderer->stats.draw_calls++;
+          renderer->stats.hair_shell_draws++;
 
           cogl_pipeline_set_alpha_test_function (pipeline,
                                                  COGL_PIPELINE_ALPHA_FUNC_GREATER, 0.49);
@@ -1832,10 +1935,15 @@ rig_renderer_flush_journal (RigRenderer *renderer,
                                                 hair_pos);
 
               cogl_primitive_draw (primitive, fb, pipeline);
+              renderer->stats.draw_calls++;
+              renderer->stats.hair_shell_draws++;
             }
         }
       else
-        cogl_primitive_draw (primitive, fb, pipeline);
+        {
+          cogl_primitive_draw (primitive, fb, pipeline);
+          renderer->stats.draw_calls++;
+        }
 
       cogl_object_unref (pipeline);
 
@@ -1950,18 +2058,29 @@ entitygraph_pre_paint_cb (RutObject *object,
       RutObject *geometry;
       CoglMatrix matrix;
       RigRendererPriv *priv;
+      RigRendererPassStats *pass_stats =
+        &renderer->stats.passes[paint_ctx->pass];
+
+      pass_stats->entities_traversed++;
 
       material = rut_entity_get_component (entity, RUT_COMPONENT_TYPE_MATERIAL);
       if (!material || !rut_material_get_visible (material))
-        return RUT_TRAVERSE_VISIT_CONTINUE;
+        {
+          pass_stats->entities_culled++;
+          return RUT_TRAVERSE_VISIT_CONTINUE;
+        }
 
       if (paint_ctx->pass == RIG_PASS_SHADOW && !rut_material_get_cast_shadow (material))
-        return RUT_TRAVERSE_VISIT_CONTINUE;
+        {
+          pass_stats->entities_culled++;
+          return RUT_TRAVERSE_VISIT_CONTINUE;
+        }
 
       geometry =
         rut_entity_get_component (object, RUT_COMPONENT_TYPE_GEOMETRY);
       if (!geometry)
         {
+          pass_stats->entities_culled++;
           if (!paint_ctx->engine->play_mode &&
               object == paint_ctx->engine->light)
             draw_entity_camera_frustum (paint_ctx->engine, object, fb);
@@ -1996,6 +2115,7 @@ entitygraph_pre_paint_cb (RutObject *object,
         }
 
       cogl_framebuffer_get_modelview_matrix (fb, &matrix);
+      pass_stats->entities_logged++;
       rig_journal_log (renderer->journal,
                        paint_ctx,
                        entity,
@@ -2030,6 +2150,47 @@ entitygraph_post_paint_cb (RutObject *object,
  * view camera. For example we will refer to the background color
  * of the play camera to visualize while rendering the view camera.
  */
+RUT_STATIC_TIMER (shadow_pass_timer,
+                  "Paint",
+                  "Shadow pass",
+                  "Rendering the shadow map from the light",
+                  0);
+RUT_STATIC_TIMER (dof_depth_pass_timer,
+                  "Paint",
+                  "Depth of field pass",
+                  "Rendering the depth buffer for the depth of field effect",
+                  0);
+RUT_STATIC_TIMER (unblended_pass_timer,
+                  "Paint",
+                  "Opaque pass",
+                  "Rendering opaque geometry",
+                  0);
+RUT_STATIC_TIMER (blended_pass_timer,
+                  "Paint",
+                  "Blended pass",
+                  "Rendering transparent geometry",
+                  0);
+
+static RutProfileTimer *
+get_pass_timer (RigPass pass)
+{
+  switch (pass)
+    {
+    case RIG_PASS_SHADOW:
+      return &shadow_pass_timer;
+    case RIG_PASS_DOF_DEPTH:
+      return &dof_depth_pass_timer;
+    case RIG_PASS_COLOR_UNBLENDED:
+      return &unblended_pass_timer;
+    case RIG_PASS_COLOR_BLENDED:
+      return &blended_pass_timer;
+    }
+
+  g_warn_if_reached ();
+
+  return &blended_pass_timer;
+}
+
 void
 rig_paint_camera_entity (RutEntity *view_camera,
                          RigPaintContext *paint_ctx,
@@ -2043,6 +2204,9 @@ rig_paint_camera_entity (RutEntity *view_camera,
   RigEngine *engine = paint_ctx->engine;
   CoglContext *ctx = engine->ctx->cogl_context;
   CoglFramebuffer *fb = rut_camera_get_framebuffer (camera);
+  RutProfileTimer *pass_timer = get_pass_timer (paint_ctx->pass);
+
+  RUT_TIMER_START (*pass_timer);
 
   rut_paint_ctx->camera = camera;
 
@@ -2076,4 +2240,38 @@ rig_paint_camera_entity (RutEntity *view_camera,
   rut_camera_end_frame (camera);
 
   rut_paint_ctx->camera = saved_camera;
+
+  RUT_TIMER_STOP (*pass_timer);
+}
+
+const RigRendererStats *
+rig_renderer_get_stats (RigRenderer *renderer)
+{
+  return &renderer->stats;
+}
+
+void
+rig_renderer_reset_stats (RigRenderer *renderer)
+{
+  memset (&renderer->stats, 0, sizeof (renderer->stats));
+}
+
+const char *
+rig_pass_get_name (RigPass pass)
+{
+  switch (pass)
+    {
+    case RIG_PASS_COLOR_UNBLENDED:
+      return "Opaque";
+    case RIG_PASS_COLOR_BLENDED:
+      return "Blended";
+    case RIG_PASS_SHADOW:
+      return "Shadow";
+    case RIG_PASS_DOF_DEPTH:
+      return "DoF depth";
+    }
+
+  g_warn_if_reached ();
+
+  return "Unknown";
 }
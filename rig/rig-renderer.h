@@ -44,6 +44,39 @@ typedef struct _RigPaintContext
 
 typedef struct _RigRenderer RigRenderer;
 
+#define RIG_N_PASSES (RIG_PASS_DOF_DEPTH + 1)
+
+typedef struct _RigRendererPassStats
+{
+  /* All entities visited while traversing the scene for this pass */
+  int entities_traversed;
+  /* Entities skipped because they are invisible, don't cast a shadow
+   * in the shadow pass or have no geometry */
+  int entities_culled;
+  /* Entities added to the journal to be drawn */
+  int entities_logged;
+} RigRendererPassStats;
+
+/* Statistics about the work done by the renderer, reset at the start
+ * of each frame by rig_renderer_reset_stats() */
+typedef struct _RigRendererStats
+{
+  RigRendererPassStats passes[RIG_N_PASSES];
+
+  int draw_calls;
+
+  /* Pipelines built by get_entity_pipeline() vs served from an
+   * entity's pipeline cache */
+  int pipelines_created;
+  int pipelines_cached;
+
+  int primitives_rebuilt;
+  int image_sources_created;
+
+  /* Every shell of every hair component is a separate draw */
+  int hair_shell_draws;
+} RigRendererStats;
+
 extern RutType rig_renderer_type;
 
 RigRenderer *
@@ -69,4 +102,13 @@ rig_renderer_init (RigEngine *engine);
 void
 rig_renderer_fini (RigEngine *engine);
 
+const RigRendererStats *
+rig_renderer_get_stats (RigRenderer *renderer);
+
+void
+rig_renderer_reset_stats (RigRenderer *renderer);
+
+const char *
+rig_pass_get_name (RigPass pass);
+
 #endif /* _RIG_RENDERER_H_ */
@@ -0,0 +1,563 @@
+/*
+ * Rig
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include <rut.h>
+
+#include "rig-search-index.h"
+
+/* The longest n-grams that are indexed. Searches up to this long are
+ * answered by a single lookup and longer searches intersect the
+ * objects of each of their n-grams */
+#define MAX_GRAM 3
+
+typedef struct _Document
+{
+  RutObject *object;
+
+  /* Lower case, or NULL */
+  char *text;
+
+  /* Interned strings */
+  GList *tags;
+
+  /* Used to keep results in the order the objects were added */
+  unsigned int serial;
+
+  bool seen;
+} Document;
+
+struct _RigSearchIndex
+{
+  /* Maps objects to Documents */
+  GHashTable *documents;
+
+  /* Map packed n-grams and tags respectively to sets of Documents.
+   * Empty sets are removed. */
+  GHashTable *grams;
+  GHashTable *tags;
+
+  unsigned int next_serial;
+
+  RigSearchIndexRemovedCallback removed_cb;
+  void *user_data;
+};
+
+/* NB: The length is packed into the top byte so that n-grams that are
+ * prefixes of each other get different keys and no key is zero */
+static void *
+pack_gram (const char *text, int n)
+{
+  uint32_t key = n << 24;
+  int i;
+
+  for (i = 0; i < n; i++)
+    key |= (uint8_t)text[i] << (16 - i * 8);
+
+  return GUINT_TO_POINTER (key);
+}
+
+static GHashTable *
+set_new (void)
+{
+  return g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+static void
+postings_add (GHashTable *postings,
+              void *key,
+              Document *doc)
+{
+  GHashTable *set = g_hash_table_lookup (postings, key);
+
+  if (set == NULL)
+    {
+      set = set_new ();
+      g_hash_table_insert (postings, key, set);
+    }
+
+  g_hash_table_insert (set, doc, doc);
+}
+
+static void
+postings_remove (GHashTable *postings,
+                 void *key,
+                 Document *doc)
+{
+  GHashTable *set = g_hash_table_lookup (postings, key);
+
+  if (set == NULL)
+    return;
+
+  g_hash_table_remove (set, doc);
+
+  if (g_hash_table_size (set) == 0)
+    g_hash_table_remove (postings, key);
+}
+
+static void
+add_postings (RigSearchIndex *index,
+              Document *doc)
+{
+  GList *l;
+
+  if (doc->text)
+    {
+      int len = strlen (doc->text);
+      int i, n;
+
+      for (i = 0; i < len; i++)
+        for (n = 1; n <= MAX_GRAM && i + n <= len; n++)
+          postings_add (index->grams, pack_gram (doc->text + i, n), doc);
+    }
+
+  for (l = doc->tags; l; l = l->next)
+    postings_add (index->tags, l->data, doc);
+}
+
+static void
+remove_postings (RigSearchIndex *index,
+                 Document *doc)
+{
+  GList *l;
+
+  if (doc->text)
+    {
+      int len = strlen (doc->text);
+      int i, n;
+
+      for (i = 0; i < len; i++)
+        for (n = 1; n <= MAX_GRAM && i + n <= len; n++)
+          postings_remove (index->grams, pack_gram (doc->text + i, n), doc);
+    }
+
+  for (l = doc->tags; l; l = l->next)
+    postings_remove (index->tags, l->data, doc);
+}
+
+static void
+document_free (Document *doc)
+{
+  g_free (doc->text);
+  g_list_free (doc->tags);
+  g_slice_free (Document, doc);
+}
+
+RigSearchIndex *
+rig_search_index_new (RigSearchIndexRemovedCallback removed_cb,
+                      void *user_data)
+{
+  RigSearchIndex *index = g_slice_new0 (RigSearchIndex);
+
+  index->documents = g_hash_table_new (g_direct_hash, g_direct_equal);
+  index->grams = g_hash_table_new_full (g_direct_hash,
+                                        g_direct_equal,
+                                        NULL, /* key destroy */
+                                        (GDestroyNotify)g_hash_table_destroy);
+  /* NB: the keys are the interned tags of the documents */
+  index->tags = g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       NULL, /* key destroy */
+                                       (GDestroyNotify)g_hash_table_destroy);
+
+  index->removed_cb = removed_cb;
+  index->user_data = user_data;
+
+  return index;
+}
+
+void
+rig_search_index_free (RigSearchIndex *index)
+{
+  rig_search_index_remove_all (index);
+
+  g_hash_table_destroy (index->documents);
+  g_hash_table_destroy (index->grams);
+  g_hash_table_destroy (index->tags);
+
+  g_slice_free (RigSearchIndex, index);
+}
+
+static bool
+tags_equal (const GList *interned_tags,
+            const GList *tags)
+{
+  for (; interned_tags && tags;
+       interned_tags = interned_tags->next, tags = tags->next)
+    {
+      if (strcmp (interned_tags->data, tags->data) != 0)
+        return false;
+    }
+
+  return interned_tags == NULL && tags == NULL;
+}
+
+void
+rig_search_index_add (RigSearchIndex *index,
+                      RutObject *object,
+                      const char *text,
+                      const GList *tags)
+{
+  Document *doc = g_hash_table_lookup (index->documents, object);
+  char *normalized_text = text ? g_ascii_strdown (text, -1) : NULL;
+  const GList *l;
+
+  if (doc)
+    {
+      doc->seen = true;
+
+      /* Objects are re-added whenever something might have changed so
+       * this is the common case */
+      if (g_strcmp0 (doc->text, normalized_text) == 0 &&
+          tags_equal (doc->tags, tags))
+        {
+          g_free (normalized_text);
+          return;
+        }
+
+      remove_postings (index, doc);
+      g_free (doc->text);
+      g_list_free (doc->tags);
+      doc->tags = NULL;
+    }
+  else
+    {
+      doc = g_slice_new0 (Document);
+      doc->object = rut_refable_ref (object);
+      doc->serial = index->next_serial++;
+      doc->seen = true;
+
+      g_hash_table_insert (index->documents, object, doc);
+    }
+
+  doc->text = normalized_text;
+
+  for (l = tags; l; l = l->next)
+    doc->tags = g_list_prepend (doc->tags, (char *)g_intern_string (l->data));
+  doc->tags = g_list_reverse (doc->tags);
+
+  add_postings (index, doc);
+}
+
+static void
+remove_document (RigSearchIndex *index,
+                 Document *doc)
+{
+  RutObject *object = doc->object;
+
+  remove_postings (index, doc);
+  document_free (doc);
+
+  if (index->removed_cb)
+    index->removed_cb (object, index->user_data);
+
+  rut_refable_unref (object);
+}
+
+void
+rig_search_index_remove (RigSearchIndex *index,
+                         RutObject *object)
+{
+  Document *doc = g_hash_table_lookup (index->documents, object);
+
+  if (doc == NULL)
+    return;
+
+  g_hash_table_remove (index->documents, object);
+  remove_document (index, doc);
+}
+
+static gboolean
+remove_all_cb (void *key,
+               void *value,
+               void *user_data)
+{
+  remove_document (user_data, value);
+  return TRUE;
+}
+
+void
+rig_search_index_remove_all (RigSearchIndex *index)
+{
+  g_hash_table_foreach_remove (index->documents, remove_all_cb, index);
+}
+
+void
+rig_search_index_begin_scan (RigSearchIndex *index)
+{
+  GHashTableIter iter;
+  void *value;
+
+  g_hash_table_iter_init (&iter, index->documents);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Document *doc = value;
+      doc->seen = false;
+    }
+}
+
+static gboolean
+remove_unseen_cb (void *key,
+                  void *value,
+                  void *user_data)
+{
+  Document *doc = value;
+
+  if (doc->seen)
+    return FALSE;
+
+  remove_document (user_data, doc);
+  return TRUE;
+}
+
+void
+rig_search_index_end_scan (RigSearchIndex *index)
+{
+  g_hash_table_foreach_remove (index->documents, remove_unseen_cb, index);
+}
+
+static void
+add_set_to_results (GHashTable *set,
+                    GHashTable *results)
+{
+  GHashTableIter iter;
+  void *key;
+
+  g_hash_table_iter_init (&iter, set);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_hash_table_insert (results, key, key);
+}
+
+/* Adds the documents that are in every one of @sets to @results.
+ * Only the smallest set is iterated. */
+static void
+add_intersection_to_results (GHashTable **sets,
+                             int n_sets,
+                             GHashTable *results)
+{
+  GHashTableIter iter;
+  void *key;
+  int smallest = 0;
+  int i;
+
+  for (i = 1; i < n_sets; i++)
+    {
+      if (g_hash_table_size (sets[i]) < g_hash_table_size (sets[smallest]))
+        smallest = i;
+    }
+
+  g_hash_table_iter_init (&iter, sets[smallest]);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      for (i = 0; i < n_sets; i++)
+        {
+          if (i != smallest && !g_hash_table_lookup (sets[i], key))
+            break;
+        }
+
+      if (i == n_sets)
+        g_hash_table_insert (results, key, key);
+    }
+}
+
+static void
+find_text (RigSearchIndex *index,
+           const char *search,
+           GHashTable *results)
+{
+  int len = strlen (search);
+  GHashTable **sets;
+  GHashTable *candidates;
+  GHashTableIter iter;
+  void *key;
+  int n_sets;
+  int i;
+
+  /* Everything with some text contains the empty string */
+  if (len == 0)
+    {
+      g_hash_table_iter_init (&iter, index->documents);
+      while (g_hash_table_iter_next (&iter, NULL, &key))
+        {
+          Document *doc = key;
+          if (doc->text)
+            g_hash_table_insert (results, doc, doc);
+        }
+      return;
+    }
+
+  if (len <= MAX_GRAM)
+    {
+      GHashTable *set = g_hash_table_lookup (index->grams,
+                                             pack_gram (search, len));
+      if (set)
+        add_set_to_results (set, results);
+      return;
+    }
+
+  n_sets = len - MAX_GRAM + 1;
+  sets = g_alloca (sizeof (GHashTable *) * n_sets);
+
+  for (i = 0; i < n_sets; i++)
+    {
+      sets[i] = g_hash_table_lookup (index->grams,
+                                     pack_gram (search + i, MAX_GRAM));
+      if (sets[i] == NULL)
+        return;
+    }
+
+  /* Having all the trigrams of the search doesn't mean they are in
+   * the same order so the candidates still need to be checked */
+  candidates = set_new ();
+  add_intersection_to_results (sets, n_sets, candidates);
+
+  g_hash_table_iter_init (&iter, candidates);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      Document *doc = key;
+      if (strstr (doc->text, search))
+        g_hash_table_insert (results, doc, doc);
+    }
+
+  g_hash_table_destroy (candidates);
+}
+
+static void
+find_all_tags (RigSearchIndex *index,
+               const char *search,
+               GHashTable *results)
+{
+  char **words = g_strsplit_set (search, " \t", 0);
+  int n_words = g_strv_length (words);
+  GHashTable **sets = g_alloca (sizeof (GHashTable *) * (n_words + 1));
+  int n_sets = 0;
+  int i;
+
+  for (i = 0; words[i]; i++)
+    {
+      /* Repeated whitespace results in empty words */
+      if (words[i][0] == '\0')
+        continue;
+
+      sets[n_sets] = g_hash_table_lookup (index->tags, words[i]);
+      if (sets[n_sets] == NULL)
+        goto DONE;
+      n_sets++;
+    }
+
+  if (n_sets)
+    add_intersection_to_results (sets, n_sets, results);
+
+DONE:
+  g_strfreev (words);
+}
+
+static bool
+document_has_any_tag (Document *doc,
+                      const GList *tags)
+{
+  const GList *l;
+
+  for (l = tags; l; l = l->next)
+    {
+      if (rut_util_find_tag (doc->tags, l->data))
+        return true;
+    }
+
+  return false;
+}
+
+static int
+compare_serial_cb (const void *a, const void *b)
+{
+  const Document *doc_a = *(const Document **)a;
+  const Document *doc_b = *(const Document **)b;
+
+  return (doc_a->serial > doc_b->serial) - (doc_a->serial < doc_b->serial);
+}
+
+GList *
+rig_search_index_query (RigSearchIndex *index,
+                        const char *search,
+                        const GList *any_tags)
+{
+  GHashTable *results = set_new ();
+  GPtrArray *sorted;
+  GHashTableIter iter;
+  void *key;
+  GList *ret = NULL;
+  const GList *l;
+  int i;
+
+  if (search)
+    {
+      char *normalized_search = g_ascii_strdown (search, -1);
+
+      find_text (index, normalized_search, results);
+      find_all_tags (index, normalized_search, results);
+
+      g_free (normalized_search);
+    }
+  else if (any_tags)
+    {
+      for (l = any_tags; l; l = l->next)
+        {
+          GHashTable *set = g_hash_table_lookup (index->tags, l->data);
+          if (set)
+            add_set_to_results (set, results);
+        }
+    }
+  else
+    {
+      g_hash_table_iter_init (&iter, index->documents);
+      while (g_hash_table_iter_next (&iter, NULL, &key))
+        g_hash_table_insert (results, key, key);
+    }
+
+  sorted = g_ptr_array_sized_new (g_hash_table_size (results));
+
+  g_hash_table_iter_init (&iter, results);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (search && any_tags && !document_has_any_tag (key, any_tags))
+        continue;
+
+      g_ptr_array_add (sorted, key);
+    }
+
+  g_ptr_array_sort (sorted, compare_serial_cb);
+
+  for (i = sorted->len - 1; i >= 0; i--)
+    {
+      Document *doc = g_ptr_array_index (sorted, i);
+      ret = g_list_prepend (ret, doc->object);
+    }
+
+  g_ptr_array_free (sorted, TRUE);
+  g_hash_table_destroy (results);
+
+  return ret;
+}
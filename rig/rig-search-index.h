@@ -0,0 +1,93 @@
+/*
+ * Rig
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RIG_SEARCH_INDEX_H_
+#define _RIG_SEARCH_INDEX_H_
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include <rut.h>
+
+/* An inverted index used by the editor to search for objects without
+ * having to compare the search against every object.
+ *
+ * Each object is indexed by a text, such as an asset path or entity
+ * label, and a list of tags. The text is case insensitively split into
+ * every n-gram of up to three bytes so a substring search only has to
+ * intersect the objects listed for the trigrams of the search before
+ * confirming the matches.
+ *
+ * The index keeps a reference on every object it contains.
+ */
+typedef struct _RigSearchIndex RigSearchIndex;
+
+/* Called whenever an object leaves the index, just before the index
+ * drops its reference */
+typedef void (*RigSearchIndexRemovedCallback) (RutObject *object,
+                                               void *user_data);
+
+RigSearchIndex *
+rig_search_index_new (RigSearchIndexRemovedCallback removed_cb,
+                      void *user_data);
+
+void
+rig_search_index_free (RigSearchIndex *index);
+
+/* Adds @object or, if it's already in the index, updates its text and
+ * tags. Objects with a NULL @text are only found by tag or by a NULL
+ * search. */
+void
+rig_search_index_add (RigSearchIndex *index,
+                      RutObject *object,
+                      const char *text,
+                      const GList *tags);
+
+void
+rig_search_index_remove (RigSearchIndex *index,
+                         RutObject *object);
+
+void
+rig_search_index_remove_all (RigSearchIndex *index);
+
+/* Objects that aren't added between rig_search_index_begin_scan() and
+ * rig_search_index_end_scan() are removed. */
+void
+rig_search_index_begin_scan (RigSearchIndex *index);
+
+void
+rig_search_index_end_scan (RigSearchIndex *index);
+
+/* Returns a list of the objects whose text contains @search, or that
+ * have a tag for every whitespace separated word in @search. A NULL
+ * @search matches every object. If @any_tags isn't NULL then only
+ * objects with at least one of those tags are returned.
+ *
+ * The objects are listed in the order they were first added. The list
+ * should be freed with g_list_free() and the objects aren't referenced
+ * so it shouldn't be kept across changes to the index.
+ */
+GList *
+rig_search_index_query (RigSearchIndex *index,
+                        const char *search,
+                        const GList *any_tags);
+
+#endif /* _RIG_SEARCH_INDEX_H_ */
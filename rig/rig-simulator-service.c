@@ -67,6 +67,12 @@ simulator__load (Rig__Simulator_Service *service,
 
   rig_pb_unserialize_ui (unserializer, ui, false);
 
+  if (rig_pb_unserializer_get_schema_mismatch (unserializer))
+    {
+      result.has_schema_mismatch = true;
+      result.schema_mismatch = true;
+    }
+
   rig_pb_unserializer_destroy (unserializer);
 
   closure (&result, closure_data);
@@ -86,6 +92,8 @@ simulator__run_frame (Rig__Simulator_Service *service,
 
   g_return_if_fail (setup != NULL);
 
+  RUT_TRACE_INSTANT ("RunFrame receive", NULL);
+
   g_print ("Simulator: Run Frame Request: n_events = %d\n",
            setup->n_events);
 
@@ -44,6 +44,8 @@ static void
 handle_update_ui_ack (const Rig__UpdateUIAck *result,
                       void *closure_data)
 {
+  RUT_TRACE_INSTANT ("UpdateUI ack", NULL);
+
   g_print ("Simulator: UI Update ACK received\n");
 }
 
@@ -71,6 +73,9 @@ rig_simulator_run_frame (RutShell *shell, void *user_data)
   g_print ("Simulator: Sending UI Update\n");
 
   rig__uidiff__init (&ui_diff);
+
+  RUT_TRACE_INSTANT ("UpdateUI send", NULL);
+
   rig__frontend__update_ui (frontend_service,
                             &ui_diff,
                             handle_update_ui_ack,
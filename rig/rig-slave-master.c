@@ -38,6 +38,18 @@ static void
 handle_load_response (const Rig__LoadResult *result,
                       void *closure_data)
 {
+  RigSlaveMaster *master = closure_data;
+
+  if (result && result->schema_mismatch &&
+      !master->packed_disabled)
+    {
+      g_warning ("Slave has different properties, resending the UI "
+                 "without packing it");
+      master->packed_disabled = true;
+      rig_slave_master_sync_ui (master);
+      return;
+    }
+
   g_print ("UI loaded by slave\n");
 }
 
@@ -174,9 +186,13 @@ rig_slave_master_sync_ui (RigSlaveMaster *master)
 
   serializer = rig_pb_serializer_new (engine);
 
+  rig_pb_serializer_set_quantize_meshes_enabled (serializer,
+                                                 rut_mesh_quantize_is_enabled ());
+  rig_pb_serializer_set_packed_enabled (serializer, !master->packed_disabled);
+
   ui = rig_pb_serialize_ui (serializer);
 
-  rig__slave__load (service, ui, handle_load_response, NULL);
+  rig__slave__load (service, ui, handle_load_response, master);
 
   rig_pb_serialized_ui_destroy (ui);
 
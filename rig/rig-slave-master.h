@@ -44,6 +44,10 @@ typedef struct _RigSlaveMaster
 
   GList *required_assets;
 
+  /* Set once the slave has reported that it can't load PACKED UIs
+   * from us */
+  bool packed_disabled;
+
 } RigSlaveMaster;
 
 void
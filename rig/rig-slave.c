@@ -81,6 +81,12 @@ slave__load (Rig__Slave_Service *service,
 
   rig_pb_unserialize_ui (unserializer, ui, false);
 
+  if (rig_pb_unserializer_get_schema_mismatch (unserializer))
+    {
+      result.has_schema_mismatch = true;
+      result.schema_mismatch = true;
+    }
+
   rig_pb_unserializer_destroy (unserializer);
 
   if (option_width > 0 && option_height > 0)
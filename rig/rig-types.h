@@ -26,5 +26,6 @@
  * struct */
 
 typedef struct _RigEngine RigEngine;
+typedef struct _RigSaveLog RigSaveLog;
 
 #endif /* _RIG_TYPES_H_ */
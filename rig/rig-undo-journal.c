@@ -1650,6 +1650,7 @@ rig_undo_journal_insert (RigUndoJournal *journal,
     }
 
   rut_list_insert (journal->undo_ops.prev, &undo_redo->list_node);
+  journal->n_changes++;
 
   dump_journal (journal, 0);
 
@@ -1700,6 +1701,7 @@ rig_undo_journal_undo (RigUndoJournal *journal)
         return false;
 
       rut_list_insert (journal->redo_ops.prev, &op->list_node);
+      journal->n_changes++;
 
       rut_shell_queue_redraw (journal->engine->shell);
 
@@ -1724,6 +1726,7 @@ rig_undo_journal_redo (RigUndoJournal *journal)
   undo_redo_apply (journal, op);
   rut_list_remove (&op->list_node);
   rut_list_insert (journal->undo_ops.prev, &op->list_node);
+  journal->n_changes++;
 
   rut_shell_queue_redraw (journal->engine->shell);
 
@@ -1758,6 +1761,12 @@ rig_undo_journal_is_empty (RigUndoJournal *journal)
           rut_list_length (&journal->redo_ops) == 0);
 }
 
+unsigned int
+rig_undo_journal_get_n_changes (RigUndoJournal *journal)
+{
+  return journal->n_changes;
+}
+
 void
 rig_undo_journal_free (RigUndoJournal *journal)
 {
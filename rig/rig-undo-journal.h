@@ -213,6 +213,11 @@ struct _RigUndoJournal
    * the top-level, master journal would set this to true.
    */
   bool apply_on_insert;
+
+  /* Counts every insert, undo and redo so that it's possible to tell
+   * whether the UI has changed since some earlier point, such as the
+   * last save */
+  unsigned int n_changes;
 };
 
 void
@@ -327,6 +332,11 @@ rig_undo_journal_set_apply_on_insert (RigUndoJournal *journal,
 bool
 rig_undo_journal_is_empty (RigUndoJournal *journal);
 
+/* Returns a count that changes whenever an operation is inserted,
+ * undone or redone */
+unsigned int
+rig_undo_journal_get_n_changes (RigUndoJournal *journal);
+
 void
 rig_undo_journal_free (RigUndoJournal *journal);
 
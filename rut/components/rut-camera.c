@@ -838,6 +838,7 @@ rut_camera_set_input_transform (RutCamera *camera,
                                 const CoglMatrix *input_transform)
 {
   camera->input_transform = *input_transform;
+  camera->input_transform_age++;
 }
 
 void
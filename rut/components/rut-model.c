@@ -21,12 +21,17 @@
 #include <config.h>
 
 #include <math.h>
+#include <stdlib.h>
 
 #include "rut-global.h"
 #include "rut-types.h"
 #include "rut-geometry.h"
 #include "rut-mesh.h"
 #include "rut-mesh-ply.h"
+#include "rut-mesh-cache.h"
+#include "rut-mesh-optimize.h"
+#include "rut-mesh-simplify.h"
+#include "rut-util.h"
 #include "rut-meshable.h"
 
 #include "components/rut-model.h"
@@ -74,13 +79,46 @@ struct _RutModelPrivate
   Vertex *fin_vertices;
   Polygon *polygons;
   Vertex *vertices;
-  RutBitmask adj_matrix;
+
+  /* The ids of the polygons that share an edge with polygon i, in
+   * ascending order, are stored in adjacent_polygons starting at
+   * adjacency_offsets[i] and ending before adjacency_offsets[i + 1] */
+  int *adjacency_offsets;
+  int *adjacent_polygons;
+
+  /* Used while growing texture patches. visited[i] holds the number of
+   * the last patch that reached polygon i and all the polygons before
+   * first_uncovered have already been covered by a patch */
+  int *visited;
+  int n_texture_patches;
+  int first_uncovered;
+
   int n_polygons;
   int n_vertices;
   int n_fin_polygons;
   int n_fin_vertices;
 };
 
+/* Derived meshes are cached in a hidden directory next to the asset
+ * they were generated from (see rut-mesh-cache.h). These need to be
+ * bumped whenever the code generating the meshes changes its output
+ * so that stale entries are no longer found. */
+#define MODEL_CACHE_KIND "rut-model-2"
+#define HAIR_MODEL_CACHE_KIND "rut-hair-model-1"
+#define MODEL_CACHE_DIRECTORY ".rig-cache"
+
+/* Models with fewer triangles than this are cheap enough to always
+ * draw at full detail */
+#define LOD_MIN_TRIANGLES 4096
+
+/* Each level of detail has this many times fewer triangles than the
+ * previous one */
+#define LOD_REDUCTION 4
+
+/* The density of triangles that a level of detail needs to provide
+ * relative to the area covered on screen, in triangles per pixel */
+#define LOD_TRIANGLES_PER_PIXEL 0.5f
+
 /* Some convinient constants */
 static float flat_normal[3] = { 0, 0, 1 };
 
@@ -94,7 +132,41 @@ rut_model_get_primitive (RutObject *object)
 
   if (!model->primitive)
     {
-      if (model->mesh)
+      /* NB: the position matrix for a mesh that was already quantized
+       * is set when the model is made */
+      if (model->quantized_mesh)
+        {
+          model->primitive =
+            rut_mesh_create_primitive (model->ctx, model->quantized_mesh);
+        }
+      else if (model->mesh && model->quantize_flags &&
+               !model->is_hair_model)
+        {
+          float scale[3], offset[3];
+          RutMesh *quantized = rut_mesh_quantize (model->mesh,
+                                                  model->quantize_flags,
+                                                  scale, offset);
+
+          if (quantized)
+            {
+              model->primitive =
+                rut_mesh_create_primitive (model->ctx, quantized);
+              rut_refable_unref (quantized);
+
+              if (model->quantize_flags & RUT_MESH_QUANTIZE_POSITIONS)
+                {
+                  cogl_matrix_init_translation (&model->position_matrix,
+                                                offset[0],
+                                                offset[1],
+                                                offset[2]);
+                  cogl_matrix_scale (&model->position_matrix,
+                                     scale[0], scale[1], scale[2]);
+                  model->has_position_matrix = true;
+                }
+            }
+        }
+
+      if (!model->primitive && model->mesh)
         {
           model->primitive =
             rut_mesh_create_primitive (model->ctx, model->mesh);
@@ -104,6 +176,60 @@ rut_model_get_primitive (RutObject *object)
   return model->primitive;
 }
 
+CoglPrimitive *
+rut_model_get_lod_primitive (RutModel *model,
+                             float screen_size)
+{
+  CoglPrimitive *primitive = rut_model_get_primitive (model);
+  float n_wanted = screen_size * screen_size * LOD_TRIANGLES_PER_PIXEL;
+  RutMesh *lod;
+  CoglIndices *indices;
+  int i;
+
+  if (!primitive)
+    return NULL;
+
+  for (i = model->n_lods - 1; i >= 0; i--)
+    if (model->lods[i]->n_indices / 3 >= n_wanted)
+      break;
+
+  if (i < 0)
+    return primitive;
+
+  if (model->lod_primitives[i])
+    return model->lod_primitives[i];
+
+  /* The levels of detail share their vertices with the full mesh so
+   * they can share the attribute buffers already uploaded for it */
+  lod = model->lods[i];
+  indices = cogl_indices_new (model->ctx->cogl_context,
+                              lod->indices_type,
+                              lod->indices_buffer->data,
+                              lod->n_indices);
+  model->lod_primitives[i] = cogl_primitive_copy (primitive);
+  cogl_primitive_set_indices (model->lod_primitives[i],
+                              indices, lod->n_indices);
+  cogl_object_unref (indices);
+
+  return model->lod_primitives[i];
+}
+
+void
+rut_model_set_quantize_flags (RutModel *model,
+                              RutMeshQuantizeFlags flags)
+{
+  g_return_if_fail (model->primitive == NULL);
+  g_return_if_fail (!model->is_hair_model);
+
+  model->quantize_flags = flags;
+}
+
+const CoglMatrix *
+rut_model_get_position_matrix (RutModel *model)
+{
+  return model->has_position_matrix ? &model->position_matrix : NULL;
+}
+
 CoglPrimitive *
 rut_model_get_fin_primitive (RutObject *object)
 {
@@ -112,6 +238,26 @@ rut_model_get_fin_primitive (RutObject *object)
   return model->fin_primitive;
 }
 
+static void
+free_lods (RutModel *model)
+{
+  int i;
+
+  for (i = 0; i < model->n_lods; i++)
+    {
+      rut_refable_unref (model->lods[i]);
+      model->lods[i] = NULL;
+
+      if (model->lod_primitives[i])
+        {
+          cogl_object_unref (model->lod_primitives[i]);
+          model->lod_primitives[i] = NULL;
+        }
+    }
+
+  model->n_lods = 0;
+}
+
 static void
 _rut_model_free (void *object)
 {
@@ -120,9 +266,14 @@ _rut_model_free (void *object)
   if (model->primitive)
     cogl_object_unref (model->primitive);
 
+  free_lods (model);
+
   if (model->mesh)
     rut_refable_unref (model->mesh);
 
+  if (model->quantized_mesh)
+    rut_refable_unref (model->quantized_mesh);
+
   if (model->patched_mesh)
     {
       g_free (model->priv->polygons);
@@ -147,9 +298,12 @@ _rut_model_copy (RutObject *object)
 {
   RutModel *model = object;
   RutModel *copy = _rut_model_new (model->ctx);
+  int i;
 
   copy->type = model->type;
-  copy->mesh = rut_refable_ref (model->mesh);
+
+  if (model->mesh)
+    copy->mesh = rut_refable_ref (model->mesh);
 
   if (model->asset)
     copy->asset = rut_refable_ref (model->asset);
@@ -167,6 +321,27 @@ _rut_model_copy (RutObject *object)
   if (model->primitive)
     copy->primitive = cogl_object_ref (model->primitive);
 
+  copy->quantize_flags = model->quantize_flags;
+  copy->has_position_matrix = model->has_position_matrix;
+  copy->position_matrix = model->position_matrix;
+
+  if (model->quantized_mesh)
+    {
+      copy->quantized_mesh = rut_refable_ref (model->quantized_mesh);
+      memcpy (copy->position_scale, model->position_scale,
+              sizeof (model->position_scale));
+      memcpy (copy->position_offset, model->position_offset,
+              sizeof (model->position_offset));
+    }
+
+  copy->n_lods = model->n_lods;
+  for (i = 0; i < model->n_lods; i++)
+    {
+      copy->lods[i] = rut_refable_ref (model->lods[i]);
+      if (model->lod_primitives[i])
+        copy->lod_primitives[i] = cogl_object_ref (model->lod_primitives[i]);
+    }
+
   if (model->is_hair_model)
     {
       copy->is_hair_model = model->is_hair_model;
@@ -239,6 +414,9 @@ _rut_model_new (RutContext *ctx)
   model->component.type = RUT_COMPONENT_TYPE_GEOMETRY;
   model->ctx = ctx;
 
+  if (rut_mesh_quantize_is_enabled ())
+    model->quantize_flags = RUT_MESH_QUANTIZE_ALL;
+
   return model;
 }
 
@@ -851,6 +1029,33 @@ measure_mesh_xyz_cb (void **attribute_data,
   return TRUE;
 }
 
+typedef struct _MeasureQuantizedState
+{
+  RutModel *model;
+  int n_components;
+} MeasureQuantizedState;
+
+/* Measures positions stored as normalized shorts by
+ * rut_mesh_quantize() without expanding the whole mesh */
+static CoglBool
+measure_quantized_mesh_cb (void **attribute_data,
+                           int vertex_index,
+                           void *user_data)
+{
+  MeasureQuantizedState *state = user_data;
+  RutModel *model = state->model;
+  const int16_t *data = attribute_data[0];
+  float pos[3] = { 0, 0, 0 };
+  void *pos_data[1] = { pos };
+  int i;
+
+  for (i = 0; i < state->n_components; i++)
+    pos[i] = (model->position_offset[i] +
+              model->position_scale[i] * MAX (data[i] / 32767.0f, -1.0f));
+
+  return measure_mesh_xyz_cb (pos_data, vertex_index, model);
+}
+
 /* Gets the angle between 2 vectors relative to a rotation axis (usually their
  * cross product). This function takes the "direction" of the angle / rotation
  * into consideration and adjusts the angle accordingly, avoiding clockwise
@@ -931,32 +1136,150 @@ check_for_shared_vertices (Polygon *poly1, Polygon *poly2)
   return 0;
 }
 
-/* Generate the adjacency matrix */
+static unsigned int
+hash_float (float value)
+{
+  union { float f; uint32_t i; } bits;
+
+  /* -0 and 0 compare equal so they must hash the same */
+  bits.f = value == 0.0f ? 0.0f : value;
+
+  return bits.i;
+}
+
+static unsigned int
+vertex_position_hash (const void *key)
+{
+  const Vertex *vertex = key;
+
+  return (hash_float (vertex->pos[0]) * 73856093u ^
+          hash_float (vertex->pos[1]) * 19349663u ^
+          hash_float (vertex->pos[2]) * 83492791u);
+}
+
+static gboolean
+vertex_position_equal (const void *a, const void *b)
+{
+  return check_vertex_equality ((Vertex *) a, (Vertex *) b);
+}
+
+static int
+compare_polygon_ids (const void *a, const void *b)
+{
+  return *(const int *) a - *(const int *) b;
+}
+
+/* Finds the polygons that share an edge with each polygon. Polygons
+ * can only share an edge if they share a vertex position so rather
+ * than testing every pair of polygons we first group the polygons by
+ * the positions of their vertices and only test the polygons within
+ * the same groups. */
 
 static void
-generate_adjacency_matrix (RutModel *model)
+generate_adjacency_lists (RutModel *model)
 {
-  int i, j;
   RutModelPrivate *priv = model->priv;
+  int n_polygons = priv->n_polygons;
+  GHashTable *positions = g_hash_table_new (vertex_position_hash,
+                                            vertex_position_equal);
+  int *polygon_positions = g_new (int, n_polygons * 3);
+  int *position_offsets;
+  int *position_polygons;
+  int *last_tested = g_new (int, n_polygons);
+  GArray *adjacent_polygons = g_array_new (FALSE, FALSE, sizeof (int));
+  int n_positions = 0;
+  int i, j, k;
+
+  /* 1. Give each distinct vertex position an id */
+
+  for (i = 0; i < n_polygons; i++)
+    {
+      Polygon *polygon = &priv->polygons[i];
+
+      for (j = 0; j < 3; j++)
+        {
+          void *value = g_hash_table_lookup (positions, polygon->vertices[j]);
 
-  _rut_bitmask_clear_all (&priv->adj_matrix);
+          if (value == NULL)
+            {
+              value = GINT_TO_POINTER (++n_positions);
+              g_hash_table_insert (positions, polygon->vertices[j], value);
+            }
+
+          polygon_positions[i * 3 + j] = GPOINTER_TO_INT (value) - 1;
+        }
+    }
+
+  g_hash_table_destroy (positions);
+
+  /* 2. List the polygons that use each position, in ascending order */
+
+  position_offsets = g_new0 (int, n_positions + 1);
+
+  for (i = 0; i < n_polygons * 3; i++)
+    position_offsets[polygon_positions[i] + 1]++;
+  for (i = 0; i < n_positions; i++)
+    position_offsets[i + 1] += position_offsets[i];
+
+  position_polygons = g_new (int, n_polygons * 3);
 
-  for (i = 0; i < priv->n_polygons; i++)
+  for (i = 0; i < n_polygons * 3; i++)
+    position_polygons[position_offsets[polygon_positions[i]]++] = i / 3;
+
+  /* Filling in the lists moved each offset to the start of the next
+   * list so shift them back */
+  for (i = n_positions; i > 0; i--)
+    position_offsets[i] = position_offsets[i - 1];
+  position_offsets[0] = 0;
+
+  /* 3. Test each polygon against the polygons it shares a position with */
+
+  for (i = 0; i < n_polygons; i++)
+    last_tested[i] = -1;
+
+  priv->adjacency_offsets = g_new (int, n_polygons + 1);
+
+  for (i = 0; i < n_polygons; i++)
     {
       Polygon *origin = &priv->polygons[i];
-      unsigned int adj_offset = priv->n_polygons * origin->id;
+      int start = adjacent_polygons->len;
 
-      for (j = 0; j < priv->n_polygons; j++)
+      priv->adjacency_offsets[i] = start;
+
+      for (j = 0; j < 3; j++)
         {
-          Polygon *child = &priv->polygons[j];
+          int position = polygon_positions[i * 3 + j];
 
-          if (origin->id == child->id)
-            _rut_bitmask_set (&priv->adj_matrix, adj_offset + child->id, 0);
-          else
-            _rut_bitmask_set (&priv->adj_matrix, adj_offset + child->id,
-                              check_for_shared_vertices (origin, child));
+          for (k = position_offsets[position];
+               k < position_offsets[position + 1];
+               k++)
+            {
+              int child_id = position_polygons[k];
+
+              if (child_id == i || last_tested[child_id] == i)
+                continue;
+
+              last_tested[child_id] = i;
+
+              if (check_for_shared_vertices (origin,
+                                             &priv->polygons[child_id]))
+                g_array_append_val (adjacent_polygons, child_id);
+            }
         }
+
+      qsort (&g_array_index (adjacent_polygons, int, start),
+             adjacent_polygons->len - start,
+             sizeof (int),
+             compare_polygon_ids);
     }
+
+  priv->adjacency_offsets[n_polygons] = adjacent_polygons->len;
+  priv->adjacent_polygons = (int *) g_array_free (adjacent_polygons, FALSE);
+
+  g_free (last_tested);
+  g_free (position_polygons);
+  g_free (position_offsets);
+  g_free (polygon_positions);
 }
 
 /* Finds a polygon which hasn't been covered by a patch yet */
@@ -964,11 +1287,13 @@ generate_adjacency_matrix (RutModel *model)
 static Polygon*
 find_uncovered_polygon (RutModel *model)
 {
-  int i;
+  RutModelPrivate *priv = model->priv;
 
-  for (i = 0; i < model->priv->n_polygons; i++)
+  /* Polygons never become uncovered again so there's no need to look
+   * at the ones we've already skipped over */
+  for (; priv->first_uncovered < priv->n_polygons; priv->first_uncovered++)
     {
-      Polygon *polygon = &model->priv->polygons[i];
+      Polygon *polygon = &priv->polygons[priv->first_uncovered];
       if (polygon->uncovered)
         return polygon;
     }
@@ -1102,33 +1427,29 @@ static void
 grow_texture_patch (RutModel *model, TexturePatch *patch)
 {
   RutModelPrivate *priv = model->priv;
-  CoglBool *visited = g_new (CoglBool, priv->n_polygons);
+  int *visited = priv->visited;
+  int patch_id = ++priv->n_texture_patches;
   GQueue *stack = g_queue_new ();
   int i;
 
-  for (i = 0; i < priv->n_polygons; i++)
-    visited[i] = FALSE;
-
   g_queue_push_tail (stack, patch->root);
 
   while (!g_queue_is_empty (stack))
     {
       Polygon *parent = g_queue_pop_tail (stack);
 
-      if (visited[parent->id])
+      if (visited[parent->id] == patch_id)
         continue;
 
-      visited[parent->id] = TRUE;
+      visited[parent->id] = patch_id;
 
-      for (i = 0; i < priv->n_polygons; i++)
+      for (i = priv->adjacency_offsets[parent->id];
+           i < priv->adjacency_offsets[parent->id + 1];
+           i++)
         {
-          Polygon *child = &priv->polygons[i];
-          unsigned int adj_offset = priv->n_polygons * parent->id;
-
-          if (_rut_bitmask_get (&priv->adj_matrix, adj_offset + child->id) != 1)
-            continue;
+          Polygon *child = &priv->polygons[priv->adjacent_polygons[i]];
 
-          if (!visited[child->id])
+          if (visited[child->id] != patch_id)
             {
               position_polygon_at_2D_origin (child);
               extrude_new_vertex (parent, child);
@@ -1142,7 +1463,6 @@ grow_texture_patch (RutModel *model, TexturePatch *patch)
         }
     }
 
-  g_free (visited);
   g_queue_free (stack);
 }
 
@@ -1286,7 +1606,11 @@ create_patched_mesh_from_model (RutObject *object)
   if (model->patched_mesh)
     return model->patched_mesh;
 
-  generate_adjacency_matrix (model);
+  generate_adjacency_lists (model);
+
+  model->priv->visited = g_new0 (int, model->priv->n_polygons);
+  model->priv->n_texture_patches = 0;
+  model->priv->first_uncovered = 0;
 
   while (create_texture_patch (model));
 
@@ -1295,6 +1619,10 @@ create_patched_mesh_from_model (RutObject *object)
 
   g_list_free (model->priv->texture_patches);
 
+  g_free (model->priv->visited);
+  g_free (model->priv->adjacency_offsets);
+  g_free (model->priv->adjacent_polygons);
+
   model->patched_mesh =
     create_renderer_mesh_from_vertices (model->priv->vertices,
                                         model->priv->n_vertices,
@@ -1343,6 +1671,66 @@ create_fin_mesh_from_model (RutObject *object)
   return model->fin_mesh;
 }
 
+/* When rendering we expect that every model has a specific set of
+ * texture coordinate attributes that may be required depending
+ * on the material state used in conjunction with the model.
+ *
+ * We currently assume a newly loaded asset mesh will only have one
+ * set of texture coodinates and so all the remaining sets of
+ * texture coordinates will simply be an alias of those...
+ */
+static bool
+add_tex_coord_aliases (RutMesh *mesh)
+{
+  static const char *alias_names[] = {
+    "cogl_tex_coord1_in",
+    "cogl_tex_coord4_in",
+    "cogl_tex_coord7_in",
+    "cogl_tex_coord11_in"
+  };
+  int n_attributes = mesh->n_attributes + G_N_ELEMENTS (alias_names);
+  RutAttribute **attributes;
+  RutAttribute *tex_attrib = NULL;
+  int i;
+
+  attributes = g_alloca (sizeof (RutAttribute *) * n_attributes);
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    {
+      RutAttribute *attribute = mesh->attributes[i];
+      if (strcmp (attribute->name, "cogl_tex_coord0_in") == 0)
+        tex_attrib = attribute;
+
+      attributes[i] = attribute;
+    }
+
+  if (tex_attrib == NULL)
+    return false;
+
+  /* NB: the texture coordinates may have been quantized so the
+   * aliases keep the same type */
+  for (i = 0; i < G_N_ELEMENTS (alias_names); i++)
+    {
+      RutAttribute *alias = rut_attribute_new (tex_attrib->buffer,
+                                               alias_names[i],
+                                               tex_attrib->stride,
+                                               tex_attrib->offset,
+                                               2,
+                                               tex_attrib->type);
+
+      rut_attribute_set_normalized (alias, tex_attrib->normalized);
+      attributes[mesh->n_attributes + i] = alias;
+    }
+
+  rut_mesh_set_attributes (mesh, attributes, n_attributes);
+
+  /* The mesh takes its own references on the attributes */
+  for (i = n_attributes - G_N_ELEMENTS (alias_names); i < n_attributes; i++)
+    rut_refable_unref (attributes[i]);
+
+  return true;
+}
+
 RutModel *
 rut_model_new_from_asset_mesh (RutContext *ctx,
                                RutMesh *mesh,
@@ -1352,9 +1740,6 @@ rut_model_new_from_asset_mesh (RutContext *ctx,
   RutModel *model;
   RutAttribute *attribute;
   RutMeshVertexCallback measure_callback;
-  RutAttribute **attributes;
-  int i;
-  RutAttribute *tex_attrib;
 
   model = _rut_model_new (ctx);
   model->type = RUT_MODEL_TYPE_FILE;
@@ -1403,61 +1788,340 @@ rut_model_new_from_asset_mesh (RutContext *ctx,
                              "cogl_tex_coord0_in",
                              NULL);
 
-  /* When rendering we expect that every model has a specific set of
-   * texture coordinate attributes that may be required depending
-   * on the material state used in conjunction with the model.
-   *
-   * We currently assume a newly loaded asset mesh will only have one
-   * set of texture coodinates and so all the remaining sets of
-   * texture coordinates will simply be an alias of those...
-   */
-  attributes = g_alloca (sizeof (RutAttribute *) * mesh->n_attributes + 4);
+  if (!add_tex_coord_aliases (model->mesh))
+    {
+      rut_refable_unref (model);
+      g_return_val_if_reached (NULL);
+    }
 
-  tex_attrib = NULL;
-  for (i = 0; i < mesh->n_attributes; i++)
+  return model;
+}
+
+/* Returns the directory that meshes derived from @asset should be
+ * cached in or NULL if they shouldn't be cached */
+static char *
+get_cache_dir (RutAsset *asset)
+{
+#ifndef __ANDROID__
+  RutContext *ctx = rut_asset_get_context (asset);
+  const char *path = rut_asset_get_path (asset);
+  char *full_path;
+  char *dir;
+  char *cache_dir;
+
+  if (path == NULL ||
+      ctx->assets_location == NULL ||
+      rut_asset_get_type (asset) == RUT_ASSET_TYPE_BUILTIN)
+    return NULL;
+
+  full_path = g_build_filename (ctx->assets_location, path, NULL);
+  dir = g_path_get_dirname (full_path);
+  cache_dir = g_build_filename (dir, MODEL_CACHE_DIRECTORY, NULL);
+
+  g_free (dir);
+  g_free (full_path);
+
+  return cache_dir;
+#else
+  /* Assets are read straight out of the application package */
+  return NULL;
+#endif
+}
+
+static bool
+lods_enabled (void)
+{
+  /* NB: this is checked from the asset loader's threads. Zero means
+   * the variable hasn't been read yet so the value is offset by one */
+  static gsize enabled = 0;
+
+  if (g_once_init_enter (&enabled))
     {
-      RutAttribute *attribute = model->mesh->attributes[i];
-      if (strcmp (attribute->name, "cogl_tex_coord0_in") == 0)
-        tex_attrib = attribute;
+      bool value = !rut_util_is_boolean_env_set ("RUT_DISABLE_MESH_LOD");
+
+      g_once_init_leave (&enabled, value + 1);
+    }
+
+  return enabled - 1;
+}
+
+/* NB: @mesh is normally the model's own mesh but it can also be a
+ * float copy of a quantized mesh since the levels of detail only
+ * depend on the order of the vertices */
+static void
+generate_lods (RutModel *model, RutMesh *mesh)
+{
+  int i;
+
+  if (!lods_enabled () ||
+      mesh->mode != COGL_VERTICES_MODE_TRIANGLES ||
+      mesh->indices_buffer == NULL ||
+      mesh->n_indices / 3 < LOD_MIN_TRIANGLES)
+    return;
+
+  /* Each level is simplified from the previous one which is much
+   * quicker than starting from the full mesh every time */
+  for (i = 0; i < RUT_MODEL_N_LODS; i++)
+    {
+      RutMesh *lod =
+        rut_mesh_simplify (mesh, mesh->n_indices / 3 / LOD_REDUCTION);
+
+      if (lod == NULL)
+        break;
+
+      /* Stop if the simplification didn't get anywhere */
+      if (lod->n_indices > mesh->n_indices / 2)
+        {
+          rut_refable_unref (lod);
+          break;
+        }
+
+      rut_mesh_optimize (lod, (RUT_MESH_OPTIMIZE_VERTEX_CACHE |
+                               RUT_MESH_OPTIMIZE_OVERDRAW));
+
+      model->lods[model->n_lods++] = lod;
+      mesh = lod;
+    }
+}
+
+static RutModel *
+new_from_asset_mesh_cached (RutContext *ctx,
+                            RutMesh *mesh,
+                            bool needs_normals,
+                            bool needs_tex_coords,
+                            const char *cache_dir)
+{
+  RutMeshCacheKey *key = rut_mesh_cache_key_new (MODEL_CACHE_KIND);
+  RutMesh *cached_meshes[1 + RUT_MODEL_N_LODS];
+  RutModel *model;
+  /* The bounds followed by the number of levels of detail */
+  float extra[7];
+  int i;
+
+  rut_mesh_cache_key_add_int (key, needs_normals);
+  rut_mesh_cache_key_add_int (key, needs_tex_coords);
+  rut_mesh_cache_key_add_int (key, lods_enabled ());
+  rut_mesh_cache_key_add_mesh (key, mesh);
+
+  /* NB: The entry always holds RUT_MODEL_N_LODS levels of detail.
+   * Unused levels are filled with the full mesh which only costs a
+   * header in the file since the buffers are shared. */
+  if (rut_mesh_cache_load (cache_dir, key,
+                           cached_meshes, G_N_ELEMENTS (cached_meshes),
+                           extra, G_N_ELEMENTS (extra)))
+    {
+      int n_lods = CLAMP ((int) extra[6], 0, RUT_MODEL_N_LODS);
+
+      model = _rut_model_new (ctx);
+      model->type = RUT_MODEL_TYPE_FILE;
+      model->mesh = cached_meshes[0];
+
+      model->min_x = extra[0];
+      model->max_x = extra[1];
+      model->min_y = extra[2];
+      model->max_y = extra[3];
+      model->min_z = extra[4];
+      model->max_z = extra[5];
+
+      model->builtin_normals = !needs_normals;
+      model->builtin_tex_coords = !needs_tex_coords;
+
+      for (i = 0; i < RUT_MODEL_N_LODS; i++)
+        {
+          if (i < n_lods)
+            model->lods[model->n_lods++] = cached_meshes[i + 1];
+          else
+            rut_refable_unref (cached_meshes[i + 1]);
+        }
+    }
+  else
+    {
+      model = rut_model_new_from_asset_mesh (ctx, mesh,
+                                             needs_normals,
+                                             needs_tex_coords);
+      if (model)
+        {
+          generate_lods (model, model->mesh);
+
+          extra[0] = model->min_x;
+          extra[1] = model->max_x;
+          extra[2] = model->min_y;
+          extra[3] = model->max_y;
+          extra[4] = model->min_z;
+          extra[5] = model->max_z;
+          extra[6] = model->n_lods;
+
+          cached_meshes[0] = model->mesh;
+          for (i = 0; i < RUT_MODEL_N_LODS; i++)
+            cached_meshes[i + 1] =
+              i < model->n_lods ? model->lods[i] : model->mesh;
+
+          rut_mesh_cache_save (cache_dir, key,
+                               cached_meshes, G_N_ELEMENTS (cached_meshes),
+                               extra, G_N_ELEMENTS (extra));
+        }
+    }
+
+  rut_mesh_cache_key_free (key);
+
+  return model;
+}
+
+RutModel *
+rut_model_new_for_loading_asset (RutContext *ctx,
+                                 RutAsset *asset,
+                                 RutMesh *mesh,
+                                 bool needs_normals,
+                                 bool needs_tex_coords)
+{
+  RutModel *model;
+  char *cache_dir;
+
+  cache_dir = get_cache_dir (asset);
+
+  if (cache_dir)
+    model = new_from_asset_mesh_cached (ctx, mesh,
+                                        needs_normals, needs_tex_coords,
+                                        cache_dir);
+  else
+    {
+      model = rut_model_new_from_asset_mesh (ctx, mesh,
+                                             needs_normals, needs_tex_coords);
+      if (model)
+        generate_lods (model, model->mesh);
+    }
+
+  g_free (cache_dir);
+
+  return model;
+}
+
+RutModel *
+rut_model_new_from_quantized_mesh (RutContext *ctx,
+                                   RutMesh *mesh,
+                                   const float position_scale[3],
+                                   const float position_offset[3],
+                                   bool needs_normals,
+                                   bool needs_tex_coords)
+{
+  RutAttribute *position =
+    rut_mesh_find_attribute (mesh, "cogl_position_in");
+  MeasureQuantizedState measure_state;
+  RutModel *model;
+  int i;
+
+  /* Missing attributes can only be derived from float positions so in
+   * that case, or if the positions aren't in the format that
+   * rut_mesh_quantize() uses, the model is made from a float copy */
+  if (needs_normals || needs_tex_coords ||
+      position == NULL ||
+      position->type != RUT_ATTRIBUTE_TYPE_SHORT ||
+      !position->normalized ||
+      position->n_components > 3)
+    {
+      RutMesh *float_mesh = rut_mesh_dequantize (mesh,
+                                                 position_scale,
+                                                 position_offset);
+
+      if (!float_mesh)
+        return NULL;
+
+      model = rut_model_new_from_asset_mesh (ctx, float_mesh,
+                                             needs_normals,
+                                             needs_tex_coords);
+      rut_refable_unref (float_mesh);
 
-      attributes[i] = model->mesh->attributes[i];
+      if (model)
+        generate_lods (model, model->mesh);
+
+      return model;
     }
 
-  g_return_val_if_fail (tex_attrib != NULL, NULL);
-
-  attributes[i++] = rut_attribute_new (tex_attrib->buffer,
-                                       "cogl_tex_coord1_in",
-                                       tex_attrib->stride,
-                                       tex_attrib->offset,
-                                       2,
-                                       RUT_ATTRIBUTE_TYPE_FLOAT);
-
-  attributes[i++] = rut_attribute_new (tex_attrib->buffer,
-                                       "cogl_tex_coord4_in",
-                                       tex_attrib->stride,
-                                       tex_attrib->offset,
-                                       2,
-                                       RUT_ATTRIBUTE_TYPE_FLOAT);
-
-  attributes[i++] = rut_attribute_new (tex_attrib->buffer,
-                                       "cogl_tex_coord7_in",
-                                       tex_attrib->stride,
-                                       tex_attrib->offset,
-                                       2,
-                                       RUT_ATTRIBUTE_TYPE_FLOAT);
-
-  attributes[i++] = rut_attribute_new (tex_attrib->buffer,
-                                       "cogl_tex_coord11_in",
-                                       tex_attrib->stride,
-                                       tex_attrib->offset,
-                                       2,
-                                       RUT_ATTRIBUTE_TYPE_FLOAT);
-
-  /* NB: Don't just append extra attributes here without allocating a
-   * larger array above... */
-  g_assert (i == mesh->n_attributes + 4);
-
-  rut_mesh_set_attributes (model->mesh, attributes, i);
+  model = _rut_model_new (ctx);
+  model->type = RUT_MODEL_TYPE_FILE;
+  model->builtin_normals = TRUE;
+  model->builtin_tex_coords = TRUE;
+
+  /* The vertices are shared with @mesh rather than copied since
+   * nothing modifies them */
+  model->quantized_mesh = rut_mesh_new (mesh->mode,
+                                        mesh->n_vertices,
+                                        mesh->attributes,
+                                        mesh->n_attributes);
+  if (mesh->indices_buffer)
+    rut_mesh_set_indices (model->quantized_mesh,
+                          mesh->indices_type,
+                          mesh->indices_buffer,
+                          mesh->n_indices);
+
+  if (!add_tex_coord_aliases (model->quantized_mesh))
+    {
+      rut_refable_unref (model);
+      g_return_val_if_reached (NULL);
+    }
+
+  memcpy (model->position_scale, position_scale,
+          sizeof (model->position_scale));
+  memcpy (model->position_offset, position_offset,
+          sizeof (model->position_offset));
+
+  cogl_matrix_init_translation (&model->position_matrix,
+                                position_offset[0],
+                                position_offset[1],
+                                position_offset[2]);
+  cogl_matrix_scale (&model->position_matrix,
+                     position_scale[0],
+                     position_scale[1],
+                     position_scale[2]);
+  model->has_position_matrix = true;
+
+  model->min_x = G_MAXFLOAT;
+  model->max_x = -G_MAXFLOAT;
+  model->min_y = G_MAXFLOAT;
+  model->max_y = -G_MAXFLOAT;
+  model->min_z = G_MAXFLOAT;
+  model->max_z = -G_MAXFLOAT;
+
+  measure_state.model = model;
+  measure_state.n_components = position->n_components;
+  rut_mesh_foreach_vertex (model->quantized_mesh,
+                           measure_quantized_mesh_cb,
+                           &measure_state,
+                           "cogl_position_in",
+                           NULL);
+
+  /* Simplifying needs float positions so the levels of detail are
+   * made from a temporary float copy. They only need their own
+   * indices so they are then rewrapped around the quantized vertices
+   * and the float copy is freed. */
+  if (lods_enabled ())
+    {
+      RutMesh *float_mesh = rut_mesh_dequantize (model->quantized_mesh,
+                                                 position_scale,
+                                                 position_offset);
+
+      if (float_mesh)
+        {
+          generate_lods (model, float_mesh);
+          rut_refable_unref (float_mesh);
+        }
+
+      for (i = 0; i < model->n_lods; i++)
+        {
+          RutMesh *lod = model->lods[i];
+          RutMesh *quantized = model->quantized_mesh;
+
+          model->lods[i] = rut_mesh_new (quantized->mode,
+                                         quantized->n_vertices,
+                                         quantized->attributes,
+                                         quantized->n_attributes);
+          rut_mesh_set_indices (model->lods[i],
+                                lod->indices_type,
+                                lod->indices_buffer,
+                                lod->n_indices);
+          rut_refable_unref (lod);
+        }
+    }
 
   return model;
 }
@@ -1474,36 +2138,106 @@ rut_model_new_from_asset (RutContext *ctx,
   if (!mesh)
     return NULL;
 
-  model = rut_model_new_from_asset_mesh (ctx, mesh,
-                                         needs_normals, needs_tex_coords);
+  model = rut_model_new_for_loading_asset (ctx, asset, mesh,
+                                           needs_normals, needs_tex_coords);
+  if (!model)
+    return NULL;
+
   model->asset = rut_refable_ref (asset);
 
   return model;
 }
 
+/* Tries to fill in the hair state of @model from the mesh cache */
+static bool
+load_cached_hair_model (RutModel *model,
+                        const char *cache_dir,
+                        RutMeshCacheKey *key)
+{
+  RutMesh *meshes[2];
+  float default_hair_length;
+
+  if (!rut_mesh_cache_load (cache_dir, key,
+                            meshes, G_N_ELEMENTS (meshes),
+                            &default_hair_length, 1))
+    return false;
+
+  /* The polygon and vertex arrays are only needed while generating
+   * the meshes so they are left empty */
+  model->priv = g_new0 (RutModelPrivate, 1);
+
+  model->patched_mesh = meshes[0];
+  model->fin_mesh = meshes[1];
+
+  model->fin_primitive = rut_mesh_create_primitive (model->ctx,
+                                                    model->fin_mesh);
+
+  rut_refable_unref (model->mesh);
+  model->mesh = model->patched_mesh;
+
+  model->default_hair_length = default_hair_length;
+
+  return true;
+}
+
 RutModel *
 rut_model_new_for_hair (RutModel *base)
 {
-  RutModel *model = _rut_model_copy (base);
+  RutModel *model;
+  RutMeshCacheKey *key = NULL;
+  char *cache_dir = NULL;
 
   int n_vertices;
   int i;
 
   g_return_val_if_fail (!base->is_hair_model, NULL);
 
+  /* The hair is extruded from the float positions */
+  if (!rut_model_get_mesh (base))
+    return NULL;
+
+  model = _rut_model_copy (base);
+
   if (model->primitive)
     {
       cogl_object_unref (model->primitive);
       model->primitive = NULL;
     }
 
+  model->quantize_flags = 0;
+  model->has_position_matrix = false;
+
+  if (model->quantized_mesh)
+    {
+      rut_refable_unref (model->quantized_mesh);
+      model->quantized_mesh = NULL;
+    }
+
+  /* The hair geometry replaces the mesh so the levels of detail
+   * derived from the original mesh no longer apply */
+  free_lods (model);
+
   model->is_hair_model = TRUE;
   model->patched_mesh = NULL;
   model->fin_mesh = NULL;
 
-  model->priv = g_new (RutModelPrivate, 1);
+  if (model->asset)
+    cache_dir = get_cache_dir (model->asset);
 
-  _rut_bitmask_init (&model->priv->adj_matrix);
+  if (cache_dir)
+    {
+      key = rut_mesh_cache_key_new (HAIR_MODEL_CACHE_KIND);
+      rut_mesh_cache_key_add_mesh (key, model->mesh);
+
+      if (load_cached_hair_model (model, cache_dir, key))
+        {
+          rut_mesh_cache_key_free (key);
+          g_free (cache_dir);
+          return model;
+        }
+    }
+
+  model->priv = g_new (RutModelPrivate, 1);
 
   model->priv->texture_patches = NULL;
 
@@ -1553,6 +2287,18 @@ rut_model_new_for_hair (RutModel *base)
 
   model->default_hair_length = rut_model_get_default_hair_length (model);
 
+  if (cache_dir)
+    {
+      RutMesh *meshes[2] = { model->patched_mesh, model->fin_mesh };
+
+      rut_mesh_cache_save (cache_dir, key,
+                           meshes, G_N_ELEMENTS (meshes),
+                           &model->default_hair_length, 1);
+
+      rut_mesh_cache_key_free (key);
+      g_free (cache_dir);
+    }
+
   return model;
 }
 
@@ -1560,6 +2306,14 @@ RutMesh *
 rut_model_get_mesh (RutObject *self)
 {
   RutModel *model = self;
+
+  /* The quantized mesh can be drawn as it is so the float copy is
+   * only made once something wants to pick the model */
+  if (!model->mesh && model->quantized_mesh)
+    model->mesh = rut_mesh_dequantize (model->quantized_mesh,
+                                       model->position_scale,
+                                       model->position_offset);
+
   return model->mesh;
 }
 
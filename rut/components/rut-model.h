@@ -27,8 +27,14 @@
 
 #include "rut-entity.h"
 #include "rut-mesh.h"
+#include "rut-mesh-quantize.h"
 
 #define RUT_MODEL(p) ((RutModel *)(p))
+
+/* The maximum number of lower detail versions of the mesh that are
+ * generated for large models */
+#define RUT_MODEL_N_LODS 3
+
 typedef struct _RutModel RutModel;
 typedef struct _RutModelPrivate RutModelPrivate;
 extern RutType rut_model_type;
@@ -63,6 +69,28 @@ struct _RutModel
 
   CoglPrimitive *primitive;
 
+  /* The primitive may be created from a quantized copy of the mesh in
+   * which case the positions need to be transformed by
+   * position_matrix to get back to model space. */
+  RutMeshQuantizeFlags quantize_flags;
+  bool has_position_matrix;
+  CoglMatrix position_matrix;
+
+  /* Set instead of @mesh when the model is made from a mesh that was
+   * already quantized, such as one sent to a slave device. This is
+   * drawn directly and the float @mesh is only expanded from it the
+   * first time it is needed for picking. */
+  RutMesh *quantized_mesh;
+  float position_scale[3];
+  float position_offset[3];
+
+  /* Lower detail versions of the mesh that share its vertices,
+   * ordered from the most to the least detailed. These are only used
+   * for drawing; picking always uses the full mesh. */
+  int n_lods;
+  RutMesh *lods[RUT_MODEL_N_LODS];
+  CoglPrimitive *lod_primitives[RUT_MODEL_N_LODS];
+
   CoglBool builtin_normals;
   CoglBool builtin_tex_coords;
 
@@ -99,9 +127,38 @@ rut_model_new_from_asset (RutContext *ctx,
                           bool needs_normals,
                           bool needs_tex_coords);
 
+/* Does the work of rut_model_new_from_asset() for an asset that is
+ * still being loaded, which may be happening in a worker thread.
+ * @mesh is used in place of the asset's mesh, only the asset's path
+ * is looked at and, since reference counting isn't thread safe, the
+ * model doesn't reference @asset. The loader is expected to set
+ * model->asset once it is back on the main thread. */
+RutModel *
+rut_model_new_for_loading_asset (RutContext *ctx,
+                                 RutAsset *asset,
+                                 RutMesh *mesh,
+                                 bool needs_normals,
+                                 bool needs_tex_coords);
+
+/* Makes a model that draws @mesh, which has been quantized with
+ * rut_mesh_quantize(), without expanding it. Like
+ * rut_model_new_for_loading_asset() this can be used from a worker
+ * thread. A float copy is only made up front if normals or texture
+ * coordinates have to be derived. */
+RutModel *
+rut_model_new_from_quantized_mesh (RutContext *ctx,
+                                   RutMesh *mesh,
+                                   const float position_scale[3],
+                                   const float position_offset[3],
+                                   bool needs_normals,
+                                   bool needs_tex_coords);
+
 RutModel *
 rut_model_new_for_hair (RutModel *base);
 
+/* NB: for models made from a quantized mesh this expands the float
+ * mesh the first time it is called so it should only be called from
+ * the main thread. */
 RutMesh *
 rut_model_get_mesh (RutObject *self);
 
@@ -114,6 +171,27 @@ rut_model_get_primitive (RutObject *object);
 CoglPrimitive *
 rut_model_get_fin_primitive (RutObject *object);
 
+/* Returns the primitive to draw @model with when its bounding sphere
+ * is @screen_size pixels across, picking the least detailed version of
+ * the mesh that still has enough triangles for that size. */
+CoglPrimitive *
+rut_model_get_lod_primitive (RutModel *model,
+                             float screen_size);
+
+/* Selects which attributes are quantized when the primitive for
+ * @model is created. This has to be called before the primitive is
+ * first requested and can't be used for hair models since the hair
+ * shells are extruded from the unquantized positions. */
+void
+rut_model_set_quantize_flags (RutModel *model,
+                              RutMeshQuantizeFlags flags);
+
+/* Returns the matrix that needs to be appended to the modelview
+ * matrix when drawing the primitive of @model, or NULL if the
+ * positions of the primitive are already in model space. */
+const CoglMatrix *
+rut_model_get_position_matrix (RutModel *model);
+
 float
 rut_model_get_default_hair_length (RutObject *object);
 
@@ -328,6 +328,9 @@ free_mesh (RutNineSlice *nine_slice)
     {
       rut_refable_unref (nine_slice->mesh);
       nine_slice->mesh = NULL;
+
+      if (nine_slice->component.entity)
+        rut_entity_notify_geometry_changed (nine_slice->component.entity);
     }
 }
 
@@ -494,6 +494,10 @@ free_model (RutShape *shape)
     {
       rut_refable_unref (shape->model);
       shape->model = NULL;
+
+      /* The pick mesh is part of the model */
+      if (shape->component.entity)
+        rut_entity_notify_geometry_changed (shape->component.entity);
     }
 }
 
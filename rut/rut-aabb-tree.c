@@ -0,0 +1,644 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "rut-aabb-tree.h"
+
+#define NULL_NODE -1
+
+/* Boxes are enlarged by this fraction of their largest dimension when
+ * they are inserted into the tree */
+#define MARGIN_SCALE 0.1f
+
+typedef struct _AABB
+{
+  float min[3];
+  float max[3];
+} AABB;
+
+typedef struct _AABBNode
+{
+  AABB aabb;
+
+  void *user_data;
+
+  /* When the node is on the free list this links to the next free
+   * node instead */
+  int parent;
+
+  int child1;
+  int child2;
+
+  /* 0 for leaves and -1 for free nodes */
+  int height;
+} AABBNode;
+
+typedef struct _RayEntry
+{
+  int node;
+  float t;
+} RayEntry;
+
+struct _RutAABBTree
+{
+  AABBNode *nodes;
+  int n_nodes;
+  int size;
+
+  int root;
+  int free_list;
+
+  /* Reused between ray casts */
+  RayEntry *heap;
+  int heap_size;
+};
+
+static bool
+node_is_leaf (const AABBNode *node)
+{
+  return node->child1 == NULL_NODE;
+}
+
+static void
+aabb_union (AABB *result, const AABB *a, const AABB *b)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      result->min[i] = MIN (a->min[i], b->min[i]);
+      result->max[i] = MAX (a->max[i], b->max[i]);
+    }
+}
+
+/* Half the surface area */
+static float
+aabb_get_area (const AABB *aabb)
+{
+  float dx = aabb->max[0] - aabb->min[0];
+  float dy = aabb->max[1] - aabb->min[1];
+  float dz = aabb->max[2] - aabb->min[2];
+
+  return dx * dy + dy * dz + dz * dx;
+}
+
+static bool
+aabb_contains (const AABB *outer, const AABB *inner)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+    if (inner->min[i] < outer->min[i] || inner->max[i] > outer->max[i])
+      return false;
+
+  return true;
+}
+
+static void
+init_fat_aabb (AABB *aabb, const float min[3], const float max[3])
+{
+  float margin = 0;
+  int i;
+
+  for (i = 0; i < 3; i++)
+    margin = MAX (margin, max[i] - min[i]);
+
+  margin *= MARGIN_SCALE;
+
+  for (i = 0; i < 3; i++)
+    {
+      aabb->min[i] = min[i] - margin;
+      aabb->max[i] = max[i] + margin;
+    }
+}
+
+RutAABBTree *
+rut_aabb_tree_new (void)
+{
+  RutAABBTree *tree = g_slice_new0 (RutAABBTree);
+
+  tree->root = NULL_NODE;
+  tree->free_list = NULL_NODE;
+
+  return tree;
+}
+
+void
+rut_aabb_tree_free (RutAABBTree *tree)
+{
+  g_free (tree->nodes);
+  g_free (tree->heap);
+  g_slice_free (RutAABBTree, tree);
+}
+
+static int
+allocate_node (RutAABBTree *tree)
+{
+  AABBNode *node;
+  int index;
+
+  if (tree->free_list == NULL_NODE)
+    {
+      int old_size = tree->size;
+      int i;
+
+      tree->size = MAX (16, tree->size * 2);
+      tree->nodes = g_renew (AABBNode, tree->nodes, tree->size);
+
+      for (i = old_size; i < tree->size; i++)
+        {
+          tree->nodes[i].parent = i + 1 < tree->size ? i + 1 : NULL_NODE;
+          tree->nodes[i].height = -1;
+        }
+
+      tree->free_list = old_size;
+
+      /* The heap can never need more entries than there are nodes */
+      tree->heap = g_renew (RayEntry, tree->heap, tree->size);
+    }
+
+  index = tree->free_list;
+  node = &tree->nodes[index];
+  tree->free_list = node->parent;
+
+  node->parent = NULL_NODE;
+  node->child1 = NULL_NODE;
+  node->child2 = NULL_NODE;
+  node->height = 0;
+  node->user_data = NULL;
+
+  tree->n_nodes++;
+
+  return index;
+}
+
+static void
+free_node (RutAABBTree *tree, int index)
+{
+  tree->nodes[index].parent = tree->free_list;
+  tree->nodes[index].height = -1;
+  tree->free_list = index;
+  tree->n_nodes--;
+}
+
+static void
+update_node (RutAABBTree *tree, int index)
+{
+  AABBNode *node = &tree->nodes[index];
+  AABBNode *child1 = &tree->nodes[node->child1];
+  AABBNode *child2 = &tree->nodes[node->child2];
+
+  aabb_union (&node->aabb, &child1->aabb, &child2->aabb);
+  node->height = 1 + MAX (child1->height, child2->height);
+}
+
+static void
+replace_child (RutAABBTree *tree,
+               int parent,
+               int old_child,
+               int new_child)
+{
+  if (parent == NULL_NODE)
+    tree->root = new_child;
+  else if (tree->nodes[parent].child1 == old_child)
+    tree->nodes[parent].child1 = new_child;
+  else
+    tree->nodes[parent].child2 = new_child;
+}
+
+/* Lifts the taller grandchild of @index_a up a level if its children
+ * are out of balance. Returns the index of the node that is now at the
+ * position @index_a was. */
+static int
+balance (RutAABBTree *tree, int index_a)
+{
+  AABBNode *a = &tree->nodes[index_a];
+  int index_b, index_c, index_f, index_g;
+  AABBNode *b, *c, *f, *g;
+  int balance;
+
+  if (node_is_leaf (a) || a->height < 2)
+    return index_a;
+
+  index_b = a->child1;
+  index_c = a->child2;
+  b = &tree->nodes[index_b];
+  c = &tree->nodes[index_c];
+
+  balance = c->height - b->height;
+
+  if (balance > 1)
+    {
+      /* Rotate C up */
+      index_f = c->child1;
+      index_g = c->child2;
+      f = &tree->nodes[index_f];
+      g = &tree->nodes[index_g];
+
+      c->child1 = index_a;
+      c->parent = a->parent;
+      a->parent = index_c;
+      replace_child (tree, c->parent, index_a, index_c);
+
+      if (f->height > g->height)
+        {
+          c->child2 = index_f;
+          a->child2 = index_g;
+          g->parent = index_a;
+        }
+      else
+        {
+          c->child2 = index_g;
+          a->child2 = index_f;
+          f->parent = index_a;
+        }
+
+      update_node (tree, index_a);
+      update_node (tree, index_c);
+
+      return index_c;
+    }
+
+  if (balance < -1)
+    {
+      /* Rotate B up */
+      index_f = b->child1;
+      index_g = b->child2;
+      f = &tree->nodes[index_f];
+      g = &tree->nodes[index_g];
+
+      b->child1 = index_a;
+      b->parent = a->parent;
+      a->parent = index_b;
+      replace_child (tree, b->parent, index_a, index_b);
+
+      if (f->height > g->height)
+        {
+          b->child2 = index_f;
+          a->child1 = index_g;
+          g->parent = index_a;
+        }
+      else
+        {
+          b->child2 = index_g;
+          a->child1 = index_f;
+          f->parent = index_a;
+        }
+
+      update_node (tree, index_a);
+      update_node (tree, index_b);
+
+      return index_b;
+    }
+
+  return index_a;
+}
+
+static void
+refit_ancestors (RutAABBTree *tree, int index)
+{
+  while (index != NULL_NODE)
+    {
+      index = balance (tree, index);
+      update_node (tree, index);
+      index = tree->nodes[index].parent;
+    }
+}
+
+/* The cost of making @leaf_aabb a sibling of a descendant of @index */
+static float
+get_descend_cost (RutAABBTree *tree,
+                  int index,
+                  const AABB *leaf_aabb,
+                  float inheritance_cost)
+{
+  AABBNode *node = &tree->nodes[index];
+  AABB aabb;
+
+  aabb_union (&aabb, leaf_aabb, &node->aabb);
+
+  if (node_is_leaf (node))
+    return aabb_get_area (&aabb) + inheritance_cost;
+  else
+    return aabb_get_area (&aabb) - aabb_get_area (&node->aabb) +
+      inheritance_cost;
+}
+
+static void
+insert_leaf (RutAABBTree *tree, int leaf)
+{
+  AABB *leaf_aabb = &tree->nodes[leaf].aabb;
+  int index, sibling, old_parent, new_parent;
+
+  if (tree->root == NULL_NODE)
+    {
+      tree->root = leaf;
+      tree->nodes[leaf].parent = NULL_NODE;
+      return;
+    }
+
+  /* Find the best sibling for the new leaf using the surface area
+   * heuristic */
+  index = tree->root;
+  while (!node_is_leaf (&tree->nodes[index]))
+    {
+      AABBNode *node = &tree->nodes[index];
+      float area = aabb_get_area (&node->aabb);
+      float combined_area, cost, inheritance_cost, cost1, cost2;
+      AABB combined;
+
+      aabb_union (&combined, &node->aabb, leaf_aabb);
+      combined_area = aabb_get_area (&combined);
+
+      /* The cost of creating a new parent for this node and the leaf */
+      cost = 2 * combined_area;
+
+      /* The minimum cost of pushing the leaf further down */
+      inheritance_cost = 2 * (combined_area - area);
+
+      cost1 = get_descend_cost (tree, node->child1, leaf_aabb,
+                                inheritance_cost);
+      cost2 = get_descend_cost (tree, node->child2, leaf_aabb,
+                                inheritance_cost);
+
+      if (cost < cost1 && cost < cost2)
+        break;
+
+      index = cost1 < cost2 ? node->child1 : node->child2;
+    }
+
+  sibling = index;
+
+  old_parent = tree->nodes[sibling].parent;
+  new_parent = allocate_node (tree);
+  tree->nodes[new_parent].parent = old_parent;
+  tree->nodes[new_parent].child1 = sibling;
+  tree->nodes[new_parent].child2 = leaf;
+  tree->nodes[sibling].parent = new_parent;
+  tree->nodes[leaf].parent = new_parent;
+
+  replace_child (tree, old_parent, sibling, new_parent);
+
+  refit_ancestors (tree, new_parent);
+}
+
+static void
+remove_leaf (RutAABBTree *tree, int leaf)
+{
+  int parent, grand_parent, sibling;
+
+  if (leaf == tree->root)
+    {
+      tree->root = NULL_NODE;
+      return;
+    }
+
+  parent = tree->nodes[leaf].parent;
+  grand_parent = tree->nodes[parent].parent;
+  sibling = (tree->nodes[parent].child1 == leaf ?
+             tree->nodes[parent].child2 :
+             tree->nodes[parent].child1);
+
+  replace_child (tree, grand_parent, parent, sibling);
+  tree->nodes[sibling].parent = grand_parent;
+  free_node (tree, parent);
+
+  refit_ancestors (tree, grand_parent);
+}
+
+int
+rut_aabb_tree_insert (RutAABBTree *tree,
+                      const float min[3],
+                      const float max[3],
+                      void *user_data)
+{
+  int proxy = allocate_node (tree);
+
+  init_fat_aabb (&tree->nodes[proxy].aabb, min, max);
+  tree->nodes[proxy].user_data = user_data;
+
+  insert_leaf (tree, proxy);
+
+  return proxy;
+}
+
+void
+rut_aabb_tree_remove (RutAABBTree *tree,
+                      int proxy)
+{
+  g_return_if_fail (proxy >= 0 && proxy < tree->size);
+  g_return_if_fail (node_is_leaf (&tree->nodes[proxy]));
+
+  remove_leaf (tree, proxy);
+  free_node (tree, proxy);
+}
+
+bool
+rut_aabb_tree_move (RutAABBTree *tree,
+                    int proxy,
+                    const float min[3],
+                    const float max[3])
+{
+  AABB aabb;
+
+  g_return_val_if_fail (proxy >= 0 && proxy < tree->size, false);
+  g_return_val_if_fail (node_is_leaf (&tree->nodes[proxy]), false);
+
+  memcpy (aabb.min, min, sizeof (aabb.min));
+  memcpy (aabb.max, max, sizeof (aabb.max));
+
+  if (aabb_contains (&tree->nodes[proxy].aabb, &aabb))
+    return false;
+
+  remove_leaf (tree, proxy);
+  init_fat_aabb (&tree->nodes[proxy].aabb, min, max);
+  insert_leaf (tree, proxy);
+
+  return true;
+}
+
+void *
+rut_aabb_tree_get_user_data (RutAABBTree *tree,
+                             int proxy)
+{
+  g_return_val_if_fail (proxy >= 0 && proxy < tree->size, NULL);
+
+  return tree->nodes[proxy].user_data;
+}
+
+static bool
+intersect_aabb (const AABB *aabb,
+                const float ray_origin[3],
+                const float inv_direction[3],
+                float max_t,
+                float *t_out)
+{
+  float t_min = 0;
+  float t_max = max_t;
+  int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      float t0 = (aabb->min[i] - ray_origin[i]) * inv_direction[i];
+      float t1 = (aabb->max[i] - ray_origin[i]) * inv_direction[i];
+
+      if (t0 > t1)
+        {
+          float tmp = t0;
+          t0 = t1;
+          t1 = tmp;
+        }
+
+      t_min = MAX (t_min, t0);
+      t_max = MIN (t_max, t1);
+
+      if (t_min > t_max)
+        return false;
+    }
+
+  *t_out = t_min;
+
+  return true;
+}
+
+static void
+heap_push (RutAABBTree *tree, int node, float t)
+{
+  RayEntry *heap = tree->heap;
+  int i = tree->heap_size++;
+
+  while (i > 0)
+    {
+      int parent = (i - 1) / 2;
+
+      if (heap[parent].t <= t)
+        break;
+
+      heap[i] = heap[parent];
+      i = parent;
+    }
+
+  heap[i].node = node;
+  heap[i].t = t;
+}
+
+static RayEntry
+heap_pop (RutAABBTree *tree)
+{
+  RayEntry *heap = tree->heap;
+  RayEntry top = heap[0];
+  RayEntry last = heap[--tree->heap_size];
+  int size = tree->heap_size;
+  int i = 0;
+
+  for (;;)
+    {
+      int child = i * 2 + 1;
+
+      if (child >= size)
+        break;
+
+      if (child + 1 < size && heap[child + 1].t < heap[child].t)
+        child++;
+
+      if (last.t <= heap[child].t)
+        break;
+
+      heap[i] = heap[child];
+      i = child;
+    }
+
+  if (size > 0)
+    heap[i] = last;
+
+  return top;
+}
+
+void
+rut_aabb_tree_ray_cast (RutAABBTree *tree,
+                        const float ray_origin[3],
+                        const float ray_direction[3],
+                        float max_t,
+                        RutAABBTreeRayCallback callback,
+                        void *user_data)
+{
+  float inv_direction[3];
+  float t;
+  int i;
+
+  if (tree->root == NULL_NODE)
+    return;
+
+  /* Avoid infinities so that a ray lying in the plane of a slab gives
+   * 0 rather than NaN */
+  for (i = 0; i < 3; i++)
+    {
+      float d = ray_direction[i];
+
+      if (fabsf (d) < 1e-20f)
+        d = d < 0 ? -1e-20f : 1e-20f;
+
+      inv_direction[i] = 1.0f / d;
+    }
+
+  tree->heap_size = 0;
+
+  if (!intersect_aabb (&tree->nodes[tree->root].aabb,
+                       ray_origin, inv_direction, max_t, &t))
+    return;
+
+  heap_push (tree, tree->root, t);
+
+  /* Visit boxes front to back so that the search can end as soon as
+   * the next box starts beyond the nearest hit */
+  while (tree->heap_size)
+    {
+      RayEntry entry = heap_pop (tree);
+      AABBNode *node = &tree->nodes[entry.node];
+
+      if (entry.t > max_t)
+        break;
+
+      if (node_is_leaf (node))
+        {
+          max_t = callback (node->user_data, max_t, user_data);
+          if (max_t < 0)
+            break;
+        }
+      else
+        {
+          if (intersect_aabb (&tree->nodes[node->child1].aabb,
+                              ray_origin, inv_direction, max_t, &t))
+            heap_push (tree, node->child1, t);
+
+          if (intersect_aabb (&tree->nodes[node->child2].aabb,
+                              ray_origin, inv_direction, max_t, &t))
+            heap_push (tree, node->child2, t);
+        }
+    }
+
+  tree->heap_size = 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RUT_AABB_TREE_H_
+#define _RUT_AABB_TREE_H_
+
+#include <stdbool.h>
+
+/* A dynamic tree of axis aligned bounding boxes for quickly finding
+ * which of a changing set of objects a ray might hit.
+ *
+ * Each object is represented by a proxy whose box is enlarged by a
+ * margin when it is inserted so that small movements of the object
+ * don't need to touch the tree at all. The tree is kept balanced with
+ * rotations as proxies are inserted and removed.
+ */
+typedef struct _RutAABBTree RutAABBTree;
+
+RutAABBTree *
+rut_aabb_tree_new (void);
+
+void
+rut_aabb_tree_free (RutAABBTree *tree);
+
+/* Returns a proxy id that can be used to move or remove the box */
+int
+rut_aabb_tree_insert (RutAABBTree *tree,
+                      const float min[3],
+                      const float max[3],
+                      void *user_data);
+
+void
+rut_aabb_tree_remove (RutAABBTree *tree,
+                      int proxy);
+
+/* Updates the box of a proxy. The tree is only modified if the new box
+ * doesn't fit inside the enlarged box the proxy already has, in which
+ * case this returns true. */
+bool
+rut_aabb_tree_move (RutAABBTree *tree,
+                    int proxy,
+                    const float min[3],
+                    const float max[3]);
+
+void *
+rut_aabb_tree_get_user_data (RutAABBTree *tree,
+                             int proxy);
+
+/* Called for each proxy whose box the ray enters before @max_t, in
+ * order of the distance at which the ray enters the box. Distances are
+ * in units of the ray direction.
+ *
+ * The callback should return the distance of the nearest hit it has
+ * found so far, or @max_t if there is none, so that boxes beyond it
+ * can be skipped. Returning a negative value stops the search. */
+typedef float (*RutAABBTreeRayCallback) (void *proxy_data,
+                                         float max_t,
+                                         void *user_data);
+
+void
+rut_aabb_tree_ray_cast (RutAABBTree *tree,
+                        const float ray_origin[3],
+                        const float ray_direction[3],
+                        float max_t,
+                        RutAABBTreeRayCallback callback,
+                        void *user_data);
+
+#endif /* _RUT_AABB_TREE_H_ */
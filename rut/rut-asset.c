@@ -21,6 +21,8 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
 #include <glib.h>
 
 #include <cogl/cogl.h>
@@ -33,7 +35,25 @@
 #include "rut-asset.h"
 #include "rut-util.h"
 #include "rut-mesh-ply.h"
+#include "rut-mesh-optimize.h"
 #include "rut-mimable.h"
+#include "rut-trace.h"
+#include "rut-bitmap-cache.h"
+#include "rut-mesh-cache.h"
+
+/* Thumbnails are cached under the assets directory, named after the
+ * checksum of the asset's file and the size of the thumbnail */
+#define THUMBNAIL_CACHE_DIRECTORY ".rig-cache/thumbnails"
+
+/* The least recently used thumbnails are deleted once they add up to
+ * more than this */
+#define THUMBNAIL_CACHE_MAX_SIZE ((uint64_t) 64 * 1024 * 1024)
+
+/* Optimized PLY meshes are cached next to the PLY file, like models,
+ * named after the checksum of the file. The kind should be changed
+ * whenever rut_mesh_optimize() or ply_attributes change the output. */
+#define PLY_CACHE_DIRECTORY ".rig-cache"
+#define PLY_CACHE_KIND "rut-optimized-ply-1"
 
 #if 0
 enum {
@@ -70,8 +90,114 @@ struct _RutAsset
   GList *inferred_tags;
 
   RutList thumbnail_cb_list;
+
+  /* Thumbnails of models and videos are only made once they are
+   * requested with rut_asset_thumbnail() */
+  bool thumbnail_pending;
+  bool thumbnail_done;
+
+  /* Set if the asset was loaded from a file in the assets directory,
+   * which means its thumbnail can be cached */
+  bool has_file;
+
+  /* Set while a worker thread is decoding the asset for
+   * rut_asset_new_async() */
+  bool loading;
+  bool load_failed;
+  RutList ready_cb_list;
+
+  /* Set for assets created with rut_asset_new_deferred() until
+   * rut_asset_load() is called. Until then the texture is only the
+   * cached thumbnail. */
+  bool deferred;
+
+  /* A checksum of the asset's file, only known for assets created with
+   * rut_asset_new_async() */
+  char *content_hash;
+};
+
+/* State for decoding an asset in one of the asset loader's worker
+ * threads. The worker only writes to this struct and reads the
+ * immutable path and type of the asset. The reference on the asset
+ * is taken and dropped on the main thread. */
+typedef struct _AssetLoad
+{
+  RutAsset *asset;
+  char *full_path;
+
+  /* Set when decoding an image that is already in memory instead of
+   * a file. The data is borrowed until the load is finished. */
+  const uint8_t *data;
+  size_t data_len;
+
+  RutBitmapCacheEntry *bitmap;
+
+  /* For models this may already be set by rut_asset_batch_add_mesh()
+   * so that only the model has to be made */
+  RutMesh *mesh;
+  bool needs_model;
+  bool needs_normals;
+  bool needs_tex_coords;
+  RutModel *model;
+
+  /* Set by rut_asset_batch_add_quantized_mesh() */
+  bool is_quantized;
+  float position_scale[3];
+  float position_offset[3];
+
+  bool needs_content_hash;
+  char *content_hash;
+  GError *error;
+
+  /* The queue of a RutAssetBatch that the finished load is handed
+   * to, or NULL to hand it to the main loop */
+  GAsyncQueue *done_queue;
+} AssetLoad;
+
+struct _RutAssetBatch
+{
+  RutContext *ctx;
+  GAsyncQueue *done_queue;
+  int n_pending;
 };
 
+static GThreadPool *asset_load_pool;
+
+/* State for finding or making the thumbnail of an asset. Looking the
+ * thumbnail up in the cache, and saving new ones, is done by a
+ * separate worker thread. Rendering thumbnails needs the GPU so
+ * that's done on the main thread, one at a time from a low priority
+ * idle handler so it doesn't get in the way of the editor. */
+typedef struct _ThumbnailJob
+{
+  RutAsset *asset;
+  int size;
+
+  /* NULL if the thumbnail can't be cached */
+  char *full_path;
+  char *cache_dir;
+
+  char *content_hash;
+  char *cache_filename;
+
+  /* The cached thumbnail that was found, or for jobs that save a
+   * thumbnail, the thumbnail to save */
+  GdkPixbuf *pixbuf;
+  bool save;
+} ThumbnailJob;
+
+static GThreadPool *thumbnail_pool;
+
+static GQueue thumbnail_queue = G_QUEUE_INIT;
+static unsigned int thumbnail_idle;
+static bool generating_video_thumbnail;
+
+static void
+start_thumbnail (RutAsset *asset);
+
+static void
+finish_thumbnail (RutAsset *asset, CoglTexture *thumbnail);
+
 #if 0
 static RutPropertySpec _asset_prop_specs[] = {
   { 0 }
@@ -96,6 +222,11 @@ _rut_asset_free (void *object)
   if (asset->path)
     g_free (asset->path);
 
+  rut_closure_list_disconnect_all (&asset->ready_cb_list);
+  rut_closure_list_disconnect_all (&asset->thumbnail_cb_list);
+
+  g_free (asset->content_hash);
+
   //rut_simple_introspectable_destroy (asset);
 
   g_slice_free (RutAsset, asset);
@@ -233,123 +364,78 @@ static RutPLYAttribute ply_attributes[] =
   }
 };
 
-typedef struct _RigThumbnailGenerator
-{
-  CoglContext *ctx;
-  CoglPipeline *cogl_pipeline;
-  RutAsset *video;
-  GstElement *pipeline;
-  GstElement *bin;
-  CoglGstVideoSink *sink;
-  CoglBool seek_done;
-}RigThumbnailGenerator;
-
-static void
-rut_video_grab_thumbnail (void *instance,
-                          void *user_data)
+/* Loads the PLY file at @full_path and reorders its triangles and
+ * vertices with rut_mesh_optimize(). Optimizing a big mesh is slow so
+ * if the checksum of the file, @content_hash, is known then the
+ * optimized mesh is cached and this only has to be done the first
+ * time the file is seen. */
+static RutMesh *
+load_optimized_ply (RutContext *ctx,
+                    const char *full_path,
+                    const char *content_hash,
+                    bool *needs_normals,
+                    bool *needs_tex_coords,
+                    GError **error)
 {
-  RigThumbnailGenerator *generator = user_data;
-  CoglOffscreen *offscreen;
-  CoglFramebuffer *fbo;
-  int tex_width;
-  int tex_height;
-
-  generator->cogl_pipeline = cogl_gst_video_sink_get_pipeline (generator->sink);
-
-  tex_height = 200;
-  tex_width = cogl_gst_video_sink_get_width_for_height (generator->sink,
-                                                        tex_height);
-
-  if (generator->video->texture)
-    cogl_object_unref (generator->video->texture);
+  RutPLYAttributeStatus padding_status[G_N_ELEMENTS (ply_attributes)];
+  RutMeshCacheKey *key = NULL;
+  char *cache_dir = NULL;
+  RutMesh *mesh;
+  float extra[2];
 
-  generator->video->texture =
-    cogl_texture_2d_new_with_size (generator->ctx,
-                                   tex_width,
-                                   tex_height);
+#ifndef __ANDROID__
+  if (content_hash)
+    {
+      char *dir = g_path_get_dirname (full_path);
 
-  offscreen = cogl_offscreen_new_with_texture (generator->video->texture);
-  fbo = offscreen;
+      cache_dir = g_build_filename (dir, PLY_CACHE_DIRECTORY, NULL);
+      g_free (dir);
 
-  cogl_framebuffer_clear4f (fbo, COGL_BUFFER_BIT_COLOR, 0, 0, 0, 0);
-  cogl_framebuffer_orthographic (fbo, 0, 0, tex_width, tex_height, 1, -1);
-  cogl_framebuffer_draw_textured_rectangle (fbo, generator->cogl_pipeline,
-                                            0, 0, tex_width, tex_height,
-                                            0, 0, 1, 1);
+      key = rut_mesh_cache_key_new (PLY_CACHE_KIND);
+      rut_mesh_cache_key_add_string (key, content_hash);
 
-  cogl_object_unref (offscreen);
-  gst_element_set_state (generator->pipeline, GST_STATE_NULL);
-  g_object_unref (generator->sink);
+      if (rut_mesh_cache_load (cache_dir, key, &mesh, 1, extra, 2))
+        {
+          *needs_normals = extra[0] != 0;
+          *needs_tex_coords = extra[1] != 0;
+          goto DONE;
+        }
+    }
+#endif
 
-  rut_closure_list_invoke (&generator->video->thumbnail_cb_list,
-                           RutThumbnailCallback,
-                           generator->video);
+  mesh = rut_mesh_new_from_ply (ctx,
+                                full_path,
+                                ply_attributes,
+                                G_N_ELEMENTS (ply_attributes),
+                                padding_status,
+                                error);
+  if (!mesh)
+    goto DONE;
 
-  g_free (generator);
-}
+  rut_mesh_optimize (mesh, RUT_MESH_OPTIMIZE_ALL);
 
-static CoglBool
-rut_thumbnail_generator_seek (GstBus *bus,
-                              GstMessage *msg,
-                              void *user_data)
-{
-  RigThumbnailGenerator *generator = (RigThumbnailGenerator*) user_data;
-  int64_t duration, seek;
+  *needs_normals = padding_status[1] == RUT_PLY_ATTRIBUTE_STATUS_PADDED;
+  *needs_tex_coords = padding_status[2] == RUT_PLY_ATTRIBUTE_STATUS_PADDED;
 
-  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ASYNC_DONE && !generator->seek_done)
+  if (key)
     {
-      gst_element_query_duration (generator->bin, GST_FORMAT_TIME, &duration);
-      seek = (rand () % (duration / (GST_SECOND))) * GST_SECOND;
-      gst_element_seek_simple (generator->pipeline, GST_FORMAT_TIME,
-          GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, seek);
-
-      gst_element_get_state (generator->bin, NULL, 0,
-                              0.2 * GST_SECOND);
-      generator->seek_done = TRUE;
+      extra[0] = *needs_normals;
+      extra[1] = *needs_tex_coords;
+      rut_mesh_cache_save (cache_dir, key, &mesh, 1, extra, 2);
     }
 
-  return TRUE;
-}
-
-static void
-rut_video_generate_thumbnail (RutAsset *asset)
-{
-  RigThumbnailGenerator *generator = g_new (RigThumbnailGenerator, 1);
-  RutContext *ctx = asset->ctx;
-  char *filename;
-  char *uri;
-  GstBus *bus;
-
-  generator->seek_done = FALSE;
-  generator->ctx = ctx->cogl_context;
-  generator->video = asset;
-  generator->sink = cogl_gst_video_sink_new (ctx->cogl_context);
-  generator->pipeline = gst_pipeline_new ("thumbnailer");
-  generator->bin = gst_element_factory_make ("playbin", NULL);
-
-  filename = g_build_filename (ctx->assets_location, asset->path, NULL);
-  uri = gst_filename_to_uri (filename, NULL);
-  g_free (filename);
-
-  g_object_set (G_OBJECT (generator->bin), "video-sink",
-                GST_ELEMENT (generator->sink),NULL);
-  g_object_set (G_OBJECT (generator->bin), "uri", uri, NULL);
-  gst_bin_add (GST_BIN (generator->pipeline), generator->bin);
-
-  gst_element_set_state (generator->pipeline, GST_STATE_PAUSED);
-
-  bus = gst_element_get_bus (generator->pipeline);
-  gst_bus_add_watch (bus, rut_thumbnail_generator_seek, generator);
-
-  g_signal_connect (generator->sink, "new-frame",
-                    G_CALLBACK (rut_video_grab_thumbnail), generator);
+DONE:
+  if (key)
+    rut_mesh_cache_key_free (key);
+  g_free (cache_dir);
 
-  g_free (uri);
+  return mesh;
 }
 
 static CoglTexture *
 rut_model_get_thumbnail (RutContext *ctx,
-                         RutModel *model)
+                         RutModel *model,
+                         int size)
 {
   RutMesh *mesh;
   CoglTexture *thumbnail;
@@ -360,8 +446,8 @@ rut_model_get_thumbnail (RutContext *ctx,
   CoglSnippet *snippet;
   CoglDepthState depth_state;
   CoglMatrix view;
-  int tex_width = 800;
-  int tex_height = 800;
+  int tex_width = size;
+  int tex_height = size;
   float fovy = 60;
   float aspect = (float)tex_width / (float)tex_height;
   float z_near = 0.1;
@@ -370,7 +456,7 @@ rut_model_get_thumbnail (RutContext *ctx,
   float translate_x = 0;
   float translate_y = 0;
   float translate_z = 0;
-  float rec_scale = 800;
+  float rec_scale = size;
   float scale_facor = 1;
   float model_scale;
   float width = model->max_x - model->min_x;
@@ -491,7 +577,9 @@ rut_model_get_thumbnail (RutContext *ctx,
   else
     model_scale = height;
 
-  if (rec_scale > model_scale)
+  /* NB: models are scaled down as well as up so that they fit
+   * whatever size of thumbnail was asked for */
+  if (model_scale > 0)
     scale_facor = rec_scale / model_scale;
 
   if (model->max_x < 0)
@@ -563,7 +651,12 @@ rut_asset_new_full (RutContext *ctx,
   rut_asset_set_inferred_tags (asset, inferred_tags);
   asset->is_video = rut_util_find_tag (inferred_tags, "video");
 
+#ifndef __ANDROID__
+  asset->has_file = type != RUT_ASSET_TYPE_BUILTIN;
+#endif
+
   rut_list_init (&asset->thumbnail_cb_list);
+  rut_list_init (&asset->ready_cb_list);
 
   switch (type)
     {
@@ -594,17 +687,24 @@ rut_asset_new_full (RutContext *ctx,
       }
     case RUT_ASSET_TYPE_PLY_MODEL:
       {
-        RutPLYAttributeStatus padding_status[G_N_ELEMENTS (ply_attributes)];
         GError *error = NULL;
-        CoglBool needs_normals = FALSE;
-        CoglBool needs_tex_coords = FALSE;
+        bool needs_normals = false;
+        bool needs_tex_coords = false;
+        char *content_hash = NULL;
 
-        asset->mesh = rut_mesh_new_from_ply (ctx,
-                                             real_path,
-                                             ply_attributes,
-                                             G_N_ELEMENTS (ply_attributes),
-                                             padding_status,
-                                             &error);
+#ifndef __ANDROID__
+        content_hash = rut_util_checksum_file (real_path);
+#endif
+
+        /* The triangles and vertices are reordered at import time so
+         * that the optimized order is what gets saved with the asset */
+        asset->mesh = load_optimized_ply (ctx,
+                                          real_path,
+                                          content_hash,
+                                          &needs_normals,
+                                          &needs_tex_coords,
+                                          &error);
+        g_free (content_hash);
 
         if (!asset->mesh)
           {
@@ -615,15 +715,8 @@ rut_asset_new_full (RutContext *ctx,
             goto DONE;
           }
 
-        if (padding_status[1] == RUT_PLY_ATTRIBUTE_STATUS_PADDED)
-          needs_normals = TRUE;
-
-        if (padding_status[2] == RUT_PLY_ATTRIBUTE_STATUS_PADDED)
-          needs_tex_coords = TRUE;
-
         asset->model = rut_model_new_from_asset (ctx, asset, needs_normals,
                                                  needs_tex_coords);
-        asset->texture = rut_model_get_thumbnail (ctx, asset->model);
 
         break;
       }
@@ -722,6 +815,9 @@ rut_asset_new_from_data (RutContext *ctx,
 
   asset->path = g_strdup (name);
 
+  rut_list_init (&asset->thumbnail_cb_list);
+  rut_list_init (&asset->ready_cb_list);
+
   asset->is_video = is_video;
   if (is_video)
     {
@@ -739,15 +835,12 @@ rut_asset_new_from_data (RutContext *ctx,
         case RUT_ASSET_TYPE_NORMAL_MAP:
         case RUT_ASSET_TYPE_ALPHA_MASK:
             {
-              GInputStream *istream =
-                g_memory_input_stream_new_from_data (data, len, NULL);
               GError *error = NULL;
-              GdkPixbuf *pixbuf =
-                gdk_pixbuf_new_from_stream (istream, NULL, &error);
-              CoglBitmap *bitmap;
+              RutBitmapCacheEntry *bitmap =
+                rut_bitmap_cache_load_data (data, len, &error);
               CoglError *cogl_error = NULL;
 
-              if (!pixbuf)
+              if (!bitmap)
                 {
                   g_slice_free (RutAsset, asset);
                   g_warning ("Failed to load asset texture: %s", error->message);
@@ -755,18 +848,13 @@ rut_asset_new_from_data (RutContext *ctx,
                   return NULL;
                 }
 
-              g_object_unref (istream);
-
-              bitmap = bitmap_new_from_pixbuf (ctx->cogl_context, pixbuf);
+              /* TODO: allow asynchronous upload. */
+              asset->texture =
+                rut_bitmap_cache_entry_create_texture (bitmap,
+                                                       ctx->cogl_context,
+                                                       &cogl_error);
 
-              asset->texture = cogl_texture_2d_new_from_bitmap (bitmap);
-
-              /* Allocate now so we can simply free the data
-               * TODO: allow asynchronous upload. */
-              cogl_texture_allocate (asset->texture, NULL);
-
-              cogl_object_unref (bitmap);
-              g_object_unref (pixbuf);
+              rut_bitmap_cache_entry_free (bitmap);
 
               if (!asset->texture)
                 {
@@ -803,6 +891,11 @@ rut_asset_new_from_data (RutContext *ctx,
                   return NULL;
                 }
 
+              /* Raw PLY data is only found in .rig files saved before
+               * meshes were serialized directly and those were never
+               * optimized */
+              rut_mesh_optimize (asset->mesh, RUT_MESH_OPTIMIZE_ALL);
+
               if (padding_status[1] == RUT_PLY_ATTRIBUTE_STATUS_PADDED)
                 needs_normals = TRUE;
 
@@ -812,7 +905,6 @@ rut_asset_new_from_data (RutContext *ctx,
               asset->model = rut_model_new_from_asset (ctx, asset,
                                                        needs_normals,
                                                        needs_tex_coords);
-              asset->texture = rut_model_get_thumbnail (ctx, asset->model);
 
               break;
             }
@@ -822,14 +914,34 @@ rut_asset_new_from_data (RutContext *ctx,
   return asset;
 }
 
+/* Works out which of the attributes that models need have to be
+ * generated for @mesh */
+static void
+get_missing_attributes (RutMesh *mesh,
+                        bool *needs_normals,
+                        bool *needs_tex_coords)
+{
+  int i;
+
+  *needs_normals = true;
+  *needs_tex_coords = true;
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    {
+      if (strcmp (mesh->attributes[i]->name, "cogl_normal_in") == 0)
+        *needs_normals = false;
+      else if (strcmp (mesh->attributes[i]->name, "cogl_tex_coord0_in") == 0)
+        *needs_tex_coords = false;
+    }
+}
+
 RutAsset *
 rut_asset_new_from_mesh (RutContext *ctx,
                          RutMesh *mesh)
 {
   RutAsset *asset = g_slice_new0 (RutAsset);
-  bool needs_normals = true;
-  bool needs_tex_coords = true;
-  int i;
+  bool needs_normals;
+  bool needs_tex_coords;
 
   rut_object_init (&asset->_parent, &rut_asset_type);
 
@@ -839,15 +951,12 @@ rut_asset_new_from_mesh (RutContext *ctx,
 
   asset->type = RUT_ASSET_TYPE_PLY_MODEL;
 
+  rut_list_init (&asset->thumbnail_cb_list);
+  rut_list_init (&asset->ready_cb_list);
+
   asset->mesh = rut_refable_ref (mesh);
 
-  for (i = 0; i < mesh->n_attributes; i++)
-    {
-      if (strcmp (mesh->attributes[i]->name, "cogl_normal_in") == 0)
-        needs_normals = false;
-      else if (strcmp (mesh->attributes[i]->name, "cogl_tex_coord0_in") == 0)
-        needs_tex_coords = false;
-    }
+  get_missing_attributes (mesh, &needs_normals, &needs_tex_coords);
 
   /* FIXME: assets should only be used in the Rig editor so we
    * shouldn't have to consider this... */
@@ -856,7 +965,6 @@ rut_asset_new_from_mesh (RutContext *ctx,
       asset->model = rut_model_new_from_asset (ctx, asset,
                                                needs_normals,
                                                needs_tex_coords);
-      asset->texture = rut_model_get_thumbnail (ctx, asset->model);
     }
 
   return asset;
@@ -910,79 +1018,1120 @@ rut_asset_new_ply_model (RutContext *ctx,
                              RUT_ASSET_TYPE_PLY_MODEL);
 }
 
-RutAssetType
-rut_asset_get_type (RutAsset *asset)
+static void
+asset_load_free (AssetLoad *load)
 {
-  return asset->type;
+  if (load->bitmap)
+    rut_bitmap_cache_entry_free (load->bitmap);
+  if (load->mesh)
+    rut_refable_unref (load->mesh);
+  if (load->model)
+    rut_refable_unref (load->model);
+  g_free (load->content_hash);
+  if (load->error)
+    g_error_free (load->error);
+
+  rut_refable_unref (load->asset);
+  g_free (load->full_path);
+
+  g_slice_free (AssetLoad, load);
 }
 
-const char *
-rut_asset_get_path (RutAsset *asset)
+static bool
+finish_asset_load (AssetLoad *load)
 {
-  return asset->path;
-}
+  RutAsset *asset = load->asset;
+  RutContext *ctx = asset->ctx;
 
-RutContext *
-rut_asset_get_context (RutAsset *asset)
-{
-  return asset->ctx;
-}
+  if (load->error)
+    {
+      g_warning ("Failed to load asset %s: %s",
+                 asset->path, load->error->message);
+      return false;
+    }
 
-CoglTexture *
-rut_asset_get_texture (RutAsset *asset)
-{
-  return asset->texture;
-}
+  switch (asset->type)
+    {
+    case RUT_ASSET_TYPE_BUILTIN:
+    case RUT_ASSET_TYPE_TEXTURE:
+    case RUT_ASSET_TYPE_NORMAL_MAP:
+    case RUT_ASSET_TYPE_ALPHA_MASK:
+      {
+        CoglError *error = NULL;
 
-RutMesh *
-rut_asset_get_mesh (RutAsset *asset)
-{
-  return asset->mesh;
-}
+        /* A deferred image may be showing its thumbnail */
+        if (asset->texture)
+          cogl_object_unref (asset->texture);
 
-RutObject *
-rut_asset_get_model (RutAsset *asset)
-{
-  return asset->model;
-}
+        asset->texture =
+          rut_bitmap_cache_entry_create_texture (load->bitmap,
+                                                 ctx->cogl_context,
+                                                 &error);
+        if (!asset->texture)
+          {
+            g_warning ("Failed to load asset texture %s: %s",
+                       asset->path, error->message);
+            cogl_error_free (error);
+          }
 
-CoglBool
-rut_asset_get_is_video (RutAsset *asset)
-{
-  return asset->is_video;
+        return asset->texture != NULL;
+      }
+    case RUT_ASSET_TYPE_PLY_MODEL:
+      if (load->needs_model && !load->model)
+        {
+          g_warning ("Failed to create a model for asset %s", asset->path);
+          return false;
+        }
+
+      asset->mesh = load->mesh;
+      load->mesh = NULL;
+
+      if (load->model)
+        {
+          asset->model = load->model;
+          load->model = NULL;
+
+          asset->model->asset = rut_refable_ref (asset);
+        }
+
+      return true;
+    }
+
+  g_warn_if_reached ();
+
+  return false;
 }
 
-static GList *
-copy_tags (const GList *tags)
+static void
+complete_asset_load (AssetLoad *load)
 {
-  const GList *l;
-  GList *copy = NULL;
-  for (l = tags; l; l = l->next)
+  RutAsset *asset = load->asset;
+
+  RUT_TRACE_BEGIN ("Asset upload", asset->path);
+
+  asset->load_failed = !finish_asset_load (load);
+  asset->loading = false;
+
+  if (asset->content_hash == NULL)
     {
-      const char *tag = g_intern_string (l->data);
-      copy = g_list_prepend (copy, (char *)tag);
+      asset->content_hash = load->content_hash;
+      load->content_hash = NULL;
     }
-  return copy;
-}
 
-void
-rut_asset_set_inferred_tags (RutAsset *asset,
-                             const GList *inferred_tags)
-{
-  asset->inferred_tags = g_list_concat (asset->inferred_tags,
-                                        copy_tags (inferred_tags));
+  RUT_TRACE_END ("Asset upload");
+
+  rut_closure_list_invoke (&asset->ready_cb_list,
+                           RutAssetReadyCallback,
+                           asset,
+                           !asset->load_failed);
+  rut_closure_list_disconnect_all (&asset->ready_cb_list);
+
+  /* Thumbnails requested while the asset was loading are made now */
+  if (asset->thumbnail_pending)
+    {
+      if (asset->load_failed)
+        finish_thumbnail (asset, NULL);
+      else
+        start_thumbnail (asset);
+    }
+
+  asset_load_free (load);
 }
 
-const GList *
-rut_asset_get_inferred_tags (RutAsset *asset)
+static gboolean
+asset_load_done_idle_cb (void *user_data)
 {
-  return asset->inferred_tags;
+  complete_asset_load (user_data);
+
+  return FALSE;
 }
 
-CoglBool
-rut_asset_has_tag (RutAsset *asset, const char *tag)
+/* Runs in one of the asset loader's worker threads */
+static void
+asset_load_thread_cb (void *data,
+                      void *user_data)
 {
-  GList *l;
+  AssetLoad *load = data;
+  RutAsset *asset = load->asset;
+
+  if (load->needs_content_hash)
+    load->content_hash = rut_util_checksum_file (load->full_path);
+
+  switch (asset->type)
+    {
+    case RUT_ASSET_TYPE_BUILTIN:
+    case RUT_ASSET_TYPE_TEXTURE:
+    case RUT_ASSET_TYPE_NORMAL_MAP:
+    case RUT_ASSET_TYPE_ALPHA_MASK:
+      if (load->data)
+        load->bitmap = rut_bitmap_cache_load_data (load->data,
+                                                   load->data_len,
+                                                   &load->error);
+      else
+        load->bitmap = rut_bitmap_cache_load_file (load->full_path,
+                                                   load->content_hash,
+                                                   &load->error);
+      break;
+    case RUT_ASSET_TYPE_PLY_MODEL:
+      {
+        if (load->mesh == NULL)
+          {
+            load->mesh = load_optimized_ply (asset->ctx,
+                                             load->full_path,
+                                             load->content_hash,
+                                             &load->needs_normals,
+                                             &load->needs_tex_coords,
+                                             &load->error);
+            if (!load->mesh)
+              break;
+          }
+
+        if (load->needs_model && load->is_quantized)
+          {
+            load->model =
+              rut_model_new_from_quantized_mesh (asset->ctx,
+                                                 load->mesh,
+                                                 load->position_scale,
+                                                 load->position_offset,
+                                                 load->needs_normals,
+                                                 load->needs_tex_coords);
+          }
+        else if (load->needs_model)
+          {
+            load->model =
+              rut_model_new_for_loading_asset (asset->ctx,
+                                               asset,
+                                               load->mesh,
+                                               load->needs_normals,
+                                               load->needs_tex_coords);
+          }
+        break;
+      }
+    }
+
+  /* GPU resources can only be created on the main thread */
+  if (load->done_queue)
+    g_async_queue_push (load->done_queue, load);
+  else
+    g_idle_add (asset_load_done_idle_cb, load);
+}
+
+static void
+init_threads (void)
+{
+#if !GLIB_CHECK_VERSION (2, 32, 0)
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+#endif
+}
+
+static GThreadPool *
+get_asset_load_pool (void)
+{
+  if (asset_load_pool == NULL)
+    {
+      int n_threads;
+
+      init_threads ();
+
+      /* Leave a core free for the main thread */
+#if GLIB_CHECK_VERSION (2, 36, 0)
+      n_threads = MAX (1, (int) g_get_num_processors () - 1);
+#else
+      n_threads = 2;
+#endif
+
+      asset_load_pool = g_thread_pool_new (asset_load_thread_cb,
+                                           NULL, /* user data */
+                                           n_threads,
+                                           FALSE, /* not exclusive */
+                                           NULL); /* error */
+    }
+
+  return asset_load_pool;
+}
+
+static bool
+thumbnail_cache_disabled (void)
+{
+  static int disabled = -1;
+
+  if (disabled == -1)
+    disabled = rut_util_is_boolean_env_set ("RUT_DISABLE_THUMBNAIL_CACHE");
+
+  return disabled;
+}
+
+static void
+thumbnail_job_free (ThumbnailJob *job)
+{
+  if (job->asset)
+    rut_refable_unref (job->asset);
+  g_free (job->full_path);
+  g_free (job->cache_dir);
+  g_free (job->content_hash);
+  g_free (job->cache_filename);
+  if (job->pixbuf)
+    g_object_unref (job->pixbuf);
+
+  g_slice_free (ThumbnailJob, job);
+}
+
+/* Takes ownership of @thumbnail, which is NULL if one couldn't be
+ * made */
+static void
+finish_thumbnail (RutAsset *asset, CoglTexture *thumbnail)
+{
+  if (thumbnail)
+    {
+      if (asset->texture)
+        cogl_object_unref (asset->texture);
+      asset->texture = thumbnail;
+    }
+
+  asset->thumbnail_pending = false;
+  asset->thumbnail_done = true;
+
+  rut_closure_list_invoke (&asset->thumbnail_cb_list,
+                           RutThumbnailCallback,
+                           asset);
+  rut_closure_list_disconnect_all (&asset->thumbnail_cb_list);
+}
+
+/* Once an image has been loaded its own texture is used instead of a
+ * thumbnail */
+static bool
+is_loaded_image (RutAsset *asset)
+{
+  return (asset->type != RUT_ASSET_TYPE_PLY_MODEL &&
+          !asset->is_video &&
+          !asset->deferred &&
+          !asset->loading &&
+          asset->texture);
+}
+
+static void
+free_pixels_cb (guchar *pixels,
+                void *user_data)
+{
+  g_free (pixels);
+}
+
+/* Reads back a thumbnail that was just made and queues writing it to
+ * the cache */
+static void
+save_thumbnail (ThumbnailJob *job,
+                CoglTexture *thumbnail)
+{
+  ThumbnailJob *save_job;
+  int width, height, rowstride;
+  uint8_t *pixels;
+
+  if (job->cache_filename == NULL)
+    return;
+
+  width = cogl_texture_get_width (thumbnail);
+  height = cogl_texture_get_height (thumbnail);
+  rowstride = width * 4;
+  pixels = g_malloc (rowstride * height);
+
+  cogl_texture_get_data (thumbnail,
+                         COGL_PIXEL_FORMAT_RGBA_8888,
+                         rowstride,
+                         pixels);
+
+  save_job = g_slice_new0 (ThumbnailJob);
+  save_job->save = true;
+  save_job->size = job->size;
+  save_job->cache_filename = job->cache_filename;
+  job->cache_filename = NULL;
+  save_job->pixbuf = gdk_pixbuf_new_from_data (pixels,
+                                               GDK_COLORSPACE_RGB,
+                                               TRUE, /* has alpha */
+                                               8, /* bits per sample */
+                                               width,
+                                               height,
+                                               rowstride,
+                                               free_pixels_cb,
+                                               NULL); /* user data */
+
+  g_thread_pool_push (thumbnail_pool, save_job, NULL);
+}
+
+static gboolean
+generate_thumbnail_idle_cb (void *user_data);
+
+static void
+queue_thumbnail_generation (void)
+{
+  if (thumbnail_idle == 0 &&
+      !generating_video_thumbnail &&
+      !g_queue_is_empty (&thumbnail_queue))
+    {
+      thumbnail_idle = g_idle_add_full (G_PRIORITY_LOW,
+                                        generate_thumbnail_idle_cb,
+                                        NULL, /* user data */
+                                        NULL); /* destroy notify */
+    }
+}
+
+typedef struct _RigThumbnailGenerator
+{
+  ThumbnailJob *job;
+  CoglContext *ctx;
+  CoglPipeline *cogl_pipeline;
+  GstElement *pipeline;
+  GstElement *bin;
+  CoglGstVideoSink *sink;
+  unsigned int bus_watch;
+  CoglBool seek_done;
+  CoglBool done;
+  CoglTexture *thumbnail;
+}RigThumbnailGenerator;
+
+/* The pipeline is torn down from an idle handler because the
+ * generator finishes from within GStreamer's callbacks */
+static gboolean
+rut_video_finish_thumbnail_idle_cb (void *user_data)
+{
+  RigThumbnailGenerator *generator = user_data;
+  ThumbnailJob *job = generator->job;
+
+  g_source_remove (generator->bus_watch);
+  gst_element_set_state (generator->pipeline, GST_STATE_NULL);
+  gst_object_unref (generator->pipeline);
+  g_object_unref (generator->sink);
+
+  if (generator->thumbnail)
+    save_thumbnail (job, generator->thumbnail);
+  finish_thumbnail (job->asset, generator->thumbnail);
+
+  thumbnail_job_free (job);
+  g_free (generator);
+
+  generating_video_thumbnail = false;
+  queue_thumbnail_generation ();
+
+  return FALSE;
+}
+
+static void
+rut_video_grab_thumbnail (void *instance,
+                          void *user_data)
+{
+  RigThumbnailGenerator *generator = user_data;
+  int size = generator->job->size;
+  CoglOffscreen *offscreen;
+  CoglFramebuffer *fbo;
+  int tex_width;
+  int tex_height;
+
+  if (generator->done)
+    return;
+
+  generator->cogl_pipeline = cogl_gst_video_sink_get_pipeline (generator->sink);
+
+  /* Fit the frame into a square of the thumbnail size */
+  tex_height = size;
+  tex_width = cogl_gst_video_sink_get_width_for_height (generator->sink,
+                                                        tex_height);
+  if (tex_width > size)
+    {
+      tex_height = MAX (1, size * size / tex_width);
+      tex_width = size;
+    }
+
+  generator->thumbnail =
+    cogl_texture_2d_new_with_size (generator->ctx,
+                                   tex_width,
+                                   tex_height);
+
+  offscreen = cogl_offscreen_new_with_texture (generator->thumbnail);
+  fbo = offscreen;
+
+  cogl_framebuffer_clear4f (fbo, COGL_BUFFER_BIT_COLOR, 0, 0, 0, 0);
+  cogl_framebuffer_orthographic (fbo, 0, 0, tex_width, tex_height, 1, -1);
+  cogl_framebuffer_draw_textured_rectangle (fbo, generator->cogl_pipeline,
+                                            0, 0, tex_width, tex_height,
+                                            0, 0, 1, 1);
+
+  cogl_object_unref (offscreen);
+
+  generator->done = TRUE;
+  g_idle_add (rut_video_finish_thumbnail_idle_cb, generator);
+}
+
+static CoglBool
+rut_thumbnail_generator_seek (GstBus *bus,
+                              GstMessage *msg,
+                              void *user_data)
+{
+  RigThumbnailGenerator *generator = (RigThumbnailGenerator*) user_data;
+  int64_t duration, seek;
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ASYNC_DONE && !generator->seek_done)
+    {
+      gst_element_query_duration (generator->bin, GST_FORMAT_TIME, &duration);
+      if (duration >= GST_SECOND)
+        seek = (rand () % (duration / (GST_SECOND))) * GST_SECOND;
+      else
+        seek = 0;
+      gst_element_seek_simple (generator->pipeline, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, seek);
+
+      gst_element_get_state (generator->bin, NULL, 0,
+                              0.2 * GST_SECOND);
+      generator->seek_done = TRUE;
+    }
+  else if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR && !generator->done)
+    {
+      /* Give up on the thumbnail so that the videos queued after this
+       * one still get theirs */
+      g_warning ("Failed to generate a thumbnail for %s",
+                 generator->job->asset->path);
+      generator->done = TRUE;
+      g_idle_add (rut_video_finish_thumbnail_idle_cb, generator);
+    }
+
+  return TRUE;
+}
+
+static void
+rut_video_generate_thumbnail (ThumbnailJob *job)
+{
+  RigThumbnailGenerator *generator = g_new0 (RigThumbnailGenerator, 1);
+  RutAsset *asset = job->asset;
+  RutContext *ctx = asset->ctx;
+  char *filename;
+  char *uri;
+  GstBus *bus;
+
+  generator->job = job;
+  generator->seek_done = FALSE;
+  generator->ctx = ctx->cogl_context;
+  generator->sink = cogl_gst_video_sink_new (ctx->cogl_context);
+  generator->pipeline = gst_pipeline_new ("thumbnailer");
+  generator->bin = gst_element_factory_make ("playbin", NULL);
+
+  filename = g_build_filename (ctx->assets_location, asset->path, NULL);
+  uri = gst_filename_to_uri (filename, NULL);
+  g_free (filename);
+
+  g_object_set (G_OBJECT (generator->bin), "video-sink",
+                GST_ELEMENT (generator->sink),NULL);
+  g_object_set (G_OBJECT (generator->bin), "uri", uri, NULL);
+  gst_bin_add (GST_BIN (generator->pipeline), generator->bin);
+
+  gst_element_set_state (generator->pipeline, GST_STATE_PAUSED);
+
+  bus = gst_element_get_bus (generator->pipeline);
+  generator->bus_watch =
+    gst_bus_add_watch (bus, rut_thumbnail_generator_seek, generator);
+  gst_object_unref (bus);
+
+  g_signal_connect (generator->sink, "new-frame",
+                    G_CALLBACK (rut_video_grab_thumbnail), generator);
+
+  g_free (uri);
+}
+
+static gboolean
+generate_thumbnail_idle_cb (void *user_data)
+{
+  ThumbnailJob *job = g_queue_pop_head (&thumbnail_queue);
+  RutAsset *asset = job->asset;
+  CoglTexture *thumbnail = NULL;
+
+  thumbnail_idle = 0;
+
+  /* Videos are decoded asynchronously by GStreamer so only one is
+   * handled at a time and the queue carries on once it has a frame */
+  if (asset->is_video)
+    {
+      generating_video_thumbnail = true;
+      rut_video_generate_thumbnail (job);
+      return FALSE;
+    }
+
+  RUT_TRACE_BEGIN ("Thumbnail", asset->path);
+
+  if (asset->model)
+    {
+      thumbnail = rut_model_get_thumbnail (asset->ctx, asset->model, job->size);
+      save_thumbnail (job, thumbnail);
+    }
+  else if (is_loaded_image (asset))
+    {
+      /* The image is only cached so that it can be shown without
+       * being decoded the next time it is deferred */
+      save_thumbnail (job, asset->texture);
+    }
+
+  finish_thumbnail (asset, thumbnail);
+
+  RUT_TRACE_END ("Thumbnail");
+
+  thumbnail_job_free (job);
+
+  queue_thumbnail_generation ();
+
+  return FALSE;
+}
+
+static gboolean
+thumbnail_lookup_done_idle_cb (void *user_data)
+{
+  ThumbnailJob *job = user_data;
+  RutAsset *asset = job->asset;
+
+  if (asset->content_hash == NULL && job->content_hash)
+    asset->content_hash = g_strdup (job->content_hash);
+
+  if (job->pixbuf && is_loaded_image (asset))
+    {
+      finish_thumbnail (asset, NULL);
+      thumbnail_job_free (job);
+      return FALSE;
+    }
+
+  if (job->pixbuf)
+    {
+      CoglBitmap *bitmap =
+        bitmap_new_from_pixbuf (asset->ctx->cogl_context, job->pixbuf);
+      CoglTexture *thumbnail = cogl_texture_2d_new_from_bitmap (bitmap);
+      CoglError *error = NULL;
+
+      /* Allocate now so we can simply free the pixbuf */
+      if (cogl_texture_allocate (thumbnail, &error))
+        {
+          cogl_object_unref (bitmap);
+          finish_thumbnail (asset, thumbnail);
+          thumbnail_job_free (job);
+          return FALSE;
+        }
+
+      cogl_error_free (error);
+      cogl_object_unref (thumbnail);
+      cogl_object_unref (bitmap);
+    }
+
+  /* A deferred asset has to be decoded after all to make its
+   * thumbnail. The thumbnail is still pending so it is started again
+   * by complete_asset_load(). */
+  if (asset->deferred)
+    {
+      rut_asset_load (asset, NULL);
+      thumbnail_job_free (job);
+      return FALSE;
+    }
+
+  g_queue_push_tail (&thumbnail_queue, job);
+  queue_thumbnail_generation ();
+
+  return FALSE;
+}
+
+static void
+write_thumbnail (ThumbnailJob *job)
+{
+  char *dir = g_path_get_dirname (job->cache_filename);
+  int width = gdk_pixbuf_get_width (job->pixbuf);
+  int height = gdk_pixbuf_get_height (job->pixbuf);
+  GError *error = NULL;
+  char *buf;
+  gsize len;
+
+  if (g_mkdir_with_parents (dir, 0755) == -1)
+    {
+      g_warning ("Failed to create thumbnail cache directory %s: %s",
+                 dir, g_strerror (errno));
+      g_free (dir);
+      return;
+    }
+
+  /* Images are read back at their full size */
+  if (width > job->size || height > job->size)
+    {
+      float scale = (float) job->size / MAX (width, height);
+      GdkPixbuf *scaled =
+        gdk_pixbuf_scale_simple (job->pixbuf,
+                                 MAX (1, (int) (width * scale)),
+                                 MAX (1, (int) (height * scale)),
+                                 GDK_INTERP_BILINEAR);
+
+      g_object_unref (job->pixbuf);
+      job->pixbuf = scaled;
+    }
+
+  if (!gdk_pixbuf_save_to_buffer (job->pixbuf, &buf, &len, "png",
+                                  &error, NULL))
+    {
+      g_warning ("Failed to encode thumbnail: %s", error->message);
+      g_error_free (error);
+      g_free (dir);
+      return;
+    }
+
+  /* NB: g_file_set_contents() writes to a temporary file first so a
+   * reader never sees a partially written thumbnail */
+  if (!g_file_set_contents (job->cache_filename, buf, len, &error))
+    {
+      g_warning ("Failed to save thumbnail: %s", error->message);
+      g_error_free (error);
+    }
+  else
+    rut_util_trim_cache_dir (dir, ".png", len, THUMBNAIL_CACHE_MAX_SIZE);
+
+  g_free (buf);
+  g_free (dir);
+}
+
+/* Runs in the thumbnail thread */
+static void
+thumbnail_thread_cb (void *data,
+                     void *user_data)
+{
+  ThumbnailJob *job = data;
+
+  if (job->save)
+    {
+      write_thumbnail (job);
+      thumbnail_job_free (job);
+      return;
+    }
+
+  if (job->content_hash == NULL)
+    job->content_hash = rut_util_checksum_file (job->full_path);
+
+  if (job->content_hash)
+    {
+      char *name = g_strdup_printf ("%s-%d.png", job->content_hash, job->size);
+
+      job->cache_filename = g_build_filename (job->cache_dir, name, NULL);
+      g_free (name);
+
+      /* Most misses are because the file doesn't exist yet so errors
+       * aren't reported */
+      job->pixbuf = gdk_pixbuf_new_from_file (job->cache_filename, NULL);
+
+      if (job->pixbuf)
+        rut_util_touch_cache_file (job->cache_filename);
+    }
+
+  g_idle_add (thumbnail_lookup_done_idle_cb, job);
+}
+
+static GThreadPool *
+get_thumbnail_pool (void)
+{
+  if (thumbnail_pool == NULL)
+    {
+      init_threads ();
+
+      /* Thumbnails are small so a single thread is plenty */
+      thumbnail_pool = g_thread_pool_new (thumbnail_thread_cb,
+                                          NULL, /* user data */
+                                          1, /* max threads */
+                                          FALSE, /* not exclusive */
+                                          NULL); /* error */
+    }
+
+  return thumbnail_pool;
+}
+
+static void
+start_thumbnail (RutAsset *asset)
+{
+  RutContext *ctx = asset->ctx;
+  ThumbnailJob *job = g_slice_new0 (ThumbnailJob);
+
+  job->asset = rut_refable_ref (asset);
+  job->size = ctx->thumbnail_size;
+
+  if (asset->has_file && !thumbnail_cache_disabled ())
+    {
+      job->full_path = g_build_filename (ctx->assets_location,
+                                         asset->path, NULL);
+      job->cache_dir = g_build_filename (ctx->assets_location,
+                                         THUMBNAIL_CACHE_DIRECTORY, NULL);
+      job->content_hash = g_strdup (asset->content_hash);
+
+      g_thread_pool_push (get_thumbnail_pool (), job, NULL);
+    }
+  else
+    {
+      g_queue_push_tail (&thumbnail_queue, job);
+      queue_thumbnail_generation ();
+    }
+}
+
+static RutAsset *
+asset_new_unloaded (RutContext *ctx,
+                    const char *path,
+                    RutAssetType type)
+{
+  RutAsset *asset = g_slice_new0 (RutAsset);
+
+  rut_object_init (&asset->_parent, &rut_asset_type);
+
+  asset->ref_count = 1;
+
+  asset->ctx = ctx;
+
+  asset->type = type;
+
+  asset->path = g_strdup (path);
+
+  rut_list_init (&asset->thumbnail_cb_list);
+  rut_list_init (&asset->ready_cb_list);
+
+  return asset;
+}
+
+/* Creates an asset that is still being loaded and the state for
+ * loading it */
+static AssetLoad *
+asset_load_new (RutContext *ctx,
+                const char *path,
+                RutAssetType type)
+{
+  AssetLoad *load = g_slice_new0 (AssetLoad);
+
+  load->asset = asset_new_unloaded (ctx, path, type);
+  load->asset->loading = true;
+
+  return load;
+}
+
+/* Returns a new reference on the asset being loaded */
+static RutAsset *
+queue_asset_load (AssetLoad *load,
+                  RutAssetBatch *batch)
+{
+  RutAsset *asset = load->asset;
+
+  /* The reference is for the caller. NB: it has to be taken before
+   * the worker could possibly finish and drop the load's reference. */
+  rut_refable_ref (asset);
+
+  if (batch)
+    {
+      load->done_queue = batch->done_queue;
+      batch->n_pending++;
+    }
+
+  g_thread_pool_push (get_asset_load_pool (), load, NULL);
+
+  return asset;
+}
+
+static RutAsset *
+load_file_asset (RutContext *ctx,
+                 const char *path,
+                 const GList *inferred_tags,
+                 RutAssetType type,
+                 const char *content_hash,
+                 RutAssetBatch *batch)
+{
+  RutAsset *asset;
+  AssetLoad *load;
+
+#ifdef __ANDROID__
+  /* There is no GLib main loop to hand the results back to */
+  return rut_asset_new_full (ctx, path, inferred_tags, type);
+#endif
+
+  if (type == RUT_ASSET_TYPE_BUILTIN ||
+      rut_util_find_tag (inferred_tags, "video"))
+    {
+      asset = rut_asset_new_full (ctx, path, inferred_tags, type);
+
+      /* The checksum is still needed to find the asset's thumbnail */
+      if (asset)
+        asset->content_hash = g_strdup (content_hash);
+
+      return asset;
+    }
+
+  load = asset_load_new (ctx, path, type);
+  asset = load->asset;
+
+  asset->has_file = true;
+  rut_asset_set_inferred_tags (asset, inferred_tags);
+  asset->content_hash = g_strdup (content_hash);
+
+  load->full_path = g_build_filename (ctx->assets_location, path, NULL);
+  load->content_hash = g_strdup (content_hash);
+  load->needs_content_hash = content_hash == NULL;
+  load->needs_model = true;
+
+  return queue_asset_load (load, batch);
+}
+
+RutAsset *
+rut_asset_new_async (RutContext *ctx,
+                     const char *path,
+                     const GList *inferred_tags,
+                     RutAssetType type,
+                     const char *content_hash)
+{
+  return load_file_asset (ctx, path, inferred_tags, type, content_hash,
+                          NULL); /* batch */
+}
+
+RutAsset *
+rut_asset_new_deferred (RutContext *ctx,
+                        const char *path,
+                        const GList *inferred_tags,
+                        RutAssetType type,
+                        const char *content_hash)
+{
+  RutAsset *asset;
+
+#ifdef __ANDROID__
+  return rut_asset_new_async (ctx, path, inferred_tags, type, content_hash);
+#endif
+
+  /* Without a checksum or a thumbnail cache there is no way to show
+   * the asset without decoding it */
+  if (content_hash == NULL ||
+      ctx->headless ||
+      thumbnail_cache_disabled () ||
+      type == RUT_ASSET_TYPE_BUILTIN ||
+      rut_util_find_tag (inferred_tags, "video"))
+    return rut_asset_new_async (ctx, path, inferred_tags, type, content_hash);
+
+  asset = asset_new_unloaded (ctx, path, type);
+
+  asset->has_file = true;
+  rut_asset_set_inferred_tags (asset, inferred_tags);
+  asset->content_hash = g_strdup (content_hash);
+  asset->deferred = true;
+
+  return asset;
+}
+
+void
+rut_asset_load (RutAsset *asset,
+                RutAssetBatch *batch)
+{
+  RutContext *ctx = asset->ctx;
+  AssetLoad *load;
+
+  if (!asset->deferred)
+    return;
+
+  asset->deferred = false;
+  asset->loading = true;
+
+  load = g_slice_new0 (AssetLoad);
+  load->asset = rut_refable_ref (asset);
+  load->full_path = g_build_filename (ctx->assets_location, asset->path, NULL);
+  load->content_hash = g_strdup (asset->content_hash);
+  load->needs_model = true;
+
+  rut_refable_unref (queue_asset_load (load, batch));
+}
+
+RutAssetBatch *
+rut_asset_batch_new (RutContext *ctx)
+{
+  RutAssetBatch *batch = g_slice_new0 (RutAssetBatch);
+
+  init_threads ();
+
+  batch->ctx = ctx;
+  batch->done_queue = g_async_queue_new ();
+
+  return batch;
+}
+
+RutAsset *
+rut_asset_batch_add_file (RutAssetBatch *batch,
+                          const char *path,
+                          const GList *inferred_tags,
+                          RutAssetType type,
+                          const char *content_hash)
+{
+  return load_file_asset (batch->ctx, path, inferred_tags, type,
+                          content_hash, batch);
+}
+
+RutAsset *
+rut_asset_batch_add_data (RutAssetBatch *batch,
+                          const char *name,
+                          RutAssetType type,
+                          bool is_video,
+                          const uint8_t *data,
+                          size_t len)
+{
+  AssetLoad *load;
+
+  /* Videos aren't decoded until they are played and models embedded
+   * as data are rare enough not to be worth a worker */
+  if (is_video || type == RUT_ASSET_TYPE_PLY_MODEL)
+    return rut_asset_new_from_data (batch->ctx, name, type, is_video,
+                                    data, len);
+
+  load = asset_load_new (batch->ctx, name, type);
+  load->data = data;
+  load->data_len = len;
+
+  return queue_asset_load (load, batch);
+}
+
+RutAsset *
+rut_asset_batch_add_mesh (RutAssetBatch *batch,
+                          RutMesh *mesh)
+{
+  AssetLoad *load = asset_load_new (batch->ctx,
+                                    NULL, /* path */
+                                    RUT_ASSET_TYPE_PLY_MODEL);
+
+  load->mesh = mesh;
+  get_missing_attributes (mesh, &load->needs_normals, &load->needs_tex_coords);
+
+  /* FIXME: assets should only be used in the Rig editor so we
+   * shouldn't have to consider this... */
+  load->needs_model = !batch->ctx->headless;
+
+  return queue_asset_load (load, batch);
+}
+
+RutAsset *
+rut_asset_batch_add_quantized_mesh (RutAssetBatch *batch,
+                                    RutMesh *mesh,
+                                    const float position_scale[3],
+                                    const float position_offset[3])
+{
+  AssetLoad *load = asset_load_new (batch->ctx,
+                                    NULL, /* path */
+                                    RUT_ASSET_TYPE_PLY_MODEL);
+
+  load->mesh = mesh;
+  get_missing_attributes (mesh, &load->needs_normals, &load->needs_tex_coords);
+
+  load->is_quantized = true;
+  memcpy (load->position_scale, position_scale,
+          sizeof (load->position_scale));
+  memcpy (load->position_offset, position_offset,
+          sizeof (load->position_offset));
+
+  /* FIXME: assets should only be used in the Rig editor so we
+   * shouldn't have to consider this... */
+  load->needs_model = !batch->ctx->headless;
+
+  return queue_asset_load (load, batch);
+}
+
+void
+rut_asset_batch_finish (RutAssetBatch *batch)
+{
+  /* The loads are completed in whatever order they finish in so the
+   * first assets can be uploaded while the rest are still decoding */
+  for (; batch->n_pending > 0; batch->n_pending--)
+    complete_asset_load (g_async_queue_pop (batch->done_queue));
+
+  g_async_queue_unref (batch->done_queue);
+
+  g_slice_free (RutAssetBatch, batch);
+}
+
+bool
+rut_asset_is_ready (RutAsset *asset)
+{
+  return !asset->loading && !asset->deferred && !asset->load_failed;
+}
+
+RutClosure *
+rut_asset_add_ready_callback (RutAsset *asset,
+                              RutAssetReadyCallback callback,
+                              void *user_data,
+                              RutClosureDestroyCallback destroy_cb)
+{
+  if (!asset->loading && !asset->deferred)
+    {
+      callback (asset, !asset->load_failed, user_data);
+      return NULL;
+    }
+  else
+    return rut_closure_list_add (&asset->ready_cb_list, callback, user_data,
+                                 destroy_cb);
+}
+
+RutAssetType
+rut_asset_get_type (RutAsset *asset)
+{
+  return asset->type;
+}
+
+const char *
+rut_asset_get_path (RutAsset *asset)
+{
+  return asset->path;
+}
+
+RutContext *
+rut_asset_get_context (RutAsset *asset)
+{
+  return asset->ctx;
+}
+
+CoglTexture *
+rut_asset_get_texture (RutAsset *asset)
+{
+  return asset->texture;
+}
+
+RutMesh *
+rut_asset_get_mesh (RutAsset *asset)
+{
+  return asset->mesh;
+}
+
+RutObject *
+rut_asset_get_model (RutAsset *asset)
+{
+  return asset->model;
+}
+
+CoglBool
+rut_asset_get_is_video (RutAsset *asset)
+{
+  return asset->is_video;
+}
+
+static GList *
+copy_tags (const GList *tags)
+{
+  const GList *l;
+  GList *copy = NULL;
+  for (l = tags; l; l = l->next)
+    {
+      const char *tag = g_intern_string (l->data);
+      copy = g_list_prepend (copy, (char *)tag);
+    }
+  return copy;
+}
+
+void
+rut_asset_set_inferred_tags (RutAsset *asset,
+                             const GList *inferred_tags)
+{
+  asset->inferred_tags = g_list_concat (asset->inferred_tags,
+                                        copy_tags (inferred_tags));
+}
+
+const GList *
+rut_asset_get_inferred_tags (RutAsset *asset)
+{
+  return asset->inferred_tags;
+}
+
+CoglBool
+rut_asset_has_tag (RutAsset *asset, const char *tag)
+{
+  GList *l;
 
   for (l = asset->inferred_tags; l; l = l->next)
     if (strcmp (tag, l->data) == 0)
@@ -1119,7 +2268,12 @@ rut_asset_add_inferred_tag (RutAsset *asset,
 bool
 rut_asset_needs_thumbnail (RutAsset *asset)
 {
-  return asset->is_video ? TRUE : FALSE;
+  if (asset->ctx->headless || asset->thumbnail_done || asset->load_failed)
+    return false;
+
+  return (asset->is_video ||
+          asset->type == RUT_ASSET_TYPE_PLY_MODEL ||
+          asset->deferred);
 }
 
 RutClosure *
@@ -1137,11 +2291,15 @@ rut_asset_thumbnail (RutAsset *asset,
                                   user_data,
                                   destroy_cb);
 
-  rut_video_generate_thumbnail (asset);
+  if (!asset->thumbnail_pending)
+    {
+      asset->thumbnail_pending = true;
 
-  /* Make sure the thumnail wasn't simply generated synchronously to
-   * make sure the closure is still valid. */
-  g_warn_if_fail (!rut_list_empty (&asset->thumbnail_cb_list));
+      /* A model can't be rendered until it has loaded so in that case
+       * the thumbnail is started from asset_load_done_idle_cb() */
+      if (!asset->loading)
+        start_thumbnail (asset);
+    }
 
   return closure;
 }
@@ -1157,3 +2315,9 @@ rut_asset_get_data_len (RutAsset *asset)
 {
   return asset->data_len;
 }
+
+const char *
+rut_asset_get_content_hash (RutAsset *asset)
+{
+  return asset->content_hash;
+}
@@ -72,6 +72,130 @@ RutAsset *
 rut_asset_new_from_mesh (RutContext *ctx,
                          RutMesh *mesh);
 
+/* Creates an asset of the given @type whose file is decoded by a
+ * pool of worker threads instead of blocking the caller. Only the
+ * final upload of the texture, or rendering the thumbnail of a
+ * model, happens on the main thread, from an idle handler, so this
+ * relies on a running GLib main loop.
+ *
+ * Until the asset is ready it has no texture, mesh or model.
+ * rut_asset_add_ready_callback() can be used to find out when
+ * loading has finished.
+ *
+ * The loader also computes a checksum of the file, see
+ * rut_asset_get_content_hash(), unless it is already known and passed
+ * as @content_hash.
+ *
+ * Video and builtin assets are cheap to create so they are always
+ * loaded straight away.
+ */
+RutAsset *
+rut_asset_new_async (RutContext *ctx,
+                     const char *path,
+                     const GList *inferred_tags,
+                     RutAssetType type,
+                     const char *content_hash);
+
+/* Creates an asset for a file that has been seen before, without
+ * decoding it. The asset is shown by the thumbnail cached for
+ * @content_hash, which is requested as usual with
+ * rut_asset_thumbnail(), and it isn't ready until it is decoded with
+ * rut_asset_load(). If the thumbnail isn't cached then the asset is
+ * decoded to make it.
+ *
+ * This falls back to rut_asset_new_async() for assets that can't be
+ * deferred, such as when @content_hash isn't known.
+ */
+RutAsset *
+rut_asset_new_deferred (RutContext *ctx,
+                        const char *path,
+                        const GList *inferred_tags,
+                        RutAssetType type,
+                        const char *content_hash);
+
+/* A batch decodes a set of assets in parallel on the loader's worker
+ * threads for when all of the assets are needed before continuing,
+ * such as when loading a UI. The assets are returned straight away,
+ * like with rut_asset_new_async(), but they are all finished by
+ * rut_asset_batch_finish() without having to go back to the main
+ * loop. */
+typedef struct _RutAssetBatch RutAssetBatch;
+
+RutAssetBatch *
+rut_asset_batch_new (RutContext *ctx);
+
+/* The batched version of rut_asset_new_async() */
+RutAsset *
+rut_asset_batch_add_file (RutAssetBatch *batch,
+                          const char *path,
+                          const GList *inferred_tags,
+                          RutAssetType type,
+                          const char *content_hash);
+
+/* The batched version of rut_asset_new_from_data(). @data must stay
+ * valid until rut_asset_batch_finish() returns. Only images are
+ * decoded in parallel. */
+RutAsset *
+rut_asset_batch_add_data (RutAssetBatch *batch,
+                          const char *name,
+                          RutAssetType type,
+                          bool is_video,
+                          const uint8_t *data,
+                          size_t len);
+
+/* The batched version of rut_asset_new_from_mesh() where the model is
+ * made on a worker thread. This takes ownership of the reference on
+ * @mesh since the caller can't safely touch the mesh again until the
+ * batch is finished. */
+RutAsset *
+rut_asset_batch_add_mesh (RutAssetBatch *batch,
+                          RutMesh *mesh);
+
+/* Like rut_asset_batch_add_mesh() but for a mesh that was quantized
+ * with rut_mesh_quantize(). The model draws the quantized mesh
+ * directly; see rut_model_new_from_quantized_mesh(). NB: the asset's
+ * own mesh is left quantized. */
+RutAsset *
+rut_asset_batch_add_quantized_mesh (RutAssetBatch *batch,
+                                    RutMesh *mesh,
+                                    const float position_scale[3],
+                                    const float position_offset[3]);
+
+/* Waits for all of the assets in @batch to be decoded, uploads them
+ * and frees the batch. Any ready callbacks are invoked from here. */
+void
+rut_asset_batch_finish (RutAssetBatch *batch);
+
+/* Starts decoding an asset created with rut_asset_new_deferred(). The
+ * load is finished by rut_asset_batch_finish() if @batch isn't NULL
+ * and otherwise from the main loop. This does nothing if the asset
+ * isn't deferred. */
+void
+rut_asset_load (RutAsset *asset,
+                RutAssetBatch *batch);
+
+typedef void (*RutAssetReadyCallback) (RutAsset *asset,
+                                       bool loaded,
+                                       void *user_data);
+
+/* Returns true if the asset has finished loading successfully. This
+ * is always true for assets that weren't created with
+ * rut_asset_new_async() or rut_asset_new_deferred(). */
+bool
+rut_asset_is_ready (RutAsset *asset);
+
+/* Registers a callback for when an asset created with
+ * rut_asset_new_async() has finished loading. @loaded will be false
+ * if the file couldn't be decoded. If loading has already finished
+ * then the callback is invoked immediately and NULL is returned.
+ * The callbacks are only invoked once, after which they are
+ * disconnected. */
+RutClosure *
+rut_asset_add_ready_callback (RutAsset *asset,
+                              RutAssetReadyCallback callback,
+                              void *user_data,
+                              RutClosureDestroyCallback destroy_cb);
+
 RutAssetType
 rut_asset_get_type (RutAsset *asset);
 
@@ -109,11 +233,20 @@ rut_infer_asset_tags (RutContext *ctx, GFileInfo *info, GFile *asset_file);
 void
 rut_asset_add_inferred_tag (RutAsset *asset, const char *tag);
 
+/* Returns true if the asset's texture is only a placeholder until a
+ * thumbnail is requested with rut_asset_thumbnail(). */
 bool
 rut_asset_needs_thumbnail (RutAsset *asset);
 
 typedef void (*RutThumbnailCallback) (RutAsset *asset, void *user_data);
 
+/* Asynchronously replaces the asset's texture with a thumbnail of
+ * RutContext::thumbnail_size and then calls @ready_callback.
+ *
+ * Thumbnails are cached in the assets directory by the asset's
+ * content hash so they are only rendered the first time an asset is
+ * seen. Otherwise they are rendered one at a time from a low priority
+ * idle handler. */
 RutClosure *
 rut_asset_thumbnail (RutAsset *asset,
                      RutThumbnailCallback ready_callback,
@@ -126,4 +259,10 @@ rut_asset_get_data (RutAsset *asset);
 size_t
 rut_asset_get_data_len (RutAsset *asset);
 
+/* Returns a hex SHA1 checksum of the asset's file. This is only known
+ * for assets created with rut_asset_new_async(), once they are ready,
+ * and is NULL otherwise. */
+const char *
+rut_asset_get_content_hash (RutAsset *asset);
+
 #endif /* _RUT_ASSET_H_ */
@@ -0,0 +1,439 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "rut-bitmap-cache.h"
+#include "rut-util.h"
+
+/* Bump this whenever the layout of the cache files changes */
+#define CACHE_MAGIC "RUTBMPC1"
+#define CACHE_MAGIC_LEN 8
+
+/* Written in the host's byte order so that a cache file copied to a
+ * machine with a different byte order is simply ignored */
+#define CACHE_BYTE_ORDER 0x01020304
+
+/* The alignment of the pixel data within the file */
+#define CACHE_DATA_ALIGNMENT 16
+#define ALIGN_DATA(OFFSET) \
+  (((OFFSET) + CACHE_DATA_ALIGNMENT - 1) & ~(size_t) (CACHE_DATA_ALIGNMENT - 1))
+
+/* Names the conversion applied to the decoded pixels. This is part of
+ * the key so it should be changed if the conversion ever changes. */
+#define CACHE_LAYOUT "premultiplied"
+
+/* The entries are shared by every project so the least recently used
+ * ones are deleted once they add up to more than this */
+#define CACHE_MAX_SIZE ((uint64_t) 512 * 1024 * 1024)
+
+/* A cache file is laid out as:
+ *
+ *   CacheHeader
+ *   the pixel data, aligned to CACHE_DATA_ALIGNMENT
+ */
+typedef struct _CacheHeader
+{
+  char magic[CACHE_MAGIC_LEN];
+  uint32_t byte_order;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t rowstride;
+  uint32_t data_offset;
+} CacheHeader;
+
+struct _RutBitmapCacheEntry
+{
+  /* NULL if the pixels were just decoded, in which case the contents
+   * are owned by the entry */
+  GMappedFile *mapped_file;
+
+  /* The same layout as a cache file */
+  uint8_t *contents;
+  size_t len;
+};
+
+static bool
+cache_disabled (void)
+{
+  /* NB: this is checked from the asset loader's threads. Zero means
+   * the variable hasn't been read yet so the value is offset by one */
+  static gsize disabled = 0;
+
+  if (g_once_init_enter (&disabled))
+    {
+      bool value = rut_util_is_boolean_env_set ("RUT_DISABLE_BITMAP_CACHE");
+
+      g_once_init_leave (&disabled, value + 1);
+    }
+
+  return disabled - 1;
+}
+
+static const char *
+get_cache_dir (void)
+{
+  static gsize cache_dir = 0;
+
+  /* NB: entries are loaded from the asset loader's threads */
+  if (g_once_init_enter (&cache_dir))
+    {
+      char *dir =
+        g_build_filename (g_get_user_cache_dir (), "rig", "bitmaps", NULL);
+      g_once_init_leave (&cache_dir, (gsize) dir);
+    }
+
+  return (const char *) cache_dir;
+}
+
+static char *
+get_entry_filename (const char *content_hash)
+{
+  char *basename =
+    g_strconcat (content_hash, "-" CACHE_LAYOUT ".bitmap", NULL);
+  char *filename = g_build_filename (get_cache_dir (), basename, NULL);
+
+  g_free (basename);
+
+  return filename;
+}
+
+static int
+get_bytes_per_pixel (CoglPixelFormat format)
+{
+  switch (format)
+    {
+    case COGL_PIXEL_FORMAT_RGBA_8888_PRE:
+      return 4;
+    case COGL_PIXEL_FORMAT_RGB_888:
+      return 3;
+    default:
+      /* Nothing else is ever written */
+      return 0;
+    }
+}
+
+static RutBitmapCacheEntry *
+lookup_entry (const char *content_hash)
+{
+  char *filename = get_entry_filename (content_hash);
+  GMappedFile *mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+  const CacheHeader *header;
+  RutBitmapCacheEntry *entry;
+  size_t len;
+  int bpp;
+
+  if (mapped_file == NULL)
+    {
+      g_free (filename);
+      return NULL;
+    }
+
+  len = g_mapped_file_get_length (mapped_file);
+  header = (const CacheHeader *) g_mapped_file_get_contents (mapped_file);
+
+  if (len < sizeof (CacheHeader) ||
+      memcmp (header->magic, CACHE_MAGIC, CACHE_MAGIC_LEN) != 0 ||
+      header->byte_order != CACHE_BYTE_ORDER)
+    goto invalid;
+
+  bpp = get_bytes_per_pixel (header->format);
+
+  if (bpp == 0 ||
+      header->width == 0 ||
+      header->height == 0 ||
+      header->rowstride / bpp < header->width ||
+      header->data_offset > len ||
+      (uint64_t) header->rowstride * header->height >
+      len - header->data_offset)
+    goto invalid;
+
+  entry = g_slice_new0 (RutBitmapCacheEntry);
+  entry->mapped_file = mapped_file;
+  entry->contents = (uint8_t *) header;
+  entry->len = len;
+
+  rut_util_touch_cache_file (filename);
+  g_free (filename);
+
+  return entry;
+
+invalid:
+
+  g_mapped_file_unref (mapped_file);
+  g_free (filename);
+
+  return NULL;
+}
+
+static void
+save_entry (const char *content_hash,
+            RutBitmapCacheEntry *entry)
+{
+  const char *cache_dir = get_cache_dir ();
+  GError *error = NULL;
+  char *filename;
+
+  if (cache_disabled ())
+    return;
+
+  if (g_mkdir_with_parents (cache_dir, 0755) == -1)
+    {
+      g_warning ("Failed to create bitmap cache directory %s: %s",
+                 cache_dir, g_strerror (errno));
+      return;
+    }
+
+  filename = get_entry_filename (content_hash);
+
+  /* NB: g_file_set_contents() writes to a temporary file first so
+   * concurrent readers never see a partial entry */
+  if (!g_file_set_contents (filename,
+                            (const char *) entry->contents,
+                            entry->len,
+                            &error))
+    {
+      g_warning ("Failed to write bitmap cache entry: %s", error->message);
+      g_error_free (error);
+    }
+  else
+    rut_util_trim_cache_dir (cache_dir, ".bitmap", entry->len, CACHE_MAX_SIZE);
+
+  g_free (filename);
+}
+
+static inline uint8_t
+premultiply (uint8_t component, uint8_t alpha)
+{
+  /* A rounded division of component * alpha by 255 */
+  unsigned int t = component * alpha + 128;
+
+  return (t + (t >> 8)) >> 8;
+}
+
+/* Converts the pixels of @pixbuf to the layout used in the cache.
+ * Cogl would otherwise premultiply the pixels itself on every
+ * upload. */
+static RutBitmapCacheEntry *
+entry_new_from_pixbuf (GdkPixbuf *pixbuf,
+                       GError **error)
+{
+  bool has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+  int width = gdk_pixbuf_get_width (pixbuf);
+  int height = gdk_pixbuf_get_height (pixbuf);
+  int src_rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  const uint8_t *src = gdk_pixbuf_get_pixels (pixbuf);
+  RutBitmapCacheEntry *entry;
+  CacheHeader *header;
+  size_t data_offset;
+  int rowstride;
+  uint8_t *dst;
+  int x, y;
+
+  if (gdk_pixbuf_get_colorspace (pixbuf) != GDK_COLORSPACE_RGB ||
+      gdk_pixbuf_get_bits_per_sample (pixbuf) != 8 ||
+      gdk_pixbuf_get_n_channels (pixbuf) != (has_alpha ? 4 : 3))
+    {
+      g_set_error (error,
+                   GDK_PIXBUF_ERROR,
+                   GDK_PIXBUF_ERROR_UNKNOWN_TYPE,
+                   "Unsupported image pixel layout");
+      return NULL;
+    }
+
+  rowstride = width * (has_alpha ? 4 : 3);
+  data_offset = ALIGN_DATA (sizeof (CacheHeader));
+
+  entry = g_slice_new0 (RutBitmapCacheEntry);
+  entry->len = data_offset + (size_t) rowstride * height;
+  entry->contents = g_malloc (entry->len);
+
+  /* The padding between the header and the data is cleared so that
+   * the cache files are reproducible */
+  memset (entry->contents, 0, data_offset);
+
+  header = (CacheHeader *) entry->contents;
+  memcpy (header->magic, CACHE_MAGIC, CACHE_MAGIC_LEN);
+  header->byte_order = CACHE_BYTE_ORDER;
+  header->format = (has_alpha ?
+                    COGL_PIXEL_FORMAT_RGBA_8888_PRE :
+                    COGL_PIXEL_FORMAT_RGB_888);
+  header->width = width;
+  header->height = height;
+  header->rowstride = rowstride;
+  header->data_offset = data_offset;
+
+  dst = entry->contents + data_offset;
+
+  for (y = 0; y < height; y++)
+    {
+      if (has_alpha)
+        {
+          for (x = 0; x < width; x++)
+            {
+              const uint8_t *s = src + x * 4;
+              uint8_t *d = dst + x * 4;
+              uint8_t alpha = s[3];
+
+              d[0] = premultiply (s[0], alpha);
+              d[1] = premultiply (s[1], alpha);
+              d[2] = premultiply (s[2], alpha);
+              d[3] = alpha;
+            }
+        }
+      else
+        memcpy (dst, src, rowstride);
+
+      src += src_rowstride;
+      dst += rowstride;
+    }
+
+  return entry;
+}
+
+/* Takes ownership of @pixbuf */
+static RutBitmapCacheEntry *
+add_pixbuf (const char *content_hash,
+            GdkPixbuf *pixbuf,
+            GError **error)
+{
+  RutBitmapCacheEntry *entry;
+
+  if (pixbuf == NULL)
+    return NULL;
+
+  entry = entry_new_from_pixbuf (pixbuf, error);
+  g_object_unref (pixbuf);
+
+  if (entry && content_hash)
+    save_entry (content_hash, entry);
+
+  return entry;
+}
+
+RutBitmapCacheEntry *
+rut_bitmap_cache_load_file (const char *filename,
+                            const char *content_hash,
+                            GError **error)
+{
+  RutBitmapCacheEntry *entry = NULL;
+  char *checksum = NULL;
+
+  if (!cache_disabled ())
+    {
+      if (content_hash == NULL)
+        content_hash = checksum = rut_util_checksum_file (filename);
+
+      if (content_hash)
+        entry = lookup_entry (content_hash);
+    }
+
+  if (entry == NULL)
+    entry = add_pixbuf (content_hash,
+                        gdk_pixbuf_new_from_file (filename, error),
+                        error);
+
+  g_free (checksum);
+
+  return entry;
+}
+
+RutBitmapCacheEntry *
+rut_bitmap_cache_load_data (const uint8_t *data,
+                            size_t len,
+                            GError **error)
+{
+  RutBitmapCacheEntry *entry = NULL;
+  char *checksum = NULL;
+
+  if (!cache_disabled ())
+    {
+      checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1, data, len);
+      entry = lookup_entry (checksum);
+    }
+
+  if (entry == NULL)
+    {
+      GInputStream *istream =
+        g_memory_input_stream_new_from_data (data, len, NULL);
+
+      entry = add_pixbuf (checksum,
+                          gdk_pixbuf_new_from_stream (istream, NULL, error),
+                          error);
+
+      g_object_unref (istream);
+    }
+
+  g_free (checksum);
+
+  return entry;
+}
+
+CoglTexture *
+rut_bitmap_cache_entry_create_texture (RutBitmapCacheEntry *entry,
+                                       CoglContext *ctx,
+                                       CoglError **error)
+{
+  const CacheHeader *header = (const CacheHeader *) entry->contents;
+  CoglBitmap *bitmap;
+  CoglTexture *texture;
+
+  /* NB: the pixels are already in the format the texture will be
+   * stored in so Cogl can upload them without any conversion */
+  bitmap = cogl_bitmap_new_for_data (ctx,
+                                     header->width,
+                                     header->height,
+                                     header->format,
+                                     header->rowstride,
+                                     entry->contents + header->data_offset);
+
+  texture = cogl_texture_2d_new_from_bitmap (bitmap);
+
+  /* Allocate now so the entry can simply be freed */
+  if (!cogl_texture_allocate (texture, error))
+    {
+      cogl_object_unref (texture);
+      texture = NULL;
+    }
+
+  cogl_object_unref (bitmap);
+
+  return texture;
+}
+
+void
+rut_bitmap_cache_entry_free (RutBitmapCacheEntry *entry)
+{
+  if (entry->mapped_file)
+    g_mapped_file_unref (entry->mapped_file);
+  else
+    g_free (entry->contents);
+
+  g_slice_free (RutBitmapCacheEntry, entry);
+}
@@ -0,0 +1,80 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RUT_BITMAP_CACHE_H_
+#define _RUT_BITMAP_CACHE_H_
+
+#include <stdint.h>
+
+#include <glib.h>
+#include <cogl/cogl.h>
+
+/* A cache of decoded images so that PNGs and JPEGs only have to be
+ * decoded the first time they are loaded.
+ *
+ * Like the mesh cache (see rut-mesh-cache.h) entries are content
+ * addressed. The key is a checksum of the encoded image plus the
+ * layout that the pixels were converted to, so an entry never needs
+ * to be invalidated. The pixels are stored premultiplied, in the
+ * format they are uploaded in, so loading an entry only has to map
+ * the file into memory and hand the mapping to Cogl.
+ *
+ * The images can come from anywhere, including read-only data
+ * directories, so the entries live in the user's cache directory.
+ * The least recently used entries are deleted once the directory
+ * grows past a fixed size.
+ *
+ * Setting the RUT_DISABLE_BITMAP_CACHE environment variable makes
+ * every lookup miss and stops entries from being written.
+ */
+
+/* Decoded pixels that are ready to be uploaded. These are either
+ * mapped from the cache or were just decoded. */
+typedef struct _RutBitmapCacheEntry RutBitmapCacheEntry;
+
+/* Returns the decoded pixels of the image in @filename, decoding it
+ * and adding it to the cache if it isn't already there. If the
+ * checksum of the file is already known it can be passed as
+ * @content_hash to save reading the file twice.
+ *
+ * This doesn't use Cogl so it is safe to call from any thread. */
+RutBitmapCacheEntry *
+rut_bitmap_cache_load_file (const char *filename,
+                            const char *content_hash,
+                            GError **error);
+
+/* Like rut_bitmap_cache_load_file() but for an encoded image that is
+ * already in memory, such as an asset received from the editor */
+RutBitmapCacheEntry *
+rut_bitmap_cache_load_data (const uint8_t *data,
+                            size_t len,
+                            GError **error);
+
+/* Creates and allocates a texture for the pixels of @entry so that
+ * the entry can be freed straight away */
+CoglTexture *
+rut_bitmap_cache_entry_create_texture (RutBitmapCacheEntry *entry,
+                                       CoglContext *ctx,
+                                       CoglError **error);
+
+void
+rut_bitmap_cache_entry_free (RutBitmapCacheEntry *entry);
+
+#endif /* _RUT_BITMAP_CACHE_H_ */
@@ -80,6 +80,7 @@ struct _RutCamera
   RutGraphableProps graphable;
 
   CoglMatrix input_transform;
+  unsigned int input_transform_age;
   GList *input_regions;
 
   RutSimpleIntrospectableProps introspectable;
@@ -33,6 +33,10 @@ _rut_init (void);
 #define CIRCLE_TEX_RADIUS 256
 #define CIRCLE_TEX_PADDING 256
 
+/* The size of the square that thumbnails of model and video assets
+ * are fitted into unless rut_set_thumbnail_size() is called */
+#define RUT_DEFAULT_THUMBNAIL_SIZE 200
+
 typedef enum
 {
   RUT_TEXT_DIRECTION_LEFT_TO_RIGHT = 1,
@@ -60,6 +64,7 @@ struct _RutContext
   CoglMatrix identity_matrix;
 
   char *assets_location;
+  int thumbnail_size;
 
   GHashTable *texture_cache;
 
@@ -95,6 +100,13 @@ void
 rut_set_assets_location (RutContext *context,
                          const char *assets_location);
 
+/* Sets the size of the square that thumbnails of model and video
+ * assets are fitted into. This should match the size they are
+ * displayed at. It only affects thumbnails made afterwards. */
+void
+rut_set_thumbnail_size (RutContext *context,
+                        int thumbnail_size);
+
 typedef void (*RutSettingsChangedCallback) (RutSettings *settings,
                                             void *user_data);
 
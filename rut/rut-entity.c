@@ -74,6 +74,8 @@ _rut_entity_free (void *object)
 
   g_free (entity->label);
 
+  rut_closure_list_disconnect_all (&entity->change_cb_list);
+
   while (entity->components->len)
     rut_entity_remove_component (entity,
                                  g_ptr_array_index (entity->components, 0));
@@ -91,6 +93,25 @@ _rut_entity_free (void *object)
   g_slice_free (RutEntity, entity);
 }
 
+static void
+notify_change (RutEntity *entity,
+               RutEntityChangeFlags changes)
+{
+  rut_closure_list_invoke (&entity->change_cb_list,
+                           RutEntityChangeCallback,
+                           entity,
+                           changes);
+}
+
+static void
+transform_changed (RutEntity *entity)
+{
+  entity->dirty = TRUE;
+  rut_graphable_bump_scene_generation ();
+
+  notify_change (entity, RUT_ENTITY_CHANGE_TRANSFORM);
+}
+
 RutType rut_entity_type;
 
 void
@@ -158,6 +179,8 @@ rut_entity_new (RutContext *ctx)
   cogl_matrix_init_identity (&entity->transform);
   entity->components = g_ptr_array_new ();
 
+  rut_list_init (&entity->change_cb_list);
+
   rut_graphable_init (entity);
 
   return entity;
@@ -209,7 +232,7 @@ rut_entity_set_position (RutObject *obj,
   entity->position[0] = position[0];
   entity->position[1] = position[1];
   entity->position[2] = position[2];
-  entity->dirty = TRUE;
+  transform_changed (entity);
 
   rut_property_dirty (&entity->ctx->property_ctx,
                       &entity->properties[RUT_ENTITY_PROP_POSITION]);
@@ -315,7 +338,7 @@ rut_entity_set_rotation (RutObject *obj,
       return;
 
   entity->rotation = *rotation;
-  entity->dirty = TRUE;
+  transform_changed (entity);
 
   rut_property_dirty (&entity->ctx->property_ctx,
                       &entity->properties[RUT_ENTITY_PROP_ROTATION]);
@@ -399,7 +422,7 @@ rut_entity_set_scale (RutObject *obj,
     return;
 
   entity->scale = scale;
-  entity->dirty = TRUE;
+  transform_changed (entity);
 
   rut_property_dirty (&entity->ctx->property_ctx,
                       &entity->properties[RUT_ENTITY_PROP_SCALE]);
@@ -457,6 +480,8 @@ rut_entity_add_component (RutEntity *entity,
   component->entity = entity;
   rut_refable_ref (object);
   g_ptr_array_add (entity->components, object);
+
+  notify_change (entity, RUT_ENTITY_CHANGE_GEOMETRY);
 }
 
 void
@@ -468,6 +493,8 @@ rut_entity_remove_component (RutEntity *entity,
   component->entity = NULL;
   rut_refable_unref (object);
   g_warn_if_fail (g_ptr_array_remove_fast (entity->components, object));
+
+  notify_change (entity, RUT_ENTITY_CHANGE_GEOMETRY);
 }
 
 void
@@ -506,7 +533,7 @@ rut_entity_rotate_x_axis (RutEntity *entity,
   cogl_quaternion_multiply (&entity->rotation, &entity->rotation,
                             &x_rotation);
 
-  entity->dirty = TRUE;
+  transform_changed (entity);
 
   rut_property_dirty (&entity->ctx->property_ctx,
                       &entity->properties[RUT_ENTITY_PROP_ROTATION]);
@@ -522,7 +549,7 @@ rut_entity_rotate_y_axis (RutEntity *entity,
   cogl_quaternion_multiply (&entity->rotation, &entity->rotation,
                             &y_rotation);
 
-  entity->dirty = TRUE;
+  transform_changed (entity);
 
   rut_property_dirty (&entity->ctx->property_ctx,
                       &entity->properties[RUT_ENTITY_PROP_ROTATION]);
@@ -538,7 +565,7 @@ rut_entity_rotate_z_axis (RutEntity *entity,
   cogl_quaternion_multiply (&entity->rotation, &entity->rotation,
                             &z_rotation);
 
-  entity->dirty = TRUE;
+  transform_changed (entity);
 
   rut_property_dirty (&entity->ctx->property_ctx,
                       &entity->properties[RUT_ENTITY_PROP_ROTATION]);
@@ -646,3 +673,23 @@ rut_entity_notify_changed (RutEntity *entity)
       rut_renderer_notify_entity_changed (renderer, entity);
     }
 }
+
+RutClosure *
+rut_entity_add_change_callback (RutEntity *entity,
+                                RutEntityChangeCallback callback,
+                                void *user_data,
+                                RutClosureDestroyCallback destroy_cb)
+{
+  g_return_val_if_fail (callback != NULL, NULL);
+
+  return rut_closure_list_add (&entity->change_cb_list,
+                               callback,
+                               user_data,
+                               destroy_cb);
+}
+
+void
+rut_entity_notify_geometry_changed (RutEntity *entity)
+{
+  notify_change (entity, RUT_ENTITY_CHANGE_GEOMETRY);
+}
@@ -29,6 +29,7 @@
 #include "rut-interfaces.h"
 #include "rut-context.h"
 #include "rut-image-source.h"
+#include "rut-closure.h"
 
 #define RUT_COMPONENT(X) ((RutComponent *)(X))
 typedef struct _RutComponent RutComponent;
@@ -101,6 +102,8 @@ struct _RutEntity
   RutSimpleIntrospectableProps introspectable;
   RutProperty properties[RUT_ENTITY_N_PROPS];
 
+  RutList change_cb_list;
+
   unsigned int dirty:1;
 };
 
@@ -238,4 +241,29 @@ rut_entity_foreach_component_safe (RutEntity *entity,
 void
 rut_entity_notify_changed (RutEntity *entity);
 
+typedef enum
+{
+  RUT_ENTITY_CHANGE_TRANSFORM = 1 << 0,
+  RUT_ENTITY_CHANGE_GEOMETRY  = 1 << 1,
+} RutEntityChangeFlags;
+
+typedef void (*RutEntityChangeCallback) (RutEntity *entity,
+                                         RutEntityChangeFlags changes,
+                                         void *user_data);
+
+/* Registers a callback for whenever the entity's local transform
+ * changes or a component is added or removed or changes its mesh.
+ * This lets state derived from many entities, such as a spatial
+ * index, be kept up to date without polling every entity. */
+RutClosure *
+rut_entity_add_change_callback (RutEntity *entity,
+                                RutEntityChangeCallback callback,
+                                void *user_data,
+                                RutClosureDestroyCallback destroy_cb);
+
+/* Should be called by geometry components when the mesh returned by
+ * rut_meshable_get_mesh() is replaced */
+void
+rut_entity_notify_geometry_changed (RutEntity *entity);
+
 #endif /* __RUT_ENTITY_H__ */
@@ -22,6 +22,12 @@
 
 #include "rut-graphable.h"
 
+static unsigned int _rut_graphable_age;
+
+/* NB: this is accessed atomically because meshes can be modified by
+ * the asset loader's threads */
+static volatile int _rut_scene_generation;
+
 void
 rut_graphable_init (RutObject *object)
 {
@@ -32,6 +38,20 @@ rut_graphable_init (RutObject *object)
   props->children.head = NULL;
   props->children.tail = NULL;
   props->children.length = 0;
+  props->subtree_age = 0;
+}
+
+static void
+bump_subtree_ages (RutObject *object)
+{
+  while (object)
+    {
+      RutGraphableProps *props =
+        rut_object_get_properties (object, RUT_INTERFACE_ID_GRAPHABLE);
+
+      props->subtree_age++;
+      object = props->parent;
+    }
 }
 
 void
@@ -74,6 +94,11 @@ rut_graphable_add_child (RutObject *parent, RutObject *child)
 
   /* XXX: maybe this should be deferred to parent_vtable->child_added ? */
   g_queue_push_tail (&parent_props->children, child);
+
+  bump_subtree_ages (parent);
+
+  _rut_graphable_age++;
+  g_atomic_int_inc (&_rut_scene_generation);
 }
 
 void
@@ -101,6 +126,11 @@ rut_graphable_remove_child (RutObject *child)
 
   g_queue_remove (&parent_props->children, child);
   rut_refable_release (child, parent);
+
+  bump_subtree_ages (parent);
+
+  _rut_graphable_age++;
+  g_atomic_int_inc (&_rut_scene_generation);
 }
 
 void
@@ -129,6 +159,33 @@ rut_graphable_get_parent (RutObject *child)
   return _rut_graphable_get_parent (child);
 }
 
+unsigned int
+rut_graphable_get_age (void)
+{
+  return _rut_graphable_age;
+}
+
+unsigned int
+rut_graphable_get_subtree_age (RutObject *object)
+{
+  RutGraphableProps *props =
+    rut_object_get_properties (object, RUT_INTERFACE_ID_GRAPHABLE);
+
+  return props->subtree_age;
+}
+
+unsigned int
+rut_graphable_get_scene_generation (void)
+{
+  return g_atomic_int_get (&_rut_scene_generation);
+}
+
+void
+rut_graphable_bump_scene_generation (void)
+{
+  g_atomic_int_inc (&_rut_scene_generation);
+}
+
 RutObject *
 rut_graphable_first (RutObject *parent)
 {
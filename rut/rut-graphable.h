@@ -39,6 +39,9 @@ typedef struct _RutGraphableProps
 {
   RutObject *parent;
   GQueue children;
+
+  /* See rut_graphable_get_subtree_age() */
+  unsigned int subtree_age;
 } RutGraphableProps;
 
 #if 0
@@ -115,6 +118,32 @@ rut_graphable_remove_all_children (RutObject *parent);
 RutObject *
 rut_graphable_get_parent (RutObject *child);
 
+/* Returns a counter that is incremented whenever a child is added to
+ * or removed from any graph. This lets state derived from the
+ * structure of a graph, such as a spatial index, cheaply tell whether
+ * it needs to be rebuilt. */
+unsigned int
+rut_graphable_get_age (void);
+
+/* Like rut_graphable_get_age() but only counts children being added
+ * to or removed from @object or its descendants, so unrelated graphs
+ * changing doesn't make the state derived from this one look stale. */
+unsigned int
+rut_graphable_get_subtree_age (RutObject *object);
+
+/* Returns a counter that is incremented whenever anything changes that
+ * could change which object is under a given point: the structure of
+ * any graph, a transform, the size or geometry of something or whether
+ * it is visible. Code that makes such a change without going through
+ * the graphable, transformable or sizable APIs should call
+ * rut_graphable_bump_scene_generation(). This lets the shell avoid
+ * re-picking while hovering over a scene that isn't changing. */
+unsigned int
+rut_graphable_get_scene_generation (void);
+
+void
+rut_graphable_bump_scene_generation (void);
+
 RutObject *
 rut_graphable_first (RutObject *parent);
 
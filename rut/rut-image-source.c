@@ -39,6 +39,9 @@ struct _RutImageSource
 
   RutList changed_cb_list;
   RutList ready_cb_list;
+
+  /* Set while waiting for an asynchronously loaded asset */
+  RutClosure *asset_ready_closure;
 };
 
 typedef struct _ImageSourceWrappers
@@ -211,6 +214,9 @@ _rut_image_source_free (void *object)
 {
   RutImageSource *source = object;
 
+  if (source->asset_ready_closure)
+    rut_closure_disconnect (source->asset_ready_closure);
+
   _rut_image_source_video_stop (source);
 }
 
@@ -261,6 +267,25 @@ new_frame_cb (gpointer instance,
                            source);
 }
 
+static void
+asset_ready_cb (RutAsset *asset,
+                bool loaded,
+                void *user_data)
+{
+  RutImageSource *source = user_data;
+
+  source->asset_ready_closure = NULL;
+
+  if (!loaded)
+    return;
+
+  source->texture = rut_asset_get_texture (asset);
+
+  rut_closure_list_invoke (&source->ready_cb_list,
+                           RutImageSourceReadyCallback,
+                           source);
+}
+
 RutImageSource*
 rut_image_source_new (RutContext *ctx,
                       RutAsset *asset)
@@ -296,6 +321,14 @@ rut_image_source_new (RutContext *ctx,
     }
   else if (rut_asset_get_texture (asset))
     source->texture = rut_asset_get_texture (asset);
+  else
+    {
+      source->asset_ready_closure =
+        rut_asset_add_ready_callback (asset,
+                                      asset_ready_cb,
+                                      source,
+                                      NULL); /* destroy notify */
+    }
 
   return source;
 }
@@ -384,6 +384,8 @@ rut_input_region_set_rectangle (RutInputRegion *region,
   region->shape.rectangle.y0 = y0;
   region->shape.rectangle.x1 = x1;
   region->shape.rectangle.y1 = y1;
+
+  rut_graphable_bump_scene_generation ();
 }
 
 void
@@ -397,6 +399,8 @@ rut_input_region_set_circle (RutInputRegion *region,
   region->shape.circle.y = y;
   region->shape.circle.r = radius;
   region->shape.circle.r_squared = radius * radius;
+
+  rut_graphable_bump_scene_generation ();
 }
 
 void
@@ -404,4 +408,6 @@ rut_input_region_set_hud_mode (RutInputRegion *region,
                                bool hud_mode)
 {
   region->hud_mode = hud_mode;
+
+  rut_graphable_bump_scene_generation ();
 }
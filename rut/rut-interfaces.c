@@ -263,6 +263,8 @@ rut_sizable_set_size (RutObject *object,
   sizable->set_size (object,
                      width,
                      height);
+
+  rut_graphable_bump_scene_generation ();
 }
 
 void
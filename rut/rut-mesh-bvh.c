@@ -0,0 +1,633 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "rut-mesh-bvh.h"
+#include "rut-profile.h"
+#include "rut-triangle-packet.h"
+
+/* A single packet of triangles costs the same to test however many of
+ * its lanes are used so there's no point splitting it */
+#define MIN_LEAF_SIZE RUT_TRIANGLE_PACKET_SIZE
+
+/* Nodes with more triangles than this are always split, even if the
+ * surface area heuristic says splitting isn't worthwhile */
+#define MAX_LEAF_SIZE (RUT_TRIANGLE_PACKET_SIZE * 2)
+
+/* The cost of testing a ray against a node's bounds relative to
+ * testing it against a packet of triangles */
+#define TRAVERSAL_COST 1.0f
+
+#define N_BINS 16
+
+/* Each level of the tree may push at most one node onto the traversal
+ * stack so limiting the depth means the stack can't overflow */
+#define MAX_DEPTH 48
+#define STACK_SIZE (MAX_DEPTH + 1)
+
+typedef struct _BVHTriangle
+{
+  float v0[3];
+  float v1[3];
+  float v2[3];
+
+  /* The ordinal of the triangle in the original mesh */
+  int index;
+} BVHTriangle;
+
+typedef struct _BVHBounds
+{
+  float min[3];
+  float max[3];
+} BVHBounds;
+
+typedef struct _BVHNode
+{
+  BVHBounds bounds;
+
+  /* The first child of an inner node always immediately follows it so
+   * for an inner node this is the index of the second child. While
+   * building, for a leaf it's the index of its first triangle and
+   * afterwards the index of its first packet. */
+  int offset;
+
+  /* 0 for inner nodes */
+  int n_triangles;
+  int n_packets;
+} BVHNode;
+
+struct _RutMeshBVH
+{
+  BVHNode *nodes;
+  int n_nodes;
+
+  /* Only used while building */
+  BVHTriangle *triangles;
+  int n_triangles;
+
+  /* The triangles of each leaf are packed together so that they can
+   * be tested all at once */
+  RutTrianglePacket *packets;
+  int n_packets;
+};
+
+static void
+bounds_init (BVHBounds *bounds)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      bounds->min[i] = G_MAXFLOAT;
+      bounds->max[i] = -G_MAXFLOAT;
+    }
+}
+
+static void
+bounds_add_point (BVHBounds *bounds, const float point[3])
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      bounds->min[i] = MIN (bounds->min[i], point[i]);
+      bounds->max[i] = MAX (bounds->max[i], point[i]);
+    }
+}
+
+static void
+bounds_add_bounds (BVHBounds *bounds, const BVHBounds *other)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      bounds->min[i] = MIN (bounds->min[i], other->min[i]);
+      bounds->max[i] = MAX (bounds->max[i], other->max[i]);
+    }
+}
+
+static void
+bounds_add_triangle (BVHBounds *bounds, const BVHTriangle *triangle)
+{
+  bounds_add_point (bounds, triangle->v0);
+  bounds_add_point (bounds, triangle->v1);
+  bounds_add_point (bounds, triangle->v2);
+}
+
+/* Half the surface area, which is all the heuristic needs */
+static float
+bounds_get_area (const BVHBounds *bounds)
+{
+  float dx = bounds->max[0] - bounds->min[0];
+  float dy = bounds->max[1] - bounds->min[1];
+  float dz = bounds->max[2] - bounds->min[2];
+
+  if (dx < 0 || dy < 0 || dz < 0)
+    return 0;
+
+  return dx * dy + dy * dz + dz * dx;
+}
+
+/* The centroid is only used for comparisons so we don't bother
+ * dividing by 3 */
+static float
+get_centroid (const BVHTriangle *triangle, int axis)
+{
+  return triangle->v0[axis] + triangle->v1[axis] + triangle->v2[axis];
+}
+
+static int
+get_bin (const BVHTriangle *triangle,
+         int axis,
+         float centroid_min,
+         float scale)
+{
+  int bin = (get_centroid (triangle, axis) - centroid_min) * scale;
+
+  return CLAMP (bin, 0, N_BINS - 1);
+}
+
+static int
+get_n_packets (int n_triangles)
+{
+  return (n_triangles + RUT_TRIANGLE_PACKET_SIZE - 1) / RUT_TRIANGLE_PACKET_SIZE;
+}
+
+typedef struct _BVHBin
+{
+  BVHBounds bounds;
+  int n_triangles;
+} BVHBin;
+
+static int
+build_node (RutMeshBVH *bvh, int start, int end, int depth)
+{
+  int node_index = bvh->n_nodes++;
+  BVHNode *node = &bvh->nodes[node_index];
+  int n_triangles = end - start;
+  BVHBounds centroid_bounds;
+  BVHBin bins[N_BINS];
+  float right_area[N_BINS];
+  int right_count[N_BINS];
+  BVHBounds accum;
+  float best_cost, leaf_cost, scale, extent;
+  int best_split = -1;
+  int axis, left_count;
+  int mid;
+  int i, j;
+
+  bounds_init (&node->bounds);
+  bounds_init (&centroid_bounds);
+
+  for (i = start; i < end; i++)
+    {
+      BVHTriangle *triangle = &bvh->triangles[i];
+      float centroid[3] = {
+        get_centroid (triangle, 0),
+        get_centroid (triangle, 1),
+        get_centroid (triangle, 2)
+      };
+
+      bounds_add_triangle (&node->bounds, triangle);
+      bounds_add_point (&centroid_bounds, centroid);
+    }
+
+  if (n_triangles <= MIN_LEAF_SIZE || depth >= MAX_DEPTH)
+    goto leaf;
+
+  axis = 0;
+  for (i = 1; i < 3; i++)
+    if (centroid_bounds.max[i] - centroid_bounds.min[i] >
+        centroid_bounds.max[axis] - centroid_bounds.min[axis])
+      axis = i;
+
+  extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+
+  /* All the centroids coincide so there's no useful way to split */
+  if (extent <= 0)
+    goto leaf;
+
+  scale = N_BINS / extent;
+
+  for (i = 0; i < N_BINS; i++)
+    {
+      bounds_init (&bins[i].bounds);
+      bins[i].n_triangles = 0;
+    }
+
+  for (i = start; i < end; i++)
+    {
+      BVHTriangle *triangle = &bvh->triangles[i];
+      BVHBin *bin =
+        &bins[get_bin (triangle, axis, centroid_bounds.min[axis], scale)];
+
+      bounds_add_triangle (&bin->bounds, triangle);
+      bin->n_triangles++;
+    }
+
+  /* Sweep from the right to find the cost of everything to the right
+   * of each split plane, then from the left to evaluate each split */
+  bounds_init (&accum);
+  right_count[N_BINS - 1] = 0;
+  for (i = N_BINS - 1; i > 0; i--)
+    {
+      bounds_add_bounds (&accum, &bins[i].bounds);
+      right_area[i - 1] = bounds_get_area (&accum);
+      right_count[i - 1] = right_count[i] + bins[i].n_triangles;
+    }
+
+  best_cost = G_MAXFLOAT;
+  bounds_init (&accum);
+  left_count = 0;
+  for (i = 0; i < N_BINS - 1; i++)
+    {
+      float cost;
+
+      bounds_add_bounds (&accum, &bins[i].bounds);
+      left_count += bins[i].n_triangles;
+
+      if (left_count == 0 || right_count[i] == 0)
+        continue;
+
+      cost = get_n_packets (left_count) * bounds_get_area (&accum) +
+        get_n_packets (right_count[i]) * right_area[i];
+
+      if (cost < best_cost)
+        {
+          best_cost = cost;
+          best_split = i;
+        }
+    }
+
+  best_cost += TRAVERSAL_COST * bounds_get_area (&node->bounds);
+  leaf_cost = get_n_packets (n_triangles) * bounds_get_area (&node->bounds);
+
+  if (best_split < 0 ||
+      (n_triangles <= MAX_LEAF_SIZE && best_cost >= leaf_cost))
+    goto leaf;
+
+  /* Partition the triangles in place about the chosen split */
+  i = start;
+  j = end - 1;
+  while (i <= j)
+    {
+      if (get_bin (&bvh->triangles[i], axis,
+                   centroid_bounds.min[axis], scale) <= best_split)
+        i++;
+      else
+        {
+          BVHTriangle tmp = bvh->triangles[i];
+          bvh->triangles[i] = bvh->triangles[j];
+          bvh->triangles[j--] = tmp;
+        }
+    }
+  mid = i;
+
+  /* Shouldn't happen since the split was chosen to leave triangles on
+   * both sides but it's not worth risking unbounded recursion over
+   * rounding differences */
+  if (mid == start || mid == end)
+    mid = start + n_triangles / 2;
+
+  node->n_triangles = 0;
+  node->n_packets = 0;
+
+  /* The node array is allocated up front so node stays valid */
+  build_node (bvh, start, mid, depth + 1);
+  node->offset = build_node (bvh, mid, end, depth + 1);
+
+  return node_index;
+
+leaf:
+  node->offset = start;
+  node->n_triangles = n_triangles;
+  node->n_packets = get_n_packets (n_triangles);
+  bvh->n_packets += node->n_packets;
+
+  return node_index;
+}
+
+static void
+pack_leaves (RutMeshBVH *bvh)
+{
+  RutTrianglePacket *packet;
+  int i, j;
+
+  packet = bvh->packets = g_new (RutTrianglePacket, bvh->n_packets);
+
+  for (i = 0; i < bvh->n_nodes; i++)
+    {
+      BVHNode *node = &bvh->nodes[i];
+      BVHTriangle *triangle;
+
+      if (node->n_packets == 0)
+        continue;
+
+      triangle = &bvh->triangles[node->offset];
+      node->offset = packet - bvh->packets;
+
+      for (j = 0; j < node->n_triangles; j++, triangle++)
+        {
+          int lane = j % RUT_TRIANGLE_PACKET_SIZE;
+
+          if (lane == 0)
+            rut_triangle_packet_init (packet);
+
+          rut_triangle_packet_set_triangle (packet, lane,
+                                            triangle->v0,
+                                            triangle->v1,
+                                            triangle->v2,
+                                            triangle->index);
+
+          if (lane == RUT_TRIANGLE_PACKET_SIZE - 1)
+            packet++;
+        }
+
+      if (node->n_triangles % RUT_TRIANGLE_PACKET_SIZE)
+        packet++;
+    }
+}
+
+static CoglBool
+add_triangle_cb (void **attributes_v0,
+                 void **attributes_v1,
+                 void **attributes_v2,
+                 int index_v0,
+                 int index_v1,
+                 int index_v2,
+                 void *user_data)
+{
+  GArray *triangles = user_data;
+  BVHTriangle triangle;
+
+  memcpy (triangle.v0, attributes_v0[0], sizeof (triangle.v0));
+  memcpy (triangle.v1, attributes_v1[0], sizeof (triangle.v1));
+  memcpy (triangle.v2, attributes_v2[0], sizeof (triangle.v2));
+  triangle.index = triangles->len;
+
+  g_array_append_val (triangles, triangle);
+
+  return TRUE;
+}
+
+RutMeshBVH *
+rut_mesh_bvh_new (RutMesh *mesh)
+{
+  RutMeshBVH *bvh = g_slice_new0 (RutMeshBVH);
+  int n_vertices = mesh->indices_buffer ? mesh->n_indices : mesh->n_vertices;
+  GArray *triangles =
+    g_array_sized_new (FALSE, FALSE, sizeof (BVHTriangle), n_vertices / 3);
+
+  RUT_STATIC_TIMER (build_timer,
+                    "Mainloop",
+                    "Mesh BVH build",
+                    "Building bounding volume hierarchies for picking",
+                    0);
+
+  RUT_TIMER_START (build_timer);
+
+  rut_mesh_foreach_triangle (mesh,
+                             add_triangle_cb,
+                             triangles,
+                             "cogl_position_in",
+                             NULL);
+
+  bvh->n_triangles = triangles->len;
+  bvh->triangles = (BVHTriangle *)g_array_free (triangles, FALSE);
+
+  if (bvh->n_triangles)
+    {
+      /* A binary tree with a non-empty leaf per triangle at most */
+      bvh->nodes = g_new (BVHNode, bvh->n_triangles * 2 - 1);
+      build_node (bvh, 0, bvh->n_triangles, 0);
+      bvh->nodes = g_renew (BVHNode, bvh->nodes, bvh->n_nodes);
+
+      pack_leaves (bvh);
+    }
+
+  g_free (bvh->triangles);
+  bvh->triangles = NULL;
+
+  RUT_TIMER_STOP (build_timer);
+
+  return bvh;
+}
+
+void
+rut_mesh_bvh_free (RutMeshBVH *bvh)
+{
+  g_free (bvh->nodes);
+  g_free (bvh->packets);
+  g_slice_free (RutMeshBVH, bvh);
+}
+
+bool
+rut_mesh_bvh_get_bounds (RutMeshBVH *bvh,
+                         float min[3],
+                         float max[3])
+{
+  if (bvh->n_nodes == 0)
+    return false;
+
+  memcpy (min, bvh->nodes[0].bounds.min, sizeof (float) * 3);
+  memcpy (max, bvh->nodes[0].bounds.max, sizeof (float) * 3);
+
+  return true;
+}
+
+/* Slab test of the ray against a node's bounds, clipped to the part of
+ * the ray between the origin and @max_t */
+static bool
+intersect_node (const BVHNode *node,
+                const float ray_origin[3],
+                const float inv_direction[3],
+                float max_t,
+                float *t_out)
+{
+  float t_min = 0;
+  float t_max = max_t;
+  int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      float t0 = (node->bounds.min[i] - ray_origin[i]) * inv_direction[i];
+      float t1 = (node->bounds.max[i] - ray_origin[i]) * inv_direction[i];
+
+      if (t0 > t1)
+        {
+          float tmp = t0;
+          t0 = t1;
+          t1 = tmp;
+        }
+
+      t_min = MAX (t_min, t0);
+      t_max = MIN (t_max, t1);
+
+      if (t_min > t_max)
+        return false;
+    }
+
+  *t_out = t_min;
+
+  return true;
+}
+
+bool
+rut_mesh_bvh_intersect (RutMeshBVH *bvh,
+                        float ray_origin[3],
+                        float ray_direction[3],
+                        int *index,
+                        float *t_out)
+{
+  int stack[STACK_SIZE];
+  float stack_t[STACK_SIZE];
+  int stack_size = 0;
+  float inv_direction[3];
+  float min_t = G_MAXFLOAT;
+  int hit_index = -1;
+  int node_index = 0;
+  int i;
+
+  if (bvh->n_nodes == 0)
+    return false;
+
+  /* Avoid infinities so that a ray lying in the plane of a slab gives
+   * 0 rather than NaN */
+  for (i = 0; i < 3; i++)
+    {
+      float d = ray_direction[i];
+
+      if (fabsf (d) < 1e-20f)
+        d = d < 0 ? -1e-20f : 1e-20f;
+
+      inv_direction[i] = 1.0f / d;
+    }
+
+  for (;;)
+    {
+      const BVHNode *node = &bvh->nodes[node_index];
+
+      if (node->n_packets)
+        {
+          const RutTrianglePacket *packet = &bvh->packets[node->offset];
+
+          for (i = 0; i < node->n_packets; i++, packet++)
+            {
+              float t[RUT_TRIANGLE_PACKET_SIZE];
+              int hits = rut_triangle_packet_intersect (packet,
+                                                        ray_origin,
+                                                        ray_direction,
+                                                        t);
+              int lane;
+
+              /* The packet only reports hits in front of the ray
+               * origin. Ties go to the earliest triangle so that the
+               * result matches a linear search of the mesh. */
+              for (lane = 0; hits; lane++, hits >>= 1)
+                {
+                  int index = packet->index[lane];
+
+                  if ((hits & 1) &&
+                      (t[lane] < min_t ||
+                       (t[lane] == min_t && index < hit_index)))
+                    {
+                      min_t = t[lane];
+                      hit_index = index;
+                    }
+                }
+            }
+        }
+      else
+        {
+          int near = node_index + 1;
+          int far = node->offset;
+          float near_t, far_t;
+          bool hit_near = intersect_node (&bvh->nodes[near],
+                                          ray_origin, inv_direction,
+                                          min_t, &near_t);
+          bool hit_far = intersect_node (&bvh->nodes[far],
+                                         ray_origin, inv_direction,
+                                         min_t, &far_t);
+
+          if (hit_near && hit_far)
+            {
+              /* Visit the nearer child first so that min_t shrinks as
+               * quickly as possible */
+              if (far_t < near_t)
+                {
+                  int tmp = near;
+                  float tmp_t = near_t;
+
+                  near = far;
+                  near_t = far_t;
+                  far = tmp;
+                  far_t = tmp_t;
+                }
+
+              stack[stack_size] = far;
+              stack_t[stack_size++] = far_t;
+              node_index = near;
+              continue;
+            }
+          else if (hit_near)
+            {
+              node_index = near;
+              continue;
+            }
+          else if (hit_far)
+            {
+              node_index = far;
+              continue;
+            }
+        }
+
+      /* Pop the next node, skipping any that are now further away than
+       * the closest hit found so far */
+      do
+        {
+          if (stack_size == 0)
+            goto done;
+
+          stack_size--;
+        }
+      while (stack_t[stack_size] > min_t);
+
+      node_index = stack[stack_size];
+    }
+
+done:
+  if (hit_index < 0)
+    return false;
+
+  if (t_out)
+    *t_out = min_t;
+
+  if (index)
+    *index = hit_index;
+
+  return true;
+}
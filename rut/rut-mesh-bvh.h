@@ -0,0 +1,63 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RUT_MESH_BVH_H_
+#define _RUT_MESH_BVH_H_
+
+#include <stdbool.h>
+
+#include "rut-mesh.h"
+
+/* A bounding volume hierarchy over the triangles of a RutMesh's
+ * "cogl_position_in" attribute so that a ray can be intersected with
+ * the mesh without testing every triangle.
+ *
+ * The hierarchy is built with a binned surface area heuristic and
+ * holds its own copy of the triangle positions, so it has to be
+ * rebuilt if the mesh's vertices or indices change. Normally you
+ * don't need to create one yourself; rut_mesh_get_bvh() lazily builds
+ * one that is cached with the mesh and rut_mesh_dirty() discards it.
+ */
+
+RutMeshBVH *
+rut_mesh_bvh_new (RutMesh *mesh);
+
+void
+rut_mesh_bvh_free (RutMeshBVH *bvh);
+
+/* Gets the bounding box of all the mesh's triangles. Returns false
+ * if the mesh has no triangles. */
+bool
+rut_mesh_bvh_get_bounds (RutMeshBVH *bvh,
+                         float min[3],
+                         float max[3]);
+
+/* Finds the nearest triangle in front of the ray origin that the ray
+ * hits. @index is set to the ordinal of the triangle as enumerated by
+ * rut_mesh_foreach_triangle() and @t_out to the distance along the
+ * ray in units of @ray_direction. */
+bool
+rut_mesh_bvh_intersect (RutMeshBVH *bvh,
+                        float ray_origin[3],
+                        float ray_direction[3],
+                        int *index,
+                        float *t_out);
+
+#endif /* _RUT_MESH_BVH_H_ */
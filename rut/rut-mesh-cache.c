@@ -0,0 +1,746 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "rut-mesh-cache.h"
+#include "rut-util.h"
+#include "rut-profile.h"
+
+/* Bump this whenever the layout of the cache files changes */
+#define CACHE_MAGIC "RUTMSHC1"
+#define CACHE_MAGIC_LEN 8
+
+/* Written in the host's byte order so that a cache file copied to a
+ * machine with a different byte order is simply ignored */
+#define CACHE_BYTE_ORDER 0x01020304
+
+/* The alignment of the buffer data within the file */
+#define CACHE_DATA_ALIGNMENT 16
+#define ALIGN_DATA(OFFSET) \
+  (((OFFSET) + CACHE_DATA_ALIGNMENT - 1) & ~(size_t) (CACHE_DATA_ALIGNMENT - 1))
+
+/* Each cache directory is limited to this size, after which the least
+ * recently used entries are deleted */
+#define CACHE_MAX_SIZE ((uint64_t) 256 * 1024 * 1024)
+
+/* Attribute names are short identifiers like "cogl_position_in" */
+#define CACHE_MAX_NAME_LEN 256
+
+/* A cache file is laid out as:
+ *
+ *   CacheHeader
+ *   CacheBuffer[n_buffers]
+ *   float extra[n_extra]
+ *   for each mesh:
+ *     CacheMesh
+ *     for each attribute:
+ *       CacheAttribute
+ *       the name, padded to a multiple of 4 bytes
+ *   the data of each buffer, aligned to CACHE_DATA_ALIGNMENT
+ */
+typedef struct _CacheHeader
+{
+  char magic[CACHE_MAGIC_LEN];
+  uint32_t byte_order;
+  uint32_t n_meshes;
+  uint32_t n_extra;
+  uint32_t n_buffers;
+} CacheHeader;
+
+typedef struct _CacheBuffer
+{
+  uint64_t offset;
+  uint64_t size;
+} CacheBuffer;
+
+typedef struct _CacheMesh
+{
+  uint32_t mode;
+  uint32_t n_vertices;
+  uint32_t n_attributes;
+  uint32_t indices_type;
+  uint32_t n_indices;
+  int32_t indices_buffer;
+} CacheMesh;
+
+typedef struct _CacheAttribute
+{
+  uint32_t buffer;
+  uint32_t stride;
+  uint32_t offset;
+  uint32_t n_components;
+  uint32_t type;
+  uint32_t normalized;
+  uint32_t name_len;
+} CacheAttribute;
+
+struct _RutMeshCacheKey
+{
+  GChecksum *checksum;
+};
+
+static bool
+cache_disabled (void)
+{
+  /* NB: this is checked from the asset loader's threads. Zero means
+   * the variable hasn't been read yet so the value is offset by one */
+  static gsize disabled = 0;
+
+  if (g_once_init_enter (&disabled))
+    {
+      bool value = rut_util_is_boolean_env_set ("RUT_DISABLE_MESH_CACHE");
+
+      g_once_init_leave (&disabled, value + 1);
+    }
+
+  return disabled - 1;
+}
+
+static int
+find_buffer_index (GPtrArray *buffers,
+                   RutBuffer *buffer)
+{
+  int i;
+
+  for (i = 0; i < buffers->len; i++)
+    if (g_ptr_array_index (buffers, i) == buffer)
+      return i;
+
+  return -1;
+}
+
+/* Gathers the distinct buffers referenced by @meshes in the order
+ * they are first referenced */
+static void
+collect_buffers (RutMesh **meshes,
+                 int n_meshes,
+                 GPtrArray *buffers)
+{
+  int i, j;
+
+  for (i = 0; i < n_meshes; i++)
+    {
+      RutMesh *mesh = meshes[i];
+
+      for (j = 0; j < mesh->n_attributes; j++)
+        {
+          RutBuffer *buffer = mesh->attributes[j]->buffer;
+
+          if (find_buffer_index (buffers, buffer) == -1)
+            g_ptr_array_add (buffers, buffer);
+        }
+
+      if (mesh->indices_buffer &&
+          find_buffer_index (buffers, mesh->indices_buffer) == -1)
+        g_ptr_array_add (buffers, mesh->indices_buffer);
+    }
+}
+
+RutMeshCacheKey *
+rut_mesh_cache_key_new (const char *kind)
+{
+  RutMeshCacheKey *key = g_slice_new (RutMeshCacheKey);
+
+  key->checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+  g_checksum_update (key->checksum,
+                     (const guchar *) CACHE_MAGIC, CACHE_MAGIC_LEN);
+  g_checksum_update (key->checksum,
+                     (const guchar *) kind, strlen (kind) + 1);
+
+  return key;
+}
+
+void
+rut_mesh_cache_key_add_int (RutMeshCacheKey *key,
+                            int value)
+{
+  int32_t v = value;
+
+  g_checksum_update (key->checksum, (const guchar *) &v, sizeof (v));
+}
+
+void
+rut_mesh_cache_key_add_string (RutMeshCacheKey *key,
+                               const char *value)
+{
+  g_checksum_update (key->checksum,
+                     (const guchar *) value, strlen (value) + 1);
+}
+
+void
+rut_mesh_cache_key_add_mesh (RutMeshCacheKey *key,
+                             RutMesh *mesh)
+{
+  GPtrArray *buffers = g_ptr_array_new ();
+  int i;
+
+  collect_buffers (&mesh, 1, buffers);
+
+  rut_mesh_cache_key_add_int (key, mesh->mode);
+  rut_mesh_cache_key_add_int (key, mesh->n_vertices);
+  rut_mesh_cache_key_add_int (key, mesh->n_attributes);
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    {
+      RutAttribute *attribute = mesh->attributes[i];
+
+      g_checksum_update (key->checksum,
+                         (const guchar *) attribute->name,
+                         strlen (attribute->name) + 1);
+      rut_mesh_cache_key_add_int (key,
+                                  find_buffer_index (buffers,
+                                                     attribute->buffer));
+      rut_mesh_cache_key_add_int (key, attribute->stride);
+      rut_mesh_cache_key_add_int (key, attribute->offset);
+      rut_mesh_cache_key_add_int (key, attribute->n_components);
+      rut_mesh_cache_key_add_int (key, attribute->type);
+      rut_mesh_cache_key_add_int (key, attribute->normalized);
+    }
+
+  rut_mesh_cache_key_add_int (key,
+                              find_buffer_index (buffers,
+                                                 mesh->indices_buffer));
+  if (mesh->indices_buffer)
+    {
+      rut_mesh_cache_key_add_int (key, mesh->indices_type);
+      rut_mesh_cache_key_add_int (key, mesh->n_indices);
+    }
+
+  for (i = 0; i < buffers->len; i++)
+    {
+      RutBuffer *buffer = g_ptr_array_index (buffers, i);
+
+      rut_mesh_cache_key_add_int (key, buffer->size);
+      g_checksum_update (key->checksum, buffer->data, buffer->size);
+    }
+
+  g_ptr_array_free (buffers, TRUE);
+}
+
+void
+rut_mesh_cache_key_free (RutMeshCacheKey *key)
+{
+  g_checksum_free (key->checksum);
+  g_slice_free (RutMeshCacheKey, key);
+}
+
+static char *
+get_entry_filename (const char *cache_dir,
+                    RutMeshCacheKey *key)
+{
+  char *basename =
+    g_strconcat (g_checksum_get_string (key->checksum), ".mesh", NULL);
+  char *filename = g_build_filename (cache_dir, basename, NULL);
+
+  g_free (basename);
+
+  return filename;
+}
+
+typedef struct _Reader
+{
+  const uint8_t *data;
+  size_t size;
+  size_t pos;
+} Reader;
+
+static bool
+read_bytes (Reader *reader,
+            void *dest,
+            size_t len)
+{
+  if (reader->size - reader->pos < len)
+    return false;
+
+  memcpy (dest, reader->data + reader->pos, len);
+  reader->pos += len;
+
+  return true;
+}
+
+static size_t
+get_sizeof_attribute_type (RutAttributeType type)
+{
+  switch (type)
+    {
+    case RUT_ATTRIBUTE_TYPE_BYTE:
+    case RUT_ATTRIBUTE_TYPE_UNSIGNED_BYTE:
+      return 1;
+    case RUT_ATTRIBUTE_TYPE_SHORT:
+    case RUT_ATTRIBUTE_TYPE_UNSIGNED_SHORT:
+      return 2;
+    case RUT_ATTRIBUTE_TYPE_FLOAT:
+      return 4;
+    }
+
+  return 0;
+}
+
+static size_t
+get_sizeof_indices_type (CoglIndicesType type)
+{
+  switch (type)
+    {
+    case COGL_INDICES_TYPE_UNSIGNED_BYTE:
+      return 1;
+    case COGL_INDICES_TYPE_UNSIGNED_SHORT:
+      return 2;
+    case COGL_INDICES_TYPE_UNSIGNED_INT:
+      return 4;
+    }
+
+  return 0;
+}
+
+/* The file could have been truncated or corrupted after it was
+ * written so everything is validated before anything is created */
+static RutMesh *
+read_mesh (Reader *reader,
+           RutBuffer **buffers,
+           int n_buffers)
+{
+  CacheMesh cache_mesh;
+  RutAttribute **attributes;
+  RutMesh *mesh = NULL;
+  int i;
+
+  if (!read_bytes (reader, &cache_mesh, sizeof (cache_mesh)) ||
+      cache_mesh.n_attributes == 0 ||
+      cache_mesh.n_attributes > 64)
+    return NULL;
+
+  attributes = g_new0 (RutAttribute *, cache_mesh.n_attributes);
+
+  for (i = 0; i < cache_mesh.n_attributes; i++)
+    {
+      CacheAttribute cache_attribute;
+      RutBuffer *buffer;
+      size_t padded_len;
+      size_t component_size;
+      char *name;
+
+      if (!read_bytes (reader, &cache_attribute, sizeof (cache_attribute)) ||
+          cache_attribute.buffer >= n_buffers)
+        goto done;
+
+      buffer = buffers[cache_attribute.buffer];
+
+      component_size = get_sizeof_attribute_type (cache_attribute.type);
+      if (component_size == 0 ||
+          cache_attribute.n_components < 1 ||
+          cache_attribute.n_components > 4)
+        goto done;
+
+      if (cache_mesh.n_vertices > 0 &&
+          ((uint64_t) cache_attribute.stride * (cache_mesh.n_vertices - 1) +
+           cache_attribute.offset +
+           component_size * cache_attribute.n_components) > buffer->size)
+        goto done;
+
+      /* NB: the length is checked before padding it so that a
+       * corrupt length can't wrap around */
+      if (cache_attribute.name_len == 0 ||
+          cache_attribute.name_len > CACHE_MAX_NAME_LEN ||
+          cache_attribute.name_len > reader->size - reader->pos)
+        goto done;
+
+      padded_len = ((size_t) cache_attribute.name_len + 3) & ~(size_t) 3;
+      if (reader->size - reader->pos < padded_len)
+        goto done;
+
+      name = g_strndup ((const char *) reader->data + reader->pos,
+                        cache_attribute.name_len);
+      reader->pos += padded_len;
+
+      attributes[i] = rut_attribute_new (buffer,
+                                         name,
+                                         cache_attribute.stride,
+                                         cache_attribute.offset,
+                                         cache_attribute.n_components,
+                                         cache_attribute.type);
+      rut_attribute_set_normalized (attributes[i],
+                                    cache_attribute.normalized);
+      g_free (name);
+    }
+
+  if (cache_mesh.indices_buffer >= 0)
+    {
+      size_t index_size = get_sizeof_indices_type (cache_mesh.indices_type);
+
+      if (cache_mesh.indices_buffer >= n_buffers ||
+          index_size == 0 ||
+          (uint64_t) index_size * cache_mesh.n_indices >
+          buffers[cache_mesh.indices_buffer]->size)
+        goto done;
+    }
+
+  mesh = rut_mesh_new (cache_mesh.mode,
+                       cache_mesh.n_vertices,
+                       attributes,
+                       cache_mesh.n_attributes);
+
+  if (cache_mesh.indices_buffer >= 0)
+    rut_mesh_set_indices (mesh,
+                          cache_mesh.indices_type,
+                          buffers[cache_mesh.indices_buffer],
+                          cache_mesh.n_indices);
+
+done:
+
+  for (i = 0; i < cache_mesh.n_attributes; i++)
+    if (attributes[i])
+      rut_refable_unref (attributes[i]);
+  g_free (attributes);
+
+  return mesh;
+}
+
+bool
+rut_mesh_cache_load (const char *cache_dir,
+                     RutMeshCacheKey *key,
+                     RutMesh **meshes,
+                     int n_meshes,
+                     float *extra,
+                     int n_extra)
+{
+  char *filename;
+  GMappedFile *mapped_file;
+  Reader reader;
+  CacheHeader header;
+  RutBuffer **buffers = NULL;
+  int n_loaded = 0;
+  bool ret = false;
+  int i;
+
+  RUT_STATIC_TIMER (load_timer,
+                    "Mainloop",
+                    "Mesh cache load",
+                    "Mapping derived meshes from the mesh cache",
+                    0);
+  RUT_STATIC_COUNTER (hit_counter,
+                      "Mesh cache hit counter",
+                      "Increments for each mesh cache entry reused",
+                      0);
+  RUT_STATIC_COUNTER (miss_counter,
+                      "Mesh cache miss counter",
+                      "Increments for each mesh cache lookup that failed",
+                      0);
+
+  if (cache_disabled ())
+    return false;
+
+  RUT_TIMER_START (load_timer);
+
+  filename = get_entry_filename (cache_dir, key);
+
+  /* NB: the mapping is writable but private so if anything modifies
+   * the buffers it only gets a copy of the modified pages. The file
+   * itself is only opened for reading. */
+  mapped_file = rut_util_map_file_private (filename, NULL);
+
+  if (mapped_file == NULL)
+    goto done;
+
+  reader.data = (const uint8_t *) g_mapped_file_get_contents (mapped_file);
+  reader.size = g_mapped_file_get_length (mapped_file);
+  reader.pos = 0;
+
+  if (!read_bytes (&reader, &header, sizeof (header)) ||
+      memcmp (header.magic, CACHE_MAGIC, CACHE_MAGIC_LEN) != 0 ||
+      header.byte_order != CACHE_BYTE_ORDER ||
+      header.n_meshes != n_meshes ||
+      header.n_extra != n_extra ||
+      header.n_buffers == 0 ||
+      header.n_buffers > reader.size / sizeof (CacheBuffer))
+    goto done;
+
+  buffers = g_new0 (RutBuffer *, header.n_buffers);
+
+  for (i = 0; i < header.n_buffers; i++)
+    {
+      CacheBuffer cache_buffer;
+
+      if (!read_bytes (&reader, &cache_buffer, sizeof (cache_buffer)) ||
+          cache_buffer.offset > reader.size ||
+          cache_buffer.size > reader.size - cache_buffer.offset)
+        goto done;
+
+      buffers[i] =
+        rut_buffer_new_for_data ((uint8_t *) reader.data + cache_buffer.offset,
+                                 cache_buffer.size,
+                                 (GDestroyNotify) g_mapped_file_unref,
+                                 g_mapped_file_ref (mapped_file));
+    }
+
+  if (!read_bytes (&reader, extra, sizeof (float) * n_extra))
+    goto done;
+
+  for (n_loaded = 0; n_loaded < n_meshes; n_loaded++)
+    {
+      meshes[n_loaded] = read_mesh (&reader, buffers, header.n_buffers);
+      if (meshes[n_loaded] == NULL)
+        goto done;
+    }
+
+  ret = true;
+
+  rut_util_touch_cache_file (filename);
+
+done:
+
+  g_free (filename);
+
+  if (!ret)
+    {
+      for (i = 0; i < n_loaded; i++)
+        rut_refable_unref (meshes[i]);
+    }
+
+  if (buffers)
+    {
+      for (i = 0; i < header.n_buffers; i++)
+        if (buffers[i])
+          rut_refable_unref (buffers[i]);
+      g_free (buffers);
+    }
+
+  /* The buffers hold their own references on the mapping */
+  if (mapped_file)
+    g_mapped_file_unref (mapped_file);
+
+  if (ret)
+    RUT_COUNTER_INC (hit_counter);
+  else
+    RUT_COUNTER_INC (miss_counter);
+
+  RUT_TIMER_STOP (load_timer);
+
+  return ret;
+}
+
+static void
+append_mesh (GByteArray *metadata,
+             RutMesh *mesh,
+             GPtrArray *buffers)
+{
+  static const uint8_t padding[4] = { 0 };
+  CacheMesh cache_mesh;
+  int i;
+
+  memset (&cache_mesh, 0, sizeof (cache_mesh));
+  cache_mesh.mode = mesh->mode;
+  cache_mesh.n_vertices = mesh->n_vertices;
+  cache_mesh.n_attributes = mesh->n_attributes;
+  cache_mesh.indices_buffer = find_buffer_index (buffers,
+                                                 mesh->indices_buffer);
+  if (mesh->indices_buffer)
+    {
+      cache_mesh.indices_type = mesh->indices_type;
+      cache_mesh.n_indices = mesh->n_indices;
+    }
+
+  g_byte_array_append (metadata, (const guint8 *) &cache_mesh,
+                       sizeof (cache_mesh));
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    {
+      RutAttribute *attribute = mesh->attributes[i];
+      CacheAttribute cache_attribute;
+      size_t name_len = strlen (attribute->name);
+
+      cache_attribute.buffer = find_buffer_index (buffers, attribute->buffer);
+      cache_attribute.stride = attribute->stride;
+      cache_attribute.offset = attribute->offset;
+      cache_attribute.n_components = attribute->n_components;
+      cache_attribute.type = attribute->type;
+      cache_attribute.normalized = attribute->normalized;
+      cache_attribute.name_len = name_len;
+
+      g_byte_array_append (metadata, (const guint8 *) &cache_attribute,
+                           sizeof (cache_attribute));
+      g_byte_array_append (metadata, (const guint8 *) attribute->name,
+                           name_len);
+      g_byte_array_append (metadata, padding, ((name_len + 3) & ~3) - name_len);
+    }
+}
+
+static bool
+write_all (FILE *fp,
+           const void *data,
+           size_t len)
+{
+  return len == 0 || fwrite (data, len, 1, fp) == 1;
+}
+
+void
+rut_mesh_cache_save (const char *cache_dir,
+                     RutMeshCacheKey *key,
+                     RutMesh **meshes,
+                     int n_meshes,
+                     const float *extra,
+                     int n_extra)
+{
+  static const uint8_t padding[CACHE_DATA_ALIGNMENT] = { 0 };
+  GPtrArray *buffers;
+  GByteArray *metadata;
+  CacheHeader header;
+  char *filename = NULL;
+  char *tmp_filename = NULL;
+  FILE *fp = NULL;
+  size_t offset;
+  int fd;
+  int i;
+
+  RUT_STATIC_TIMER (save_timer,
+                    "Mainloop",
+                    "Mesh cache save",
+                    "Writing derived meshes to the mesh cache",
+                    0);
+
+  if (cache_disabled ())
+    return;
+
+  RUT_TIMER_START (save_timer);
+
+  buffers = g_ptr_array_new ();
+  collect_buffers (meshes, n_meshes, buffers);
+
+  metadata = g_byte_array_new ();
+  g_byte_array_append (metadata, (const guint8 *) extra,
+                       sizeof (float) * n_extra);
+  for (i = 0; i < n_meshes; i++)
+    append_mesh (metadata, meshes[i], buffers);
+
+  memcpy (header.magic, CACHE_MAGIC, CACHE_MAGIC_LEN);
+  header.byte_order = CACHE_BYTE_ORDER;
+  header.n_meshes = n_meshes;
+  header.n_extra = n_extra;
+  header.n_buffers = buffers->len;
+
+  if (g_mkdir_with_parents (cache_dir, 0755) == -1)
+    {
+      g_warning ("Failed to create mesh cache directory %s: %s",
+                 cache_dir, g_strerror (errno));
+      goto done;
+    }
+
+  /* The entry is written to a temporary file in the same directory
+   * and then renamed over the final name so that concurrent readers
+   * never see a partial file */
+  filename = get_entry_filename (cache_dir, key);
+  tmp_filename = g_strconcat (filename, ".XXXXXX", NULL);
+
+  fd = g_mkstemp_full (tmp_filename, O_RDWR, 0644);
+  if (fd == -1 || (fp = fdopen (fd, "wb")) == NULL)
+    {
+      g_warning ("Failed to create mesh cache entry %s: %s",
+                 tmp_filename, g_strerror (errno));
+      if (fd != -1)
+        {
+          close (fd);
+          g_unlink (tmp_filename);
+        }
+      goto done;
+    }
+
+  if (!write_all (fp, &header, sizeof (header)))
+    goto write_error;
+
+  offset = sizeof (header) + sizeof (CacheBuffer) * buffers->len +
+    metadata->len;
+
+  for (i = 0; i < buffers->len; i++)
+    {
+      RutBuffer *buffer = g_ptr_array_index (buffers, i);
+      CacheBuffer cache_buffer;
+
+      offset = ALIGN_DATA (offset);
+
+      cache_buffer.offset = offset;
+      cache_buffer.size = buffer->size;
+
+      if (!write_all (fp, &cache_buffer, sizeof (cache_buffer)))
+        goto write_error;
+
+      offset += buffer->size;
+    }
+
+  if (!write_all (fp, metadata->data, metadata->len))
+    goto write_error;
+
+  offset = sizeof (header) + sizeof (CacheBuffer) * buffers->len +
+    metadata->len;
+
+  for (i = 0; i < buffers->len; i++)
+    {
+      RutBuffer *buffer = g_ptr_array_index (buffers, i);
+      size_t aligned = ALIGN_DATA (offset);
+
+      if (!write_all (fp, padding, aligned - offset) ||
+          !write_all (fp, buffer->data, buffer->size))
+        goto write_error;
+
+      offset = aligned + buffer->size;
+    }
+
+  if (fclose (fp) != 0)
+    {
+      fp = NULL;
+      goto write_error;
+    }
+  fp = NULL;
+
+  if (g_rename (tmp_filename, filename) == -1)
+    goto write_error;
+
+  rut_util_trim_cache_dir (cache_dir, ".mesh", offset, CACHE_MAX_SIZE);
+
+  goto done;
+
+write_error:
+
+  g_warning ("Failed to write mesh cache entry %s: %s",
+             filename, g_strerror (errno));
+
+  if (fp)
+    fclose (fp);
+  g_unlink (tmp_filename);
+
+done:
+
+  g_free (filename);
+  g_free (tmp_filename);
+  g_byte_array_free (metadata, TRUE);
+  g_ptr_array_free (buffers, TRUE);
+
+  RUT_TIMER_STOP (save_timer);
+}
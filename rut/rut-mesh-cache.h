@@ -0,0 +1,94 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RUT_MESH_CACHE_H_
+#define _RUT_MESH_CACHE_H_
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "rut-mesh.h"
+
+/* A cache of meshes that are expensive to derive from other meshes,
+ * such as models with generated normals and tangents.
+ *
+ * Entries are content addressed: the key is a hash of the source
+ * meshes and of whatever parameters affect how the derived meshes
+ * are generated, so an entry never needs to be invalidated. Each
+ * entry is a single file holding a group of meshes plus a few floats
+ * of extra state. Loading an entry maps the file into memory and the
+ * meshes' buffers point straight into the mapping. The mapping is
+ * private so modifying the buffers doesn't change the file. The least
+ * recently used entries in a cache directory are deleted once it grows
+ * past a fixed size.
+ *
+ * Setting the RUT_DISABLE_MESH_CACHE environment variable makes every
+ * lookup miss and stops entries from being written.
+ */
+
+typedef struct _RutMeshCacheKey RutMeshCacheKey;
+
+/* @kind names what is being derived. It should be changed whenever
+ * the code generating the derived meshes changes its output. */
+RutMeshCacheKey *
+rut_mesh_cache_key_new (const char *kind);
+
+void
+rut_mesh_cache_key_add_mesh (RutMeshCacheKey *key,
+                             RutMesh *mesh);
+
+void
+rut_mesh_cache_key_add_int (RutMeshCacheKey *key,
+                            int value);
+
+void
+rut_mesh_cache_key_add_string (RutMeshCacheKey *key,
+                               const char *value);
+
+void
+rut_mesh_cache_key_free (RutMeshCacheKey *key);
+
+/* Looks up the entry for @key in @cache_dir. On a hit this returns
+ * true and fills in @meshes with new references and @extra with the
+ * values that were saved with the entry. @n_meshes and @n_extra must
+ * match what the entry was saved with, otherwise it is treated as a
+ * miss. */
+bool
+rut_mesh_cache_load (const char *cache_dir,
+                     RutMeshCacheKey *key,
+                     RutMesh **meshes,
+                     int n_meshes,
+                     float *extra,
+                     int n_extra);
+
+/* Writes an entry for @key to @cache_dir, creating the directory if
+ * needed. The file is replaced atomically so a reader never sees a
+ * partially written entry. Failing to write the cache isn't fatal so
+ * errors are only reported as warnings. */
+void
+rut_mesh_cache_save (const char *cache_dir,
+                     RutMeshCacheKey *key,
+                     RutMesh **meshes,
+                     int n_meshes,
+                     const float *extra,
+                     int n_extra);
+
+#endif /* _RUT_MESH_CACHE_H_ */
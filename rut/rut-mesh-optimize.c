@@ -0,0 +1,725 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "rut-mesh-optimize.h"
+#include "rut-profile.h"
+
+/* The size of the LRU cache that the triangle ordering is scored
+ * against. Forsyth's scoring degrades gracefully when the real cache
+ * is smaller so this doesn't need to match the hardware exactly. */
+#define VERTEX_CACHE_SIZE 32
+
+/* The constants suggested in Forsyth's paper */
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+/* Valences above this all get the same (tiny) boost */
+#define MAX_SCORED_VALENCE 32
+
+/* The size of the FIFO cache simulated to find the points where the
+ * triangle order can be split into clusters for overdraw reduction.
+ * Smaller than VERTEX_CACHE_SIZE because the GPUs we care about most
+ * have small post transform caches. */
+#define OVERDRAW_FIFO_SIZE 16
+
+static float cache_position_scores[VERTEX_CACHE_SIZE];
+static float valence_scores[MAX_SCORED_VALENCE];
+
+typedef struct _ForsythState
+{
+  int n_vertices;
+  int n_triangles;
+  const uint32_t *indices;
+
+  /* The triangles using vertex i are listed in adjacent_triangles
+   * starting at adjacency_offsets[i]. The first n_live_triangles[i]
+   * of them haven't been emitted yet. */
+  int *adjacency_offsets;
+  int *adjacent_triangles;
+  int *n_live_triangles;
+
+  int *cache_positions;
+  float *vertex_scores;
+  bool *emitted;
+} ForsythState;
+
+static void
+init_score_tables (void)
+{
+  /* Meshes may be optimized by the asset loader's worker threads */
+  static size_t initialized = 0;
+  int i;
+
+  if (!g_once_init_enter (&initialized))
+    return;
+
+  for (i = 0; i < VERTEX_CACHE_SIZE; i++)
+    {
+      /* The last triangle's vertices get a fixed score regardless of
+       * their order because the triangle will be reused in whatever
+       * order its vertices appear */
+      if (i < 3)
+        cache_position_scores[i] = LAST_TRIANGLE_SCORE;
+      else
+        {
+          float scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+          cache_position_scores[i] =
+            powf (1.0f - (i - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+
+  valence_scores[0] = 0;
+  for (i = 1; i < MAX_SCORED_VALENCE; i++)
+    valence_scores[i] = VALENCE_BOOST_SCALE * powf (i, -VALENCE_BOOST_POWER);
+
+  g_once_init_leave (&initialized, 1);
+}
+
+static float
+score_vertex (int cache_position,
+              int n_live_triangles)
+{
+  float score;
+
+  /* Vertices that aren't used by any more triangles don't matter */
+  if (n_live_triangles == 0)
+    return -1;
+
+  score = cache_position < 0 ? 0 : cache_position_scores[cache_position];
+
+  /* Boost vertices with few triangles left so that lone triangles
+   * don't get left behind to be drawn with a cold cache later */
+  score += valence_scores[MIN (n_live_triangles, MAX_SCORED_VALENCE - 1)];
+
+  return score;
+}
+
+static float
+score_triangle (ForsythState *state,
+                int triangle)
+{
+  const uint32_t *tri = state->indices + triangle * 3;
+
+  return (state->vertex_scores[tri[0]] +
+          state->vertex_scores[tri[1]] +
+          state->vertex_scores[tri[2]]);
+}
+
+static void
+build_adjacency (ForsythState *state)
+{
+  int n_indices = state->n_triangles * 3;
+  int *fill;
+  int i;
+
+  state->adjacency_offsets = g_new0 (int, state->n_vertices + 1);
+  state->adjacent_triangles = g_new (int, n_indices);
+  state->n_live_triangles = g_new0 (int, state->n_vertices);
+
+  for (i = 0; i < n_indices; i++)
+    state->n_live_triangles[state->indices[i]]++;
+
+  for (i = 0; i < state->n_vertices; i++)
+    state->adjacency_offsets[i + 1] =
+      state->adjacency_offsets[i] + state->n_live_triangles[i];
+
+  fill = g_memdup (state->adjacency_offsets, sizeof (int) * state->n_vertices);
+
+  for (i = 0; i < n_indices; i++)
+    state->adjacent_triangles[fill[state->indices[i]]++] = i / 3;
+
+  g_free (fill);
+}
+
+static void
+remove_live_triangle (ForsythState *state,
+                      int vertex,
+                      int triangle)
+{
+  int *triangles = state->adjacent_triangles + state->adjacency_offsets[vertex];
+  int last = state->n_live_triangles[vertex] - 1;
+  int i;
+
+  for (i = 0; i <= last; i++)
+    if (triangles[i] == triangle)
+      {
+        triangles[i] = triangles[last];
+        triangles[last] = triangle;
+        state->n_live_triangles[vertex]--;
+        return;
+      }
+}
+
+/* Writes the triangles of @indices into @order_out in the order that
+ * they should be drawn */
+static void
+optimize_vertex_cache (const uint32_t *indices,
+                       int n_triangles,
+                       int n_vertices,
+                       int *order_out)
+{
+  ForsythState state;
+  int cache[VERTEX_CACHE_SIZE + 3];
+  int new_cache[VERTEX_CACHE_SIZE + 3];
+  int cache_len = 0;
+  int next_unemitted = 0;
+  int best_triangle = -1;
+  int n_emitted;
+  int i, j, k;
+
+  init_score_tables ();
+
+  state.n_vertices = n_vertices;
+  state.n_triangles = n_triangles;
+  state.indices = indices;
+
+  build_adjacency (&state);
+
+  state.cache_positions = g_new (int, n_vertices);
+  state.vertex_scores = g_new (float, n_vertices);
+  state.emitted = g_new0 (bool, n_triangles);
+
+  for (i = 0; i < n_vertices; i++)
+    {
+      state.cache_positions[i] = -1;
+      state.vertex_scores[i] = score_vertex (-1, state.n_live_triangles[i]);
+    }
+
+  for (n_emitted = 0; n_emitted < n_triangles; n_emitted++)
+    {
+      const uint32_t *tri;
+      int new_cache_len = 0;
+      float best_score = -G_MAXFLOAT;
+
+      /* If none of the triangles touching the cache are left then we
+       * have to start again somewhere else. Picking the next triangle
+       * in the original order is as good a guess as any and keeps
+       * this linear. */
+      if (best_triangle < 0)
+        {
+          while (state.emitted[next_unemitted])
+            next_unemitted++;
+          best_triangle = next_unemitted;
+        }
+
+      order_out[n_emitted] = best_triangle;
+      state.emitted[best_triangle] = true;
+
+      tri = indices + best_triangle * 3;
+
+      /* The triangle's vertices move to the front of the cache */
+      for (i = 0; i < 3; i++)
+        {
+          remove_live_triangle (&state, tri[i], best_triangle);
+
+          for (j = 0; j < new_cache_len; j++)
+            if (new_cache[j] == tri[i])
+              break;
+          if (j == new_cache_len)
+            new_cache[new_cache_len++] = tri[i];
+        }
+
+      for (i = 0; i < cache_len; i++)
+        {
+          int vertex = cache[i];
+
+          if (vertex != tri[0] && vertex != tri[1] && vertex != tri[2])
+            new_cache[new_cache_len++] = vertex;
+        }
+
+      /* Anything that falls off the end of the cache is rescored too
+       * since it has lost its cache position score */
+      for (i = 0; i < new_cache_len; i++)
+        {
+          int vertex = new_cache[i];
+
+          state.cache_positions[vertex] = i < VERTEX_CACHE_SIZE ? i : -1;
+          state.vertex_scores[vertex] =
+            score_vertex (state.cache_positions[vertex],
+                          state.n_live_triangles[vertex]);
+        }
+
+      /* Only triangles using a vertex that is still in the cache are
+       * considered for the next triangle */
+      best_triangle = -1;
+      for (i = 0; i < new_cache_len; i++)
+        {
+          int vertex = new_cache[i];
+          int *triangles =
+            state.adjacent_triangles + state.adjacency_offsets[vertex];
+
+          for (k = 0; k < state.n_live_triangles[vertex]; k++)
+            {
+              int triangle = triangles[k];
+              float score = score_triangle (&state, triangle);
+
+              if (i < VERTEX_CACHE_SIZE && score > best_score)
+                {
+                  best_score = score;
+                  best_triangle = triangle;
+                }
+            }
+        }
+
+      cache_len = MIN (new_cache_len, VERTEX_CACHE_SIZE);
+      memcpy (cache, new_cache, sizeof (int) * cache_len);
+    }
+
+  g_free (state.adjacency_offsets);
+  g_free (state.adjacent_triangles);
+  g_free (state.n_live_triangles);
+  g_free (state.cache_positions);
+  g_free (state.vertex_scores);
+  g_free (state.emitted);
+}
+
+typedef struct _Cluster
+{
+  int start;
+  int n_triangles;
+  float sort_key;
+} Cluster;
+
+static int
+compare_clusters (const void *a,
+                  const void *b)
+{
+  const Cluster *cluster_a = a;
+  const Cluster *cluster_b = b;
+
+  if (cluster_a->sort_key > cluster_b->sort_key)
+    return -1;
+  if (cluster_a->sort_key < cluster_b->sort_key)
+    return 1;
+
+  /* Keep the sort stable */
+  return cluster_a->start - cluster_b->start;
+}
+
+static void
+get_position (const uint8_t *positions,
+              size_t stride,
+              int n_components,
+              uint32_t vertex,
+              float position[3])
+{
+  const float *p = (const float *) (positions + stride * vertex);
+  int i;
+
+  for (i = 0; i < 3; i++)
+    position[i] = i < n_components ? p[i] : 0;
+}
+
+/* Reorders @order, a list of triangles that has been optimized for
+ * the vertex cache, to reduce overdraw.
+ *
+ * This is the approach from Sander, Nehab and Barczak's "Fast
+ * Triangle Reordering for Vertex Locality and Reduced Overdraw". The
+ * list is split at "hard boundaries" where a triangle misses the
+ * cache for all of its vertices. Rearranging the clusters between
+ * those points costs almost nothing in cache efficiency. The clusters
+ * are then drawn in order of how much they face away from the centre
+ * of the mesh, since those are the most likely to occlude the rest.
+ */
+static void
+optimize_overdraw (const uint32_t *indices,
+                   int n_triangles,
+                   int n_vertices,
+                   RutAttribute *position_attribute,
+                   int *order)
+{
+  const uint8_t *positions = position_attribute->buffer->data +
+    position_attribute->offset;
+  size_t stride = position_attribute->stride;
+  int n_components = position_attribute->n_components;
+  int *fifo_timestamps = g_new (int, n_vertices);
+  GArray *clusters = g_array_new (FALSE, FALSE, sizeof (Cluster));
+  float mesh_centroid[3] = { 0, 0, 0 };
+  int *sorted_order;
+  int timestamp = 0;
+  int i, j, k;
+
+  for (i = 0; i < n_vertices; i++)
+    fifo_timestamps[i] = -OVERDRAW_FIFO_SIZE - 1;
+
+  for (i = 0; i < n_triangles; i++)
+    {
+      const uint32_t *tri = indices + order[i] * 3;
+      int n_misses = 0;
+
+      /* A vertex is in the FIFO if fewer than OVERDRAW_FIFO_SIZE
+       * vertices have been pushed since it was */
+      for (j = 0; j < 3; j++)
+        if (timestamp - fifo_timestamps[tri[j]] > OVERDRAW_FIFO_SIZE)
+          {
+            fifo_timestamps[tri[j]] = timestamp++;
+            n_misses++;
+          }
+
+      if (n_misses == 3 || i == 0)
+        {
+          Cluster cluster = { i, 0, 0 };
+          g_array_append_val (clusters, cluster);
+        }
+
+      g_array_index (clusters, Cluster, clusters->len - 1).n_triangles++;
+    }
+
+  g_free (fifo_timestamps);
+
+  if (clusters->len < 2)
+    {
+      g_array_free (clusters, TRUE);
+      return;
+    }
+
+  for (i = 0; i < n_vertices; i++)
+    {
+      float position[3];
+
+      get_position (positions, stride, n_components, i, position);
+      for (j = 0; j < 3; j++)
+        mesh_centroid[j] += position[j];
+    }
+  for (j = 0; j < 3; j++)
+    mesh_centroid[j] /= n_vertices;
+
+  for (i = 0; i < clusters->len; i++)
+    {
+      Cluster *cluster = &g_array_index (clusters, Cluster, i);
+      float centroid[3] = { 0, 0, 0 };
+      float normal[3] = { 0, 0, 0 };
+      float length;
+
+      for (k = cluster->start; k < cluster->start + cluster->n_triangles; k++)
+        {
+          const uint32_t *tri = indices + order[k] * 3;
+          float v0[3], v1[3], v2[3];
+          float e1[3], e2[3];
+
+          get_position (positions, stride, n_components, tri[0], v0);
+          get_position (positions, stride, n_components, tri[1], v1);
+          get_position (positions, stride, n_components, tri[2], v2);
+
+          for (j = 0; j < 3; j++)
+            {
+              centroid[j] += (v0[j] + v1[j] + v2[j]) / 3.0f;
+              e1[j] = v1[j] - v0[j];
+              e2[j] = v2[j] - v0[j];
+            }
+
+          /* NB: the cross product isn't normalized so that bigger
+           * triangles have more influence */
+          normal[0] += e1[1] * e2[2] - e1[2] * e2[1];
+          normal[1] += e1[2] * e2[0] - e1[0] * e2[2];
+          normal[2] += e1[0] * e2[1] - e1[1] * e2[0];
+        }
+
+      length = sqrtf (normal[0] * normal[0] +
+                      normal[1] * normal[1] +
+                      normal[2] * normal[2]);
+      if (length > 0)
+        {
+          for (j = 0; j < 3; j++)
+            {
+              centroid[j] = centroid[j] / cluster->n_triangles -
+                mesh_centroid[j];
+              cluster->sort_key += centroid[j] * normal[j] / length;
+            }
+        }
+    }
+
+  qsort (clusters->data, clusters->len, sizeof (Cluster), compare_clusters);
+
+  sorted_order = g_new (int, n_triangles);
+  for (i = 0, k = 0; i < clusters->len; i++)
+    {
+      Cluster *cluster = &g_array_index (clusters, Cluster, i);
+
+      memcpy (sorted_order + k,
+              order + cluster->start,
+              sizeof (int) * cluster->n_triangles);
+      k += cluster->n_triangles;
+    }
+
+  memcpy (order, sorted_order, sizeof (int) * n_triangles);
+
+  g_free (sorted_order);
+  g_array_free (clusters, TRUE);
+}
+
+/* Checks that every vertex buffer is only used with one stride and is
+ * big enough to hold every vertex at that stride so that it can be
+ * permuted as an array of fixed size vertices */
+static bool
+can_reorder_vertices (RutMesh *mesh)
+{
+  int i, j;
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    {
+      RutAttribute *attribute = mesh->attributes[i];
+
+      if (attribute->stride == 0 ||
+          attribute->buffer == mesh->indices_buffer ||
+          attribute->stride * mesh->n_vertices > attribute->buffer->size)
+        return false;
+
+      for (j = 0; j < i; j++)
+        {
+          RutAttribute *other = mesh->attributes[j];
+
+          if (other->buffer == attribute->buffer &&
+              other->stride != attribute->stride)
+            return false;
+        }
+    }
+
+  return true;
+}
+
+static void
+reorder_vertices (RutMesh *mesh,
+                  uint32_t *indices,
+                  int n_indices)
+{
+  int n_vertices = mesh->n_vertices;
+  int *remap = g_new (int, n_vertices);
+  int next_vertex = 0;
+  int i, j;
+
+  for (i = 0; i < n_vertices; i++)
+    remap[i] = -1;
+
+  for (i = 0; i < n_indices; i++)
+    {
+      if (remap[indices[i]] == -1)
+        remap[indices[i]] = next_vertex++;
+      indices[i] = remap[indices[i]];
+    }
+
+  /* Vertices that aren't referenced are moved to the end */
+  for (i = 0; i < n_vertices; i++)
+    if (remap[i] == -1)
+      remap[i] = next_vertex++;
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    {
+      RutBuffer *buffer = mesh->attributes[i]->buffer;
+      size_t stride = mesh->attributes[i]->stride;
+      uint8_t *data;
+
+      /* Each buffer only needs permuting once */
+      for (j = 0; j < i; j++)
+        if (mesh->attributes[j]->buffer == buffer)
+          break;
+      if (j < i)
+        continue;
+
+      data = g_malloc (buffer->size);
+
+      for (j = 0; j < n_vertices; j++)
+        memcpy (data + remap[j] * stride, buffer->data + j * stride, stride);
+
+      /* Anything after the last vertex is left where it was */
+      memcpy (data + n_vertices * stride,
+              buffer->data + n_vertices * stride,
+              buffer->size - n_vertices * stride);
+
+      if (buffer->data_destroy)
+        {
+          buffer->data_destroy (buffer->data_destroy_data);
+          buffer->data_destroy = NULL;
+          buffer->data_destroy_data = NULL;
+        }
+      else
+        g_free (buffer->data);
+
+      buffer->data = data;
+    }
+
+  g_free (remap);
+}
+
+static uint32_t *
+read_indices (RutMesh *mesh,
+              int n_indices)
+{
+  uint32_t *indices = g_new (uint32_t, n_indices);
+  const void *data = mesh->indices_buffer->data;
+  int i;
+
+  switch (mesh->indices_type)
+    {
+    case COGL_INDICES_TYPE_UNSIGNED_BYTE:
+      for (i = 0; i < n_indices; i++)
+        indices[i] = ((const uint8_t *) data)[i];
+      break;
+    case COGL_INDICES_TYPE_UNSIGNED_SHORT:
+      for (i = 0; i < n_indices; i++)
+        indices[i] = ((const uint16_t *) data)[i];
+      break;
+    case COGL_INDICES_TYPE_UNSIGNED_INT:
+      memcpy (indices, data, sizeof (uint32_t) * n_indices);
+      break;
+    }
+
+  return indices;
+}
+
+static void
+write_indices (RutMesh *mesh,
+               const uint32_t *indices,
+               int n_indices)
+{
+  void *data = mesh->indices_buffer->data;
+  int i;
+
+  switch (mesh->indices_type)
+    {
+    case COGL_INDICES_TYPE_UNSIGNED_BYTE:
+      for (i = 0; i < n_indices; i++)
+        ((uint8_t *) data)[i] = indices[i];
+      break;
+    case COGL_INDICES_TYPE_UNSIGNED_SHORT:
+      for (i = 0; i < n_indices; i++)
+        ((uint16_t *) data)[i] = indices[i];
+      break;
+    case COGL_INDICES_TYPE_UNSIGNED_INT:
+      memcpy (data, indices, sizeof (uint32_t) * n_indices);
+      break;
+    }
+}
+
+static size_t
+get_sizeof_indices_type (CoglIndicesType type)
+{
+  switch (type)
+    {
+    case COGL_INDICES_TYPE_UNSIGNED_BYTE:
+      return 1;
+    case COGL_INDICES_TYPE_UNSIGNED_SHORT:
+      return 2;
+    case COGL_INDICES_TYPE_UNSIGNED_INT:
+      return 4;
+    }
+
+  g_return_val_if_reached (0);
+}
+
+bool
+rut_mesh_optimize (RutMesh *mesh,
+                   RutMeshOptimizeFlags flags)
+{
+  RutAttribute *position_attribute = NULL;
+  int n_triangles;
+  int n_indices;
+  uint32_t *indices;
+  uint32_t *reordered;
+  int *order;
+  int i;
+
+  RUT_STATIC_TIMER (optimize_timer,
+                    "Mainloop",
+                    "Mesh optimize",
+                    "Reordering imported meshes for the vertex cache",
+                    0);
+
+  if (mesh->mode != COGL_VERTICES_MODE_TRIANGLES ||
+      mesh->indices_buffer == NULL ||
+      mesh->n_indices < 3 ||
+      mesh->n_vertices < 1 ||
+      mesh->indices_buffer->size <
+      get_sizeof_indices_type (mesh->indices_type) * mesh->n_indices)
+    return false;
+
+  if ((flags & RUT_MESH_OPTIMIZE_VERTEX_FETCH) && !can_reorder_vertices (mesh))
+    return false;
+
+  RUT_TIMER_START (optimize_timer);
+
+  n_triangles = mesh->n_indices / 3;
+  n_indices = n_triangles * 3;
+  indices = read_indices (mesh, n_indices);
+
+  for (i = 0; i < n_indices; i++)
+    if (indices[i] >= mesh->n_vertices)
+      {
+        g_free (indices);
+        RUT_TIMER_STOP (optimize_timer);
+        return false;
+      }
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    {
+      RutAttribute *attribute = mesh->attributes[i];
+
+      if (strcmp (attribute->name, "cogl_position_in") == 0 &&
+          attribute->type == RUT_ATTRIBUTE_TYPE_FLOAT &&
+          attribute->stride * (mesh->n_vertices - 1) + attribute->offset +
+          sizeof (float) * attribute->n_components <= attribute->buffer->size)
+        position_attribute = attribute;
+    }
+
+  order = g_new (int, n_triangles);
+
+  if (flags & RUT_MESH_OPTIMIZE_VERTEX_CACHE)
+    optimize_vertex_cache (indices, n_triangles, mesh->n_vertices, order);
+  else
+    {
+      for (i = 0; i < n_triangles; i++)
+        order[i] = i;
+    }
+
+  if ((flags & RUT_MESH_OPTIMIZE_OVERDRAW) && position_attribute)
+    optimize_overdraw (indices, n_triangles, mesh->n_vertices,
+                       position_attribute, order);
+
+  reordered = g_new (uint32_t, n_indices);
+  for (i = 0; i < n_triangles; i++)
+    memcpy (reordered + i * 3, indices + order[i] * 3, sizeof (uint32_t) * 3);
+
+  if (flags & RUT_MESH_OPTIMIZE_VERTEX_FETCH)
+    reorder_vertices (mesh, reordered, n_indices);
+
+  write_indices (mesh, reordered, n_indices);
+
+  g_free (reordered);
+  g_free (order);
+  g_free (indices);
+
+  /* NB: meshes are optimized as they are imported, possibly on one of
+   * the asset loader's threads, so nothing can be using the mesh yet */
+  rut_mesh_discard_derived_state (mesh);
+
+  RUT_TIMER_STOP (optimize_timer);
+
+  return true;
+}
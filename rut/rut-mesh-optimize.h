@@ -0,0 +1,68 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RUT_MESH_OPTIMIZE_H_
+#define _RUT_MESH_OPTIMIZE_H_
+
+#include <stdbool.h>
+
+#include "rut-mesh.h"
+
+/*
+ * RUT_MESH_OPTIMIZE_VERTEX_CACHE: Reorders the triangles so that
+ *   consecutive triangles reuse recently transformed vertices, using
+ *   Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+ * RUT_MESH_OPTIMIZE_OVERDRAW: Splits the triangles into clusters at
+ *   the points where the vertex cache would be cold anyway and sorts
+ *   the clusters so that outward facing ones come first. This reduces
+ *   overdraw without hurting vertex cache efficiency.
+ * RUT_MESH_OPTIMIZE_VERTEX_FETCH: Renumbers the vertices in the order
+ *   they are first referenced by the indices so that vertex fetches
+ *   walk through memory sequentially.
+ */
+typedef enum {
+  RUT_MESH_OPTIMIZE_VERTEX_CACHE = 1L<<0,
+  RUT_MESH_OPTIMIZE_OVERDRAW = 1L<<1,
+  RUT_MESH_OPTIMIZE_VERTEX_FETCH = 1L<<2,
+
+  RUT_MESH_OPTIMIZE_ALL = (RUT_MESH_OPTIMIZE_VERTEX_CACHE |
+                           RUT_MESH_OPTIMIZE_OVERDRAW |
+                           RUT_MESH_OPTIMIZE_VERTEX_FETCH)
+} RutMeshOptimizeFlags;
+
+/* Reorders the triangles and vertices of @mesh in place to make it
+ * cheaper to draw. The geometry itself isn't changed. This is
+ * intended to be run once when a mesh is imported.
+ *
+ * Only indexed triangle lists are optimized. Vertex fetch
+ * optimization also requires each vertex buffer to be used with a
+ * single stride. The buffers are modified directly so they must not
+ * be shared with any other mesh. This doesn't call rut_mesh_dirty()
+ * so it is safe to run on a mesh that is still being loaded on another
+ * thread but the caller must call it if the mesh was already in use.
+ *
+ * Returns false if the mesh couldn't be optimized, in which case it
+ * is left untouched.
+ */
+bool
+rut_mesh_optimize (RutMesh *mesh,
+                   RutMeshOptimizeFlags flags);
+
+#endif /* _RUT_MESH_OPTIMIZE_H_ */
@@ -28,6 +28,7 @@
 
 #include "rut-mesh-ply.h"
 #include "rut-interfaces.h"
+#include "rut-profile.h"
 
 typedef struct _LoaderAttribute
 {
@@ -48,15 +49,53 @@ typedef struct _LoaderProperty
   int component;
   const char *name;
   LoaderAttribute *loader_attribute;
+
+  /* Only used when reading binary data directly */
+  e_ply_type source_type;
+  size_t source_offset;
 } LoaderProperty;
 
+typedef struct _BinaryProperty
+{
+  char *name;
+  e_ply_type type;
+
+  /* Offset of the property within a vertex record */
+  size_t offset;
+} BinaryProperty;
+
+/* Describes a binary little-endian PLY file whose data can be decoded
+ * directly without going through rply. That is only possible if the
+ * vertex records have a fixed size, which means they have no list
+ * properties, and the vertex element comes first followed by a face
+ * element containing only the vertex_indices list. */
+typedef struct _BinaryHeader
+{
+  /* The start of the element data, just after the header */
+  const uint8_t *body;
+  const uint8_t *end;
+
+  GArray *vertex_properties;
+  int32_t n_vertices;
+  size_t vertex_size;
+
+  int32_t n_faces;
+  e_ply_type face_length_type;
+  e_ply_type face_index_type;
+} BinaryHeader;
+
 typedef struct _Loader
 {
   RutContext *ctx;
   p_ply ply;
   GError *error;
 
+  /* If this is set then the data is decoded directly instead of via
+   * rply */
+  BinaryHeader *header;
+
   LoaderAttribute *loader_attributes;
+  int n_loader_attributes;
   LoaderProperty *loader_properties;
 
   unsigned int n_vertex_bytes;
@@ -65,6 +104,10 @@ typedef struct _Loader
   uint8_t *current_vertex_pos;
   CoglBool read_property;
 
+  /* Face indices are checked against this so that a malformed file
+   * can't make later passes over the mesh index out of bounds */
+  int32_t n_vertices;
+
   unsigned int first_vertex, last_vertex;
   GArray *faces;
   CoglIndicesType indices_type;
@@ -106,6 +149,30 @@ get_sizeof_attribute_type (RutAttributeType type)
   return 0;
 }
 
+static void
+store_attribute_value (RutAttributeType type,
+                       uint8_t *pos,
+                       double value)
+{
+  switch (type)
+    {
+    case RUT_ATTRIBUTE_TYPE_BYTE:
+      *((int8_t *)pos) = value;
+      break;
+    case RUT_ATTRIBUTE_TYPE_UNSIGNED_BYTE:
+      *pos = value;
+      break;
+    case RUT_ATTRIBUTE_TYPE_SHORT:
+      *((int16_t *)pos) = value;
+      break;
+    case RUT_ATTRIBUTE_TYPE_UNSIGNED_SHORT:
+      *((uint16_t *)pos) = value;
+      break;
+    case RUT_ATTRIBUTE_TYPE_FLOAT:
+      *((float *)pos) = value;
+    }
+}
+
 static int
 rut_mesh_ply_loader_vertex_read_cb (p_ply_argument argument)
 {
@@ -114,7 +181,6 @@ rut_mesh_ply_loader_vertex_read_cb (p_ply_argument argument)
   LoaderProperty *loader_property;
   LoaderAttribute *loader_attribute;
   uint8_t *pos;
-  double value;
 
   ply_get_argument_user_data (argument, (void **) &loader, &prop_num);
 
@@ -128,24 +194,9 @@ rut_mesh_ply_loader_vertex_read_cb (p_ply_argument argument)
   pos += get_sizeof_attribute_type (loader_attribute->type) *
     loader_property->component;
 
-  value = ply_get_argument_value (argument);
-  switch (loader_attribute->type)
-    {
-    case RUT_ATTRIBUTE_TYPE_BYTE:
-      *((int8_t *)pos) = value;
-      break;
-    case RUT_ATTRIBUTE_TYPE_UNSIGNED_BYTE:
-      *pos = value;
-      break;
-    case RUT_ATTRIBUTE_TYPE_SHORT:
-      *((int16_t *)pos) = value;
-      break;
-    case RUT_ATTRIBUTE_TYPE_UNSIGNED_SHORT:
-      *((uint16_t *)pos) = value;
-      break;
-    case RUT_ATTRIBUTE_TYPE_FLOAT:
-      *((float *)pos) = value;
-    }
+  store_attribute_value (loader_attribute->type,
+                         pos,
+                         ply_get_argument_value (argument));
 
   loader->read_property = TRUE;
 
@@ -188,6 +239,17 @@ rut_mesh_ply_loader_face_read_cb (p_ply_argument argument)
   ply_get_argument_user_data (argument, (void **) &loader, &prop_num);
   ply_get_argument_property (argument, NULL, &length, &index);
 
+  if (index != -1 &&
+      (ply_get_argument_value (argument) < 0 ||
+       ply_get_argument_value (argument) >= loader->n_vertices))
+    {
+      g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
+                   RUT_MESH_PLY_ERROR_INVALID,
+                   "Invalid vertex index in PLY file");
+      /* Returning 0 aborts the read */
+      return 0;
+    }
+
   if (index == 0)
     loader->first_vertex = ply_get_argument_value (argument);
   else if (index == 1)
@@ -278,27 +340,35 @@ find_property (p_ply_element element, const char *property_name)
   return NULL;
 }
 
+static int
+get_sizeof_indices_type (CoglIndicesType type)
+{
+  switch (type)
+    {
+    case COGL_INDICES_TYPE_UNSIGNED_BYTE:
+      return 1;
+    case COGL_INDICES_TYPE_UNSIGNED_SHORT:
+      return 2;
+    case COGL_INDICES_TYPE_UNSIGNED_INT:
+      return 4;
+    }
+
+  g_warn_if_reached ();
+  return 0;
+}
+
 static CoglBool
 init_indices_array (Loader *loader,
                     int n_vertices,
                     GError **error)
 {
   if (n_vertices <= 0x100)
-    {
-      loader->indices_type = COGL_INDICES_TYPE_UNSIGNED_BYTE;
-      loader->faces = g_array_new (FALSE, FALSE, sizeof (uint8_t));
-    }
+    loader->indices_type = COGL_INDICES_TYPE_UNSIGNED_BYTE;
   else if (n_vertices <= 0x10000)
-    {
-      loader->indices_type = COGL_INDICES_TYPE_UNSIGNED_SHORT;
-      loader->faces = g_array_new (FALSE, FALSE, sizeof (uint16_t));
-    }
+    loader->indices_type = COGL_INDICES_TYPE_UNSIGNED_SHORT;
   else if (cogl_has_feature (loader->ctx->cogl_context,
                              COGL_FEATURE_ID_UNSIGNED_INT_INDICES))
-    {
-      loader->indices_type = COGL_INDICES_TYPE_UNSIGNED_INT;
-      loader->faces = g_array_new (FALSE, FALSE, sizeof (uint32_t));
-    }
+    loader->indices_type = COGL_INDICES_TYPE_UNSIGNED_INT;
   else
     {
       g_set_error (error, RUT_MESH_PLY_ERROR,
@@ -308,26 +378,551 @@ init_indices_array (Loader *loader,
       return FALSE;
     }
 
+  /* The binary loader writes the indices straight into a buffer */
+  if (loader->header == NULL)
+    {
+      int index_size = get_sizeof_indices_type (loader->indices_type);
+      loader->faces = g_array_new (FALSE, FALSE, index_size);
+    }
+
+  return TRUE;
+}
+
+typedef struct _PLYTypeInfo
+{
+  const char *name;
+  int size;
+} PLYTypeInfo;
+
+/* Indexed by e_ply_type */
+static const PLYTypeInfo ply_type_info[] = {
+  { "int8", 1 }, { "uint8", 1 }, { "int16", 2 }, { "uint16", 2 },
+  { "int32", 4 }, { "uint32", 4 }, { "float32", 4 }, { "float64", 8 },
+  { "char", 1 }, { "uchar", 1 }, { "short", 2 }, { "ushort", 2 },
+  { "int", 4 }, { "uint", 4 }, { "float", 4 }, { "double", 8 }
+};
+
+static CoglBool
+lookup_ply_type (const char *name, e_ply_type *type)
+{
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (ply_type_info); i++)
+    if (strcmp (ply_type_info[i].name, name) == 0)
+      {
+        *type = i;
+        return TRUE;
+      }
+
+  return FALSE;
+}
+
+static CoglBool
+is_float_ply_type (e_ply_type type)
+{
+  return (type == PLY_FLOAT32 || type == PLY_FLOAT ||
+          type == PLY_FLOAT64 || type == PLY_DOUBLE);
+}
+
+/* Reads a little-endian value that may not be aligned */
+static double
+read_ply_value (e_ply_type type, const uint8_t *pos)
+{
+  switch (type)
+    {
+    case PLY_INT8:
+    case PLY_CHAR:
+      return *(const int8_t *) pos;
+    case PLY_UINT8:
+    case PLY_UCHAR:
+      return *pos;
+    case PLY_INT16:
+    case PLY_SHORT:
+      {
+        int16_t value;
+        memcpy (&value, pos, sizeof (value));
+        return value;
+      }
+    case PLY_UINT16:
+    case PLY_USHORT:
+      {
+        uint16_t value;
+        memcpy (&value, pos, sizeof (value));
+        return value;
+      }
+    case PLY_INT32:
+    case PLY_INT:
+      {
+        int32_t value;
+        memcpy (&value, pos, sizeof (value));
+        return value;
+      }
+    case PLY_UIN32:
+    case PLY_UINT:
+      {
+        uint32_t value;
+        memcpy (&value, pos, sizeof (value));
+        return value;
+      }
+    case PLY_FLOAT32:
+    case PLY_FLOAT:
+      {
+        float value;
+        memcpy (&value, pos, sizeof (value));
+        return value;
+      }
+    case PLY_FLOAT64:
+    case PLY_DOUBLE:
+      {
+        double value;
+        memcpy (&value, pos, sizeof (value));
+        return value;
+      }
+    case PLY_LIST:
+      break;
+    }
+
+  g_warn_if_reached ();
+  return 0;
+}
+
+/* Like read_ply_value() but for the integer types used by face lists */
+static uint32_t
+read_ply_index (e_ply_type type, const uint8_t *pos)
+{
+  switch (ply_type_info[type].size)
+    {
+    case 1:
+      return *pos;
+    case 2:
+      {
+        uint16_t value;
+        memcpy (&value, pos, sizeof (value));
+        return value;
+      }
+    default:
+      {
+        uint32_t value;
+        memcpy (&value, pos, sizeof (value));
+        return value;
+      }
+    }
+}
+
+/* Splits a header line into words, ignoring repeated whitespace. The
+ * returned array should be freed with g_strfreev() */
+static char **
+split_header_line (const char *start,
+                   const char *end,
+                   int *n_words_out)
+{
+  char *line = g_strndup (start, end - start);
+  char **words = g_strsplit_set (g_strstrip (line), " \t", -1);
+  int i, n_words = 0;
+
+  for (i = 0; words[i]; i++)
+    {
+      if (words[i][0])
+        words[n_words++] = words[i];
+      else
+        g_free (words[i]);
+    }
+  words[n_words] = NULL;
+
+  g_free (line);
+
+  *n_words_out = n_words;
+
+  return words;
+}
+
+static void
+binary_header_destroy (BinaryHeader *header)
+{
+  int i;
+
+  for (i = 0; i < header->vertex_properties->len; i++)
+    g_free (g_array_index (header->vertex_properties,
+                           BinaryProperty, i).name);
+
+  g_array_free (header->vertex_properties, TRUE);
+}
+
+/* Checks whether the data is a binary PLY file that can be decoded
+ * directly and if so parses the header. If this returns FALSE the
+ * data should be loaded with rply instead, which will also take care
+ * of reporting any syntax errors. */
+static CoglBool
+parse_binary_header (const uint8_t *data,
+                     size_t len,
+                     BinaryHeader *header)
+{
+  const char *pos = (const char *) data;
+  const char *end = pos + len;
+  CoglBool seen_format = FALSE;
+  int n_elements = 0;
+  int n_face_properties = 0;
+  int line_num;
+
+  if (G_BYTE_ORDER != G_LITTLE_ENDIAN)
+    return FALSE;
+
+  memset (header, 0, sizeof (BinaryHeader));
+  header->vertex_properties =
+    g_array_new (FALSE, FALSE, sizeof (BinaryProperty));
+  header->end = data + len;
+
+  for (line_num = 0; ; line_num++)
+    {
+      const char *eol = memchr (pos, '\n', end - pos);
+      char **words;
+      int n_words;
+      CoglBool ok = FALSE;
+
+      if (eol == NULL)
+        goto error;
+
+      words = split_header_line (pos, eol, &n_words);
+      pos = eol + 1;
+
+      if (line_num == 0)
+        ok = n_words == 1 && strcmp (words[0], "ply") == 0;
+      else if (n_words == 0)
+        ok = FALSE;
+      else if (strcmp (words[0], "format") == 0)
+        {
+          ok = (n_words == 3 &&
+                strcmp (words[1], "binary_little_endian") == 0 &&
+                strcmp (words[2], "1.0") == 0);
+          seen_format = TRUE;
+        }
+      else if (strcmp (words[0], "comment") == 0 ||
+               strcmp (words[0], "obj_info") == 0)
+        ok = TRUE;
+      else if (strcmp (words[0], "element") == 0 && n_words == 3)
+        {
+          int64_t count = g_ascii_strtoll (words[2], NULL, 10);
+
+          n_elements++;
+
+          if (count < 0 || count > G_MAXINT32)
+            ok = FALSE;
+          else if (n_elements == 1)
+            {
+              ok = strcmp (words[1], "vertex") == 0;
+              header->n_vertices = count;
+            }
+          else if (n_elements == 2)
+            {
+              ok = strcmp (words[1], "face") == 0;
+              header->n_faces = count;
+            }
+          else /* Anything after the faces is never read */
+            ok = TRUE;
+        }
+      else if (strcmp (words[0], "property") == 0 && n_elements == 1)
+        {
+          BinaryProperty property;
+
+          if (n_words == 3 && lookup_ply_type (words[1], &property.type))
+            {
+              property.name = g_strdup (words[2]);
+              property.offset = header->vertex_size;
+              g_array_append_val (header->vertex_properties, property);
+
+              header->vertex_size += ply_type_info[property.type].size;
+              ok = TRUE;
+            }
+        }
+      else if (strcmp (words[0], "property") == 0 && n_elements == 2)
+        {
+          n_face_properties++;
+
+          ok = (n_words == 5 &&
+                strcmp (words[1], "list") == 0 &&
+                lookup_ply_type (words[2], &header->face_length_type) &&
+                lookup_ply_type (words[3], &header->face_index_type) &&
+                !is_float_ply_type (header->face_length_type) &&
+                !is_float_ply_type (header->face_index_type) &&
+                strcmp (words[4], "vertex_indices") == 0);
+        }
+      else if (strcmp (words[0], "property") == 0 && n_elements > 2)
+        ok = TRUE;
+      else if (strcmp (words[0], "end_header") == 0 && n_words == 1)
+        {
+          g_strfreev (words);
+          break;
+        }
+
+      g_strfreev (words);
+
+      if (!ok)
+        goto error;
+    }
+
+  header->body = (const uint8_t *) pos;
+
+  if (!seen_format ||
+      n_elements < 2 ||
+      n_face_properties != 1 ||
+      header->vertex_size == 0 ||
+      header->n_vertices > (header->end - header->body) / header->vertex_size)
+    goto error;
+
   return TRUE;
+
+error:
+  binary_header_destroy (header);
+  return FALSE;
+}
+
+/* Copies one property of every vertex record into the interleaved
+ * vertex buffer */
+static void
+read_binary_property (Loader *loader,
+                      LoaderAttribute *loader_attribute,
+                      LoaderProperty *loader_property)
+{
+  const BinaryHeader *header = loader->header;
+  int component_size = get_sizeof_attribute_type (loader_attribute->type);
+  const uint8_t *src = header->body + loader_property->source_offset;
+  size_t src_stride = header->vertex_size;
+  uint8_t *dst = (loader->vertex_buffer->data + loader_attribute->offset +
+                  component_size * loader_property->component);
+  size_t dst_stride = loader->n_vertex_bytes;
+  int n_vertices = header->n_vertices;
+  int i;
+
+  /* In the common case the file already stores the type we want so
+   * the values can be copied without converting them */
+  if (ply_type_info[loader_property->source_type].size == component_size &&
+      (is_float_ply_type (loader_property->source_type) ==
+       (loader_attribute->type == RUT_ATTRIBUTE_TYPE_FLOAT)))
+    {
+      switch (component_size)
+        {
+        case 1:
+          for (i = 0; i < n_vertices; i++, src += src_stride, dst += dst_stride)
+            *dst = *src;
+          return;
+        case 2:
+          for (i = 0; i < n_vertices; i++, src += src_stride, dst += dst_stride)
+            memcpy (dst, src, 2);
+          return;
+        case 4:
+          for (i = 0; i < n_vertices; i++, src += src_stride, dst += dst_stride)
+            memcpy (dst, src, 4);
+          return;
+        }
+    }
+
+  for (i = 0; i < n_vertices; i++, src += src_stride, dst += dst_stride)
+    store_attribute_value (loader_attribute->type,
+                           dst,
+                           read_ply_value (loader_property->source_type, src));
+}
+
+static void
+read_binary_vertices (Loader *loader)
+{
+  int i, j;
+
+  for (i = 0; i < loader->n_loader_attributes; i++)
+    {
+      LoaderAttribute *loader_attribute = &loader->loader_attributes[i];
+
+      if (loader_attribute->padding)
+        continue;
+
+      for (j = 0; j < loader_attribute->n_components; j++)
+        {
+          int p = i * RUT_PLY_MAX_ATTRIBUTE_PROPERTIES + j;
+          read_binary_property (loader,
+                                loader_attribute,
+                                &loader->loader_properties[p]);
+        }
+    }
+}
+
+/* Decodes the face lists straight into an index buffer, splitting each
+ * polygon into a fan of triangles the same way the rply callback
+ * does */
+static RutBuffer *
+read_binary_faces (Loader *loader,
+                   const char *display_name,
+                   int *n_indices_out)
+{
+  const BinaryHeader *header = loader->header;
+  int length_size = ply_type_info[header->face_length_type].size;
+  int index_size = ply_type_info[header->face_index_type].size;
+  int out_size = get_sizeof_indices_type (loader->indices_type);
+  const uint8_t *faces =
+    header->body + (size_t) header->n_vertices * header->vertex_size;
+  const uint8_t *pos = faces;
+  uint32_t n_vertices = header->n_vertices;
+  RutBuffer *buffer;
+  uint8_t *out;
+  int64_t n_indices = 0;
+  int i, j;
+
+  /* The faces have a variable size so first check that they are all
+   * there and count how many triangles they will make */
+  for (i = 0; i < header->n_faces; i++)
+    {
+      uint32_t length;
+
+      if (header->end - pos < length_size)
+        goto truncated;
+      length = read_ply_index (header->face_length_type, pos);
+      pos += length_size;
+
+      if ((header->end - pos) / index_size < length)
+        goto truncated;
+      pos += (size_t) length * index_size;
+
+      if (length >= 3)
+        n_indices += ((int64_t) length - 2) * 3;
+    }
+
+  if (n_indices > G_MAXINT / out_size)
+    {
+      g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
+                   RUT_MESH_PLY_ERROR_UNSUPPORTED,
+                   "Too many faces in PLY file %s", display_name);
+      return NULL;
+    }
+
+  buffer = rut_buffer_new (n_indices * out_size);
+  out = buffer->data;
+
+  for (i = 0, pos = faces; i < header->n_faces; i++)
+    {
+      uint32_t length = read_ply_index (header->face_length_type, pos);
+      uint32_t first_vertex, last_vertex;
+
+      pos += length_size;
+
+      if (length < 3)
+        {
+          pos += (size_t) length * index_size;
+          continue;
+        }
+
+      first_vertex = read_ply_index (header->face_index_type, pos);
+      last_vertex = read_ply_index (header->face_index_type, pos + index_size);
+      pos += index_size * 2;
+
+      if (first_vertex >= n_vertices || last_vertex >= n_vertices)
+        goto invalid_index;
+
+      for (j = 2; j < length; j++, pos += index_size)
+        {
+          uint32_t new_vertex = read_ply_index (header->face_index_type, pos);
+          uint32_t triangle[3] = { first_vertex, last_vertex, new_vertex };
+          int k;
+
+          if (new_vertex >= n_vertices)
+            goto invalid_index;
+
+          for (k = 0; k < 3; k++, out += out_size)
+            {
+              switch (loader->indices_type)
+                {
+                case COGL_INDICES_TYPE_UNSIGNED_BYTE:
+                  *out = triangle[k];
+                  break;
+                case COGL_INDICES_TYPE_UNSIGNED_SHORT:
+                  *(uint16_t *) out = triangle[k];
+                  break;
+                case COGL_INDICES_TYPE_UNSIGNED_INT:
+                  *(uint32_t *) out = triangle[k];
+                  break;
+                }
+            }
+
+          last_vertex = new_vertex;
+        }
+    }
+
+  *n_indices_out = n_indices;
+
+  return buffer;
+
+invalid_index:
+  rut_refable_unref (buffer);
+  g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
+               RUT_MESH_PLY_ERROR_INVALID,
+               "Invalid vertex index in PLY file %s", display_name);
+  return NULL;
+
+truncated:
+  g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
+               RUT_MESH_PLY_ERROR_INVALID,
+               "Truncated face data in PLY file %s", display_name);
+  return NULL;
+}
+
+static CoglBool
+find_vertex_property (Loader *loader,
+                      p_ply_element vertex_element,
+                      const char *name,
+                      e_ply_type *type,
+                      size_t *offset)
+{
+  if (loader->header)
+    {
+      GArray *properties = loader->header->vertex_properties;
+      int i;
+
+      for (i = 0; i < properties->len; i++)
+        {
+          BinaryProperty *property =
+            &g_array_index (properties, BinaryProperty, i);
+
+          if (strcmp (property->name, name) == 0)
+            {
+              *type = property->type;
+              *offset = property->offset;
+              return TRUE;
+            }
+        }
+
+      return FALSE;
+    }
+  else
+    {
+      p_ply_property ply_prop = find_property (vertex_element, name);
+
+      if (!ply_prop)
+        return FALSE;
+
+      ply_get_property_info (ply_prop, NULL, type, NULL, NULL);
+      *offset = 0;
+
+      return TRUE;
+    }
 }
 
+/* Loads a mesh either by decoding the data directly if loader->header
+ * is set or otherwise by reading it through the rply handle in
+ * loader->ply */
 static RutMesh *
-_rut_mesh_new_from_p_ply (RutContext *ctx,
-                          Loader *loader,
-                          p_ply ply,
-                          const char *display_name,
-                          RutPLYAttribute *attributes,
-                          int n_attributes,
-                          RutPLYAttributeStatus *load_status,
-                          GError **error)
+_rut_mesh_new_from_loader (RutContext *ctx,
+                           Loader *loader,
+                           const char *display_name,
+                           RutPLYAttribute *attributes,
+                           int n_attributes,
+                           RutPLYAttributeStatus *load_status,
+                           GError **error)
 {
   LoaderAttribute loader_attributes[n_attributes];
-  int n_loader_attributes;
+  int n_loader_attributes = 0;
   LoaderProperty loader_properties[n_attributes *
                                    RUT_PLY_MAX_ATTRIBUTE_PROPERTIES];
   RutAttribute *rut_attributes[n_attributes];
-  p_ply_element vertex_element;
-  RutBuffer *indices_buffer;
+  p_ply_element vertex_element = NULL;
+  RutBuffer *indices_buffer = NULL;
+  int n_indices;
   RutMesh *mesh = NULL;
   int i;
   int32_t n_vertices;
@@ -339,34 +934,38 @@ _rut_mesh_new_from_p_ply (RutContext *ctx,
   loader->loader_attributes = loader_attributes;
   loader->loader_properties = loader_properties;
 
-  loader->ply = ply;
-
-  if (!ply_read_header (loader->ply))
+  if (loader->header)
+    n_vertices = loader->header->n_vertices;
+  else
     {
-      g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
-                   RUT_MESH_PLY_ERROR_UNKNOWN,
-                   "Failed to parse header of PLY file %s", display_name);
-      goto EXIT;
-    }
+      if (!ply_read_header (loader->ply))
+        {
+          g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
+                       RUT_MESH_PLY_ERROR_UNKNOWN,
+                       "Failed to parse header of PLY file %s", display_name);
+          goto EXIT;
+        }
 
-  vertex_element = find_element (loader, "vertex");
-  if (!vertex_element)
-    {
-      g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
-                   RUT_MESH_PLY_ERROR_MISSING_PROPERTY,
-                   "PLY file %s is missing the vertex properties",
-                   display_name);
-      goto EXIT;
+      vertex_element = find_element (loader, "vertex");
+      if (!vertex_element)
+        {
+          g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
+                       RUT_MESH_PLY_ERROR_MISSING_PROPERTY,
+                       "PLY file %s is missing the vertex properties",
+                       display_name);
+          goto EXIT;
+        }
+
+      ply_get_element_info (vertex_element, NULL, &n_vertices);
     }
 
-  ply_get_element_info (vertex_element, NULL, &n_vertices);
+  loader->n_vertices = n_vertices;
 
   if (!init_indices_array (loader, n_vertices, &loader->error))
     goto EXIT;
 
   /* Group properties into attributes */
 
-  n_loader_attributes = 0;
   for (i = 0; i < n_attributes; i++)
     {
       RutPLYAttribute *attribute = &attributes[i];
@@ -376,19 +975,21 @@ _rut_mesh_new_from_p_ply (RutContext *ctx,
       e_ply_type ply_attribute_type;
       int component_size;
 
+      size_t source_offsets[RUT_PLY_MAX_ATTRIBUTE_PROPERTIES];
+      e_ply_type source_types[RUT_PLY_MAX_ATTRIBUTE_PROPERTIES];
+
       for (j = 0; j < attribute->n_properties; j++)
         {
           RutPLYProperty *property = &attribute->properties[j];
-          p_ply_property ply_prop;
           e_ply_type ply_property_type;
 
-          ply_prop = find_property (vertex_element, property->name);
-          if (!ply_prop)
+          if (!find_vertex_property (loader, vertex_element, property->name,
+                                     &ply_property_type, &source_offsets[j]))
             break;
 
+          source_types[j] = ply_property_type;
           n_components++;
 
-          ply_get_property_info (ply_prop, NULL, &ply_property_type, NULL, NULL);
           if (n_components == 1)
             ply_attribute_type = ply_property_type;
           else if (ply_property_type != ply_attribute_type)
@@ -453,6 +1054,8 @@ _rut_mesh_new_from_p_ply (RutContext *ctx,
               loader_property->component = j;
               loader_property->name = attribute->properties[j].name;
               loader_property->loader_attribute = loader_attribute;
+              loader_property->source_type = source_types[j];
+              loader_property->source_offset = source_offsets[j];
             }
         }
 
@@ -475,6 +1078,8 @@ _rut_mesh_new_from_p_ply (RutContext *ctx,
       n_loader_attributes++;
     }
 
+  loader->n_loader_attributes = n_loader_attributes;
+
   /* Align the size of a vertex to the size of the largest component type */
   loader->n_vertex_bytes = ((loader->n_vertex_bytes + max_component_size - 1) &
                            ~(unsigned int) (max_component_size - 1));
@@ -492,7 +1097,7 @@ _rut_mesh_new_from_p_ply (RutContext *ctx,
       RutAttribute *rut_attribute;
       int j;
 
-      if (!loader_attribute->padding)
+      if (!loader_attribute->padding && loader->header == NULL)
         {
             for (j = 0; j < loader_attribute->n_components; j++)
               {
@@ -524,29 +1129,46 @@ _rut_mesh_new_from_p_ply (RutContext *ctx,
       rut_attributes[i] = rut_attribute;
     }
 
-  if (!ply_set_read_cb (loader->ply, "face", "vertex_indices",
-                        rut_mesh_ply_loader_face_read_cb,
-                        loader, i))
+  if (loader->header)
     {
-      g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
-                   RUT_MESH_PLY_ERROR_MISSING_PROPERTY,
-                   "PLY file %s is missing face property "
-                   "'vertex_indices'",
-                   display_name);
-      goto EXIT;
-    }
+      read_binary_vertices (loader);
 
-  if (!ply_read (loader->ply))
-    {
-      g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
-                   RUT_MESH_PLY_ERROR_UNKNOWN,
-                   "Unknown error loading PLY file %s", display_name);
-      goto EXIT;
+      indices_buffer = read_binary_faces (loader, display_name, &n_indices);
+      if (!indices_buffer)
+        goto EXIT;
     }
+  else
+    {
+      if (!ply_set_read_cb (loader->ply, "face", "vertex_indices",
+                            rut_mesh_ply_loader_face_read_cb,
+                            loader, i))
+        {
+          g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
+                       RUT_MESH_PLY_ERROR_MISSING_PROPERTY,
+                       "PLY file %s is missing face property "
+                       "'vertex_indices'",
+                       display_name);
+          goto EXIT;
+        }
+
+      if (!ply_read (loader->ply))
+        {
+          if (loader->error == NULL)
+            g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
+                         RUT_MESH_PLY_ERROR_UNKNOWN,
+                         "Unknown error loading PLY file %s", display_name);
+          goto EXIT;
+        }
 
-  ply_close (loader->ply);
+      ply_close (loader->ply);
 
-  if (loader->faces->len == 0)
+      n_indices = loader->faces->len;
+      indices_buffer = rut_buffer_new (loader->faces->len *
+                                       g_array_get_element_size (loader->faces));
+      memcpy (indices_buffer->data, loader->faces->data, indices_buffer->size);
+    }
+
+  if (n_indices == 0)
     {
       g_set_error (&loader->error, RUT_MESH_PLY_ERROR,
                    RUT_MESH_PLY_ERROR_INVALID,
@@ -560,22 +1182,19 @@ _rut_mesh_new_from_p_ply (RutContext *ctx,
                        rut_attributes,
                        n_loader_attributes);
 
-  indices_buffer = rut_buffer_new (loader->faces->len *
-                                   g_array_get_element_size (loader->faces));
-  memcpy (indices_buffer->data, loader->faces->data, indices_buffer->size);
-
   rut_mesh_set_indices (mesh,
                         loader->indices_type,
                         indices_buffer,
-                        loader->faces->len);
-
-  rut_refable_unref (indices_buffer);
+                        n_indices);
 
 EXIT:
 
   if (loader->error)
     g_propagate_error (error, loader->error);
 
+  if (indices_buffer)
+    rut_refable_unref (indices_buffer);
+
   if (loader->vertex_buffer)
     rut_refable_unref (loader->vertex_buffer);
 
@@ -589,6 +1208,52 @@ EXIT:
   return mesh;
 }
 
+/* Tries to decode the data directly. Returns FALSE without setting
+ * *mesh_out if the file isn't in a format that the binary loader
+ * handles, in which case it should be loaded through rply instead */
+static CoglBool
+try_load_binary (RutContext *ctx,
+                 const uint8_t *data,
+                 size_t len,
+                 const char *display_name,
+                 RutPLYAttribute *attributes,
+                 int n_attributes,
+                 RutPLYAttributeStatus *load_status,
+                 RutMesh **mesh_out,
+                 GError **error)
+{
+  BinaryHeader header;
+  Loader loader;
+
+  RUT_STATIC_TIMER (binary_timer,
+                    "Mainloop",
+                    "Binary PLY load",
+                    "Decoding binary PLY files without rply",
+                    0);
+
+  if (!parse_binary_header (data, len, &header))
+    return FALSE;
+
+  RUT_TIMER_START (binary_timer);
+
+  memset (&loader, 0, sizeof (Loader));
+  loader.header = &header;
+
+  *mesh_out = _rut_mesh_new_from_loader (ctx,
+                                         &loader,
+                                         display_name,
+                                         attributes,
+                                         n_attributes,
+                                         load_status,
+                                         error);
+
+  binary_header_destroy (&header);
+
+  RUT_TIMER_STOP (binary_timer);
+
+  return TRUE;
+}
+
 RutMesh *
 rut_mesh_new_from_ply (RutContext *ctx,
                        const char *filename,
@@ -599,27 +1264,51 @@ rut_mesh_new_from_ply (RutContext *ctx,
 {
   Loader loader;
   p_ply ply;
-  RutMesh *mesh;
+  RutMesh *mesh = NULL;
   char *display_name;
+  GMappedFile *mapped_file;
+
+  display_name = g_filename_display_name (filename);
+
+  mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+  if (mapped_file)
+    {
+      CoglBool loaded =
+        try_load_binary (ctx,
+                         (const uint8_t *)
+                         g_mapped_file_get_contents (mapped_file),
+                         g_mapped_file_get_length (mapped_file),
+                         display_name,
+                         attributes,
+                         n_attributes,
+                         load_status,
+                         &mesh,
+                         error);
+
+      g_mapped_file_unref (mapped_file);
+
+      if (loaded)
+        goto done;
+    }
 
   memset (&loader, 0, sizeof (Loader));
 
   ply = ply_open (filename, rut_mesh_ply_loader_error_cb, error);
 
   if (!ply)
-    return NULL;
+    goto done;
 
-  display_name = g_filename_display_name (filename);
+  loader.ply = ply;
 
-  mesh = _rut_mesh_new_from_p_ply (ctx,
-                                   &loader,
-                                   ply,
-                                   display_name,
-                                   attributes,
-                                   n_attributes,
-                                   load_status,
-                                   error);
+  mesh = _rut_mesh_new_from_loader (ctx,
+                                    &loader,
+                                    display_name,
+                                    attributes,
+                                    n_attributes,
+                                    load_status,
+                                    error);
 
+done:
   g_free (display_name);
 
   return mesh;
@@ -636,27 +1325,34 @@ rut_mesh_new_from_ply_data (RutContext *ctx,
 {
   Loader loader;
   p_ply ply;
-  RutMesh *mesh;
+  RutMesh *mesh = NULL;
   char *display_name;
 
+  display_name = g_strdup_printf ("<serialized asset %p>", data);
+
+  if (try_load_binary (ctx, data, len, display_name,
+                       attributes, n_attributes, load_status,
+                       &mesh, error))
+    goto done;
+
   memset (&loader, 0, sizeof (Loader));
 
   ply = ply_start (data, len, rut_mesh_ply_loader_error_cb, error);
 
   if (!ply)
-    return NULL;
+    goto done;
 
-  display_name = g_strdup_printf ("<serialized asset %p>", data);
+  loader.ply = ply;
 
-  mesh = _rut_mesh_new_from_p_ply (ctx,
-                                   &loader,
-                                   ply,
-                                   display_name,
-                                   attributes,
-                                   n_attributes,
-                                   load_status,
-                                   error);
+  mesh = _rut_mesh_new_from_loader (ctx,
+                                    &loader,
+                                    display_name,
+                                    attributes,
+                                    n_attributes,
+                                    load_status,
+                                    error);
 
+done:
   g_free (display_name);
 
   return mesh;
@@ -0,0 +1,503 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "rut-mesh-quantize.h"
+#include "rut-profile.h"
+#include "rut-util.h"
+
+typedef enum _PackFormat
+{
+  /* The data is copied unchanged */
+  PACK_FORMAT_COPY,
+
+  /* Float data is converted to normalized integers */
+  PACK_FORMAT_POSITION,
+  PACK_FORMAT_DIRECTION,
+  PACK_FORMAT_TEX_COORD,
+
+  /* Normalized integers are converted back to floats */
+  PACK_FORMAT_EXPAND
+} PackFormat;
+
+/* Describes where an attribute of the source mesh ends up in the
+ * interleaved vertices of the new mesh */
+typedef struct _PackedAttribute
+{
+  RutAttribute *source;
+  PackFormat format;
+
+  RutAttributeType type;
+  bool normalized;
+  size_t offset;
+
+  /* The index of an earlier attribute that refers to the same source
+   * data, or -1 */
+  int alias;
+} PackedAttribute;
+
+bool
+rut_mesh_quantize_is_enabled (void)
+{
+  /* NB: this is checked from the asset loader's threads. Zero means
+   * the variable hasn't been read yet so the value is offset by one */
+  static gsize enabled = 0;
+
+  if (g_once_init_enter (&enabled))
+    {
+      bool value = rut_util_is_boolean_env_set ("RUT_QUANTIZE_MESHES");
+
+      g_once_init_leave (&enabled, value + 1);
+    }
+
+  return enabled - 1;
+}
+
+static size_t
+get_sizeof_attribute_type (RutAttributeType type)
+{
+  switch (type)
+    {
+    case RUT_ATTRIBUTE_TYPE_BYTE:
+    case RUT_ATTRIBUTE_TYPE_UNSIGNED_BYTE:
+      return 1;
+    case RUT_ATTRIBUTE_TYPE_SHORT:
+    case RUT_ATTRIBUTE_TYPE_UNSIGNED_SHORT:
+      return 2;
+    case RUT_ATTRIBUTE_TYPE_FLOAT:
+      return 4;
+    }
+
+  g_return_val_if_reached (0);
+}
+
+static bool
+attribute_fits_buffer (RutAttribute *attribute,
+                       int n_vertices)
+{
+  size_t size = get_sizeof_attribute_type (attribute->type) *
+    attribute->n_components;
+
+  return (n_vertices == 0 ||
+          (attribute->stride * (n_vertices - 1) + attribute->offset + size <=
+           attribute->buffer->size));
+}
+
+static const uint8_t *
+get_vertex_data (RutAttribute *attribute,
+                 int vertex)
+{
+  return (attribute->buffer->data + attribute->offset +
+          attribute->stride * vertex);
+}
+
+static bool
+is_tex_coord_attribute (const char *name)
+{
+  return (g_str_has_prefix (name, "cogl_tex_coord") &&
+          g_str_has_suffix (name, "_in"));
+}
+
+static bool
+tex_coords_are_normalized (RutAttribute *attribute,
+                           int n_vertices)
+{
+  int i, j;
+
+  for (i = 0; i < n_vertices; i++)
+    {
+      const float *tex_coord = (const float *) get_vertex_data (attribute, i);
+
+      for (j = 0; j < attribute->n_components; j++)
+        if (!(tex_coord[j] >= 0 && tex_coord[j] <= 1))
+          return false;
+    }
+
+  return true;
+}
+
+static void
+find_aliases (PackedAttribute *packed,
+              int n_attributes)
+{
+  int i, j;
+
+  for (i = 0; i < n_attributes; i++)
+    {
+      RutAttribute *a = packed[i].source;
+
+      packed[i].alias = -1;
+
+      for (j = 0; j < i; j++)
+        {
+          RutAttribute *b = packed[j].source;
+
+          if (a->buffer == b->buffer &&
+              a->offset == b->offset &&
+              a->stride == b->stride &&
+              a->type == b->type &&
+              a->n_components == b->n_components &&
+              a->normalized == b->normalized)
+            {
+              packed[i].alias = j;
+              break;
+            }
+        }
+    }
+}
+
+/* Assigns an offset within the new vertices to each attribute and
+ * returns the stride. Every attribute starts on a 4 byte boundary
+ * since some GPUs fetch unaligned attributes very slowly. */
+static size_t
+layout_attributes (PackedAttribute *packed,
+                   int n_attributes)
+{
+  size_t stride = 0;
+  int i;
+
+  for (i = 0; i < n_attributes; i++)
+    {
+      if (packed[i].alias >= 0)
+        {
+          packed[i].offset = packed[packed[i].alias].offset;
+          continue;
+        }
+
+      packed[i].offset = stride;
+      stride += get_sizeof_attribute_type (packed[i].type) *
+        packed[i].source->n_components;
+      stride = (stride + 3) & ~(size_t) 3;
+    }
+
+  return stride;
+}
+
+static int16_t
+pack_snorm16 (float value)
+{
+  return lrintf (CLAMP (value, -1.0f, 1.0f) * 32767.0f);
+}
+
+static int8_t
+pack_snorm8 (float value)
+{
+  return lrintf (CLAMP (value, -1.0f, 1.0f) * 127.0f);
+}
+
+static uint16_t
+pack_unorm16 (float value)
+{
+  return lrintf (CLAMP (value, 0.0f, 1.0f) * 65535.0f);
+}
+
+/* Follows the OpenGL rules for converting normalized integers */
+static float
+unpack_component (const uint8_t *data,
+                  int component,
+                  RutAttributeType type,
+                  bool normalized)
+{
+  float value;
+
+  switch (type)
+    {
+    case RUT_ATTRIBUTE_TYPE_BYTE:
+      value = ((const int8_t *) data)[component];
+      return normalized ? MAX (value / 127.0f, -1.0f) : value;
+    case RUT_ATTRIBUTE_TYPE_UNSIGNED_BYTE:
+      value = data[component];
+      return normalized ? value / 255.0f : value;
+    case RUT_ATTRIBUTE_TYPE_SHORT:
+      value = ((const int16_t *) data)[component];
+      return normalized ? MAX (value / 32767.0f, -1.0f) : value;
+    case RUT_ATTRIBUTE_TYPE_UNSIGNED_SHORT:
+      value = ((const uint16_t *) data)[component];
+      return normalized ? value / 65535.0f : value;
+    case RUT_ATTRIBUTE_TYPE_FLOAT:
+      return ((const float *) data)[component];
+    }
+
+  g_return_val_if_reached (0);
+}
+
+static void
+pack_attribute (PackedAttribute *packed,
+                int n_vertices,
+                uint8_t *vertices,
+                size_t stride,
+                const float position_scale[3],
+                const float position_offset[3])
+{
+  RutAttribute *source = packed->source;
+  int n_components = source->n_components;
+  bool is_position = strcmp (source->name, "cogl_position_in") == 0;
+  size_t size = get_sizeof_attribute_type (source->type) * n_components;
+  int i, j;
+
+  for (i = 0; i < n_vertices; i++)
+    {
+      const uint8_t *src = get_vertex_data (source, i);
+      uint8_t *dst = vertices + stride * i + packed->offset;
+      const float *src_float = (const float *) src;
+
+      switch (packed->format)
+        {
+        case PACK_FORMAT_COPY:
+          memcpy (dst, src, size);
+          break;
+
+        case PACK_FORMAT_POSITION:
+          for (j = 0; j < n_components; j++)
+            ((int16_t *) dst)[j] =
+              pack_snorm16 ((src_float[j] - position_offset[j]) /
+                            position_scale[j]);
+          break;
+
+        case PACK_FORMAT_DIRECTION:
+          for (j = 0; j < n_components; j++)
+            ((int8_t *) dst)[j] = pack_snorm8 (src_float[j]);
+          break;
+
+        case PACK_FORMAT_TEX_COORD:
+          for (j = 0; j < n_components; j++)
+            ((uint16_t *) dst)[j] = pack_unorm16 (src_float[j]);
+          break;
+
+        case PACK_FORMAT_EXPAND:
+          for (j = 0; j < n_components; j++)
+            {
+              float value = unpack_component (src, j,
+                                              source->type,
+                                              source->normalized);
+
+              if (is_position && j < 3)
+                value = position_offset[j] + position_scale[j] * value;
+
+              ((float *) dst)[j] = value;
+            }
+          break;
+        }
+    }
+}
+
+static RutMesh *
+pack_mesh (RutMesh *mesh,
+           PackedAttribute *packed,
+           const float position_scale[3],
+           const float position_offset[3])
+{
+  int n_attributes = mesh->n_attributes;
+  RutAttribute **attributes = g_alloca (sizeof (void *) * n_attributes);
+  RutBuffer *buffer;
+  RutMesh *packed_mesh;
+  size_t stride;
+  int i;
+
+  find_aliases (packed, n_attributes);
+  stride = layout_attributes (packed, n_attributes);
+
+  buffer = rut_buffer_new (stride * mesh->n_vertices);
+
+  /* Clear the padding so that the contents are deterministic */
+  memset (buffer->data, 0, buffer->size);
+
+  for (i = 0; i < n_attributes; i++)
+    {
+      if (packed[i].alias < 0)
+        pack_attribute (&packed[i], mesh->n_vertices,
+                        buffer->data, stride,
+                        position_scale, position_offset);
+
+      attributes[i] = rut_attribute_new (buffer,
+                                         packed[i].source->name,
+                                         stride,
+                                         packed[i].offset,
+                                         packed[i].source->n_components,
+                                         packed[i].type);
+      rut_attribute_set_normalized (attributes[i], packed[i].normalized);
+    }
+
+  packed_mesh = rut_mesh_new (mesh->mode, mesh->n_vertices,
+                              attributes, n_attributes);
+
+  if (mesh->indices_buffer)
+    rut_mesh_set_indices (packed_mesh,
+                          mesh->indices_type,
+                          mesh->indices_buffer,
+                          mesh->n_indices);
+
+  for (i = 0; i < n_attributes; i++)
+    rut_refable_unref (attributes[i]);
+  rut_refable_unref (buffer);
+
+  return packed_mesh;
+}
+
+static void
+measure_positions (RutAttribute *attribute,
+                   int n_vertices,
+                   float position_scale[3],
+                   float position_offset[3])
+{
+  float min[3] = { G_MAXFLOAT, G_MAXFLOAT, G_MAXFLOAT };
+  float max[3] = { -G_MAXFLOAT, -G_MAXFLOAT, -G_MAXFLOAT };
+  int i, j;
+
+  for (i = 0; i < n_vertices; i++)
+    {
+      const float *position = (const float *) get_vertex_data (attribute, i);
+
+      for (j = 0; j < attribute->n_components; j++)
+        {
+          min[j] = MIN (min[j], position[j]);
+          max[j] = MAX (max[j], position[j]);
+        }
+    }
+
+  for (j = 0; j < attribute->n_components; j++)
+    {
+      position_offset[j] = (min[j] + max[j]) / 2.0f;
+      position_scale[j] = (max[j] - min[j]) / 2.0f;
+
+      /* Avoid dividing by zero for flat meshes */
+      if (position_scale[j] <= 0)
+        position_scale[j] = 1;
+    }
+}
+
+RutMesh *
+rut_mesh_quantize (RutMesh *mesh,
+                   RutMeshQuantizeFlags flags,
+                   float position_scale[3],
+                   float position_offset[3])
+{
+  PackedAttribute *packed = g_alloca (sizeof (PackedAttribute) *
+                                      mesh->n_attributes);
+  RutMesh *quantized;
+  int i;
+
+  RUT_STATIC_TIMER (quantize_timer,
+                    "Mainloop",
+                    "Mesh quantize",
+                    "Packing mesh attributes into smaller types",
+                    0);
+
+  for (i = 0; i < 3; i++)
+    {
+      position_scale[i] = 1;
+      position_offset[i] = 0;
+    }
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    {
+      RutAttribute *attribute = mesh->attributes[i];
+      const char *name = attribute->name;
+      bool is_float = attribute->type == RUT_ATTRIBUTE_TYPE_FLOAT;
+
+      if (!attribute_fits_buffer (attribute, mesh->n_vertices))
+        return NULL;
+
+      packed[i].source = attribute;
+      packed[i].format = PACK_FORMAT_COPY;
+      packed[i].type = attribute->type;
+      packed[i].normalized = attribute->normalized;
+
+      if (!is_float)
+        continue;
+
+      if ((flags & RUT_MESH_QUANTIZE_POSITIONS) &&
+          strcmp (name, "cogl_position_in") == 0 &&
+          attribute->n_components <= 3)
+        {
+          measure_positions (attribute, mesh->n_vertices,
+                             position_scale, position_offset);
+          packed[i].format = PACK_FORMAT_POSITION;
+          packed[i].type = RUT_ATTRIBUTE_TYPE_SHORT;
+        }
+      else if ((flags & RUT_MESH_QUANTIZE_NORMALS) &&
+               (strcmp (name, "cogl_normal_in") == 0 ||
+                strcmp (name, "tangent_in") == 0))
+        {
+          packed[i].format = PACK_FORMAT_DIRECTION;
+          packed[i].type = RUT_ATTRIBUTE_TYPE_BYTE;
+        }
+      else if ((flags & RUT_MESH_QUANTIZE_TEX_COORDS) &&
+               is_tex_coord_attribute (name) &&
+               tex_coords_are_normalized (attribute, mesh->n_vertices))
+        {
+          packed[i].format = PACK_FORMAT_TEX_COORD;
+          packed[i].type = RUT_ATTRIBUTE_TYPE_UNSIGNED_SHORT;
+        }
+
+      if (packed[i].format != PACK_FORMAT_COPY)
+        packed[i].normalized = true;
+    }
+
+  RUT_TIMER_START (quantize_timer);
+
+  quantized = pack_mesh (mesh, packed, position_scale, position_offset);
+
+  RUT_TIMER_STOP (quantize_timer);
+
+  return quantized;
+}
+
+RutMesh *
+rut_mesh_dequantize (RutMesh *mesh,
+                     const float position_scale[3],
+                     const float position_offset[3])
+{
+  PackedAttribute *packed = g_alloca (sizeof (PackedAttribute) *
+                                      mesh->n_attributes);
+  int i;
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    {
+      RutAttribute *attribute = mesh->attributes[i];
+
+      if (!attribute_fits_buffer (attribute, mesh->n_vertices))
+        return NULL;
+
+      packed[i].source = attribute;
+
+      if (attribute->normalized &&
+          attribute->type != RUT_ATTRIBUTE_TYPE_FLOAT)
+        {
+          packed[i].format = PACK_FORMAT_EXPAND;
+          packed[i].type = RUT_ATTRIBUTE_TYPE_FLOAT;
+          packed[i].normalized = false;
+        }
+      else
+        {
+          packed[i].format = PACK_FORMAT_COPY;
+          packed[i].type = attribute->type;
+          packed[i].normalized = attribute->normalized;
+        }
+    }
+
+  return pack_mesh (mesh, packed, position_scale, position_offset);
+}
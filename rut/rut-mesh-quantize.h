@@ -0,0 +1,84 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RUT_MESH_QUANTIZE_H_
+#define _RUT_MESH_QUANTIZE_H_
+
+#include <stdbool.h>
+
+#include "rut-mesh.h"
+
+/*
+ * RUT_MESH_QUANTIZE_POSITIONS: Stores "cogl_position_in" as
+ *   normalized shorts. The positions are mapped into the -1 to 1
+ *   range so they have to be transformed by a per mesh scale and
+ *   offset to get back to model space.
+ * RUT_MESH_QUANTIZE_NORMALS: Stores "cogl_normal_in" and "tangent_in"
+ *   as normalized bytes.
+ * RUT_MESH_QUANTIZE_TEX_COORDS: Stores texture coordinates as
+ *   normalized unsigned shorts. Attributes with coordinates outside of
+ *   the 0 to 1 range are left as floats.
+ */
+typedef enum {
+  RUT_MESH_QUANTIZE_POSITIONS = 1L<<0,
+  RUT_MESH_QUANTIZE_NORMALS = 1L<<1,
+  RUT_MESH_QUANTIZE_TEX_COORDS = 1L<<2,
+
+  RUT_MESH_QUANTIZE_ALL = (RUT_MESH_QUANTIZE_POSITIONS |
+                           RUT_MESH_QUANTIZE_NORMALS |
+                           RUT_MESH_QUANTIZE_TEX_COORDS)
+} RutMeshQuantizeFlags;
+
+/* Quantizing is lossy so it is opt in. This returns true if the
+ * RUT_QUANTIZE_MESHES environment variable is set, in which case
+ * meshes are quantized before being uploaded to the GPU or sent to a
+ * slave device. */
+bool
+rut_mesh_quantize_is_enabled (void);
+
+/* Creates a copy of @mesh with its float attributes stored in smaller
+ * types, according to @flags. All of the vertex attributes are packed
+ * into a single interleaved buffer. The indices are shared with
+ * @mesh. Attributes that aliased the same data in @mesh still alias
+ * each other in the copy.
+ *
+ * A quantized position p maps back to model space as
+ * position_offset + position_scale * p. If positions aren't quantized
+ * the scale is 1 and the offset is 0.
+ *
+ * Returns NULL if the attributes of @mesh don't fit in their buffers.
+ */
+RutMesh *
+rut_mesh_quantize (RutMesh *mesh,
+                   RutMeshQuantizeFlags flags,
+                   float position_scale[3],
+                   float position_offset[3]);
+
+/* The inverse of rut_mesh_quantize(). Creates a copy of @mesh where
+ * all of the normalized attributes are expanded back into floats, and
+ * the positions are transformed by @position_scale and
+ * @position_offset. This is useful when a mesh needs to be
+ * inspected on the CPU. */
+RutMesh *
+rut_mesh_dequantize (RutMesh *mesh,
+                     const float position_scale[3],
+                     const float position_offset[3]);
+
+#endif /* _RUT_MESH_QUANTIZE_H_ */
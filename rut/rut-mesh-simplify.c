@@ -0,0 +1,753 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "rut-mesh-simplify.h"
+#include "rut-profile.h"
+
+/* Boundary edges are kept in place by adding the quadric of a plane
+ * perpendicular to the boundary, scaled by this much */
+#define BOUNDARY_WEIGHT 10.0
+
+/* A symmetric 4x4 matrix representing the sum of squared distances to
+ * a set of planes:
+ *
+ *   a2 ab ac ad
+ *      b2 bc bd
+ *         c2 cd
+ *            d2
+ */
+typedef struct _Quadric
+{
+  double a2, ab, ac, ad;
+  double b2, bc, bd;
+  double c2, cd;
+  double d2;
+} Quadric;
+
+typedef struct _Collapse
+{
+  float cost;
+  int from;
+  int to;
+} Collapse;
+
+typedef struct _SimplifyState
+{
+  int n_vertices;
+
+  /* Vertices that share a position are welded into a group which is
+   * identified by the lowest vertex index in the group. The vertices
+   * of group g are listed in group_vertices starting at
+   * group_offsets[g]. */
+  int *groups;
+  int *group_offsets;
+  int *group_vertices;
+
+  float *positions;
+  Quadric *quadrics;
+
+  uint32_t *indices;
+  int n_triangles;
+} SimplifyState;
+
+static void
+quadric_add_plane (Quadric *q,
+                   const double normal[3],
+                   double d,
+                   double weight)
+{
+  double a = normal[0], b = normal[1], c = normal[2];
+
+  q->a2 += weight * a * a;
+  q->ab += weight * a * b;
+  q->ac += weight * a * c;
+  q->ad += weight * a * d;
+  q->b2 += weight * b * b;
+  q->bc += weight * b * c;
+  q->bd += weight * b * d;
+  q->c2 += weight * c * c;
+  q->cd += weight * c * d;
+  q->d2 += weight * d * d;
+}
+
+static void
+quadric_add (Quadric *q,
+             const Quadric *other)
+{
+  q->a2 += other->a2;
+  q->ab += other->ab;
+  q->ac += other->ac;
+  q->ad += other->ad;
+  q->b2 += other->b2;
+  q->bc += other->bc;
+  q->bd += other->bd;
+  q->c2 += other->c2;
+  q->cd += other->cd;
+  q->d2 += other->d2;
+}
+
+static double
+quadric_evaluate (const Quadric *q,
+                  const float *p)
+{
+  double x = p[0], y = p[1], z = p[2];
+
+  return (q->a2 * x * x + 2 * q->ab * x * y + 2 * q->ac * x * z +
+          2 * q->ad * x +
+          q->b2 * y * y + 2 * q->bc * y * z + 2 * q->bd * y +
+          q->c2 * z * z + 2 * q->cd * z +
+          q->d2);
+}
+
+/* Returns twice the area of the triangle */
+static double
+triangle_normal (const float *p0,
+                 const float *p1,
+                 const float *p2,
+                 double normal[3])
+{
+  double e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+  double e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+  double length;
+
+  normal[0] = e0[1] * e1[2] - e0[2] * e1[1];
+  normal[1] = e0[2] * e1[0] - e0[0] * e1[2];
+  normal[2] = e0[0] * e1[1] - e0[1] * e1[0];
+
+  length = sqrt (normal[0] * normal[0] +
+                 normal[1] * normal[1] +
+                 normal[2] * normal[2]);
+
+  if (length > 0)
+    {
+      normal[0] /= length;
+      normal[1] /= length;
+      normal[2] /= length;
+    }
+
+  return length;
+}
+
+static const float *
+get_position (SimplifyState *state,
+              int vertex)
+{
+  return state->positions + vertex * 3;
+}
+
+static bool
+read_positions (SimplifyState *state,
+                RutMesh *mesh)
+{
+  RutAttribute *attribute = NULL;
+  int i;
+
+  for (i = 0; i < mesh->n_attributes; i++)
+    if (strcmp (mesh->attributes[i]->name, "cogl_position_in") == 0)
+      {
+        attribute = mesh->attributes[i];
+        break;
+      }
+
+  if (attribute == NULL ||
+      attribute->type != RUT_ATTRIBUTE_TYPE_FLOAT ||
+      attribute->stride * (mesh->n_vertices - 1) + attribute->offset +
+      sizeof (float) * attribute->n_components > attribute->buffer->size)
+    return false;
+
+  state->positions = g_new0 (float, mesh->n_vertices * 3);
+
+  for (i = 0; i < mesh->n_vertices; i++)
+    {
+      const float *position =
+        (const float *) (attribute->buffer->data + attribute->offset +
+                         attribute->stride * i);
+
+      memcpy (state->positions + i * 3, position,
+              sizeof (float) * MIN (attribute->n_components, 3));
+    }
+
+  return true;
+}
+
+static bool
+read_indices (SimplifyState *state,
+              RutMesh *mesh)
+{
+  const void *data = mesh->indices_buffer->data;
+  int n_indices = (mesh->n_indices / 3) * 3;
+  size_t index_size;
+  int i;
+
+  switch (mesh->indices_type)
+    {
+    case COGL_INDICES_TYPE_UNSIGNED_BYTE:
+      index_size = 1;
+      break;
+    case COGL_INDICES_TYPE_UNSIGNED_SHORT:
+      index_size = 2;
+      break;
+    case COGL_INDICES_TYPE_UNSIGNED_INT:
+      index_size = 4;
+      break;
+    default:
+      return false;
+    }
+
+  if (index_size * n_indices > mesh->indices_buffer->size)
+    return false;
+
+  state->indices = g_new (uint32_t, n_indices);
+  state->n_triangles = n_indices / 3;
+
+  for (i = 0; i < n_indices; i++)
+    {
+      uint32_t index;
+
+      if (index_size == 1)
+        index = ((const uint8_t *) data)[i];
+      else if (index_size == 2)
+        index = ((const uint16_t *) data)[i];
+      else
+        index = ((const uint32_t *) data)[i];
+
+      if (index >= mesh->n_vertices)
+        return false;
+
+      state->indices[i] = index;
+    }
+
+  return true;
+}
+
+static int
+compare_positions (const void *a,
+                   const void *b,
+                   void *user_data)
+{
+  const float *positions = user_data;
+  const float *pa = positions + *(const int *) a * 3;
+  const float *pb = positions + *(const int *) b * 3;
+  int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      if (pa[i] < pb[i])
+        return -1;
+      else if (pa[i] > pb[i])
+        return 1;
+    }
+
+  /* Keep the sort stable so the lowest index leads its group */
+  return *(const int *) a - *(const int *) b;
+}
+
+static void
+weld_vertices (SimplifyState *state)
+{
+  int n_vertices = state->n_vertices;
+  int *sorted = g_new (int, n_vertices);
+  int *counts = g_new0 (int, n_vertices + 1);
+  int *fill;
+  int i;
+
+  for (i = 0; i < n_vertices; i++)
+    sorted[i] = i;
+
+  g_qsort_with_data (sorted, n_vertices, sizeof (int),
+                     compare_positions, state->positions);
+
+  state->groups = g_new (int, n_vertices);
+
+  for (i = 0; i < n_vertices; i++)
+    {
+      int vertex = sorted[i];
+
+      if (i > 0 &&
+          memcmp (get_position (state, vertex),
+                  get_position (state, sorted[i - 1]),
+                  sizeof (float) * 3) == 0)
+        state->groups[vertex] = state->groups[sorted[i - 1]];
+      else
+        state->groups[vertex] = vertex;
+
+      counts[state->groups[vertex] + 1]++;
+    }
+
+  state->group_offsets = counts;
+  for (i = 0; i < n_vertices; i++)
+    state->group_offsets[i + 1] += state->group_offsets[i];
+
+  /* The sorted array isn't needed anymore so it is reused for the
+   * lists of vertices in each group */
+  state->group_vertices = sorted;
+
+  fill = g_memdup (state->group_offsets, sizeof (int) * n_vertices);
+  for (i = 0; i < n_vertices; i++)
+    state->group_vertices[fill[state->groups[i]]++] = i;
+  g_free (fill);
+}
+
+static int
+compare_edges (const void *a, const void *b)
+{
+  const int *ea = a;
+  const int *eb = b;
+
+  if (ea[0] != eb[0])
+    return ea[0] - eb[0];
+  return ea[1] - eb[1];
+}
+
+static void
+init_quadrics (SimplifyState *state)
+{
+  int n_triangles = state->n_triangles;
+  int *edges = g_new (int, n_triangles * 3 * 3);
+  int i, j;
+
+  state->quadrics = g_new0 (Quadric, state->n_vertices);
+
+  for (i = 0; i < n_triangles; i++)
+    {
+      const uint32_t *triangle = state->indices + i * 3;
+      const float *p;
+      int g[3];
+      double normal[3];
+      double area, d;
+
+      for (j = 0; j < 3; j++)
+        g[j] = state->groups[triangle[j]];
+
+      area = triangle_normal (get_position (state, g[0]),
+                              get_position (state, g[1]),
+                              get_position (state, g[2]),
+                              normal) / 2;
+
+      p = get_position (state, g[0]);
+      d = -(normal[0] * p[0] + normal[1] * p[1] + normal[2] * p[2]);
+
+      for (j = 0; j < 3; j++)
+        {
+          quadric_add_plane (&state->quadrics[g[j]], normal, d, area);
+
+          /* Record each edge along with the triangle it came from */
+          edges[(i * 3 + j) * 3 + 0] = MIN (g[j], g[(j + 1) % 3]);
+          edges[(i * 3 + j) * 3 + 1] = MAX (g[j], g[(j + 1) % 3]);
+          edges[(i * 3 + j) * 3 + 2] = i;
+        }
+    }
+
+  qsort (edges, n_triangles * 3, sizeof (int) * 3, compare_edges);
+
+  /* Edges that are only used by one triangle are on the boundary of
+   * the mesh */
+  for (i = 0; i < n_triangles * 3; i++)
+    {
+      int *edge = edges + i * 3;
+      const uint32_t *triangle;
+      const float *p0, *p1;
+      double face_normal[3], normal[3], e[3], length, d, weight;
+
+      if ((i > 0 && compare_edges (edge, edge - 3) == 0) ||
+          (i + 1 < n_triangles * 3 && compare_edges (edge, edge + 3) == 0))
+        continue;
+
+      triangle = state->indices + edge[2] * 3;
+      triangle_normal (get_position (state, state->groups[triangle[0]]),
+                       get_position (state, state->groups[triangle[1]]),
+                       get_position (state, state->groups[triangle[2]]),
+                       face_normal);
+
+      p0 = get_position (state, edge[0]);
+      p1 = get_position (state, edge[1]);
+      for (j = 0; j < 3; j++)
+        e[j] = p1[j] - p0[j];
+
+      normal[0] = e[1] * face_normal[2] - e[2] * face_normal[1];
+      normal[1] = e[2] * face_normal[0] - e[0] * face_normal[2];
+      normal[2] = e[0] * face_normal[1] - e[1] * face_normal[0];
+      length = sqrt (normal[0] * normal[0] +
+                     normal[1] * normal[1] +
+                     normal[2] * normal[2]);
+      if (length == 0)
+        continue;
+
+      for (j = 0; j < 3; j++)
+        normal[j] /= length;
+
+      d = -(normal[0] * p0[0] + normal[1] * p0[1] + normal[2] * p0[2]);
+      weight = BOUNDARY_WEIGHT * length * length;
+
+      quadric_add_plane (&state->quadrics[edge[0]], normal, d, weight);
+      quadric_add_plane (&state->quadrics[edge[1]], normal, d, weight);
+    }
+
+  g_free (edges);
+}
+
+static int
+compare_collapses (const void *a, const void *b)
+{
+  const Collapse *ca = a;
+  const Collapse *cb = b;
+
+  if (ca->cost < cb->cost)
+    return -1;
+  else if (ca->cost > cb->cost)
+    return 1;
+  return 0;
+}
+
+static float
+collapse_cost (SimplifyState *state,
+               int from,
+               int to)
+{
+  Quadric q = state->quadrics[from];
+
+  quadric_add (&q, &state->quadrics[to]);
+
+  return quadric_evaluate (&q, get_position (state, to));
+}
+
+/* Checks that moving group @from onto group @to doesn't turn any of
+ * the surrounding triangles inside out */
+static bool
+collapse_flips_triangles (SimplifyState *state,
+                          const int *adjacency_offsets,
+                          const int *adjacent_triangles,
+                          int from,
+                          int to)
+{
+  int i, j;
+
+  for (i = adjacency_offsets[from]; i < adjacency_offsets[from + 1]; i++)
+    {
+      const uint32_t *triangle = state->indices + adjacent_triangles[i] * 3;
+      const float *before[3], *after[3];
+      double n0[3], n1[3];
+      bool shared = false;
+
+      for (j = 0; j < 3; j++)
+        {
+          int g = state->groups[triangle[j]];
+
+          if (g == to)
+            shared = true;
+
+          before[j] = get_position (state, g);
+          after[j] = get_position (state, g == from ? to : g);
+        }
+
+      /* These triangles disappear */
+      if (shared)
+        continue;
+
+      triangle_normal (before[0], before[1], before[2], n0);
+      if (triangle_normal (after[0], after[1], after[2], n1) == 0 ||
+          n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0)
+        return true;
+    }
+
+  return false;
+}
+
+static void
+lock_neighbours (SimplifyState *state,
+                 const int *adjacency_offsets,
+                 const int *adjacent_triangles,
+                 int group,
+                 bool *locked)
+{
+  int i, j;
+
+  for (i = adjacency_offsets[group]; i < adjacency_offsets[group + 1]; i++)
+    {
+      const uint32_t *triangle = state->indices + adjacent_triangles[i] * 3;
+
+      for (j = 0; j < 3; j++)
+        locked[state->groups[triangle[j]]] = true;
+    }
+}
+
+/* Chooses which vertex of group @to each vertex of group @from should
+ * become. Where a triangle disappears its vertices show which of the
+ * vertices at the two positions belong to the same side of any seam.
+ * Any other vertices just take the first vertex of @to. */
+static void
+map_collapsed_vertices (SimplifyState *state,
+                        const int *adjacency_offsets,
+                        const int *adjacent_triangles,
+                        int from,
+                        int to,
+                        int *vertex_map)
+{
+  int i, j, k;
+
+  for (i = adjacency_offsets[from]; i < adjacency_offsets[from + 1]; i++)
+    {
+      const uint32_t *triangle = state->indices + adjacent_triangles[i] * 3;
+
+      for (j = 0; j < 3; j++)
+        {
+          if (state->groups[triangle[j]] != from ||
+              vertex_map[triangle[j]] != -1)
+            continue;
+
+          for (k = 0; k < 3; k++)
+            if (state->groups[triangle[k]] == to)
+              {
+                vertex_map[triangle[j]] = triangle[k];
+                break;
+              }
+        }
+    }
+
+  for (i = state->group_offsets[from]; i < state->group_offsets[from + 1]; i++)
+    {
+      int vertex = state->group_vertices[i];
+
+      if (vertex_map[vertex] == -1)
+        vertex_map[vertex] = to;
+    }
+}
+
+/* Collapses as many independent edges as possible, cheapest first.
+ * Returns the number of collapses. */
+static int
+simplify_pass (SimplifyState *state,
+               int max_collapses)
+{
+  int n_vertices = state->n_vertices;
+  int n_triangles = state->n_triangles;
+  int *adjacency_offsets = g_new0 (int, n_vertices + 1);
+  int *adjacent_triangles = g_new (int, n_triangles * 3);
+  int *fill;
+  Collapse *collapses = g_new (Collapse, n_triangles * 3);
+  bool *locked = g_new0 (bool, n_vertices);
+  int *vertex_map = g_new (int, n_vertices);
+  int n_collapses = 0;
+  int n_candidates = 0;
+  int n_kept = 0;
+  int i, j;
+
+  for (i = 0; i < n_triangles * 3; i++)
+    adjacency_offsets[state->groups[state->indices[i]] + 1]++;
+  for (i = 0; i < n_vertices; i++)
+    adjacency_offsets[i + 1] += adjacency_offsets[i];
+
+  fill = g_memdup (adjacency_offsets, sizeof (int) * n_vertices);
+  for (i = 0; i < n_triangles * 3; i++)
+    adjacent_triangles[fill[state->groups[state->indices[i]]]++] = i / 3;
+  g_free (fill);
+
+  for (i = 0; i < n_triangles; i++)
+    {
+      const uint32_t *triangle = state->indices + i * 3;
+
+      for (j = 0; j < 3; j++)
+        {
+          int a = state->groups[triangle[j]];
+          int b = state->groups[triangle[(j + 1) % 3]];
+          float cost_ab, cost_ba;
+
+          /* NB: interior edges are seen from both of their triangles
+           * but the duplicate will just find its groups locked */
+          cost_ab = collapse_cost (state, a, b);
+          cost_ba = collapse_cost (state, b, a);
+
+          collapses[n_candidates].cost = MIN (cost_ab, cost_ba);
+          collapses[n_candidates].from = cost_ab <= cost_ba ? a : b;
+          collapses[n_candidates].to = cost_ab <= cost_ba ? b : a;
+          n_candidates++;
+        }
+    }
+
+  qsort (collapses, n_candidates, sizeof (Collapse), compare_collapses);
+
+  for (i = 0; i < n_vertices; i++)
+    vertex_map[i] = -1;
+
+  for (i = 0; i < n_candidates && n_collapses < max_collapses; i++)
+    {
+      int from = collapses[i].from;
+      int to = collapses[i].to;
+
+      if (locked[from] || locked[to])
+        continue;
+
+      if (collapse_flips_triangles (state,
+                                    adjacency_offsets,
+                                    adjacent_triangles,
+                                    from, to))
+        continue;
+
+      map_collapsed_vertices (state,
+                              adjacency_offsets,
+                              adjacent_triangles,
+                              from, to,
+                              vertex_map);
+
+      quadric_add (&state->quadrics[to], &state->quadrics[from]);
+
+      /* The adjacency information around both groups is stale now */
+      lock_neighbours (state, adjacency_offsets, adjacent_triangles,
+                       from, locked);
+      lock_neighbours (state, adjacency_offsets, adjacent_triangles,
+                       to, locked);
+
+      n_collapses++;
+    }
+
+  for (i = 0; i < n_triangles; i++)
+    {
+      uint32_t *triangle = state->indices + i * 3;
+      uint32_t mapped[3];
+      int g[3];
+
+      for (j = 0; j < 3; j++)
+        {
+          mapped[j] = (vertex_map[triangle[j]] == -1 ?
+                       triangle[j] : vertex_map[triangle[j]]);
+          g[j] = state->groups[mapped[j]];
+        }
+
+      if (g[0] == g[1] || g[1] == g[2] || g[2] == g[0])
+        continue;
+
+      memcpy (state->indices + n_kept * 3, mapped, sizeof (mapped));
+      n_kept++;
+    }
+
+  state->n_triangles = n_kept;
+
+  g_free (vertex_map);
+  g_free (locked);
+  g_free (collapses);
+  g_free (adjacent_triangles);
+  g_free (adjacency_offsets);
+
+  return n_collapses;
+}
+
+static RutMesh *
+create_simplified_mesh (SimplifyState *state,
+                        RutMesh *mesh)
+{
+  int n_indices = state->n_triangles * 3;
+  RutBuffer *buffer;
+  RutMesh *simplified;
+  int i;
+
+  switch (mesh->indices_type)
+    {
+    case COGL_INDICES_TYPE_UNSIGNED_BYTE:
+      buffer = rut_buffer_new (n_indices);
+      for (i = 0; i < n_indices; i++)
+        ((uint8_t *) buffer->data)[i] = state->indices[i];
+      break;
+    case COGL_INDICES_TYPE_UNSIGNED_SHORT:
+      buffer = rut_buffer_new (sizeof (uint16_t) * n_indices);
+      for (i = 0; i < n_indices; i++)
+        ((uint16_t *) buffer->data)[i] = state->indices[i];
+      break;
+    case COGL_INDICES_TYPE_UNSIGNED_INT:
+    default:
+      buffer = rut_buffer_new (sizeof (uint32_t) * n_indices);
+      memcpy (buffer->data, state->indices, sizeof (uint32_t) * n_indices);
+      break;
+    }
+
+  simplified = rut_mesh_new (mesh->mode,
+                             mesh->n_vertices,
+                             mesh->attributes,
+                             mesh->n_attributes);
+  rut_mesh_set_indices (simplified, mesh->indices_type, buffer, n_indices);
+  rut_refable_unref (buffer);
+
+  return simplified;
+}
+
+RutMesh *
+rut_mesh_simplify (RutMesh *mesh,
+                   int target_n_triangles)
+{
+  SimplifyState state;
+  RutMesh *simplified = NULL;
+
+  RUT_STATIC_TIMER (simplify_timer,
+                    "Mainloop",
+                    "Mesh simplify",
+                    "Generating lower detail versions of meshes",
+                    0);
+
+  if (mesh->mode != COGL_VERTICES_MODE_TRIANGLES ||
+      mesh->indices_buffer == NULL ||
+      mesh->n_indices < 3 ||
+      mesh->n_vertices < 1)
+    return NULL;
+
+  RUT_TIMER_START (simplify_timer);
+
+  memset (&state, 0, sizeof (state));
+  state.n_vertices = mesh->n_vertices;
+
+  if (!read_positions (&state, mesh) ||
+      !read_indices (&state, mesh))
+    goto done;
+
+  weld_vertices (&state);
+  init_quadrics (&state);
+
+  while (state.n_triangles > target_n_triangles)
+    {
+      /* Each collapse removes about two triangles. Limiting the
+       * collapses per pass avoids overshooting the target since all
+       * the candidates are ranked up front. */
+      int max_collapses = (state.n_triangles - target_n_triangles + 1) / 2;
+
+      if (simplify_pass (&state, MAX (max_collapses, 1)) == 0)
+        break;
+    }
+
+  simplified = create_simplified_mesh (&state, mesh);
+
+done:
+
+  g_free (state.indices);
+  g_free (state.quadrics);
+  g_free (state.positions);
+  g_free (state.group_vertices);
+  g_free (state.group_offsets);
+  g_free (state.groups);
+
+  RUT_TIMER_STOP (simplify_timer);
+
+  return simplified;
+}
@@ -0,0 +1,48 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RUT_MESH_SIMPLIFY_H_
+#define _RUT_MESH_SIMPLIFY_H_
+
+#include "rut-mesh.h"
+
+/* Creates a lower detail version of @mesh with roughly
+ * @target_n_triangles triangles by repeatedly collapsing the edges
+ * that least change the shape of the mesh, as measured by Garland and
+ * Heckbert's quadric error metric.
+ *
+ * Edges are always collapsed onto one of their existing vertices so
+ * the new mesh shares all of its attributes with @mesh and only has
+ * its own indices. Vertices that share a position are treated as a
+ * single vertex so that seams in the normals or texture coordinates
+ * don't open up into cracks.
+ *
+ * The simplification stops early if no more edges can be collapsed
+ * without flipping triangles so the result may have more triangles
+ * than requested.
+ *
+ * Only indexed triangle lists with float positions can be simplified,
+ * otherwise NULL is returned.
+ */
+RutMesh *
+rut_mesh_simplify (RutMesh *mesh,
+                   int target_n_triangles);
+
+#endif /* _RUT_MESH_SIMPLIFY_H_ */
@@ -20,7 +20,10 @@
 
 #include <config.h>
 
+#include <string.h>
+
 #include "rut-mesh.h"
+#include "rut-mesh-bvh.h"
 #include "rut-interfaces.h"
 
 static void
@@ -28,7 +31,10 @@ _rut_buffer_free (void *object)
 {
   RutBuffer *buffer = object;
 
-  g_free (buffer->data);
+  if (buffer->data_destroy)
+    buffer->data_destroy (buffer->data_destroy_data);
+  else
+    g_free (buffer->data);
   g_slice_free (RutBuffer, buffer);
 }
 
@@ -58,6 +64,30 @@ rut_buffer_new (size_t buffer_size)
   buffer->size = buffer_size;
   buffer->data = g_malloc (buffer_size);
 
+  buffer->data_destroy = NULL;
+  buffer->data_destroy_data = NULL;
+
+  return buffer;
+}
+
+RutBuffer *
+rut_buffer_new_for_data (uint8_t *data,
+                         size_t size,
+                         GDestroyNotify destroy,
+                         void *user_data)
+{
+  RutBuffer *buffer = g_slice_new (RutBuffer);
+
+  rut_object_init (&buffer->_parent, &rut_buffer_type);
+
+  buffer->ref_count = 1;
+
+  buffer->size = size;
+  buffer->data = data;
+
+  buffer->data_destroy = destroy;
+  buffer->data_destroy_data = user_data;
+
   return buffer;
 }
 
@@ -121,6 +151,11 @@ _rut_mesh_free (RutObject *object)
   for (i = 0; i < mesh->n_attributes; i++)
     rut_refable_unref (mesh->attributes[i]);
 
+  if (mesh->bvh)
+    rut_mesh_bvh_free (mesh->bvh);
+
+  rut_closure_list_disconnect_all (&mesh->changed_cb_list);
+
   g_slice_free1 (mesh->n_attributes * sizeof (void *), mesh->attributes);
   g_slice_free (RutMesh, mesh);
 }
@@ -148,6 +183,7 @@ rut_mesh_new (CoglVerticesMode mode,
   RutMesh *mesh = g_slice_new0 (RutMesh);
 
   rut_object_init (&mesh->_parent, &rut_mesh_type);
+  rut_list_init (&mesh->changed_cb_list);
 
   mesh->ref_count = 1;
   mesh->mode = mode;
@@ -168,6 +204,7 @@ rut_mesh_new_from_buffer_p3 (CoglVerticesMode mode,
   RutAttribute **attributes = g_slice_alloc (sizeof (void *) * n_attributes);
 
   rut_object_init (&mesh->_parent, &rut_mesh_type);
+  rut_list_init (&mesh->changed_cb_list);
   mesh->ref_count = 1;
 
   attributes[0] = rut_attribute_new (buffer,
@@ -200,6 +237,7 @@ rut_mesh_new_from_buffer_p3n3 (CoglVerticesMode mode,
   RutAttribute **attributes = g_slice_alloc (sizeof (void *) * n_attributes);
 
   rut_object_init (&mesh->_parent, &rut_mesh_type);
+  rut_list_init (&mesh->changed_cb_list);
   mesh->ref_count = 1;
 
   attributes[0] = rut_attribute_new (buffer,
@@ -233,6 +271,7 @@ rut_mesh_new_from_buffer_p3c4 (CoglVerticesMode mode,
   RutAttribute **attributes = g_slice_alloc (sizeof (void *) * n_attributes);
 
   rut_object_init (&mesh->_parent, &rut_mesh_type);
+  rut_list_init (&mesh->changed_cb_list);
   mesh->ref_count = 1;
 
   attributes[0] = rut_attribute_new (buffer,
@@ -266,6 +305,8 @@ rut_mesh_set_indices (RutMesh *mesh,
   mesh->indices_buffer = rut_refable_ref (buffer);
   mesh->indices_type = type;
   mesh->n_indices = n_indices;
+
+  rut_mesh_discard_derived_state (mesh);
 }
 
 void
@@ -288,6 +329,114 @@ rut_mesh_set_attributes (RutMesh *mesh,
 
   mesh->attributes = attributes_real;
   mesh->n_attributes = n_attributes;
+
+  rut_mesh_discard_derived_state (mesh);
+}
+
+void
+rut_mesh_discard_derived_state (RutMesh *mesh)
+{
+  if (mesh->bvh)
+    {
+      rut_mesh_bvh_free (mesh->bvh);
+      mesh->bvh = NULL;
+    }
+
+  mesh->bounds_valid = false;
+}
+
+void
+rut_mesh_dirty (RutMesh *mesh)
+{
+  rut_mesh_discard_derived_state (mesh);
+
+  rut_graphable_bump_scene_generation ();
+
+  rut_closure_list_invoke (&mesh->changed_cb_list,
+                           RutMeshChangedCallback,
+                           mesh);
+}
+
+RutMeshBVH *
+rut_mesh_get_bvh (RutMesh *mesh)
+{
+  if (mesh->bvh == NULL)
+    mesh->bvh = rut_mesh_bvh_new (mesh);
+
+  return mesh->bvh;
+}
+
+static CoglBool
+add_triangle_bounds_cb (void **attributes_v0,
+                        void **attributes_v1,
+                        void **attributes_v2,
+                        int index_v0,
+                        int index_v1,
+                        int index_v2,
+                        void *user_data)
+{
+  RutMesh *mesh = user_data;
+  const float *v[3] = {
+      attributes_v0[0], attributes_v1[0], attributes_v2[0]
+  };
+  int i, j;
+
+  if (!mesh->has_bounds)
+    {
+      memcpy (mesh->bounds_min, v[0], sizeof (float) * 3);
+      memcpy (mesh->bounds_max, v[0], sizeof (float) * 3);
+      mesh->has_bounds = true;
+    }
+
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 3; j++)
+      {
+        mesh->bounds_min[j] = MIN (mesh->bounds_min[j], v[i][j]);
+        mesh->bounds_max[j] = MAX (mesh->bounds_max[j], v[i][j]);
+      }
+
+  return TRUE;
+}
+
+bool
+rut_mesh_get_bounds (RutMesh *mesh,
+                     float min[3],
+                     float max[3])
+{
+  if (!mesh->bounds_valid)
+    {
+      mesh->has_bounds = false;
+
+      rut_mesh_foreach_triangle (mesh,
+                                 add_triangle_bounds_cb,
+                                 mesh,
+                                 "cogl_position_in",
+                                 NULL);
+
+      mesh->bounds_valid = true;
+    }
+
+  if (!mesh->has_bounds)
+    return false;
+
+  memcpy (min, mesh->bounds_min, sizeof (float) * 3);
+  memcpy (max, mesh->bounds_max, sizeof (float) * 3);
+
+  return true;
+}
+
+RutClosure *
+rut_mesh_add_changed_callback (RutMesh *mesh,
+                               RutMeshChangedCallback callback,
+                               void *user_data,
+                               RutClosureDestroyCallback destroy_cb)
+{
+  g_return_val_if_fail (callback != NULL, NULL);
+
+  return rut_closure_list_add (&mesh->changed_cb_list,
+                               callback,
+                               user_data,
+                               destroy_cb);
 }
 
 static void
@@ -28,9 +28,11 @@
 typedef struct _RutBuffer RutBuffer;
 typedef struct _RutAttribute RutAttribute;
 typedef struct _RutMesh RutMesh;
+typedef struct _RutMeshBVH RutMeshBVH;
 
 #include "rut-context.h"
 #include "rut-list.h"
+#include "rut-closure.h"
 
 typedef struct _RutEditAttribute
 {
@@ -67,6 +69,11 @@ struct _RutBuffer
 
   uint8_t *data;
   size_t size;
+
+  /* If set, the data isn't owned by the buffer and this is called
+   * with data_destroy_data instead of freeing it */
+  GDestroyNotify data_destroy;
+  void *data_destroy_data;
 };
 
 struct _RutAttribute
@@ -106,6 +113,17 @@ struct _RutMesh
   CoglIndicesType indices_type;
   int n_indices;
   RutBuffer *indices_buffer;
+
+  /* Lazily built for picking by rut_mesh_get_bvh () */
+  RutMeshBVH *bvh;
+
+  /* Lazily computed by rut_mesh_get_bounds () */
+  bool bounds_valid;
+  bool has_bounds;
+  float bounds_min[3];
+  float bounds_max[3];
+
+  RutList changed_cb_list;
 };
 
 void
@@ -114,6 +132,16 @@ _rut_buffer_init_type (void);
 RutBuffer *
 rut_buffer_new (size_t buffer_size);
 
+/* Creates a buffer that uses @data directly instead of allocating its
+ * own storage, for example to wrap part of a memory mapped file. The
+ * data must stay valid until @destroy is called with @user_data,
+ * which happens when the buffer is freed. */
+RutBuffer *
+rut_buffer_new_for_data (uint8_t *data,
+                         size_t size,
+                         GDestroyNotify destroy,
+                         void *user_data);
+
 void
 _rut_attribute_init_type (void);
 
@@ -164,6 +192,49 @@ rut_mesh_set_indices (RutMesh *mesh,
                       RutBuffer *buffer,
                       int n_indices);
 
+/* Any state derived from the vertex data, such as the BVH used for
+ * picking, is cached with the mesh. This must be called after
+ * modifying a mesh that may already be in use, by changing the
+ * contents of its buffers in place or by replacing its attributes or
+ * indices, so that the state gets rebuilt and anything picking the
+ * mesh is notified. It should only be called from the main thread. */
+void
+rut_mesh_dirty (RutMesh *mesh);
+
+/* Only discards the state derived from the vertex data without
+ * notifying anyone, for while a mesh is still being built and nothing
+ * else can see it, possibly on another thread. Replacing the
+ * attributes or indices does this automatically. */
+void
+rut_mesh_discard_derived_state (RutMesh *mesh);
+
+/* Returns a bounding volume hierarchy over the mesh's triangles for
+ * intersecting rays. The first call builds it, so the cost of
+ * building is only paid for meshes that actually get picked. */
+RutMeshBVH *
+rut_mesh_get_bvh (RutMesh *mesh);
+
+/* Gets the bounding box of the mesh's triangles, like
+ * rut_mesh_bvh_get_bounds(), but without building the BVH. The
+ * result is cached until rut_mesh_dirty() is called. Returns false
+ * if the mesh has no triangles. */
+bool
+rut_mesh_get_bounds (RutMesh *mesh,
+                     float min[3],
+                     float max[3]);
+
+typedef void (*RutMeshChangedCallback) (RutMesh *mesh,
+                                        void *user_data);
+
+/* Registers a callback for when rut_mesh_dirty() is called so that
+ * state derived from the mesh elsewhere, such as its bounds in a
+ * spatial index, can be updated */
+RutClosure *
+rut_mesh_add_changed_callback (RutMesh *mesh,
+                               RutMeshChangedCallback callback,
+                               void *user_data,
+                               RutClosureDestroyCallback destroy_cb);
+
 /* Performs a deep copy of all the buffers */
 RutMesh *
 rut_mesh_copy (RutMesh *mesh);
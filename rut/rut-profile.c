@@ -0,0 +1,380 @@
+/*
+ * Rut
+ *
+ * An object oriented GL/GLES Abstraction/Utility Layer
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "rut-profile.h"
+#include "rut-trace.h"
+#include "rut-util.h"
+
+/* Guards against a timer naming itself, or a cycle of timers naming
+ * each other, as a parent */
+#define MAX_TIMER_DEPTH 32
+
+bool _rut_profile_enabled = false;
+
+/* Timers and counters aren't thread safe so anything measured from
+ * another thread, such as the asset loader's worker threads, is
+ * ignored */
+static GThread *_rut_profile_thread;
+
+static RutProfileTimer *_rut_profile_timers;
+static RutProfileTimer *_rut_profile_timers_tail;
+static RutProfileCounter *_rut_profile_counters;
+static RutProfileCounter *_rut_profile_counters_tail;
+
+/* The number of frames completed since profiling was last reset */
+static uint64_t _rut_profile_n_frames;
+
+static void
+register_timer (RutProfileTimer *timer)
+{
+  timer->next = NULL;
+
+  if (_rut_profile_timers_tail)
+    _rut_profile_timers_tail->next = timer;
+  else
+    _rut_profile_timers = timer;
+
+  _rut_profile_timers_tail = timer;
+  timer->registered = true;
+}
+
+static void
+register_counter (RutProfileCounter *counter)
+{
+  counter->next = NULL;
+
+  if (_rut_profile_counters_tail)
+    _rut_profile_counters_tail->next = counter;
+  else
+    _rut_profile_counters = counter;
+
+  _rut_profile_counters_tail = counter;
+  counter->registered = true;
+}
+
+void
+_rut_profile_timer_start (RutProfileTimer *timer)
+{
+  if (g_thread_self () != _rut_profile_thread)
+    return;
+
+  if (G_UNLIKELY (!timer->registered))
+    register_timer (timer);
+
+  /* Only the outermost start of a recursive timer is measured */
+  if (timer->depth++ == 0)
+    {
+      RUT_TRACE_BEGIN (timer->name, NULL);
+      timer->start = rut_trace_get_time ();
+    }
+}
+
+void
+_rut_profile_timer_stop (RutProfileTimer *timer)
+{
+  uint64_t elapsed;
+
+  if (g_thread_self () != _rut_profile_thread)
+    return;
+
+  /* The timer may have been started before profiling was enabled */
+  if (timer->depth == 0)
+    return;
+
+  if (--timer->depth > 0)
+    return;
+
+  elapsed = rut_trace_get_time () - timer->start;
+
+  RUT_TRACE_END (timer->name);
+
+  timer->frame_total += elapsed;
+  timer->frame_count++;
+  timer->total += elapsed;
+  timer->count++;
+}
+
+void
+_rut_profile_counter_add (RutProfileCounter *counter, int64_t value)
+{
+  if (g_thread_self () != _rut_profile_thread)
+    return;
+
+  if (G_UNLIKELY (!counter->registered))
+    register_counter (counter);
+
+  counter->frame_value += value;
+  counter->total += value;
+}
+
+void
+_rut_profile_init (void)
+{
+  _rut_profile_thread = g_thread_self ();
+
+  if (rut_util_is_boolean_env_set ("RUT_PROFILE"))
+    rut_profile_set_enabled (true);
+}
+
+void
+rut_profile_set_enabled (bool enabled)
+{
+  RutProfileTimer *timer;
+
+  if (_rut_profile_enabled == enabled)
+    return;
+
+  /* Any timers that were running when profiling was last disabled
+   * will never see their matching stop so we forget about them */
+  for (timer = _rut_profile_timers; timer; timer = timer->next)
+    timer->depth = 0;
+
+  _rut_profile_enabled = enabled;
+}
+
+void
+rut_profile_end_frame (void)
+{
+  int index = _rut_profile_n_frames % RUT_PROFILE_N_FRAMES;
+  RutProfileTimer *timer;
+  RutProfileCounter *counter;
+
+  for (timer = _rut_profile_timers; timer; timer = timer->next)
+    {
+      timer->history[index] = timer->frame_total;
+      timer->frame_total = 0;
+      timer->frame_count = 0;
+    }
+
+  for (counter = _rut_profile_counters; counter; counter = counter->next)
+    {
+      counter->history[index] = counter->frame_value;
+      counter->frame_value = 0;
+    }
+
+  _rut_profile_n_frames++;
+}
+
+int
+rut_profile_get_n_frames (void)
+{
+  return MIN (_rut_profile_n_frames, RUT_PROFILE_N_FRAMES);
+}
+
+static int
+get_history_index (int frames_ago)
+{
+  g_return_val_if_fail (frames_ago >= 0, -1);
+
+  if (frames_ago >= rut_profile_get_n_frames ())
+    return -1;
+
+  return (_rut_profile_n_frames - 1 - frames_ago) % RUT_PROFILE_N_FRAMES;
+}
+
+uint64_t
+rut_profile_timer_get_frame_time (RutProfileTimer *timer, int frames_ago)
+{
+  int index = get_history_index (frames_ago);
+
+  return index < 0 ? 0 : timer->history[index];
+}
+
+int64_t
+rut_profile_counter_get_frame_value (RutProfileCounter *counter,
+                                     int frames_ago)
+{
+  int index = get_history_index (frames_ago);
+
+  return index < 0 ? 0 : counter->history[index];
+}
+
+uint64_t
+rut_profile_timer_get_average_time (RutProfileTimer *timer)
+{
+  int n_frames = rut_profile_get_n_frames ();
+  uint64_t sum = 0;
+  int i;
+
+  if (n_frames == 0)
+    return 0;
+
+  for (i = 0; i < n_frames; i++)
+    sum += timer->history[i];
+
+  return sum / n_frames;
+}
+
+static int64_t
+counter_get_average_value (RutProfileCounter *counter)
+{
+  int n_frames = rut_profile_get_n_frames ();
+  int64_t sum = 0;
+  int i;
+
+  if (n_frames == 0)
+    return 0;
+
+  for (i = 0; i < n_frames; i++)
+    sum += counter->history[i];
+
+  return sum / n_frames;
+}
+
+static bool
+timer_is_root (RutProfileTimer *timer)
+{
+  RutProfileTimer *other;
+
+  if (timer->parent_name == NULL)
+    return true;
+
+  for (other = _rut_profile_timers; other; other = other->next)
+    if (other != timer && strcmp (other->name, timer->parent_name) == 0)
+      return false;
+
+  return true;
+}
+
+static void
+foreach_child_timer (RutProfileTimer *parent,
+                     int depth,
+                     RutProfileTimerCallback callback,
+                     void *user_data)
+{
+  RutProfileTimer *timer;
+
+  if (depth >= MAX_TIMER_DEPTH)
+    return;
+
+  for (timer = _rut_profile_timers; timer; timer = timer->next)
+    {
+      if (timer == parent ||
+          timer->parent_name == NULL ||
+          strcmp (timer->parent_name, parent->name) != 0)
+        continue;
+
+      callback (timer, depth, user_data);
+      foreach_child_timer (timer, depth + 1, callback, user_data);
+    }
+}
+
+void
+rut_profile_foreach_timer (RutProfileTimerCallback callback,
+                           void *user_data)
+{
+  RutProfileTimer *timer;
+
+  for (timer = _rut_profile_timers; timer; timer = timer->next)
+    {
+      if (!timer_is_root (timer))
+        continue;
+
+      callback (timer, 0, user_data);
+      foreach_child_timer (timer, 1, callback, user_data);
+    }
+}
+
+void
+rut_profile_foreach_counter (RutProfileCounterCallback callback,
+                             void *user_data)
+{
+  RutProfileCounter *counter;
+
+  for (counter = _rut_profile_counters; counter; counter = counter->next)
+    callback (counter, user_data);
+}
+
+void
+rut_profile_reset (void)
+{
+  RutProfileTimer *timer;
+  RutProfileCounter *counter;
+
+  for (timer = _rut_profile_timers; timer; timer = timer->next)
+    {
+      timer->frame_total = 0;
+      timer->frame_count = 0;
+      timer->total = 0;
+      timer->count = 0;
+      memset (timer->history, 0, sizeof (timer->history));
+    }
+
+  for (counter = _rut_profile_counters; counter; counter = counter->next)
+    {
+      counter->frame_value = 0;
+      counter->total = 0;
+      memset (counter->history, 0, sizeof (counter->history));
+    }
+
+  _rut_profile_n_frames = 0;
+}
+
+static void
+print_timer_cb (RutProfileTimer *timer,
+                int depth,
+                void *user_data)
+{
+  g_print ("  %*s%-*s %10.3f ms/frame %12.3f ms total %10" G_GUINT64_FORMAT
+           " calls\n",
+           depth * 2, "",
+           MAX (1, 32 - depth * 2), timer->name,
+           rut_profile_timer_get_average_time (timer) / 1e6,
+           timer->total / 1e6,
+           timer->count);
+}
+
+static void
+print_counter_cb (RutProfileCounter *counter,
+                  void *user_data)
+{
+  g_print ("  %-32s %10" G_GINT64_FORMAT " /frame %14" G_GINT64_FORMAT
+           " total\n",
+           counter->name,
+           counter_get_average_value (counter),
+           counter->total);
+}
+
+void
+rut_profile_print_report (void)
+{
+  const char *prgname = g_get_prgname ();
+
+  g_print ("Profile report for %s (averaged over the last %d frames of %"
+           G_GUINT64_FORMAT "):\n",
+           prgname ? prgname : "unknown",
+           rut_profile_get_n_frames (),
+           _rut_profile_n_frames);
+
+  g_print (" Timers:\n");
+  rut_profile_foreach_timer (print_timer_cb, NULL);
+
+  g_print (" Counters:\n");
+  rut_profile_foreach_counter (print_counter_cb, NULL);
+}
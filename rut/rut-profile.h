@@ -0,0 +1,191 @@
+/*
+ * Rut
+ *
+ * An object oriented GL/GLES Abstraction/Utility Layer
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+
+#ifndef _RUT_PROFILE_H_
+#define _RUT_PROFILE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The number of frames of per-timer and per-counter history that are
+ * kept for the report API and the editor overlay. */
+#define RUT_PROFILE_N_FRAMES 64
+
+typedef struct _RutProfileTimer RutProfileTimer;
+typedef struct _RutProfileCounter RutProfileCounter;
+
+/* Timers and counters are declared statically at the point where
+ * they are used with RUT_STATIC_TIMER() and RUT_STATIC_COUNTER() and
+ * are lazily registered the first time they are hit while profiling
+ * is enabled. The hierarchy is described by name: a timer names its
+ * parent and any timer whose parent isn't registered is treated as a
+ * root.
+ *
+ * Profiling is only expected to happen on the mainloop thread.
+ */
+struct _RutProfileTimer
+{
+  const char *parent_name;
+  const char *name;
+  const char *description;
+  unsigned int flags;
+
+  /*< private >*/
+  RutProfileTimer *next;
+  bool registered;
+
+  int depth;
+  uint64_t start;
+
+  uint64_t frame_total;
+  unsigned int frame_count;
+
+  uint64_t total;
+  uint64_t count;
+
+  uint64_t history[RUT_PROFILE_N_FRAMES];
+};
+
+struct _RutProfileCounter
+{
+  const char *name;
+  const char *description;
+  unsigned int flags;
+
+  /*< private >*/
+  RutProfileCounter *next;
+  bool registered;
+
+  int64_t frame_value;
+  int64_t total;
+
+  int64_t history[RUT_PROFILE_N_FRAMES];
+};
+
+extern bool _rut_profile_enabled;
+
+void
+_rut_profile_timer_start (RutProfileTimer *timer);
+
+void
+_rut_profile_timer_stop (RutProfileTimer *timer);
+
+void
+_rut_profile_counter_add (RutProfileCounter *counter, int64_t value);
+
+#define RUT_STATIC_TIMER(VAR, PARENT, NAME, DESCRIPTION, FLAGS) \
+  static RutProfileTimer VAR = { PARENT, NAME, DESCRIPTION, FLAGS }
+
+#define RUT_STATIC_COUNTER(VAR, NAME, DESCRIPTION, FLAGS) \
+  static RutProfileCounter VAR = { NAME, DESCRIPTION, FLAGS }
+
+/* When profiling is disabled these only cost a single predictable
+ * branch */
+#define RUT_TIMER_START(TIMER) \
+  G_STMT_START { \
+    if (G_UNLIKELY (_rut_profile_enabled)) \
+      _rut_profile_timer_start (&(TIMER)); \
+  } G_STMT_END
+
+#define RUT_TIMER_STOP(TIMER) \
+  G_STMT_START { \
+    if (G_UNLIKELY (_rut_profile_enabled)) \
+      _rut_profile_timer_stop (&(TIMER)); \
+  } G_STMT_END
+
+#define RUT_COUNTER_ADD(COUNTER, VALUE) \
+  G_STMT_START { \
+    if (G_UNLIKELY (_rut_profile_enabled)) \
+      _rut_profile_counter_add (&(COUNTER), (VALUE)); \
+  } G_STMT_END
+
+#define RUT_COUNTER_INC(COUNTER) RUT_COUNTER_ADD (COUNTER, 1)
+#define RUT_COUNTER_DEC(COUNTER) RUT_COUNTER_ADD (COUNTER, -1)
+
+/* Called once by _rut_init(); profiling is enabled from the start if
+ * the RUT_PROFILE or RUT_TRACE environment variables are set. */
+void
+_rut_profile_init (void);
+
+void
+rut_profile_set_enabled (bool enabled);
+
+static inline bool
+rut_profile_get_enabled (void)
+{
+  return _rut_profile_enabled;
+}
+
+/* Moves the per-frame totals of all registered timers and counters
+ * into their history and resets them for the next frame. */
+void
+rut_profile_end_frame (void);
+
+/* Returns how many frames of history are valid, up to
+ * RUT_PROFILE_N_FRAMES */
+int
+rut_profile_get_n_frames (void);
+
+/* @frames_ago: 0 for the most recently completed frame */
+uint64_t
+rut_profile_timer_get_frame_time (RutProfileTimer *timer, int frames_ago);
+
+int64_t
+rut_profile_counter_get_frame_value (RutProfileCounter *counter,
+                                     int frames_ago);
+
+/* Returns the mean time per frame, in nanoseconds, over the recorded
+ * history */
+uint64_t
+rut_profile_timer_get_average_time (RutProfileTimer *timer);
+
+typedef void (*RutProfileTimerCallback) (RutProfileTimer *timer,
+                                         int depth,
+                                         void *user_data);
+
+typedef void (*RutProfileCounterCallback) (RutProfileCounter *counter,
+                                           void *user_data);
+
+/* Visits the registered timers depth first, parents before their
+ * children */
+void
+rut_profile_foreach_timer (RutProfileTimerCallback callback,
+                           void *user_data);
+
+void
+rut_profile_foreach_counter (RutProfileCounterCallback callback,
+                             void *user_data);
+
+void
+rut_profile_reset (void);
+
+void
+rut_profile_print_report (void);
+
+G_END_DECLS
+
+#endif /* _RUT_PROFILE_H_ */
@@ -28,6 +28,7 @@
 #include "rut-property.h"
 #include "rut-interfaces.h"
 #include "rut-color.h"
+#include "rut-profile.h"
 
 void
 rut_property_context_init (RutPropertyContext *context)
@@ -523,6 +524,17 @@ rut_property_dirty (RutPropertyContext *ctx,
 {
   GSList *l;
 
+  RUT_STATIC_COUNTER (property_dirty_counter,
+                      "Property updates",
+                      "Increments for each property marked dirty",
+                      0);
+  RUT_STATIC_COUNTER (property_binding_counter,
+                      "Property bindings",
+                      "Increments for each binding callback run",
+                      0);
+
+  RUT_COUNTER_INC (property_dirty_counter);
+
   /* FIXME: The plan is for updates to happen asynchronously by
    * queueing an update with the context but for now we simply
    * trigger the updates synchronously.
@@ -532,7 +544,10 @@ rut_property_dirty (RutPropertyContext *ctx,
       RutProperty *dependant = l->data;
       RutPropertyBinding *binding = dependant->binding;
       if (binding)
-        binding->callback (dependant, binding->user_data);
+        {
+          RUT_COUNTER_INC (property_binding_counter);
+          binding->callback (dependant, binding->user_data);
+        }
     }
 }
 
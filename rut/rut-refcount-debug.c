@@ -549,8 +549,8 @@ atexit_cb (void)
   g_free (state);
 }
 
-void
-_rut_refcount_debug_object_created (void *object)
+static void
+object_created (void *object)
 {
   RutRefcountDebugState *state = get_state ();
 
@@ -589,8 +589,8 @@ _rut_refcount_debug_object_created (void *object)
     }
 }
 
-void
-_rut_refcount_debug_claim (void *object, void *owner)
+static void
+claim (void *object, void *owner)
 {
   RutRefcountDebugState *state = get_state ();
   RutRefcountDebugObject *object_data;
@@ -630,14 +630,35 @@ _rut_refcount_debug_claim (void *object, void *owner)
   object_data->object_ref_count++;
 }
 
+/* Objects may be created and referenced by worker threads, such as
+ * the asset loader's, so the state is only touched with this lock
+ * held */
+G_LOCK_DEFINE_STATIC (refcount_debug);
+
+void
+_rut_refcount_debug_object_created (void *object)
+{
+  G_LOCK (refcount_debug);
+  object_created (object);
+  G_UNLOCK (refcount_debug);
+}
+
+void
+_rut_refcount_debug_claim (void *object, void *owner)
+{
+  G_LOCK (refcount_debug);
+  claim (object, owner);
+  G_UNLOCK (refcount_debug);
+}
+
 void
 _rut_refcount_debug_ref (void *object)
 {
   _rut_refcount_debug_claim (object, NULL /* owner */);
 }
 
-void
-_rut_refcount_debug_release (void *object, void *owner)
+static void
+release (void *object, void *owner)
 {
   RutRefcountDebugState *state = get_state ();
   RutRefcountDebugObject *object_data;
@@ -686,6 +707,14 @@ _rut_refcount_debug_release (void *object, void *owner)
     }
 }
 
+void
+_rut_refcount_debug_release (void *object, void *owner)
+{
+  G_LOCK (refcount_debug);
+  release (object, owner);
+  G_UNLOCK (refcount_debug);
+}
+
 void
 _rut_refcount_debug_unref (void *object)
 {
@@ -58,6 +58,8 @@
 #include "rut-transform.h"
 #include "rut-input-region.h"
 #include "rut-mimable.h"
+#include "rut-profile.h"
+#include "rut-trace.h"
 
 #include "components/rut-nine-slice.h"
 #include "components/rut-camera.h"
@@ -175,6 +177,11 @@ struct _RutShell
   int glib_paint_idle;
   CoglBool redraw_queued;
 
+  /* Incremented at the start of each redraw. Input events are
+   * dispatched once per frame so this is used to limit how often we
+   * re-pick while the pointer is moving */
+  unsigned int frame;
+
   /* Queue of callbacks to be invoked before painting. If
    * ‘flushing_pre_paints‘ is TRUE then this will be maintained in
    * sorted order. Otherwise it is kept in no particular order and it
@@ -269,6 +276,18 @@ typedef struct _InputCamera
 {
   RutCamera *camera;
   RutObject *scenegraph;
+
+  /* The result of the last pick through this camera along with
+   * everything it depended on so that hovering over a scene that
+   * isn't changing doesn't need to traverse the scenegraph */
+  bool pick_valid;
+  float pick_x, pick_y;
+  unsigned int pick_scene_generation;
+  unsigned int pick_transform_age;
+  unsigned int pick_projection_age;
+  unsigned int pick_input_transform_age;
+  unsigned int pick_frame;
+  RutObject *picked_object;
 } InputCamera;
 
 void
@@ -276,7 +295,7 @@ rut_shell_add_input_camera (RutShell *shell,
                             RutCamera *camera,
                             RutObject *scenegraph)
 {
-  InputCamera *input_camera = g_slice_new (InputCamera);
+  InputCamera *input_camera = g_slice_new0 (InputCamera);
 
   input_camera->camera = rut_refable_ref (camera);
 
@@ -1038,6 +1057,47 @@ camera_pre_pick_region_cb (RutObject *object,
   return RUT_TRAVERSE_VISIT_CONTINUE;
 }
 
+/* The projection can change without bumping the camera's
+ * transform_age, eg. when the orthographic coordinates are updated
+ * for a resize, so each of the ages that can affect how an event is
+ * mapped into the scene need to be checked */
+static bool
+pick_camera_is_current (InputCamera *input_camera)
+{
+  RutCamera *camera = input_camera->camera;
+
+  return (input_camera->pick_transform_age == camera->transform_age &&
+          input_camera->pick_projection_age == camera->projection_age &&
+          input_camera->pick_input_transform_age ==
+          camera->input_transform_age);
+}
+
+/* Checks whether the last pick through @input_camera can be reused
+ * for a pick at (@x, @y). The result is reused if neither the pointer
+ * nor anything that could affect picking has changed. While the
+ * pointer is moving we also only re-pick once per frame so that a burst
+ * of motion events doesn't cost a traversal each. */
+static bool
+can_reuse_pick (RutShell *shell,
+                InputCamera *input_camera,
+                RutInputEvent *event,
+                float x,
+                float y)
+{
+  if (!input_camera->pick_valid ||
+      input_camera->pick_scene_generation !=
+      rut_graphable_get_scene_generation () ||
+      !pick_camera_is_current (input_camera))
+    return false;
+
+  if (input_camera->pick_x == x && input_camera->pick_y == y)
+    return true;
+
+  return (rut_input_event_get_type (event) == RUT_INPUT_EVENT_TYPE_MOTION &&
+          rut_motion_event_get_action (event) == RUT_MOTION_EVENT_ACTION_MOVE &&
+          input_camera->pick_frame == shell->frame);
+}
+
 static RutObject *
 _rut_shell_get_scenegraph_event_target (RutShell *shell,
                                         RutInputEvent *event)
@@ -1046,6 +1106,15 @@ _rut_shell_get_scenegraph_event_target (RutShell *shell,
   RutCamera *picked_camera = NULL;
   GList *l;
 
+  RUT_STATIC_COUNTER (pick_cache_hit_counter,
+                      "Pick cache hit counter",
+                      "Increments for each reused scenegraph pick",
+                      0);
+  RUT_STATIC_COUNTER (pick_cache_miss_counter,
+                      "Pick cache miss counter",
+                      "Increments for each scenegraph pick traversal",
+                      0);
+
   /* Key events by default go to the object that has key focus. If
    * there is no object with key focus then we will let them go to
    * whichever object the pointer is over to implement a kind of
@@ -1069,21 +1138,42 @@ _rut_shell_get_scenegraph_event_target (RutShell *shell,
 
       if (scenegraph)
         {
-          state.camera = camera;
-          state.event = event;
-          state.x = x;
-          state.y = y;
-          state.picked_object = NULL;
-
-          rut_graphable_traverse (scenegraph,
-                                  RUT_TRAVERSE_DEPTH_FIRST,
-                                  camera_pre_pick_region_cb,
-                                  NULL, /* post_children_cb */
-                                  &state);
-
-          if (state.picked_object)
+          if (can_reuse_pick (shell, input_camera, event, x, y))
+            {
+              RUT_COUNTER_INC (pick_cache_hit_counter);
+            }
+          else
+            {
+              RUT_COUNTER_INC (pick_cache_miss_counter);
+
+              state.camera = camera;
+              state.event = event;
+              state.x = x;
+              state.y = y;
+              state.picked_object = NULL;
+
+              rut_graphable_traverse (scenegraph,
+                                      RUT_TRAVERSE_DEPTH_FIRST,
+                                      camera_pre_pick_region_cb,
+                                      NULL, /* post_children_cb */
+                                      &state);
+
+              input_camera->pick_valid = true;
+              input_camera->pick_x = x;
+              input_camera->pick_y = y;
+              input_camera->pick_scene_generation =
+                rut_graphable_get_scene_generation ();
+              input_camera->pick_transform_age = camera->transform_age;
+              input_camera->pick_projection_age = camera->projection_age;
+              input_camera->pick_input_transform_age =
+                camera->input_transform_age;
+              input_camera->pick_frame = shell->frame;
+              input_camera->picked_object = state.picked_object;
+            }
+
+          if (input_camera->picked_object)
             {
-              picked_object = state.picked_object;
+              picked_object = input_camera->picked_object;
               picked_camera = camera;
             }
         }
@@ -1719,6 +1809,7 @@ rut_shell_start_redraw (RutShell *shell)
   g_return_if_fail (shell->redraw_queued == TRUE);
 
   shell->redraw_queued = FALSE;
+  shell->frame++;
 #ifndef __ANDROID__
   g_source_remove (shell->glib_paint_idle);
   shell->glib_paint_idle = 0;
@@ -1730,8 +1821,18 @@ rut_shell_update_timelines (RutShell *shell)
 {
   GSList *l;
 
+  RUT_STATIC_TIMER (update_timelines_timer,
+                    "Mainloop",
+                    "Timelines",
+                    "Time spent progressing timelines",
+                    0);
+
+  RUT_TIMER_START (update_timelines_timer);
+
   for (l = shell->rut_ctx->timelines; l; l = l->next)
     _rut_timeline_update (l->data);
+
+  RUT_TIMER_STOP (update_timelines_timer);
 }
 
 static void
@@ -1757,14 +1858,30 @@ rut_shell_dispatch_input_events (RutShell *shell)
 {
   RutInputEvent *event, *tmp;
 
+  RUT_STATIC_TIMER (input_timer,
+                    "Mainloop",
+                    "Input",
+                    "Time spent dispatching queued input events",
+                    0);
+  RUT_STATIC_COUNTER (input_event_counter,
+                      "Input events",
+                      "Increments for each dispatched input event",
+                      0);
+
+  RUT_TIMER_START (input_timer);
+
   rut_list_for_each_safe (event, tmp, &shell->input_queue, list_node)
     {
+      RUT_COUNTER_INC (input_event_counter);
+
       rut_shell_dispatch_input_event (shell, event);
       rut_list_remove (&event->list_node);
       free_input_event (shell, event);
     }
 
   shell->input_queue_len = 0;
+
+  RUT_TIMER_STOP (input_timer);
 }
 
 RutList *
@@ -1830,7 +1947,17 @@ rut_shell_handle_stream_event (RutShell *shell,
 void
 rut_shell_run_pre_paint_callbacks (RutShell *shell)
 {
+  RUT_STATIC_TIMER (pre_paint_timer,
+                    "Mainloop",
+                    "Pre-paint",
+                    "Time spent flushing queued pre-paint updates",
+                    0);
+
+  RUT_TIMER_START (pre_paint_timer);
+
   flush_pre_paint_callbacks (shell);
+
+  RUT_TIMER_STOP (pre_paint_timer);
 }
 
 bool
@@ -1848,7 +1975,23 @@ rut_shell_check_timelines (RutShell *shell)
 static void
 _rut_shell_paint (RutShell *shell)
 {
+  RUT_STATIC_TIMER (mainloop_timer,
+                    NULL,
+                    "Mainloop",
+                    "Time spent processing a frame",
+                    0);
+
+  RUT_TIMER_START (mainloop_timer);
+
   shell->paint_cb (shell, shell->user_data);
+
+  RUT_TIMER_STOP (mainloop_timer);
+
+  if (G_UNLIKELY (rut_profile_get_enabled ()))
+    rut_profile_end_frame ();
+
+  if (G_UNLIKELY (rut_trace_get_enabled ()))
+    rut_trace_flush ();
 }
 
 #ifdef USE_SDL
@@ -2198,6 +2341,11 @@ rut_shell_main (RutShell *shell)
 
   shell->fini_cb (shell, shell->user_data);
 
+  if (rut_profile_get_enabled ())
+    rut_profile_print_report ();
+
+  rut_trace_close ();
+
 #ifdef USE_SDL
   g_main_context_set_poll_func (g_main_context_default (),
                                 rut_sdl_original_poll);
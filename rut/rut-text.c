@@ -37,6 +37,7 @@
 #include "rut-input-region.h"
 #include "rut-color.h"
 #include "rut-meshable.h"
+#include "rut-profile.h"
 
 #include "components/rut-camera.h"
 
@@ -48,18 +49,6 @@
 
 #define RUT_NOTE(type,...)         G_STMT_START { } G_STMT_END
 
-#ifdef __COUNTER__
-#define RUT_STATIC_TIMER(A,B,C,D,E) extern void G_PASTE (_rut_dummy_decl, __COUNTER__) (void)
-#define RUT_STATIC_COUNTER(A,B,C,D) extern void G_PASTE (_rut_dummy_decl, __COUNTER__) (void)
-#else
-#define RUT_STATIC_TIMER(A,B,C,D,E) extern void G_PASTE (_rut_dummy_decl, __LINE__) (void)
-#define RUT_STATIC_COUNTER(A,B,C,D) extern void G_PASTE (_rut_dummy_decl, __LINE__) (void)
-#endif
-#define RUT_COUNTER_INC(A,B) G_STMT_START { } G_STMT_END
-#define RUT_COUNTER_DEC(A,B) G_STMT_START { } G_STMT_END
-#define RUT_TIMER_START(A,B) G_STMT_START { } G_STMT_END
-#define RUT_TIMER_STOP(A,B) G_STMT_START { } G_STMT_END
-
 /* cursor width in pixels */
 #define DEFAULT_CURSOR_SIZE     2
 
@@ -828,7 +817,7 @@ rut_text_create_layout_no_cache (RutText  *text,
                     "Layout creation",
                     0);
 
-  RUT_TIMER_START (_rut_uprof_context, text_layout_timer);
+  RUT_TIMER_START (text_layout_timer);
 
   layout = pango_layout_new (text->ctx->pango_context);
   pango_layout_set_font_description (layout, text->font_desc);
@@ -887,7 +876,7 @@ rut_text_create_layout_no_cache (RutText  *text,
 
   g_free (contents);
 
-  RUT_TIMER_STOP (_rut_uprof_context, text_layout_timer);
+  RUT_TIMER_STOP (text_layout_timer);
 
   return layout;
 }
@@ -1118,8 +1107,7 @@ rut_text_create_layout (RutText *text,
                             allocation_width,
                             allocation_height);
 
-              RUT_COUNTER_INC (_rut_uprof_context,
-                                   text_cache_hit_counter);
+              RUT_COUNTER_INC (text_cache_hit_counter);
 
               return text->cached_layouts[i].layout;
 	    }
@@ -1152,8 +1140,7 @@ rut_text_create_layout (RutText *text,
 				allocation_width,
 				allocation_height);
 
-                  RUT_COUNTER_INC (_rut_uprof_context,
-                                       text_cache_hit_counter);
+                  RUT_COUNTER_INC (text_cache_hit_counter);
 
 		  return text->cached_layouts[i].layout;
 		}
@@ -1172,7 +1159,7 @@ rut_text_create_layout (RutText *text,
             allocation_width,
             allocation_height);
 
-  RUT_COUNTER_INC (_rut_uprof_context, text_cache_miss_counter);
+  RUT_COUNTER_INC (text_cache_miss_counter);
 
   /* If we make it here then we didn't have a cached version so we
      need to recreate the layout */
@@ -0,0 +1,227 @@
+/*
+ * Rut
+ *
+ * An object oriented GL/GLES Abstraction/Utility Layer
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "rut-trace.h"
+#include "rut-profile.h"
+
+bool _rut_trace_enabled = false;
+
+static FILE *_rut_trace_file;
+static pid_t _rut_trace_pid;
+static bool _rut_trace_first_event;
+
+uint64_t
+rut_trace_get_time (void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  return (uint64_t)g_get_monotonic_time () * 1000;
+#endif
+}
+
+static void
+write_json_string (FILE *file, const char *str)
+{
+  const char *p;
+
+  fputc ('"', file);
+
+  for (p = str; *p; p++)
+    {
+      switch (*p)
+        {
+        case '"':
+          fputs ("\\\"", file);
+          break;
+        case '\\':
+          fputs ("\\\\", file);
+          break;
+        default:
+          if ((unsigned char)*p < 0x20)
+            fprintf (file, "\\u%04x", *p);
+          else
+            fputc (*p, file);
+        }
+    }
+
+  fputc ('"', file);
+}
+
+static void
+start_event (const char *name, char phase, uint64_t ts)
+{
+  if (_rut_trace_first_event)
+    _rut_trace_first_event = false;
+  else
+    fputs (",\n", _rut_trace_file);
+
+  fputs ("{\"name\":", _rut_trace_file);
+  write_json_string (_rut_trace_file, name);
+  fprintf (_rut_trace_file,
+           ",\"ph\":\"%c\",\"ts\":%" G_GUINT64_FORMAT ".%03u"
+           ",\"pid\":%d,\"tid\":%d",
+           phase,
+           ts / 1000, (unsigned int)(ts % 1000),
+           (int)_rut_trace_pid, (int)_rut_trace_pid);
+}
+
+static void
+write_process_name (void)
+{
+  const char *prgname = g_get_prgname ();
+
+  start_event ("process_name", 'M', 0);
+  fputs (",\"args\":{\"name\":", _rut_trace_file);
+  write_json_string (_rut_trace_file, prgname ? prgname : "unknown");
+  fputs ("}}", _rut_trace_file);
+}
+
+static bool
+ensure_trace_file (void)
+{
+  pid_t pid = getpid ();
+
+  /* The file may have been inherited across a fork in which case the
+   * child starts its own trace. The parent's FILE is deliberately
+   * leaked rather than closed since closing would flush the parent's
+   * buffered events a second time. */
+  if (_rut_trace_file && _rut_trace_pid == pid)
+    return true;
+
+  {
+    const char *dir = getenv ("RUT_TRACE_DIR");
+    char *basename = g_strdup_printf ("rig-trace-%d.json", (int)pid);
+    char *filename = g_build_filename (dir ? dir : ".", basename, NULL);
+
+    _rut_trace_file = fopen (filename, "w");
+    if (_rut_trace_file == NULL)
+      {
+        g_warning ("Failed to open trace file %s", filename);
+        _rut_trace_enabled = false;
+      }
+
+    g_free (filename);
+    g_free (basename);
+  }
+
+  if (_rut_trace_file == NULL)
+    return false;
+
+  _rut_trace_pid = pid;
+  _rut_trace_first_event = true;
+
+  fputs ("[\n", _rut_trace_file);
+  write_process_name ();
+
+  return true;
+}
+
+void
+_rut_trace_init (void)
+{
+  if (!getenv ("RUT_TRACE"))
+    return;
+
+  _rut_trace_enabled = true;
+
+  /* Timers are traced as begin/end pairs */
+  rut_profile_set_enabled (true);
+}
+
+static void
+write_event (const char *name,
+             char phase,
+             const char *detail)
+{
+  uint64_t ts = rut_trace_get_time ();
+
+  if (!ensure_trace_file ())
+    return;
+
+  start_event (name, phase, ts);
+
+  if (phase == 'i')
+    fputs (",\"s\":\"p\"", _rut_trace_file);
+
+  if (detail)
+    {
+      fputs (",\"args\":{\"detail\":", _rut_trace_file);
+      write_json_string (_rut_trace_file, detail);
+      fputc ('}', _rut_trace_file);
+    }
+
+  fputc ('}', _rut_trace_file);
+}
+
+void
+_rut_trace_begin (const char *name, const char *detail)
+{
+  write_event (name, 'B', detail);
+}
+
+void
+_rut_trace_end (const char *name)
+{
+  write_event (name, 'E', NULL);
+}
+
+void
+_rut_trace_instant (const char *name, const char *detail)
+{
+  write_event (name, 'i', detail);
+}
+
+void
+rut_trace_flush (void)
+{
+  if (_rut_trace_file && _rut_trace_pid == getpid ())
+    fflush (_rut_trace_file);
+}
+
+void
+rut_trace_close (void)
+{
+  if (_rut_trace_file && _rut_trace_pid == getpid ())
+    {
+      fputs ("\n]\n", _rut_trace_file);
+      fclose (_rut_trace_file);
+    }
+
+  _rut_trace_file = NULL;
+  _rut_trace_enabled = false;
+}
@@ -0,0 +1,107 @@
+/*
+ * Rut
+ *
+ * An object oriented GL/GLES Abstraction/Utility Layer
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+
+#ifndef _RUT_TRACE_H_
+#define _RUT_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Writes trace events in the Chrome JSON trace format to a file named
+ * rig-trace-<pid>.json, so that the frames of the frontend, simulator
+ * and slave processes can be viewed together in chrome://tracing or
+ * Perfetto after combining the files with rig-trace-merge.
+ *
+ * Tracing is enabled by setting the RUT_TRACE environment variable,
+ * which is inherited by the simulator. Files are written to the
+ * current directory unless RUT_TRACE_DIR is set. Timestamps come from
+ * CLOCK_MONOTONIC so events from processes on the same machine line
+ * up.
+ *
+ * While tracing, every profiler timer (see rut-profile.h) also emits a
+ * begin/end pair, so enabling tracing implies enabling profiling.
+ *
+ * Each event is written on its own line; rig-trace-merge relies on
+ * that.
+ */
+
+extern bool _rut_trace_enabled;
+
+void
+_rut_trace_init (void);
+
+/* @detail is optional and is recorded in the event's args */
+void
+_rut_trace_begin (const char *name, const char *detail);
+
+void
+_rut_trace_end (const char *name);
+
+void
+_rut_trace_instant (const char *name, const char *detail);
+
+#define RUT_TRACE_BEGIN(NAME, DETAIL) \
+  G_STMT_START { \
+    if (G_UNLIKELY (_rut_trace_enabled)) \
+      _rut_trace_begin ((NAME), (DETAIL)); \
+  } G_STMT_END
+
+#define RUT_TRACE_END(NAME) \
+  G_STMT_START { \
+    if (G_UNLIKELY (_rut_trace_enabled)) \
+      _rut_trace_end (NAME); \
+  } G_STMT_END
+
+#define RUT_TRACE_INSTANT(NAME, DETAIL) \
+  G_STMT_START { \
+    if (G_UNLIKELY (_rut_trace_enabled)) \
+      _rut_trace_instant ((NAME), (DETAIL)); \
+  } G_STMT_END
+
+/* Returns CLOCK_MONOTONIC in nanoseconds; shared with the profiler so
+ * timers and trace events agree */
+uint64_t
+rut_trace_get_time (void);
+
+static inline bool
+rut_trace_get_enabled (void)
+{
+  return _rut_trace_enabled;
+}
+
+/* Pushes buffered events out to the trace file. This is done at the
+ * end of each frame so that a crashing process still leaves a usable
+ * trace behind. */
+void
+rut_trace_flush (void);
+
+void
+rut_trace_close (void);
+
+G_END_DECLS
+
+#endif /* _RUT_TRACE_H_ */
@@ -108,6 +108,7 @@ rut_transform_translate (RutTransform *transform,
                          float z)
 {
   cogl_matrix_translate (&transform->matrix, x, y, z);
+  rut_graphable_bump_scene_generation ();
 }
 
 void
@@ -117,6 +118,7 @@ rut_transform_quaternion_rotate (RutTransform *transform,
   CoglMatrix rotation;
   cogl_matrix_init_from_quaternion (&rotation, quaternion);
   cogl_matrix_multiply (&transform->matrix, &transform->matrix, &rotation);
+  rut_graphable_bump_scene_generation ();
 }
 
 void
@@ -127,6 +129,7 @@ rut_transform_rotate (RutTransform *transform,
                       float z)
 {
   cogl_matrix_rotate (&transform->matrix, angle, x, y, z);
+  rut_graphable_bump_scene_generation ();
 }
 void
 rut_transform_scale (RutTransform *transform,
@@ -135,6 +138,7 @@ rut_transform_scale (RutTransform *transform,
                      float z)
 {
   cogl_matrix_scale (&transform->matrix, x, y, z);
+  rut_graphable_bump_scene_generation ();
 }
 
 void
@@ -142,12 +146,14 @@ rut_transform_transform (RutTransform *transform,
                          const CoglMatrix *matrix)
 {
   cogl_matrix_multiply (&transform->matrix, &transform->matrix, matrix);
+  rut_graphable_bump_scene_generation ();
 }
 
 void
 rut_transform_init_identity (RutTransform *transform)
 {
   cogl_matrix_init_identity (&transform->matrix);
+  rut_graphable_bump_scene_generation ();
 }
 
 const CoglMatrix *
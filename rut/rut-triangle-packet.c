@@ -0,0 +1,456 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "rut-triangle-packet.h"
+#include "rut-util.h"
+
+#if defined (__SSE2__)
+#define HAVE_SSE2_KERNEL
+#include <emmintrin.h>
+#endif
+
+/* The AVX kernel is compiled with a target attribute so it doesn't
+ * depend on the compiler flags and is only used if the CPU reports
+ * support at runtime */
+#if (defined (__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+  (defined (__x86_64__) || defined (__i386__))
+#define HAVE_AVX_KERNEL
+#include <immintrin.h>
+#endif
+
+/* Only AArch64 has a NEON divide instruction. Using the reciprocal
+ * estimate on 32-bit ARM would give slightly different results from
+ * the other kernels. */
+#if defined (__ARM_NEON) && defined (__aarch64__)
+#define HAVE_NEON_KERNEL
+#include <arm_neon.h>
+#endif
+
+/* This matches rut_util_intersect_triangle() */
+#define EPSILON 0.00001f
+
+#define N_LANES RUT_TRIANGLE_PACKET_SIZE
+
+typedef int (*PacketKernel) (const RutTrianglePacket *packet,
+                             const float ray_origin[3],
+                             const float ray_direction[3],
+                             float *t_out);
+
+void
+rut_triangle_packet_init (RutTrianglePacket *packet)
+{
+  memset (packet, 0, sizeof (RutTrianglePacket));
+  memset (packet->index, 0xff, sizeof (packet->index));
+}
+
+void
+rut_triangle_packet_set_triangle (RutTrianglePacket *packet,
+                                  int lane,
+                                  const float v0[3],
+                                  const float v1[3],
+                                  const float v2[3],
+                                  int index)
+{
+  int i;
+
+  g_return_if_fail (lane >= 0 && lane < N_LANES);
+
+  for (i = 0; i < 3; i++)
+    {
+      packet->v0[i][lane] = v0[i];
+      packet->edge1[i][lane] = v1[i] - v0[i];
+      packet->edge2[i][lane] = v2[i] - v0[i];
+    }
+
+  packet->index[lane] = index;
+}
+
+static int
+intersect_scalar (const RutTrianglePacket *packet,
+                  const float ray_origin[3],
+                  const float ray_direction[3],
+                  float *t_out)
+{
+  const float *d = ray_direction;
+  int mask = 0;
+  int i;
+
+  for (i = 0; i < N_LANES; i++)
+    {
+      float e1[3] = {
+        packet->edge1[0][i], packet->edge1[1][i], packet->edge1[2][i]
+      };
+      float e2[3] = {
+        packet->edge2[0][i], packet->edge2[1][i], packet->edge2[2][i]
+      };
+      float tvec[3] = {
+        ray_origin[0] - packet->v0[0][i],
+        ray_origin[1] - packet->v0[1][i],
+        ray_origin[2] - packet->v0[2][i]
+      };
+      float pvec[3], qvec[3];
+      float det, inv_det, u, v, t;
+
+      pvec[0] = d[1] * e2[2] - d[2] * e2[1];
+      pvec[1] = d[2] * e2[0] - d[0] * e2[2];
+      pvec[2] = d[0] * e2[1] - d[1] * e2[0];
+
+      det = e1[0] * pvec[0] + e1[1] * pvec[1] + e1[2] * pvec[2];
+      if (det > -EPSILON && det < EPSILON)
+        continue;
+
+      inv_det = 1.0f / det;
+
+      u = (tvec[0] * pvec[0] + tvec[1] * pvec[1] + tvec[2] * pvec[2]) * inv_det;
+      if (u < 0.f || u > 1.f)
+        continue;
+
+      qvec[0] = tvec[1] * e1[2] - tvec[2] * e1[1];
+      qvec[1] = tvec[2] * e1[0] - tvec[0] * e1[2];
+      qvec[2] = tvec[0] * e1[1] - tvec[1] * e1[0];
+
+      v = (d[0] * qvec[0] + d[1] * qvec[1] + d[2] * qvec[2]) * inv_det;
+      if (v < 0.f || u + v > 1.f)
+        continue;
+
+      t = (e2[0] * qvec[0] + e2[1] * qvec[1] + e2[2] * qvec[2]) * inv_det;
+      if (t <= 0)
+        continue;
+
+      t_out[i] = t;
+      mask |= 1 << i;
+    }
+
+  return mask;
+}
+
+#ifdef HAVE_SSE2_KERNEL
+
+/* Tests the four lanes starting at @lane */
+static int
+intersect_sse2_half (const RutTrianglePacket *packet,
+                     int lane,
+                     const float ray_origin[3],
+                     const float ray_direction[3],
+                     float *t_out)
+{
+  __m128 dx = _mm_set1_ps (ray_direction[0]);
+  __m128 dy = _mm_set1_ps (ray_direction[1]);
+  __m128 dz = _mm_set1_ps (ray_direction[2]);
+  __m128 e1x = _mm_loadu_ps (&packet->edge1[0][lane]);
+  __m128 e1y = _mm_loadu_ps (&packet->edge1[1][lane]);
+  __m128 e1z = _mm_loadu_ps (&packet->edge1[2][lane]);
+  __m128 e2x = _mm_loadu_ps (&packet->edge2[0][lane]);
+  __m128 e2y = _mm_loadu_ps (&packet->edge2[1][lane]);
+  __m128 e2z = _mm_loadu_ps (&packet->edge2[2][lane]);
+  __m128 tx = _mm_sub_ps (_mm_set1_ps (ray_origin[0]),
+                          _mm_loadu_ps (&packet->v0[0][lane]));
+  __m128 ty = _mm_sub_ps (_mm_set1_ps (ray_origin[1]),
+                          _mm_loadu_ps (&packet->v0[1][lane]));
+  __m128 tz = _mm_sub_ps (_mm_set1_ps (ray_origin[2]),
+                          _mm_loadu_ps (&packet->v0[2][lane]));
+  __m128 zero = _mm_setzero_ps ();
+  __m128 one = _mm_set1_ps (1.0f);
+  __m128 px, py, pz, qx, qy, qz;
+  __m128 det, inv_det, u, v, t, valid;
+
+  px = _mm_sub_ps (_mm_mul_ps (dy, e2z), _mm_mul_ps (dz, e2y));
+  py = _mm_sub_ps (_mm_mul_ps (dz, e2x), _mm_mul_ps (dx, e2z));
+  pz = _mm_sub_ps (_mm_mul_ps (dx, e2y), _mm_mul_ps (dy, e2x));
+
+  det = _mm_add_ps (_mm_add_ps (_mm_mul_ps (e1x, px), _mm_mul_ps (e1y, py)),
+                    _mm_mul_ps (e1z, pz));
+  valid = _mm_or_ps (_mm_cmple_ps (det, _mm_set1_ps (-EPSILON)),
+                     _mm_cmpge_ps (det, _mm_set1_ps (EPSILON)));
+
+  inv_det = _mm_div_ps (one, det);
+
+  u = _mm_mul_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (tx, px),
+                                          _mm_mul_ps (ty, py)),
+                              _mm_mul_ps (tz, pz)),
+                  inv_det);
+  valid = _mm_and_ps (valid, _mm_and_ps (_mm_cmpge_ps (u, zero),
+                                         _mm_cmple_ps (u, one)));
+
+  qx = _mm_sub_ps (_mm_mul_ps (ty, e1z), _mm_mul_ps (tz, e1y));
+  qy = _mm_sub_ps (_mm_mul_ps (tz, e1x), _mm_mul_ps (tx, e1z));
+  qz = _mm_sub_ps (_mm_mul_ps (tx, e1y), _mm_mul_ps (ty, e1x));
+
+  v = _mm_mul_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, qx),
+                                          _mm_mul_ps (dy, qy)),
+                              _mm_mul_ps (dz, qz)),
+                  inv_det);
+  valid = _mm_and_ps (valid,
+                      _mm_and_ps (_mm_cmpge_ps (v, zero),
+                                  _mm_cmple_ps (_mm_add_ps (u, v), one)));
+
+  t = _mm_mul_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (e2x, qx),
+                                          _mm_mul_ps (e2y, qy)),
+                              _mm_mul_ps (e2z, qz)),
+                  inv_det);
+  valid = _mm_and_ps (valid, _mm_cmpgt_ps (t, zero));
+
+  _mm_storeu_ps (t_out + lane, t);
+
+  return _mm_movemask_ps (valid) << lane;
+}
+
+static int
+intersect_sse2 (const RutTrianglePacket *packet,
+                const float ray_origin[3],
+                const float ray_direction[3],
+                float *t_out)
+{
+  return (intersect_sse2_half (packet, 0, ray_origin, ray_direction, t_out) |
+          intersect_sse2_half (packet, 4, ray_origin, ray_direction, t_out));
+}
+
+#endif /* HAVE_SSE2_KERNEL */
+
+#ifdef HAVE_AVX_KERNEL
+
+__attribute__ ((target ("avx"))) static int
+intersect_avx (const RutTrianglePacket *packet,
+               const float ray_origin[3],
+               const float ray_direction[3],
+               float *t_out)
+{
+  __m256 dx = _mm256_set1_ps (ray_direction[0]);
+  __m256 dy = _mm256_set1_ps (ray_direction[1]);
+  __m256 dz = _mm256_set1_ps (ray_direction[2]);
+  __m256 e1x = _mm256_loadu_ps (packet->edge1[0]);
+  __m256 e1y = _mm256_loadu_ps (packet->edge1[1]);
+  __m256 e1z = _mm256_loadu_ps (packet->edge1[2]);
+  __m256 e2x = _mm256_loadu_ps (packet->edge2[0]);
+  __m256 e2y = _mm256_loadu_ps (packet->edge2[1]);
+  __m256 e2z = _mm256_loadu_ps (packet->edge2[2]);
+  __m256 tx = _mm256_sub_ps (_mm256_set1_ps (ray_origin[0]),
+                             _mm256_loadu_ps (packet->v0[0]));
+  __m256 ty = _mm256_sub_ps (_mm256_set1_ps (ray_origin[1]),
+                             _mm256_loadu_ps (packet->v0[1]));
+  __m256 tz = _mm256_sub_ps (_mm256_set1_ps (ray_origin[2]),
+                             _mm256_loadu_ps (packet->v0[2]));
+  __m256 zero = _mm256_setzero_ps ();
+  __m256 one = _mm256_set1_ps (1.0f);
+  __m256 px, py, pz, qx, qy, qz;
+  __m256 det, inv_det, u, v, t, valid;
+
+  px = _mm256_sub_ps (_mm256_mul_ps (dy, e2z), _mm256_mul_ps (dz, e2y));
+  py = _mm256_sub_ps (_mm256_mul_ps (dz, e2x), _mm256_mul_ps (dx, e2z));
+  pz = _mm256_sub_ps (_mm256_mul_ps (dx, e2y), _mm256_mul_ps (dy, e2x));
+
+  det = _mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (e1x, px),
+                                      _mm256_mul_ps (e1y, py)),
+                       _mm256_mul_ps (e1z, pz));
+  valid = _mm256_or_ps (_mm256_cmp_ps (det, _mm256_set1_ps (-EPSILON),
+                                       _CMP_LE_OQ),
+                        _mm256_cmp_ps (det, _mm256_set1_ps (EPSILON),
+                                       _CMP_GE_OQ));
+
+  inv_det = _mm256_div_ps (one, det);
+
+  u = _mm256_mul_ps (_mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (tx, px),
+                                                   _mm256_mul_ps (ty, py)),
+                                    _mm256_mul_ps (tz, pz)),
+                     inv_det);
+  valid = _mm256_and_ps (valid,
+                         _mm256_and_ps (_mm256_cmp_ps (u, zero, _CMP_GE_OQ),
+                                        _mm256_cmp_ps (u, one, _CMP_LE_OQ)));
+
+  qx = _mm256_sub_ps (_mm256_mul_ps (ty, e1z), _mm256_mul_ps (tz, e1y));
+  qy = _mm256_sub_ps (_mm256_mul_ps (tz, e1x), _mm256_mul_ps (tx, e1z));
+  qz = _mm256_sub_ps (_mm256_mul_ps (tx, e1y), _mm256_mul_ps (ty, e1x));
+
+  v = _mm256_mul_ps (_mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (dx, qx),
+                                                   _mm256_mul_ps (dy, qy)),
+                                    _mm256_mul_ps (dz, qz)),
+                     inv_det);
+  valid = _mm256_and_ps (valid,
+                         _mm256_and_ps (_mm256_cmp_ps (v, zero, _CMP_GE_OQ),
+                                        _mm256_cmp_ps (_mm256_add_ps (u, v),
+                                                       one, _CMP_LE_OQ)));
+
+  t = _mm256_mul_ps (_mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (e2x, qx),
+                                                   _mm256_mul_ps (e2y, qy)),
+                                    _mm256_mul_ps (e2z, qz)),
+                     inv_det);
+  valid = _mm256_and_ps (valid, _mm256_cmp_ps (t, zero, _CMP_GT_OQ));
+
+  _mm256_storeu_ps (t_out, t);
+
+  return _mm256_movemask_ps (valid);
+}
+
+#endif /* HAVE_AVX_KERNEL */
+
+#ifdef HAVE_NEON_KERNEL
+
+static int
+neon_get_mask (uint32x4_t valid)
+{
+  uint32_t lanes[4];
+
+  vst1q_u32 (lanes, valid);
+
+  return ((lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8));
+}
+
+/* Tests the four lanes starting at @lane */
+static int
+intersect_neon_half (const RutTrianglePacket *packet,
+                     int lane,
+                     const float ray_origin[3],
+                     const float ray_direction[3],
+                     float *t_out)
+{
+  float32x4_t dx = vdupq_n_f32 (ray_direction[0]);
+  float32x4_t dy = vdupq_n_f32 (ray_direction[1]);
+  float32x4_t dz = vdupq_n_f32 (ray_direction[2]);
+  float32x4_t e1x = vld1q_f32 (&packet->edge1[0][lane]);
+  float32x4_t e1y = vld1q_f32 (&packet->edge1[1][lane]);
+  float32x4_t e1z = vld1q_f32 (&packet->edge1[2][lane]);
+  float32x4_t e2x = vld1q_f32 (&packet->edge2[0][lane]);
+  float32x4_t e2y = vld1q_f32 (&packet->edge2[1][lane]);
+  float32x4_t e2z = vld1q_f32 (&packet->edge2[2][lane]);
+  float32x4_t tx = vsubq_f32 (vdupq_n_f32 (ray_origin[0]),
+                              vld1q_f32 (&packet->v0[0][lane]));
+  float32x4_t ty = vsubq_f32 (vdupq_n_f32 (ray_origin[1]),
+                              vld1q_f32 (&packet->v0[1][lane]));
+  float32x4_t tz = vsubq_f32 (vdupq_n_f32 (ray_origin[2]),
+                              vld1q_f32 (&packet->v0[2][lane]));
+  float32x4_t zero = vdupq_n_f32 (0);
+  float32x4_t one = vdupq_n_f32 (1.0f);
+  float32x4_t px, py, pz, qx, qy, qz;
+  float32x4_t det, inv_det, u, v, t;
+  uint32x4_t valid;
+
+  px = vsubq_f32 (vmulq_f32 (dy, e2z), vmulq_f32 (dz, e2y));
+  py = vsubq_f32 (vmulq_f32 (dz, e2x), vmulq_f32 (dx, e2z));
+  pz = vsubq_f32 (vmulq_f32 (dx, e2y), vmulq_f32 (dy, e2x));
+
+  det = vaddq_f32 (vaddq_f32 (vmulq_f32 (e1x, px), vmulq_f32 (e1y, py)),
+                   vmulq_f32 (e1z, pz));
+  valid = vorrq_u32 (vcleq_f32 (det, vdupq_n_f32 (-EPSILON)),
+                     vcgeq_f32 (det, vdupq_n_f32 (EPSILON)));
+
+  inv_det = vdivq_f32 (one, det);
+
+  u = vmulq_f32 (vaddq_f32 (vaddq_f32 (vmulq_f32 (tx, px),
+                                       vmulq_f32 (ty, py)),
+                            vmulq_f32 (tz, pz)),
+                 inv_det);
+  valid = vandq_u32 (valid, vandq_u32 (vcgeq_f32 (u, zero),
+                                       vcleq_f32 (u, one)));
+
+  qx = vsubq_f32 (vmulq_f32 (ty, e1z), vmulq_f32 (tz, e1y));
+  qy = vsubq_f32 (vmulq_f32 (tz, e1x), vmulq_f32 (tx, e1z));
+  qz = vsubq_f32 (vmulq_f32 (tx, e1y), vmulq_f32 (ty, e1x));
+
+  v = vmulq_f32 (vaddq_f32 (vaddq_f32 (vmulq_f32 (dx, qx),
+                                       vmulq_f32 (dy, qy)),
+                            vmulq_f32 (dz, qz)),
+                 inv_det);
+  valid = vandq_u32 (valid,
+                     vandq_u32 (vcgeq_f32 (v, zero),
+                                vcleq_f32 (vaddq_f32 (u, v), one)));
+
+  t = vmulq_f32 (vaddq_f32 (vaddq_f32 (vmulq_f32 (e2x, qx),
+                                       vmulq_f32 (e2y, qy)),
+                            vmulq_f32 (e2z, qz)),
+                 inv_det);
+  valid = vandq_u32 (valid, vcgtq_f32 (t, zero));
+
+  vst1q_f32 (t_out + lane, t);
+
+  return neon_get_mask (valid) << lane;
+}
+
+static int
+intersect_neon (const RutTrianglePacket *packet,
+                const float ray_origin[3],
+                const float ray_direction[3],
+                float *t_out)
+{
+  return (intersect_neon_half (packet, 0, ray_origin, ray_direction, t_out) |
+          intersect_neon_half (packet, 4, ray_origin, ray_direction, t_out));
+}
+
+#endif /* HAVE_NEON_KERNEL */
+
+static PacketKernel _rut_triangle_packet_kernel;
+static const char *_rut_triangle_packet_kernel_name;
+
+static void
+select_kernel (void)
+{
+  _rut_triangle_packet_kernel = intersect_scalar;
+  _rut_triangle_packet_kernel_name = "scalar";
+
+  if (rut_util_is_boolean_env_set ("RUT_DISABLE_SIMD"))
+    return;
+
+#ifdef HAVE_SSE2_KERNEL
+  _rut_triangle_packet_kernel = intersect_sse2;
+  _rut_triangle_packet_kernel_name = "sse2";
+#endif
+
+#ifdef HAVE_AVX_KERNEL
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx"))
+    {
+      _rut_triangle_packet_kernel = intersect_avx;
+      _rut_triangle_packet_kernel_name = "avx";
+    }
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+  _rut_triangle_packet_kernel = intersect_neon;
+  _rut_triangle_packet_kernel_name = "neon";
+#endif
+}
+
+int
+rut_triangle_packet_intersect (const RutTrianglePacket *packet,
+                               const float ray_origin[3],
+                               const float ray_direction[3],
+                               float t_out[RUT_TRIANGLE_PACKET_SIZE])
+{
+  if (G_UNLIKELY (_rut_triangle_packet_kernel == NULL))
+    select_kernel ();
+
+  return _rut_triangle_packet_kernel (packet, ray_origin, ray_direction,
+                                      t_out);
+}
+
+const char *
+rut_triangle_packet_get_kernel_name (void)
+{
+  if (G_UNLIKELY (_rut_triangle_packet_kernel == NULL))
+    select_kernel ();
+
+  return _rut_triangle_packet_kernel_name;
+}
@@ -0,0 +1,80 @@
+/*
+ * Rut
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RUT_TRIANGLE_PACKET_H_
+#define _RUT_TRIANGLE_PACKET_H_
+
+#include <stdbool.h>
+
+#define RUT_TRIANGLE_PACKET_SIZE 8
+
+/* A group of triangles laid out so that a single ray can be tested
+ * against all of them at once with SIMD instructions.
+ *
+ * Each triangle is stored as its first vertex and the two edges that
+ * leave it, which is what the Möller–Trumbore test needs. Each
+ * component is stored in its own array so that the same lane of each
+ * array describes the same triangle. Unused lanes have an index of -1
+ * and zero length edges so they never report a hit.
+ */
+typedef struct _RutTrianglePacket
+{
+  float v0[3][RUT_TRIANGLE_PACKET_SIZE];
+  float edge1[3][RUT_TRIANGLE_PACKET_SIZE];
+  float edge2[3][RUT_TRIANGLE_PACKET_SIZE];
+
+  /* An arbitrary index for each triangle, chosen by the caller */
+  int index[RUT_TRIANGLE_PACKET_SIZE];
+} RutTrianglePacket;
+
+/* Marks all the lanes of @packet as unused */
+void
+rut_triangle_packet_init (RutTrianglePacket *packet);
+
+void
+rut_triangle_packet_set_triangle (RutTrianglePacket *packet,
+                                  int lane,
+                                  const float v0[3],
+                                  const float v1[3],
+                                  const float v2[3],
+                                  int index);
+
+/* Tests a ray against every triangle in @packet. Returns a bit mask of
+ * the lanes whose triangle is hit in front of the ray origin and
+ * writes the distance of each of those hits into @t_out, in units of
+ * @ray_direction. The values in @t_out for lanes that weren't hit are
+ * undefined.
+ *
+ * The fastest implementation supported by the CPU is chosen the first
+ * time this is called. Setting the RUT_DISABLE_SIMD environment
+ * variable forces the portable implementation.
+ */
+int
+rut_triangle_packet_intersect (const RutTrianglePacket *packet,
+                               const float ray_origin[3],
+                               const float ray_direction[3],
+                               float t_out[RUT_TRIANGLE_PACKET_SIZE]);
+
+/* Returns the name of the implementation that
+ * rut_triangle_packet_intersect() uses, for debugging */
+const char *
+rut_triangle_packet_get_kernel_name (void);
+
+#endif /* _RUT_TRIANGLE_PACKET_H_ */
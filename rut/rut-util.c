@@ -27,12 +27,18 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <cogl/cogl.h>
 
 #include "rut-global.h"
 #include "rut-mesh.h"
+#include "rut-mesh-bvh.h"
 #include "rut-util.h"
 
 /* Help macros to scale from OpenGL <-1,1> coordinates system to
@@ -270,51 +276,6 @@ rut_util_intersect_triangle (float v0[3], float v1[3], float v2[3],
   return TRUE;
 }
 
-typedef struct _IntersectState
-{
-  float *ray_origin;
-  float *ray_direction;
-  float min_t;
-  int index;
-  int hit_index;
-  bool found;
-} IntersectState;
-
-static CoglBool
-intersect_triangle_cb (void **attributes_v0,
-                       void **attributes_v1,
-                       void **attributes_v2,
-                       int index_v0,
-                       int index_v1,
-                       int index_v2,
-                       void *user_data)
-{
-  IntersectState *state = user_data;
-  float *pos_v0 = attributes_v0[0];
-  float *pos_v1 = attributes_v1[0];
-  float *pos_v2 = attributes_v2[0];
-  float u, v, t;
-  bool hit;
-
-  hit = rut_util_intersect_triangle (pos_v0, pos_v1, pos_v2,
-                                     state->ray_origin,
-                                     state->ray_direction,
-                                     &u, &v, &t);
-
-  /* found a closer triangle. t > 0 means that we don't want results
-   * behind the ray origin */
-  if (hit && t > 0 && t < state->min_t)
-    {
-      state->min_t = t;
-      state->found = TRUE;
-      state->hit_index = state->index;
-    }
-
-  state->index++;
-
-  return TRUE;
-}
-
 bool
 rut_util_intersect_mesh (RutMesh *mesh,
                          float ray_origin[3],
@@ -322,32 +283,11 @@ rut_util_intersect_mesh (RutMesh *mesh,
                          int *index,
                          float *t_out)
 {
-  IntersectState state;
-
-  state.ray_origin = ray_origin;
-  state.ray_direction = ray_direction;
-  state.min_t = G_MAXFLOAT;
-  state.found = FALSE;
-  state.index = 0;
-
-  rut_mesh_foreach_triangle (mesh,
-                             intersect_triangle_cb,
-                             &state,
-                             "cogl_position_in",
-                             NULL);
-
-  if (state.found)
-    {
-      if (t_out)
-        *t_out = state.min_t;
-
-      if (index)
-        *index = state.hit_index;
-
-      return TRUE;
-    }
-
-  return FALSE;
+  return rut_mesh_bvh_intersect (rut_mesh_get_bvh (mesh),
+                                 ray_origin,
+                                 ray_direction,
+                                 index,
+                                 t_out);
 }
 
 unsigned int
@@ -581,6 +521,216 @@ rut_util_is_boolean_env_set (const char *variable)
   return ret;
 }
 
+char *
+rut_util_checksum_file (const char *filename)
+{
+  GChecksum *checksum;
+  uint8_t buf[65536];
+  size_t len;
+  char *ret;
+  FILE *fp;
+
+  fp = fopen (filename, "rb");
+  if (fp == NULL)
+    return NULL;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+  while ((len = fread (buf, 1, sizeof (buf), fp)) > 0)
+    g_checksum_update (checksum, buf, len);
+
+  if (ferror (fp))
+    ret = NULL;
+  else
+    ret = g_strdup (g_checksum_get_string (checksum));
+
+  g_checksum_free (checksum);
+  fclose (fp);
+
+  return ret;
+}
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+GMappedFile *
+rut_util_map_file_private (const char *filename,
+                           GError **error)
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  GMappedFile *mapped_file;
+  int fd = g_open (filename, O_RDONLY | O_CLOEXEC, 0);
+
+  if (fd == -1)
+    {
+      int errsv = errno;
+
+      g_set_error (error,
+                   G_FILE_ERROR,
+                   g_file_error_from_errno (errsv),
+                   "Failed to open file '%s': %s",
+                   filename, g_strerror (errsv));
+      return NULL;
+    }
+
+  /* NB: GLib always maps files privately so writing to the mapping
+   * only touches a copy of the pages and doesn't need write access
+   * to the file. The mapping stays valid after the fd is closed. */
+  mapped_file = g_mapped_file_new_from_fd (fd, TRUE, error);
+
+  close (fd);
+
+  return mapped_file;
+#else
+  /* Older GLib can only make a writable mapping by opening the file
+   * for writing */
+  return g_mapped_file_new (filename, TRUE, error);
+#endif
+}
+
+void
+rut_util_touch_cache_file (const char *filename)
+{
+  GStatBuf buf;
+
+  if (g_stat (filename, &buf) == 0 &&
+      buf.st_mtime + 60 * 60 < time (NULL))
+    g_utime (filename, NULL);
+}
+
+typedef struct _CacheFile
+{
+  char *filename;
+  uint64_t size;
+  time_t mtime;
+} CacheFile;
+
+static int
+compare_cache_file_mtimes (const void *a,
+                           const void *b)
+{
+  const CacheFile *file_a = a;
+  const CacheFile *file_b = b;
+
+  if (file_a->mtime < file_b->mtime)
+    return -1;
+  else if (file_a->mtime > file_b->mtime)
+    return 1;
+  else
+    return 0;
+}
+
+static void
+trim_cache_dir (const char *dir,
+                const char *suffix,
+                uint64_t max_size)
+{
+  GArray *files = g_array_new (FALSE, FALSE, sizeof (CacheFile));
+  uint64_t total_size = 0;
+  const char *name;
+  GDir *gdir;
+  int i;
+
+  gdir = g_dir_open (dir, 0, NULL);
+  if (gdir == NULL)
+    {
+      g_array_free (files, TRUE);
+      return;
+    }
+
+  /* NB: temporary files that are still being written don't have the
+   * suffix so they are never deleted from under their writers */
+  while ((name = g_dir_read_name (gdir)))
+    {
+      CacheFile file;
+      GStatBuf buf;
+
+      if (!g_str_has_suffix (name, suffix))
+        continue;
+
+      file.filename = g_build_filename (dir, name, NULL);
+
+      if (g_stat (file.filename, &buf) == -1 || !S_ISREG (buf.st_mode))
+        {
+          g_free (file.filename);
+          continue;
+        }
+
+      file.size = buf.st_size;
+      file.mtime = buf.st_mtime;
+      total_size += file.size;
+
+      g_array_append_val (files, file);
+    }
+
+  g_dir_close (gdir);
+
+  if (total_size > max_size)
+    {
+      /* Trim to below the limit so that every new entry doesn't
+       * immediately cause another trim */
+      uint64_t target_size = max_size / 4 * 3;
+
+      g_array_sort (files, compare_cache_file_mtimes);
+
+      for (i = 0; i < files->len && total_size > target_size; i++)
+        {
+          CacheFile *file = &g_array_index (files, CacheFile, i);
+
+          if (g_unlink (file->filename) == 0)
+            total_size -= file->size;
+        }
+    }
+
+  for (i = 0; i < files->len; i++)
+    g_free (g_array_index (files, CacheFile, i).filename);
+  g_array_free (files, TRUE);
+}
+
+G_LOCK_DEFINE_STATIC (cache_trim);
+
+void
+rut_util_trim_cache_dir (const char *dir,
+                         const char *suffix,
+                         size_t size,
+                         uint64_t max_size)
+{
+  /* Maps each directory to the number of bytes written to it since it
+   * was last checked */
+  static GHashTable *written = NULL;
+  uint64_t *pending;
+  bool needs_trim;
+
+  G_LOCK (cache_trim);
+
+  if (written == NULL)
+    written = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  pending = g_hash_table_lookup (written, dir);
+
+  if (pending == NULL)
+    {
+      /* The directory may have been filled by an earlier run */
+      pending = g_new0 (uint64_t, 1);
+      g_hash_table_insert (written, g_strdup (dir), pending);
+      needs_trim = true;
+    }
+  else
+    {
+      *pending += size;
+      needs_trim = *pending > max_size / 8;
+    }
+
+  if (needs_trim)
+    *pending = 0;
+
+  G_UNLOCK (cache_trim);
+
+  if (needs_trim)
+    trim_cache_dir (dir, suffix, max_size);
+}
+
 void
 rut_util_matrix_scaled_perspective (CoglMatrix *matrix,
                                     float fov_y,
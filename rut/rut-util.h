@@ -24,6 +24,7 @@
 #define _RUT_UTIL_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <cogl/cogl.h>
 
@@ -178,6 +179,40 @@ rut_util_distribute_natural_allocation (int extra_space,
 CoglBool
 rut_util_is_boolean_env_set (const char *variable);
 
+/* Returns a newly allocated hex SHA1 checksum of the contents of
+ * @filename or NULL if it can't be read. This is safe to call from
+ * any thread. */
+char *
+rut_util_checksum_file (const char *filename);
+
+/* Maps @filename into memory so that the contents can be modified
+ * without changing the file, like g_mapped_file_new() with writable
+ * set, but only opens the file for reading so that read-only files
+ * can be mapped too. */
+GMappedFile *
+rut_util_map_file_private (const char *filename,
+                           GError **error);
+
+/* Marks a file in an on-disk cache as recently used by updating its
+ * modification time, so that rut_util_trim_cache_dir() evicts the
+ * least recently used entries first. To avoid writing to the disk on
+ * every lookup the time is only updated if it is over an hour old. */
+void
+rut_util_touch_cache_file (const char *filename);
+
+/* Should be called after writing a file of @size bytes to the cache
+ * directory @dir. The first time this is called for a directory, and
+ * then whenever enough has been written to it since, the files in
+ * @dir whose names end with @suffix are totalled. If they exceed
+ * @max_size then the ones with the oldest modification times are
+ * deleted until they are comfortably below it. This is safe to call
+ * from any thread. */
+void
+rut_util_trim_cache_dir (const char *dir,
+                         const char *suffix,
+                         size_t size,
+                         uint64_t max_size);
+
 void
 rut_util_matrix_scaled_perspective (CoglMatrix *matrix,
                                     float fov_y,
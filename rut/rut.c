@@ -42,6 +42,9 @@
 #include "rut-geometry.h"
 #include "rut-scroll-bar.h"
 #include "rut-image-source.h"
+#include "rut-profile.h"
+#include "rut-trace.h"
+#include "rut-bitmap-cache.h"
 
 typedef struct _RutTextureCacheEntry
 {
@@ -248,6 +251,28 @@ rut_find_data_file (const char *base_filename)
   return NULL;
 }
 
+/* Decoding images is slow so the decoded pixels are taken from the
+ * bitmap cache where possible */
+static CoglTexture *
+load_texture_file (RutContext *ctx, const char *filename, CoglError **error)
+{
+  RutBitmapCacheEntry *entry =
+    rut_bitmap_cache_load_file (filename,
+                                NULL, /* content hash */
+                                (GError **) error);
+  CoglTexture *texture;
+
+  if (entry == NULL)
+    return NULL;
+
+  texture = rut_bitmap_cache_entry_create_texture (entry,
+                                                   ctx->cogl_context,
+                                                   error);
+  rut_bitmap_cache_entry_free (entry);
+
+  return texture;
+}
+
 CoglTexture *
 rut_load_texture (RutContext *ctx, const char *filename, CoglError **error)
 {
@@ -260,8 +285,7 @@ rut_load_texture (RutContext *ctx, const char *filename, CoglError **error)
   if (entry)
     return cogl_object_ref (entry->texture);
 
-  texture = (CoglTexture*)
-    cogl_texture_2d_new_from_file (ctx->cogl_context, filename, error);
+  texture = load_texture_file (ctx, filename, error);
   if (!texture)
     return NULL;
 
@@ -332,6 +356,8 @@ rut_context_new (RutShell *shell)
 
   context->headless = rut_shell_get_headless (shell);
 
+  context->thumbnail_size = RUT_DEFAULT_THUMBNAIL_SIZE;
+
   if (!context->headless)
     {
 #ifdef USE_SDL
@@ -416,6 +442,13 @@ rut_set_assets_location (RutContext *context,
   context->assets_location = g_strdup (assets_location);
 }
 
+void
+rut_set_thumbnail_size (RutContext *context,
+                        int thumbnail_size)
+{
+  context->thumbnail_size = thumbnail_size;
+}
+
 void
 _rut_init (void)
 {
@@ -426,6 +459,9 @@ _rut_init (void)
       //bindtextdomain (GETTEXT_PACKAGE, RUT_LOCALEDIR);
       //bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
 
+      _rut_profile_init ();
+      _rut_trace_init ();
+
       _rut_context_init_type ();
       _rut_text_buffer_init_type ();
       _rut_text_init_type ();
@@ -19,6 +19,8 @@
 #include "rut-shell.h"
 #include "rut-bitmask.h"
 #include "rut-memory-stack.h"
+#include "rut-profile.h"
+#include "rut-trace.h"
 #include "rut-graph.h"
 #include "rut-transform.h"
 #include "rut-rectangle.h"
@@ -41,7 +43,15 @@
 #include "rut-dof-effect.h"
 #include "rut-inspector.h"
 #include "rut-mesh.h"
+#include "rut-mesh-bvh.h"
+#include "rut-triangle-packet.h"
+#include "rut-aabb-tree.h"
 #include "rut-mesh-ply.h"
+#include "rut-mesh-cache.h"
+#include "rut-bitmap-cache.h"
+#include "rut-mesh-optimize.h"
+#include "rut-mesh-quantize.h"
+#include "rut-mesh-simplify.h"
 #include "rut-ui-viewport.h"
 #include "rut-image.h"
 #include "rut-box-layout.h"
@@ -0,0 +1,1274 @@
+/*
+ * Synthetic Scene Generator Tool
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This tool generates synthetic .rig files of an arbitrary size so
+ * that we can measure how loading, simulation and rendering scale
+ * with the number of entities, components, controllers and
+ * keyframes in a UI.
+ *
+ * The generated UI is described using the same rig.proto messages
+ * that rig-pb.c emits when saving from the editor, laid out the same
+ * way: assets first, then entities in parent before child order and
+ * finally controllers. All randomness comes from a seeded generator
+ * so the same options always produce the same file.
+ *
+ * Usage:
+ * rig-scene-gen [OPTION...] OUTPUT_FILE
+ *
+ * Application Options:
+ *   -n, --entities=N            Number of entities to generate
+ *   -d, --depth=N               Maximum depth of the entity tree
+ *   -t, --components=LIST       Comma separated component kinds to mix
+ *   -c, --controllers=N         Number of controllers
+ *   -p, --paths=N               Number of animated properties per controller
+ *   -k, --keyframes=N           Number of keyframes per path
+ *   -m, --meshes=N              Number of distinct generated meshes
+ *   -r, --mesh-detail=N         Number of rings in each generated mesh
+ *   -e, --embed-meshes          Embed meshes in the .rig file
+ *   -s, --seed=N                Random seed
+ *
+ * The component kinds are: shape, model, text, nine-slice,
+ * pointalism and hair.
+ *
+ * Unless --embed-meshes is given the meshes are written as binary
+ * .ply files into the same directory as the .rig file (which is
+ * where the editor and device look for assets) and only referenced
+ * by path.
+ *
+ * Examples:
+ *
+ * To create a scene that's ten times bigger than a typical UI:
+ *   ./rig-scene-gen -n 5000 -d 6 -c 4 -p 64 -k 8 big/big.rig
+ *
+ * To create a self contained scene of only models and hair:
+ *   ./rig-scene-gen -n 1000 -t model,hair -r 32 -e models.rig
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "rig.pb-c.h"
+
+/* NB: these must match the values of RutAssetType in rut-types.h */
+#define ASSET_TYPE_TEXTURE 1
+#define ASSET_TYPE_PLY_MODEL 4
+
+#define TEXTURE_SIZE 256
+#define MESH_RADIUS 50
+
+/* Each generated vertex is interleaved as:
+ *   position[3], normal[3], tex_coord[2], tangent[3] */
+#define VERTEX_N_FLOATS 11
+#define VERTEX_STRIDE (VERTEX_N_FLOATS * sizeof (float))
+
+typedef enum _ComponentKind
+{
+  KIND_SHAPE,
+  KIND_MODEL,
+  KIND_TEXT,
+  KIND_NINE_SLICE,
+  KIND_POINTALISM,
+  KIND_HAIR,
+  N_KINDS
+} ComponentKind;
+
+static const char *kind_names[] =
+{
+  "shape",
+  "model",
+  "text",
+  "nine-slice",
+  "pointalism",
+  "hair"
+};
+
+typedef struct _GenMesh
+{
+  int n_vertices;
+  float *vertices;
+  int n_indices;
+  uint32_t *indices;
+} GenMesh;
+
+typedef struct _SceneGen
+{
+  GRand *rand;
+
+  /* Every message we allocate is tracked here so it can all be freed
+   * in one go once the UI has been written out */
+  GPtrArray *allocations;
+
+  int64_t next_id;
+
+  ComponentKind kinds[N_KINDS];
+  int n_kinds;
+
+  int64_t texture_asset_id;
+  int64_t *mesh_asset_ids;
+
+  int64_t *entity_ids;
+  int *entity_depths;
+} SceneGen;
+
+static int n_entities = 100;
+static int max_depth = 4;
+static char *components = NULL;
+static int n_controllers = 1;
+static int n_paths = 16;
+static int n_keyframes = 4;
+static int n_meshes = 4;
+static int mesh_detail = 16;
+static gboolean embed_meshes = FALSE;
+static int seed = 0;
+static char **remaining_args = NULL;
+
+static const GOptionEntry options[] =
+{
+  { "entities", 'n', 0, G_OPTION_ARG_INT,
+    &n_entities, "Number of entities to generate", "N" },
+  { "depth", 'd', 0, G_OPTION_ARG_INT,
+    &max_depth, "Maximum depth of the entity tree", "N" },
+  { "components", 't', 0, G_OPTION_ARG_STRING,
+    &components, "Comma separated component kinds to mix", "LIST" },
+  { "controllers", 'c', 0, G_OPTION_ARG_INT,
+    &n_controllers, "Number of controllers", "N" },
+  { "paths", 'p', 0, G_OPTION_ARG_INT,
+    &n_paths, "Number of animated properties per controller", "N" },
+  { "keyframes", 'k', 0, G_OPTION_ARG_INT,
+    &n_keyframes, "Number of keyframes per path", "N" },
+  { "meshes", 'm', 0, G_OPTION_ARG_INT,
+    &n_meshes, "Number of distinct generated meshes", "N" },
+  { "mesh-detail", 'r', 0, G_OPTION_ARG_INT,
+    &mesh_detail, "Number of rings in each generated mesh", "N" },
+  { "embed-meshes", 'e', 0, 0,
+    &embed_meshes, "Embed meshes in the .rig file" },
+  { "seed", 's', 0, G_OPTION_ARG_INT,
+    &seed, "Random seed", "N" },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY,
+    &remaining_args, "Output File", "OUTPUT_FILE" },
+  { 0 }
+};
+
+static void *
+gen_alloc (SceneGen *gen, size_t size)
+{
+  void *mem = g_malloc0 (size);
+  g_ptr_array_add (gen->allocations, mem);
+  return mem;
+}
+
+typedef void (*PBMessageInitFunc) (void *message);
+
+static inline void *
+_pb_new (SceneGen *gen, size_t size, void *_message_init)
+{
+  PBMessageInitFunc message_init = _message_init;
+  void *msg = gen_alloc (gen, size);
+
+  message_init (msg);
+  return msg;
+}
+
+#define pb_new(GEN, TYPE, INIT) \
+  ((TYPE *)_pb_new (GEN, sizeof (TYPE), INIT))
+
+static char *
+gen_strdup_printf (SceneGen *gen, const char *format, ...)
+{
+  va_list args;
+  char *str;
+
+  va_start (args, format);
+  str = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  g_ptr_array_add (gen->allocations, str);
+
+  return str;
+}
+
+static int64_t
+gen_id (SceneGen *gen)
+{
+  return gen->next_id++;
+}
+
+static float
+gen_float (SceneGen *gen, float min, float max)
+{
+  return g_rand_double_range (gen->rand, min, max);
+}
+
+static Rig__Color *
+gen_color (SceneGen *gen)
+{
+  Rig__Color *pb_color = pb_new (gen, Rig__Color, rig__color__init);
+  int red = g_rand_int_range (gen->rand, 0, 256);
+  int green = g_rand_int_range (gen->rand, 0, 256);
+  int blue = g_rand_int_range (gen->rand, 0, 256);
+
+  pb_color->hex = gen_strdup_printf (gen, "#%02x%02x%02xff",
+                                     red, green, blue);
+  return pb_color;
+}
+
+static Rig__Vec3 *
+gen_vec3 (SceneGen *gen, float x, float y, float z)
+{
+  Rig__Vec3 *pb_vec3 = pb_new (gen, Rig__Vec3, rig__vec3__init);
+
+  pb_vec3->x = x;
+  pb_vec3->y = y;
+  pb_vec3->z = z;
+
+  return pb_vec3;
+}
+
+/* NB: the components are generated in a fixed order so that the same
+ * seed always gives the same scene, regardless of the order in which
+ * the compiler evaluates function arguments */
+static Rig__Vec3 *
+gen_random_vec3 (SceneGen *gen, float spread, float depth)
+{
+  float x = gen_float (gen, -spread, spread);
+  float y = gen_float (gen, -spread, spread);
+  float z = gen_float (gen, -depth, 0);
+
+  return gen_vec3 (gen, x, y, z);
+}
+
+static Rig__Rotation *
+gen_rotation (SceneGen *gen)
+{
+  Rig__Rotation *pb_rotation = pb_new (gen, Rig__Rotation,
+                                       rig__rotation__init);
+  float x = gen_float (gen, -1, 1);
+  float y = gen_float (gen, -1, 1);
+  float z = gen_float (gen, -1, 1);
+  float len = sqrtf (x * x + y * y + z * z);
+
+  if (len < 0.0001)
+    {
+      x = 0;
+      y = 0;
+      z = 1;
+      len = 1;
+    }
+
+  pb_rotation->angle = gen_float (gen, 0, 360);
+  pb_rotation->x = x / len;
+  pb_rotation->y = y / len;
+  pb_rotation->z = z / len;
+
+  return pb_rotation;
+}
+
+static Rig__PropertyValue *
+gen_property_value (SceneGen *gen)
+{
+  return pb_new (gen, Rig__PropertyValue, rig__property_value__init);
+}
+
+static Rig__Boxed *
+gen_boxed (SceneGen *gen,
+           const char *name,
+           Rig__PropertyType type)
+{
+  Rig__Boxed *pb_boxed = pb_new (gen, Rig__Boxed, rig__boxed__init);
+
+  pb_boxed->name = (char *)name;
+  pb_boxed->has_type = TRUE;
+  pb_boxed->type = type;
+  pb_boxed->value = gen_property_value (gen);
+
+  return pb_boxed;
+}
+
+static Rig__Boxed *
+gen_boxed_float (SceneGen *gen, const char *name, float value)
+{
+  Rig__Boxed *pb_boxed = gen_boxed (gen, name, RIG__PROPERTY_TYPE__FLOAT);
+
+  pb_boxed->value->has_float_value = TRUE;
+  pb_boxed->value->float_value = value;
+
+  return pb_boxed;
+}
+
+static Rig__Boxed *
+gen_boxed_integer (SceneGen *gen, const char *name, int value)
+{
+  Rig__Boxed *pb_boxed = gen_boxed (gen, name, RIG__PROPERTY_TYPE__INTEGER);
+
+  pb_boxed->value->has_integer_value = TRUE;
+  pb_boxed->value->integer_value = value;
+
+  return pb_boxed;
+}
+
+static Rig__Boxed *
+gen_boxed_boolean (SceneGen *gen, const char *name, gboolean value)
+{
+  Rig__Boxed *pb_boxed = gen_boxed (gen, name, RIG__PROPERTY_TYPE__BOOLEAN);
+
+  pb_boxed->value->has_boolean_value = TRUE;
+  pb_boxed->value->boolean_value = value;
+
+  return pb_boxed;
+}
+
+static Rig__Boxed *
+gen_boxed_color (SceneGen *gen, const char *name)
+{
+  Rig__Boxed *pb_boxed = gen_boxed (gen, name, RIG__PROPERTY_TYPE__COLOR);
+
+  pb_boxed->value->color_value = gen_color (gen);
+
+  return pb_boxed;
+}
+
+static Rig__Boxed *
+gen_boxed_asset (SceneGen *gen, const char *name, int64_t asset_id)
+{
+  Rig__Boxed *pb_boxed = gen_boxed (gen, name, RIG__PROPERTY_TYPE__ASSET);
+
+  pb_boxed->value->has_asset_value = TRUE;
+  pb_boxed->value->asset_value = asset_id;
+
+  return pb_boxed;
+}
+
+static Rig__Boxed **
+gen_boxed_array (SceneGen *gen, int n_properties)
+{
+  return gen_alloc (gen, sizeof (void *) * n_properties);
+}
+
+/* Generates a lumpy UV sphere so that each mesh has a distinct
+ * silhouette and non-trivial normals */
+static void
+gen_mesh (SceneGen *gen, GenMesh *mesh, int n_rings)
+{
+  int n_segments = n_rings * 2;
+  int stride = n_segments + 1;
+  float lump_amplitude = gen_float (gen, 0.05, 0.3);
+  int lump_theta = g_rand_int_range (gen->rand, 1, 6);
+  int lump_phi = g_rand_int_range (gen->rand, 1, 6);
+  int i, j;
+
+  mesh->n_vertices = (n_rings + 1) * stride;
+  mesh->vertices = g_new0 (float, mesh->n_vertices * VERTEX_N_FLOATS);
+
+  for (i = 0; i <= n_rings; i++)
+    {
+      float theta = G_PI * i / n_rings;
+
+      for (j = 0; j <= n_segments; j++)
+        {
+          float phi = 2 * G_PI * j / n_segments;
+          float *v = mesh->vertices + (i * stride + j) * VERTEX_N_FLOATS;
+          float r = MESH_RADIUS * (1 + lump_amplitude *
+                                   sinf (lump_theta * theta) *
+                                   cosf (lump_phi * phi));
+
+          v[0] = r * sinf (theta) * cosf (phi);
+          v[1] = r * cosf (theta);
+          v[2] = r * sinf (theta) * sinf (phi);
+
+          /* normals are accumulated from the faces below */
+
+          v[6] = (float)j / n_segments;
+          v[7] = (float)i / n_rings;
+
+          v[8] = -sinf (phi);
+          v[9] = 0;
+          v[10] = cosf (phi);
+        }
+    }
+
+  mesh->n_indices = n_rings * n_segments * 6;
+  mesh->indices = g_new (uint32_t, mesh->n_indices);
+
+  for (i = 0; i < n_rings; i++)
+    {
+      for (j = 0; j < n_segments; j++)
+        {
+          uint32_t *index = mesh->indices + (i * n_segments + j) * 6;
+          uint32_t v0 = i * stride + j;
+          uint32_t v1 = v0 + 1;
+          uint32_t v2 = v0 + stride;
+          uint32_t v3 = v2 + 1;
+
+          index[0] = v0;
+          index[1] = v2;
+          index[2] = v1;
+          index[3] = v1;
+          index[4] = v2;
+          index[5] = v3;
+        }
+    }
+
+  for (i = 0; i < mesh->n_indices; i += 3)
+    {
+      float *a = mesh->vertices + mesh->indices[i] * VERTEX_N_FLOATS;
+      float *b = mesh->vertices + mesh->indices[i + 1] * VERTEX_N_FLOATS;
+      float *c = mesh->vertices + mesh->indices[i + 2] * VERTEX_N_FLOATS;
+      float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+      float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+      float n[3] = {
+        e0[1] * e1[2] - e0[2] * e1[1],
+        e0[2] * e1[0] - e0[0] * e1[2],
+        e0[0] * e1[1] - e0[1] * e1[0]
+      };
+
+      for (j = 0; j < 3; j++)
+        {
+          a[3 + j] += n[j];
+          b[3 + j] += n[j];
+          c[3 + j] += n[j];
+        }
+    }
+
+  for (i = 0; i < mesh->n_vertices; i++)
+    {
+      float *n = mesh->vertices + i * VERTEX_N_FLOATS + 3;
+      float len = sqrtf (n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+      if (len > 0.000001)
+        {
+          n[0] /= len;
+          n[1] /= len;
+          n[2] /= len;
+        }
+      else
+        n[1] = 1;
+    }
+}
+
+static void
+gen_mesh_destroy (GenMesh *mesh)
+{
+  g_free (mesh->vertices);
+  g_free (mesh->indices);
+}
+
+static gboolean
+write_ply (GenMesh *mesh, const char *filename, GError **error)
+{
+  GString *ply = g_string_new (NULL);
+  int n_faces = mesh->n_indices / 3;
+  gboolean ret;
+  int i;
+
+  g_string_append_printf (ply,
+                          "ply\n"
+                          "format binary_little_endian 1.0\n"
+                          "comment generated by rig-scene-gen\n"
+                          "element vertex %d\n"
+                          "property float x\n"
+                          "property float y\n"
+                          "property float z\n"
+                          "property float nx\n"
+                          "property float ny\n"
+                          "property float nz\n"
+                          "property float s\n"
+                          "property float t\n"
+                          "property float tanx\n"
+                          "property float tany\n"
+                          "property float tanz\n"
+                          "element face %d\n"
+                          "property list uchar uint vertex_indices\n"
+                          "end_header\n",
+                          mesh->n_vertices,
+                          n_faces);
+
+  for (i = 0; i < mesh->n_vertices * VERTEX_N_FLOATS; i++)
+    {
+      union { float f; uint32_t u; } value;
+
+      value.f = mesh->vertices[i];
+      value.u = GUINT32_TO_LE (value.u);
+      g_string_append_len (ply, (char *)&value.u, sizeof (value.u));
+    }
+
+  for (i = 0; i < n_faces; i++)
+    {
+      int j;
+
+      g_string_append_c (ply, 3);
+      for (j = 0; j < 3; j++)
+        {
+          uint32_t index = GUINT32_TO_LE (mesh->indices[i * 3 + j]);
+          g_string_append_len (ply, (char *)&index, sizeof (index));
+        }
+    }
+
+  ret = g_file_set_contents (filename, ply->str, ply->len, error);
+
+  g_string_free (ply, TRUE);
+
+  return ret;
+}
+
+static Rig__Attribute *
+gen_float_attribute (SceneGen *gen,
+                     int64_t buffer_id,
+                     const char *name,
+                     int offset,
+                     int n_components)
+{
+  Rig__Attribute *pb_attribute = pb_new (gen, Rig__Attribute,
+                                         rig__attribute__init);
+
+  pb_attribute->has_buffer_id = TRUE;
+  pb_attribute->buffer_id = buffer_id;
+  pb_attribute->name = (char *)name;
+  pb_attribute->has_stride = TRUE;
+  pb_attribute->stride = VERTEX_STRIDE;
+  pb_attribute->has_offset = TRUE;
+  pb_attribute->offset = offset * sizeof (float);
+  pb_attribute->has_n_components = TRUE;
+  pb_attribute->n_components = n_components;
+  pb_attribute->has_type = TRUE;
+  pb_attribute->type = RIG__ATTRIBUTE__TYPE__FLOAT;
+
+  return pb_attribute;
+}
+
+static Rig__Mesh *
+gen_pb_mesh (SceneGen *gen, GenMesh *mesh)
+{
+  Rig__Mesh *pb_mesh = pb_new (gen, Rig__Mesh, rig__mesh__init);
+  Rig__Buffer *vertex_buffer;
+  Rig__Buffer *index_buffer;
+
+  vertex_buffer = pb_new (gen, Rig__Buffer, rig__buffer__init);
+  vertex_buffer->has_id = TRUE;
+  vertex_buffer->id = gen_id (gen);
+  vertex_buffer->has_data = TRUE;
+  vertex_buffer->data.data = (uint8_t *)mesh->vertices;
+  vertex_buffer->data.len = mesh->n_vertices * VERTEX_STRIDE;
+
+  index_buffer = pb_new (gen, Rig__Buffer, rig__buffer__init);
+  index_buffer->has_id = TRUE;
+  index_buffer->id = gen_id (gen);
+  index_buffer->has_data = TRUE;
+
+  pb_mesh->has_indices_type = TRUE;
+  if (mesh->n_vertices <= 0x10000)
+    {
+      uint16_t *indices = gen_alloc (gen, sizeof (uint16_t) * mesh->n_indices);
+      int i;
+
+      for (i = 0; i < mesh->n_indices; i++)
+        indices[i] = mesh->indices[i];
+
+      pb_mesh->indices_type = RIG__MESH__INDICES_TYPE__UNSIGNED_SHORT;
+      index_buffer->data.data = (uint8_t *)indices;
+      index_buffer->data.len = sizeof (uint16_t) * mesh->n_indices;
+    }
+  else
+    {
+      pb_mesh->indices_type = RIG__MESH__INDICES_TYPE__UNSIGNED_INT;
+      index_buffer->data.data = (uint8_t *)mesh->indices;
+      index_buffer->data.len = sizeof (uint32_t) * mesh->n_indices;
+    }
+
+  pb_mesh->has_mode = TRUE;
+  pb_mesh->mode = RIG__MESH__MODE__TRIANGLES;
+
+  pb_mesh->n_buffers = 2;
+  pb_mesh->buffers = gen_alloc (gen, sizeof (void *) * 2);
+  pb_mesh->buffers[0] = vertex_buffer;
+  pb_mesh->buffers[1] = index_buffer;
+
+  pb_mesh->n_attributes = 4;
+  pb_mesh->attributes = gen_alloc (gen, sizeof (void *) * 4);
+  pb_mesh->attributes[0] =
+    gen_float_attribute (gen, vertex_buffer->id, "cogl_position_in", 0, 3);
+  pb_mesh->attributes[1] =
+    gen_float_attribute (gen, vertex_buffer->id, "cogl_normal_in", 3, 3);
+  pb_mesh->attributes[2] =
+    gen_float_attribute (gen, vertex_buffer->id, "cogl_tex_coord0_in", 6, 2);
+  pb_mesh->attributes[3] =
+    gen_float_attribute (gen, vertex_buffer->id, "tangent_in", 8, 3);
+
+  pb_mesh->has_n_vertices = TRUE;
+  pb_mesh->n_vertices = mesh->n_vertices;
+
+  pb_mesh->has_n_indices = TRUE;
+  pb_mesh->n_indices = mesh->n_indices;
+
+  pb_mesh->has_indices_buffer_id = TRUE;
+  pb_mesh->indices_buffer_id = index_buffer->id;
+
+  return pb_mesh;
+}
+
+static Rig__Asset *
+gen_texture_asset (SceneGen *gen)
+{
+  Rig__Asset *pb_asset = pb_new (gen, Rig__Asset, rig__asset__init);
+  GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8,
+                                      TEXTURE_SIZE, TEXTURE_SIZE);
+  int rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  uint8_t *pixels = gdk_pixbuf_get_pixels (pixbuf);
+  GError *error = NULL;
+  char *contents;
+  gsize len;
+  int x, y;
+
+  /* A checkerboard so that texture sampling is visible when
+   * inspecting the generated scenes */
+  for (y = 0; y < TEXTURE_SIZE; y++)
+    for (x = 0; x < TEXTURE_SIZE; x++)
+      {
+        uint8_t *p = pixels + y * rowstride + x * 4;
+        gboolean light = ((x / 32) + (y / 32)) & 1;
+
+        p[0] = light ? 0xee : 0x40;
+        p[1] = light ? 0xee : 0x60;
+        p[2] = light ? 0xee : 0x90;
+        p[3] = 0xff;
+      }
+
+  if (!gdk_pixbuf_save_to_buffer (pixbuf, &contents, &len, "png",
+                                  &error, NULL))
+    {
+      g_error ("Failed to encode texture: %s", error->message);
+    }
+
+  g_object_unref (pixbuf);
+
+  g_ptr_array_add (gen->allocations, contents);
+
+  gen->texture_asset_id = gen_id (gen);
+
+  pb_asset->has_id = TRUE;
+  pb_asset->id = gen->texture_asset_id;
+  pb_asset->path = "scene-gen-checkerboard.png";
+  pb_asset->has_type = TRUE;
+  pb_asset->type = ASSET_TYPE_TEXTURE;
+  pb_asset->has_is_video = TRUE;
+  pb_asset->is_video = FALSE;
+  pb_asset->has_data = TRUE;
+  pb_asset->data.data = (uint8_t *)contents;
+  pb_asset->data.len = len;
+
+  return pb_asset;
+}
+
+static Rig__Asset *
+gen_mesh_asset (SceneGen *gen,
+                int index,
+                GenMesh *mesh,
+                const char *assets_dir)
+{
+  Rig__Asset *pb_asset = pb_new (gen, Rig__Asset, rig__asset__init);
+
+  /* Vary the detail of each mesh a little so that they don't all
+   * have identical triangle counts */
+  gen_mesh (gen, mesh, mesh_detail + index % 4);
+
+  gen->mesh_asset_ids[index] = gen_id (gen);
+
+  pb_asset->has_id = TRUE;
+  pb_asset->id = gen->mesh_asset_ids[index];
+  pb_asset->path = gen_strdup_printf (gen, "scene-gen-mesh-%d.ply", index);
+  pb_asset->has_type = TRUE;
+  pb_asset->type = ASSET_TYPE_PLY_MODEL;
+
+  if (embed_meshes)
+    pb_asset->mesh = gen_pb_mesh (gen, mesh);
+  else
+    {
+      char *filename = g_build_filename (assets_dir, pb_asset->path, NULL);
+      GError *error = NULL;
+
+      if (!write_ply (mesh, filename, &error))
+        g_error ("Failed to write %s: %s", filename, error->message);
+
+      g_free (filename);
+    }
+
+  return pb_asset;
+}
+
+static Rig__Entity__Component *
+gen_component (SceneGen *gen, Rig__Entity__Component__Type type)
+{
+  Rig__Entity__Component *pb_component =
+    pb_new (gen, Rig__Entity__Component, rig__entity__component__init);
+
+  pb_component->has_id = TRUE;
+  pb_component->id = gen_id (gen);
+  pb_component->has_type = TRUE;
+  pb_component->type = type;
+
+  return pb_component;
+}
+
+static Rig__Entity__Component *
+gen_material (SceneGen *gen, gboolean textured)
+{
+  Rig__Entity__Component *pb_component =
+    gen_component (gen, RIG__ENTITY__COMPONENT__TYPE__MATERIAL);
+  Rig__Boxed **properties = gen_boxed_array (gen, 7);
+  int n = 0;
+
+  properties[n++] = gen_boxed_boolean (gen, "visible", TRUE);
+  properties[n++] = gen_boxed_boolean (gen, "cast_shadow", TRUE);
+  properties[n++] = gen_boxed_boolean (gen, "receive_shadow", TRUE);
+  if (textured)
+    properties[n++] = gen_boxed_asset (gen, "color_source",
+                                       gen->texture_asset_id);
+  properties[n++] = gen_boxed_color (gen, "ambient");
+  properties[n++] = gen_boxed_color (gen, "diffuse");
+  properties[n++] = gen_boxed_float (gen, "shininess",
+                                     gen_float (gen, 1, 100));
+
+  pb_component->n_properties = n;
+  pb_component->properties = properties;
+
+  return pb_component;
+}
+
+static Rig__Entity__Component *
+gen_model (SceneGen *gen)
+{
+  Rig__Entity__Component *pb_component =
+    gen_component (gen, RIG__ENTITY__COMPONENT__TYPE__MODEL);
+  int mesh = g_rand_int_range (gen->rand, 0, n_meshes);
+
+  pb_component->model = pb_new (gen, Rig__Entity__Component__Model,
+                                rig__entity__component__model__init);
+  pb_component->model->has_asset_id = TRUE;
+  pb_component->model->asset_id = gen->mesh_asset_ids[mesh];
+
+  return pb_component;
+}
+
+static void
+gen_components (SceneGen *gen, Rig__Entity *pb_entity)
+{
+  ComponentKind kind =
+    gen->kinds[g_rand_int_range (gen->rand, 0, gen->n_kinds)];
+  Rig__Entity__Component **pb_components =
+    gen_alloc (gen, sizeof (void *) * 3);
+  Rig__Entity__Component *pb_component;
+  Rig__Boxed **properties;
+  int n = 0;
+
+  switch (kind)
+    {
+    case KIND_SHAPE:
+      pb_components[n++] = gen_material (gen, TRUE);
+      pb_component = gen_component (gen, RIG__ENTITY__COMPONENT__TYPE__SHAPE);
+      pb_component->shape = pb_new (gen, Rig__Entity__Component__Shape,
+                                    rig__entity__component__shape__init);
+      properties = gen_boxed_array (gen, 3);
+      properties[0] = gen_boxed_boolean (gen, "shaped",
+                                         g_rand_boolean (gen->rand));
+      properties[1] = gen_boxed_float (gen, "width", TEXTURE_SIZE);
+      properties[2] = gen_boxed_float (gen, "height", TEXTURE_SIZE);
+      pb_component->n_properties = 3;
+      pb_component->properties = properties;
+      pb_components[n++] = pb_component;
+      break;
+
+    case KIND_MODEL:
+      pb_components[n++] = gen_material (gen, FALSE);
+      pb_components[n++] = gen_model (gen);
+      break;
+
+    case KIND_TEXT:
+      pb_component = gen_component (gen, RIG__ENTITY__COMPONENT__TYPE__TEXT);
+      pb_component->text = pb_new (gen, Rig__Entity__Component__Text,
+                                   rig__entity__component__text__init);
+      pb_component->text->text =
+        gen_strdup_printf (gen, "Text %d",
+                           g_rand_int_range (gen->rand, 0, 10000));
+      pb_component->text->font = "Sans 60px";
+      pb_component->text->color = gen_color (gen);
+      pb_components[n++] = pb_component;
+      break;
+
+    case KIND_NINE_SLICE:
+      pb_components[n++] = gen_material (gen, TRUE);
+      pb_component =
+        gen_component (gen, RIG__ENTITY__COMPONENT__TYPE__NINE_SLICE);
+      properties = gen_boxed_array (gen, 6);
+      properties[0] = gen_boxed_float (gen, "width", gen_float (gen, 64, 512));
+      properties[1] = gen_boxed_float (gen, "height", gen_float (gen, 64, 512));
+      properties[2] = gen_boxed_float (gen, "left", 32);
+      properties[3] = gen_boxed_float (gen, "right", 32);
+      properties[4] = gen_boxed_float (gen, "top", 32);
+      properties[5] = gen_boxed_float (gen, "bottom", 32);
+      pb_component->n_properties = 6;
+      pb_component->properties = properties;
+      pb_components[n++] = pb_component;
+      break;
+
+    case KIND_POINTALISM:
+      pb_components[n++] = gen_material (gen, TRUE);
+      pb_component =
+        gen_component (gen, RIG__ENTITY__COMPONENT__TYPE__POINTALISM_GRID);
+      pb_component->grid =
+        pb_new (gen, Rig__Entity__Component__PointalismGrid,
+                rig__entity__component__pointalism_grid__init);
+      pb_component->grid->has_cell_size = TRUE;
+      pb_component->grid->cell_size = g_rand_int_range (gen->rand, 8, 32);
+      pb_component->grid->has_scale = TRUE;
+      pb_component->grid->scale = gen_float (gen, 1, 3);
+      pb_component->grid->has_z = TRUE;
+      pb_component->grid->z = gen_float (gen, 0, 10);
+      pb_component->grid->has_lighter = TRUE;
+      pb_component->grid->lighter = g_rand_boolean (gen->rand);
+      pb_components[n++] = pb_component;
+      break;
+
+    case KIND_HAIR:
+      pb_components[n++] = gen_material (gen, FALSE);
+      pb_components[n++] = gen_model (gen);
+      pb_component = gen_component (gen, RIG__ENTITY__COMPONENT__TYPE__HAIR);
+      properties = gen_boxed_array (gen, 4);
+      properties[0] = gen_boxed_float (gen, "hair-length",
+                                       gen_float (gen, 5, 30));
+      properties[1] = gen_boxed_integer (gen, "hair-detail",
+                                         g_rand_int_range (gen->rand, 5, 20));
+      properties[2] = gen_boxed_integer (gen, "hair-density",
+                                         g_rand_int_range (gen->rand,
+                                                           500, 20000));
+      properties[3] = gen_boxed_float (gen, "hair-thickness",
+                                       gen_float (gen, 0.05, 0.5));
+      pb_component->n_properties = 4;
+      pb_component->properties = properties;
+      pb_components[n++] = pb_component;
+      break;
+
+    case N_KINDS:
+      g_warn_if_reached ();
+      break;
+    }
+
+  pb_entity->n_components = n;
+  pb_entity->components = pb_components;
+}
+
+/* Picks the smallest fan out that lets n_entities fit within
+ * max_depth levels of the tree */
+static int
+calculate_fan_out (void)
+{
+  int fan_out;
+
+  if (max_depth <= 1)
+    return n_entities;
+
+  for (fan_out = 1; fan_out < n_entities; fan_out++)
+    {
+      double capacity = 0;
+      double level = 1;
+      int i;
+
+      for (i = 0; i < max_depth; i++)
+        {
+          level *= fan_out;
+          capacity += level;
+        }
+
+      if (capacity >= n_entities)
+        break;
+    }
+
+  return fan_out;
+}
+
+static Rig__Entity **
+gen_entities (SceneGen *gen)
+{
+  Rig__Entity **pb_entities =
+    gen_alloc (gen, sizeof (void *) * n_entities);
+  int fan_out = calculate_fan_out ();
+  int i;
+
+  gen->entity_ids = g_new (int64_t, n_entities);
+  gen->entity_depths = g_new (int, n_entities);
+
+  /* Entities are laid out as a breadth first fan_out-ary tree below
+   * a virtual root so the i'th entity's parent is (i / fan_out) - 1
+   * and parents are always serialized before their children. */
+  for (i = 0; i < n_entities; i++)
+    {
+      Rig__Entity *pb_entity = pb_new (gen, Rig__Entity, rig__entity__init);
+      int parent = i / fan_out - 1;
+      float spread;
+
+      pb_entity->has_id = TRUE;
+      pb_entity->id = gen->entity_ids[i] = gen_id (gen);
+
+      if (parent >= 0)
+        {
+          pb_entity->has_parent_id = TRUE;
+          pb_entity->parent_id = gen->entity_ids[parent];
+          gen->entity_depths[i] = gen->entity_depths[parent] + 1;
+        }
+      else
+        gen->entity_depths[i] = 0;
+
+      pb_entity->label = gen_strdup_printf (gen, "entity%d", i);
+
+      /* Top level entities are spread out over the device while
+       * children are kept close to their parent */
+      spread = gen->entity_depths[i] ? 200 : 1000;
+      pb_entity->position = gen_random_vec3 (gen, spread, spread / 2);
+      pb_entity->rotation = gen_rotation (gen);
+
+      if (g_rand_boolean (gen->rand))
+        {
+          pb_entity->has_scale = TRUE;
+          pb_entity->scale = gen_float (gen, 0.5, 1.5);
+        }
+
+      gen_components (gen, pb_entity);
+
+      pb_entities[i] = pb_entity;
+    }
+
+  return pb_entities;
+}
+
+static void
+gen_path_value (SceneGen *gen,
+                Rig__PropertyType type,
+                Rig__PropertyValue *pb_value)
+{
+  switch (type)
+    {
+    case RIG__PROPERTY_TYPE__VEC3:
+      pb_value->vec3_value = gen_random_vec3 (gen, 1000, 500);
+      break;
+    case RIG__PROPERTY_TYPE__QUATERNION:
+      pb_value->quaternion_value = gen_rotation (gen);
+      break;
+    case RIG__PROPERTY_TYPE__FLOAT:
+      pb_value->has_float_value = TRUE;
+      pb_value->float_value = gen_float (gen, 0.5, 1.5);
+      break;
+    default:
+      g_warn_if_reached ();
+    }
+}
+
+static Rig__Controller__Property *
+gen_controller_property (SceneGen *gen,
+                         int64_t object_id,
+                         const char *name,
+                         Rig__PropertyType type,
+                         float length)
+{
+  Rig__Controller__Property *pb_property =
+    pb_new (gen, Rig__Controller__Property, rig__controller__property__init);
+  Rig__Path *pb_path;
+  int i;
+
+  pb_property->has_object_id = TRUE;
+  pb_property->object_id = object_id;
+  pb_property->name = (char *)name;
+
+  pb_property->has_method = TRUE;
+  pb_property->method = n_keyframes ?
+    RIG__CONTROLLER__PROPERTY__METHOD__PATH :
+    RIG__CONTROLLER__PROPERTY__METHOD__CONSTANT;
+
+  pb_property->has_type = TRUE;
+  pb_property->type = type;
+
+  pb_property->constant = gen_property_value (gen);
+  gen_path_value (gen, type, pb_property->constant);
+
+  if (!n_keyframes)
+    return pb_property;
+
+  pb_path = pb_new (gen, Rig__Path, rig__path__init);
+  pb_path->n_nodes = n_keyframes;
+  pb_path->nodes = gen_alloc (gen, sizeof (void *) * n_keyframes);
+
+  for (i = 0; i < n_keyframes; i++)
+    {
+      Rig__Node *pb_node = pb_new (gen, Rig__Node, rig__node__init);
+
+      pb_node->has_t = TRUE;
+      pb_node->t = n_keyframes > 1 ? length * i / (n_keyframes - 1) : 0;
+      pb_node->value = gen_property_value (gen);
+      gen_path_value (gen, type, pb_node->value);
+
+      pb_path->nodes[i] = pb_node;
+    }
+
+  pb_property->path = pb_path;
+
+  return pb_property;
+}
+
+static Rig__Controller **
+gen_controllers (SceneGen *gen)
+{
+  static const struct {
+    const char *name;
+    Rig__PropertyType type;
+  } animatable[] = {
+    { "position", RIG__PROPERTY_TYPE__VEC3 },
+    { "rotation", RIG__PROPERTY_TYPE__QUATERNION },
+    { "scale", RIG__PROPERTY_TYPE__FLOAT }
+  };
+  Rig__Controller **pb_controllers =
+    gen_alloc (gen, sizeof (void *) * n_controllers);
+  int i;
+
+  for (i = 0; i < n_controllers; i++)
+    {
+      Rig__Controller *pb_controller =
+        pb_new (gen, Rig__Controller, rig__controller__init);
+      float length = g_rand_int_range (gen->rand, 5, 60);
+      Rig__Boxed **properties = gen_boxed_array (gen, 4);
+      int j;
+
+      pb_controller->has_id = TRUE;
+      pb_controller->id = gen_id (gen);
+      pb_controller->name = gen_strdup_printf (gen, "Controller %d", i);
+
+      properties[0] = gen_boxed_boolean (gen, "active", TRUE);
+      properties[1] = gen_boxed_boolean (gen, "loop", TRUE);
+      properties[2] = gen_boxed_boolean (gen, "running", TRUE);
+      properties[3] = gen_boxed_float (gen, "length", length);
+      pb_controller->n_controller_properties = 4;
+      pb_controller->controller_properties = properties;
+
+      pb_controller->n_properties = n_paths;
+      pb_controller->properties = gen_alloc (gen, sizeof (void *) * n_paths);
+
+      /* Each (entity, property) pair is only controlled once by a
+       * controller so we walk through all of the entities for each
+       * animatable property in turn. */
+      for (j = 0; j < n_paths; j++)
+        {
+          int entity = (j + i * n_paths) % n_entities;
+          int prop = (j / n_entities) % G_N_ELEMENTS (animatable);
+
+          pb_controller->properties[j] =
+            gen_controller_property (gen,
+                                     gen->entity_ids[entity],
+                                     animatable[prop].name,
+                                     animatable[prop].type,
+                                     length);
+        }
+
+      pb_controllers[i] = pb_controller;
+    }
+
+  return pb_controllers;
+}
+
+static gboolean
+parse_components (SceneGen *gen, const char *list)
+{
+  char **names;
+  int i;
+
+  if (!list)
+    {
+      for (i = 0; i < N_KINDS; i++)
+        gen->kinds[i] = i;
+      gen->n_kinds = N_KINDS;
+      return TRUE;
+    }
+
+  names = g_strsplit (list, ",", -1);
+  gen->n_kinds = 0;
+
+  for (i = 0; names[i]; i++)
+    {
+      int j;
+
+      for (j = 0; j < N_KINDS; j++)
+        if (strcmp (g_strstrip (names[i]), kind_names[j]) == 0)
+          break;
+
+      if (j == N_KINDS)
+        {
+          fprintf (stderr, "Unknown component kind \"%s\"\n", names[i]);
+          g_strfreev (names);
+          return FALSE;
+        }
+
+      if (gen->n_kinds < N_KINDS)
+        gen->kinds[gen->n_kinds++] = j;
+    }
+
+  g_strfreev (names);
+
+  return gen->n_kinds > 0;
+}
+
+typedef struct _BufferedFile
+{
+  ProtobufCBuffer base;
+  FILE *fp;
+  gboolean error;
+} BufferedFile;
+
+static void
+append_to_file (ProtobufCBuffer *buffer,
+                unsigned len,
+                const unsigned char *data)
+{
+  BufferedFile *buffered_file = (BufferedFile *)buffer;
+
+  if (buffered_file->error)
+    return;
+
+  if (fwrite (data, len, 1, buffered_file->fp) != 1)
+    buffered_file->error = TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context = g_option_context_new (NULL);
+  GError *error = NULL;
+  SceneGen gen;
+  const char *output;
+  char *assets_dir;
+  GenMesh *meshes;
+  Rig__UI ui;
+  int n_assets;
+  int i;
+
+  BufferedFile buffered_file = {
+    { append_to_file },
+    NULL, /* file pointer */
+    FALSE
+  };
+
+  g_option_context_add_main_entries (context, options, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "option parsing failed: %s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (remaining_args == NULL || remaining_args[0] == NULL)
+    {
+      fprintf (stderr, "An output file must be given\n");
+      return EXIT_FAILURE;
+    }
+
+  if (n_entities < 1 || max_depth < 1 || n_controllers < 0 ||
+      n_paths < 0 || n_keyframes < 0 || n_meshes < 1 || mesh_detail < 2)
+    {
+      fprintf (stderr, "Invalid scene dimensions\n");
+      return EXIT_FAILURE;
+    }
+
+  /* Each entity only has three animatable properties */
+  if (n_paths > n_entities * 3)
+    n_paths = n_entities * 3;
+
+  memset (&gen, 0, sizeof (gen));
+
+  if (!parse_components (&gen, components))
+    return EXIT_FAILURE;
+
+  output = remaining_args[0];
+  assets_dir = g_path_get_dirname (output);
+
+  gen.rand = g_rand_new_with_seed (seed);
+  gen.allocations = g_ptr_array_new_with_free_func (g_free);
+  gen.next_id = 1;
+
+  rig__ui__init (&ui);
+
+  ui.has_mode = TRUE;
+  ui.mode = RIG__UI__MODE__FULL;
+
+  ui.device = pb_new (&gen, Rig__Device, rig__device__init);
+  ui.device->has_width = TRUE;
+  ui.device->width = 1280;
+  ui.device->has_height = TRUE;
+  ui.device->height = 720;
+
+  n_assets = 1 + n_meshes;
+  ui.n_assets = n_assets;
+  ui.assets = gen_alloc (&gen, sizeof (void *) * n_assets);
+
+  ui.assets[0] = gen_texture_asset (&gen);
+
+  meshes = g_new0 (GenMesh, n_meshes);
+  gen.mesh_asset_ids = g_new (int64_t, n_meshes);
+  for (i = 0; i < n_meshes; i++)
+    ui.assets[1 + i] = gen_mesh_asset (&gen, i, &meshes[i], assets_dir);
+
+  ui.n_entities = n_entities;
+  ui.entities = gen_entities (&gen);
+
+  ui.n_controllers = n_controllers;
+  ui.controllers = gen_controllers (&gen);
+
+  buffered_file.fp = fopen (output, "w");
+  if (!buffered_file.fp)
+    {
+      fprintf (stderr, "Failed to open %s for writing\n", output);
+      return EXIT_FAILURE;
+    }
+
+  rig__ui__pack_to_buffer (&ui, &buffered_file.base);
+
+  if (fclose (buffered_file.fp) != 0 || buffered_file.error)
+    {
+      fprintf (stderr, "Failed to write %s\n", output);
+      return EXIT_FAILURE;
+    }
+
+  printf ("Wrote %s: %d entities, %d controllers x %d paths x %d keyframes, "
+          "%d %s meshes\n",
+          output, n_entities, n_controllers, n_paths, n_keyframes,
+          n_meshes, embed_meshes ? "embedded" : "external");
+
+  for (i = 0; i < n_meshes; i++)
+    gen_mesh_destroy (&meshes[i]);
+  g_free (meshes);
+  g_free (gen.mesh_asset_ids);
+  g_free (gen.entity_ids);
+  g_free (gen.entity_depths);
+  g_ptr_array_free (gen.allocations, TRUE);
+  g_rand_free (gen.rand);
+  g_free (assets_dir);
+  g_option_context_free (context);
+
+  return EXIT_SUCCESS;
+}
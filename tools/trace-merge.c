@@ -0,0 +1,155 @@
+/*
+ * Trace Merge Tool
+ *
+ * Copyright (C) 2013  Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This tool combines the per-process rig-trace-<pid>.json files
+ * written when running with RUT_TRACE=1 into a single trace that can
+ * be loaded into chrome://tracing or Perfetto to see how the frames
+ * of the frontend, simulator and slaves interleave.
+ *
+ * Usage:
+ * rig-trace-merge [OPTION...] TRACE_FILE...
+ *
+ * Application Options:
+ *   -o, --output=FILE           Write the merged trace to FILE
+ *
+ * The per-process files are written with one event per line (see
+ * rut/rut-trace.c) so we don't need a full JSON parser. A file whose
+ * process crashed is missing its closing bracket which is also
+ * handled.
+ *
+ * All processes timestamp their events with CLOCK_MONOTONIC so no
+ * adjustment is made when merging. Traces from slaves running on a
+ * different machine will not line up with the others.
+ *
+ * Example:
+ *   RUT_TRACE=1 RUT_TRACE_DIR=/tmp/trace ./rig my-ui/my-ui.rig
+ *   ./rig-trace-merge -o merged.json /tmp/trace/rig-trace-*.json
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+static char *_trace_merge_output = NULL;
+static char **_trace_merge_remaining_args = NULL;
+
+static const GOptionEntry _trace_merge_entries[] =
+{
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &_trace_merge_output,
+    "Write the merged trace to FILE", "FILE" },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY,
+    &_trace_merge_remaining_args, "Traces" },
+  { 0 }
+};
+
+static int
+append_events (FILE *out,
+               const char *filename,
+               int n_events)
+{
+  char *contents;
+  char **lines;
+  GError *error = NULL;
+  int i;
+
+  if (!g_file_get_contents (filename, &contents, NULL, &error))
+    {
+      fprintf (stderr, "Failed to read %s: %s\n", filename, error->message);
+      g_error_free (error);
+      return n_events;
+    }
+
+  lines = g_strsplit (contents, "\n", -1);
+
+  for (i = 0; lines[i]; i++)
+    {
+      char *event = g_strstrip (lines[i]);
+      int len = strlen (event);
+
+      if (event[0] != '{')
+        continue;
+
+      if (event[len - 1] == ',')
+        event[--len] = '\0';
+
+      /* Skip anything that was truncated by a crash */
+      if (event[len - 1] != '}')
+        continue;
+
+      fprintf (out, "%s%s", n_events ? ",\n" : "", event);
+      n_events++;
+    }
+
+  g_strfreev (lines);
+  g_free (contents);
+
+  return n_events;
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context = g_option_context_new (NULL);
+  GError *error = NULL;
+  FILE *out = stdout;
+  int n_events = 0;
+  int i;
+
+  g_option_context_add_main_entries (context, _trace_merge_entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "option parsing failed: %s\n", error->message);
+      exit (EXIT_FAILURE);
+    }
+
+  if (_trace_merge_remaining_args == NULL ||
+      _trace_merge_remaining_args[0] == NULL)
+    {
+      fprintf (stderr, "At least one trace file is required\n");
+      exit (EXIT_FAILURE);
+    }
+
+  if (_trace_merge_output)
+    {
+      out = fopen (_trace_merge_output, "w");
+      if (out == NULL)
+        {
+          fprintf (stderr, "Failed to open %s\n", _trace_merge_output);
+          exit (EXIT_FAILURE);
+        }
+    }
+
+  fputs ("{\"traceEvents\":[\n", out);
+
+  for (i = 0; _trace_merge_remaining_args[i]; i++)
+    n_events = append_events (out, _trace_merge_remaining_args[i], n_events);
+
+  fputs ("\n],\"displayTimeUnit\":\"ms\"}\n", out);
+
+  if (out != stdout)
+    fclose (out);
+
+  g_option_context_free (context);
+
+  return EXIT_SUCCESS;
+}